@@ -28,6 +28,14 @@
 #include <iomanip>
 #include <ios>
 #include <locale>
+#include <memory>
+#include <atomic>
+#include <limits>
+#include <new>
+#include <cstdlib>
+#if defined(_MSC_VER) || defined(__MINGW32__)
+#include <malloc.h>
+#endif
 namespace aly {
 	struct MakeString {
 		std::ostringstream ss;
@@ -40,6 +48,87 @@ namespace aly {
 			return *this;
 		}
 	};
+	/*
+	 Opt-in copy-on-write handle for buffers such as Image, Volume and Vector. Copies of the handle share
+	 one buffer, so snapshots handed to worker threads cost a reference count. write() clones the buffer
+	 only while another handle still references it. A single handle must not be used by two threads at once.
+	 */
+	template<class T> class CopyOnWrite {
+	protected:
+		std::shared_ptr<T> buffer;
+	public:
+		CopyOnWrite() :buffer(std::make_shared<T>()) {
+		}
+		CopyOnWrite(const T& value) :buffer(std::make_shared<T>(value)) {
+		}
+		CopyOnWrite(T&& value) :buffer(std::make_shared<T>(std::move(value))) {
+		}
+		const T& read() const {
+			return *buffer;
+		}
+		const T& operator*() const {
+			return *buffer;
+		}
+		const T* operator->() const {
+			return buffer.get();
+		}
+		T& write() {
+			if (buffer.use_count() != 1) {
+				buffer = std::make_shared<T>(*buffer);
+			}
+			//Pairs with the release of other handles so their reads complete before this write.
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return *buffer;
+		}
+		bool isShared() const {
+			return (buffer.use_count() > 1);
+		}
+	};
+	/*
+	 Allocator for std::vector that aligns storage to A bytes. Pixel buffers use it so SIMD kernels start on
+	 a cache line and can use aligned loads on contiguous data.
+	 */
+	template<class T, size_t A = 64> struct AlignedAllocator {
+		typedef T value_type;
+		template<class U> struct rebind {
+			typedef AlignedAllocator<U, A> other;
+		};
+		AlignedAllocator() noexcept {
+		}
+		template<class U> AlignedAllocator(const AlignedAllocator<U, A>&) noexcept {
+		}
+		T* allocate(size_t n) {
+			if (n == 0)
+				return nullptr;
+			if (n > std::numeric_limits<size_t>::max() / sizeof(T))
+				throw std::bad_alloc();
+			void* ptr = nullptr;
+#if defined(_MSC_VER) || defined(__MINGW32__)
+			ptr = _aligned_malloc(n * sizeof(T), A);
+#else
+			if (posix_memalign(&ptr, A, n * sizeof(T)) != 0)
+				ptr = nullptr;
+#endif
+			if (ptr == nullptr)
+				throw std::bad_alloc();
+			return static_cast<T*>(ptr);
+		}
+		void deallocate(T* ptr, size_t) noexcept {
+#if defined(_MSC_VER) || defined(__MINGW32__)
+			_aligned_free(ptr);
+#else
+			free(ptr);
+#endif
+		}
+	};
+	template<class T, class U, size_t A> bool operator==(
+		const AlignedAllocator<T, A>&, const AlignedAllocator<U, A>&) {
+		return true;
+	}
+	template<class T, class U, size_t A> bool operator!=(
+		const AlignedAllocator<T, A>&, const AlignedAllocator<U, A>&) {
+		return false;
+	}
 	inline bool Contains(const std::string& str, const std::string& pattern) {
 		return (str.find(pattern) != std::string::npos);
 	}
@@ -49,6 +49,7 @@
 #include "AlloyAnimator.h"
 #include "AlloyEnum.h"
 #include "AlloyCursorLocator.h"
+#include "AlloyWorker.h"
 int printOglError(const char *file, int line);
 #define CHECK_GL_ERROR() printOglError(__FILE__, __LINE__)
 
@@ -190,8 +191,12 @@ struct Region;
 
 class AlloyContext {
 private:
+	struct DeferredTask {
+		std::function<void()> func;
+		std::promise<void> promise;
+		bool block = false;
+	};
 	std::thread::id threadId;
-	std::mutex taskLock;
 	std::list<std::string> assetDirectories;
 	std::shared_ptr<Font> fonts[ALY_NUMBER_OF_FONTS];
 	std::list<GLFWwindow*> windowHistory;
@@ -205,6 +210,7 @@ private:
 	const double ANIMATE_INTERVAL_SEC = 1.0 / 30.0;
 	const double UPDATE_LOCATOR_INTERVAL_SEC = 1.0 / 15.0;
 	const double UPDATE_CURSOR_INTERVAL_SEC = 1.0 / 30.0;
+	const double DEFERRED_TASK_BUDGET_SEC = 1.0 / 60.0;
 	bool leftMouseButton = false;
 	bool rightMouseButton = false;
 	std::chrono::steady_clock::time_point endTime;
@@ -219,7 +225,8 @@ private:
 	const Cursor* cursor = nullptr;
 	std::list<EventHandler*> listeners;
 	std::shared_ptr<Composite> glassPanel;
-	std::list<std::function<void()>> deferredTasks;
+	MPSCQueue<DeferredTask> deferredTasks;
+	std::atomic<size_t> deferredTaskCount;
 	static std::shared_ptr<AlloyContext> defaultContext;
 	int2 viewSize;
 	int2 screenSize;
@@ -261,11 +268,16 @@ public:
 	int getScreenHeight() {
 		return screenSize.y;
 	}
-	void addDeferredTask(const std::function<void()>& func,bool block=false);
+	/*
+	 Queues func to run on the context thread. The future is ready once func has run, a blocking
+	 caller waits on it and receives any exception func throws.
+	 */
+	std::shared_future<void> addDeferredTask(const std::function<void()>& func,bool block=false);
 	bool hasDeferredTasks() const {
-		return (deferredTasks.size() > 0);
+		return (deferredTaskCount > 0);
 	}
-	bool executeDeferredTasks();
+	//Runs the tasks queued before the call, stopping early once timeBudget seconds have elapsed (if positive).
+	bool executeDeferredTasks(double timeBudget = 0.0);
 	std::shared_ptr<Composite>& getGlassPanel();
 
 	inline pixel2 getRelativeCursorDownPosition() const {
@@ -24,8 +24,27 @@
 #include "AlloyVector.h"
 #include <iostream>
 namespace aly {
-	void Triangulate(std::vector<float2>& pxyz, std::vector<uint3>& v);
-	bool CircumCircle(float, float, float, float, float, float, float, float, float&, float&, float&);
+	bool SANITY_CHECK_DELAUNAY();
+	/*
+	 Bowyer-Watson insertion of points in the given order. Triangles are indexes into points,
+	 duplicate points are skipped and collinear input produces no triangles.
+	 */
+	void Triangulate(const std::vector<float2>& points, const std::vector<uint32_t>& order, std::vector<uint3>& triangles);
+	/*
+	 Delaunay triangulation of pts in BRIO order, same as MakeDelaunay. Kept for existing callers,
+	 pts is not modified and triangles index into it.
+	 */
+	void Triangulate(std::vector<float2>& pts, std::vector<uint3>& triangles);
+	/*
+	 Circumcircle (xc,yc,r) of triangle (x1,y1),(x2,y2),(x3,y3) and whether (xp,yp) lies inside it.
+	 Inexact float arithmetic, kept as a utility. Triangulation uses the exact incircle predicate instead.
+	 */
+	bool CircumCircle(float xp, float yp, float x1, float y1, float x2, float y2, float x3, float y3, float& xc, float& yc, float& r);
+	/*
+	 Delaunay triangulation of a point set, inserted in biased randomized insertion order (BRIO)
+	 with each round sorted along a Hilbert curve.
+	 Amenta, N., Choi, S., & Rote, G. (2003). Incremental constructions con BRIO. Symposium on Computational geometry.
+	 */
 	void MakeDelaunay(const std::vector<float2>& vertexes, std::vector<uint3>& output);
 	inline void MakeDelaunay(const Vector2f& vertexes, std::vector<uint3>& output) {
 		MakeDelaunay(vertexes.data, output);
@@ -31,44 +31,220 @@
 #include <map>
 namespace aly {
 bool SANITY_CHECK_DENSE_MATRIX();
+/*
+ * Strided window into row-major matrix storage. Row i starts at data + i * stride, so a view can address
+ * a sub-block of a larger matrix without copying. V is the element type, either vec<T,C> or a scalar.
+ */
+template<class V> struct DenseMatrixView {
+	V* data;
+	int rows, cols;
+	size_t stride;
+	DenseMatrixView() :
+			data(nullptr), rows(0), cols(0), stride(0) {
+	}
+	DenseMatrixView(V* data, int rows, int cols, size_t stride) :
+			data(data), rows(rows), cols(cols), stride(stride) {
+	}
+	template<class U> DenseMatrixView(const DenseMatrixView<U>& view) :
+			data(view.data), rows(view.rows), cols(view.cols), stride(
+					view.stride) {
+	}
+	V* operator[](size_t i) const {
+		return data + i * stride;
+	}
+	V& operator()(size_t i, size_t j) const {
+		return data[i * stride + j];
+	}
+	DenseMatrixView<V> block(int i, int j, int r, int c) const {
+		return DenseMatrixView<V>(data + i * stride + j, r, c, stride);
+	}
+};
+enum class MatrixUpdate {
+	Assign, Add, Subtract
+};
+/*
+ * Cache-blocked matrix product out = A*B, out += A*B or out -= A*B. Row blocks run in parallel, and the
+ * inner loop streams contiguous rows of B and out, so it vectorizes for both scalar and vec<T,C> elements.
+ */
+template<class V, class VA, class VB> void MatrixMultiply(
+		const DenseMatrixView<V>& out, const DenseMatrixView<VA>& A,
+		const DenseMatrixView<VB>& B, MatrixUpdate update =
+				MatrixUpdate::Assign) {
+	if (A.cols != B.rows || out.rows != A.rows || out.cols != B.cols)
+		throw std::runtime_error(
+				MakeString()
+						<< "Cannot multiply matrices. Dimensions do not match. "
+						<< "[" << out.rows << "," << out.cols << "] = ["
+						<< A.rows << "," << A.cols << "] * [" << B.rows << ","
+						<< B.cols << "]");
+	const int BLOCK_ROWS = 16;
+	const int BLOCK_INNER = 128;
+	const int BLOCK_COLS = 512;
+	const int M = out.rows;
+	const int N = out.cols;
+	const int K = A.cols;
+	const bool subtract = (update == MatrixUpdate::Subtract);
+	const int rowBlocks = (M + BLOCK_ROWS - 1) / BLOCK_ROWS;
+#pragma omp parallel for schedule(dynamic) if ((double)M * N * K > 32768)
+	for (int rb = 0; rb < rowBlocks; rb++) {
+		int i0 = rb * BLOCK_ROWS;
+		int i1 = std::min(M, i0 + BLOCK_ROWS);
+		if (update == MatrixUpdate::Assign) {
+			for (int i = i0; i < i1; i++) {
+				std::fill(out[i], out[i] + N, V());
+			}
+		}
+		for (int j0 = 0; j0 < N; j0 += BLOCK_COLS) {
+			int j1 = std::min(N, j0 + BLOCK_COLS);
+			for (int k0 = 0; k0 < K; k0 += BLOCK_INNER) {
+				int k1 = std::min(K, k0 + BLOCK_INNER);
+				for (int i = i0; i < i1; i++) {
+					V* o = out[i];
+					const VA* a = A[i];
+					for (int k = k0; k < k1; k++) {
+						auto aik = a[k];
+						const VB* b = B[k];
+						if (subtract) {
+							for (int j = j0; j < j1; j++) {
+								o[j] -= aik * b[j];
+							}
+						} else {
+							for (int j = j0; j < j1; j++) {
+								o[j] += aik * b[j];
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+}
+//Blocked product out = A^T*B without forming the transpose.
+template<class V, class VA, class VB> void MatrixTransposeMultiply(
+		const DenseMatrixView<V>& out, const DenseMatrixView<VA>& A,
+		const DenseMatrixView<VB>& B, MatrixUpdate update =
+				MatrixUpdate::Assign) {
+	if (A.rows != B.rows || out.rows != A.cols || out.cols != B.cols)
+		throw std::runtime_error(
+				MakeString()
+						<< "Cannot multiply matrices. Dimensions do not match. "
+						<< "[" << out.rows << "," << out.cols << "] = ["
+						<< A.cols << "," << A.rows << "] * [" << B.rows << ","
+						<< B.cols << "]");
+	const int BLOCK_ROWS = 16;
+	const int BLOCK_INNER = 128;
+	const int BLOCK_COLS = 512;
+	const int M = out.rows;
+	const int N = out.cols;
+	const int K = A.rows;
+	const bool subtract = (update == MatrixUpdate::Subtract);
+	const int rowBlocks = (M + BLOCK_ROWS - 1) / BLOCK_ROWS;
+#pragma omp parallel for schedule(dynamic) if ((double)M * N * K > 32768)
+	for (int rb = 0; rb < rowBlocks; rb++) {
+		int i0 = rb * BLOCK_ROWS;
+		int i1 = std::min(M, i0 + BLOCK_ROWS);
+		if (update == MatrixUpdate::Assign) {
+			for (int i = i0; i < i1; i++) {
+				std::fill(out[i], out[i] + N, V());
+			}
+		}
+		for (int j0 = 0; j0 < N; j0 += BLOCK_COLS) {
+			int j1 = std::min(N, j0 + BLOCK_COLS);
+			for (int k0 = 0; k0 < K; k0 += BLOCK_INNER) {
+				int k1 = std::min(K, k0 + BLOCK_INNER);
+				for (int k = k0; k < k1; k++) {
+					const VA* a = A[k];
+					const VB* b = B[k];
+					for (int i = i0; i < i1; i++) {
+						auto aki = a[i];
+						V* o = out[i];
+						if (subtract) {
+							for (int j = j0; j < j1; j++) {
+								o[j] -= aki * b[j];
+							}
+						} else {
+							for (int j = j0; j < j1; j++) {
+								o[j] += aki * b[j];
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+}
+//Matrix-vector product out = A*x. Rows are independent and run in parallel.
+template<class V, class VA, class VB> void MatrixVectorMultiply(V* out,
+		const DenseMatrixView<VA>& A, const VB* x) {
+#pragma omp parallel for if ((double)A.rows * A.cols > 32768)
+	for (int i = 0; i < A.rows; i++) {
+		const VA* a = A[i];
+		V sum = V();
+		for (int j = 0; j < A.cols; j++) {
+			sum += a[j] * x[j];
+		}
+		out[i] = sum;
+	}
+}
+//Matrix-vector product out = A^T*x. Each thread accumulates a band of columns over all rows.
+template<class V, class VA, class VB> void MatrixTransposeVectorMultiply(V* out,
+		const DenseMatrixView<VA>& A, const VB* x) {
+	const int BLOCK_COLS = 256;
+	const int colBlocks = (A.cols + BLOCK_COLS - 1) / BLOCK_COLS;
+#pragma omp parallel for if ((double)A.rows * A.cols > 32768)
+	for (int cb = 0; cb < colBlocks; cb++) {
+		int j0 = cb * BLOCK_COLS;
+		int j1 = std::min(A.cols, j0 + BLOCK_COLS);
+		std::fill(out + j0, out + j1, V());
+		for (int i = 0; i < A.rows; i++) {
+			const VA* a = A[i];
+			auto xi = x[i];
+			for (int j = j0; j < j1; j++) {
+				out[j] += a[j] * xi;
+			}
+		}
+	}
+}
+//Dense matrix stored as one contiguous row-major array of vec<T,C>. Row i is operator[](i).
 template<class T, int C> struct DenseMatrix {
 private:
-	std::vector<std::vector<vec<T, C>>>data;
+	std::vector<vec<T, C>> data;
 public:
 	int rows, cols;
 	typedef vec<T, C> ValueType;
 	typedef typename std::vector<ValueType>::iterator iterator;
 	typedef typename std::vector<ValueType>::const_iterator const_iterator;
 	typedef typename std::vector<ValueType>::reverse_iterator reverse_iterator;
-	iterator begin(int i) const {
-		return data[i].begin();
+	typedef typename std::vector<ValueType>::const_reverse_iterator const_reverse_iterator;
+	const_iterator begin(int i) const {
+		return data.begin() + i * (size_t) cols;
 	}
-	iterator end(int i) const {
-		return data[i].end();
+	const_iterator end(int i) const {
+		return data.begin() + (i + 1) * (size_t) cols;
 	}
 	iterator begin(int i) {
-		return data[i].begin();
+		return data.begin() + i * (size_t) cols;
 	}
 	iterator end(int i) {
-		return data[i].end();
+		return data.begin() + (i + 1) * (size_t) cols;
 	}
 	const_iterator cbegin(int i) const {
-		return data[i].cbegin();
+		return data.cbegin() + i * (size_t) cols;
 	}
 	const_iterator cend(int i) const {
-		return data[i].cend();
+		return data.cbegin() + (i + 1) * (size_t) cols;
 	}
 	reverse_iterator rbegin(int i) {
-		return data[i].rbegin();
+		return reverse_iterator(end(i));
 	}
 	reverse_iterator rend(int i) {
-		return data[i].rend();
+		return reverse_iterator(begin(i));
 	}
-	reverse_iterator rbegin(int i) const {
-		return data[i].rbegin();
+	const_reverse_iterator rbegin(int i) const {
+		return const_reverse_iterator(end(i));
 	}
-	reverse_iterator rend(int i) const {
-		return data[i].rend();
+	const_reverse_iterator rend(int i) const {
+		return const_reverse_iterator(begin(i));
 	}
 	template<class Archive> void serialize(Archive & archive) {
 		archive(CEREAL_NVP(rows), CEREAL_NVP(cols),
@@ -76,30 +252,48 @@ public:
 						MakeString() << "matrix"<<C,
 						data));
 	}
-	std::vector<vec<T, C>>& operator[](size_t i) {
+	vec<T, C>* operator[](size_t i) {
 		if (i >= rows || i < 0)
 		throw std::runtime_error(
 				MakeString() << "Index (" << i
 				<< ",*) exceeds matrix bounds [" << rows << ","
 				<< cols << "]");
-		return data[i];
+		return data.data() + i * cols;
 	}
-	const std::vector<vec<T, C>>& operator[](size_t i) const {
+	const vec<T, C>* operator[](size_t i) const {
 		if (i >= rows || i < 0)
 		throw std::runtime_error(
 				MakeString() << "Index (" << i
 				<< ",*) exceeds matrix bounds [" << rows << ","
 				<< cols << "]");
-		return data[i];
+		return data.data() + i * cols;
+	}
+	vec<T, C>* ptr() {
+		return data.data();
+	}
+	const vec<T, C>* ptr() const {
+		return data.data();
+	}
+	DenseMatrixView<vec<T, C>> view() {
+		return DenseMatrixView<vec<T, C>>(data.data(), rows, cols, cols);
+	}
+	DenseMatrixView<const vec<T, C>> view() const {
+		return DenseMatrixView<const vec<T, C>>(data.data(), rows, cols, cols);
+	}
+	DenseMatrixView<vec<T, C>> block(int i, int j, int r, int c) {
+		return view().block(i, j, r, c);
+	}
+	DenseMatrixView<const vec<T, C>> block(int i, int j, int r, int c) const {
+		return view().block(i, j, r, c);
 	}
 	DenseMatrix(): rows(0),cols(0) {
 	}
 	DenseMatrix(int rows, int cols) :
-	data(rows,std::vector<vec<T,C>>(cols)),rows(rows), cols(cols) {
+	data(rows * (size_t) cols),rows(rows), cols(cols) {
 	}
 	void resize(int rows,int cols) {
 		if(this->rows!=rows||this->cols!=cols) {
-			data=std::vector<std::vector<vec<T,C>>>(rows,std::vector<vec<T,C>>(cols));
+			data=std::vector<vec<T,C>>(rows * (size_t) cols);
 			this->rows=rows;
 			this->cols=cols;
 		}
@@ -110,7 +304,7 @@ public:
 				MakeString() << "Index (" << i << "," << j
 				<< ") exceeds matrix bounds [" << rows << ","
 				<< cols << "]");
-		data[i][j] = value;
+		data[i * cols + j] = value;
 	}
 	void set(size_t i, size_t j, const T& value) {
 		if (i >= rows || j >= cols || i < 0 || j < 0)
@@ -118,7 +312,7 @@ public:
 				MakeString() << "Index (" << i << "," << j
 				<< ") exceeds matrix bounds [" << rows << ","
 				<< cols << "]");
-		data[i][j] = vec<T, C>(value);
+		data[i * cols + j] = vec<T, C>(value);
 	}
 	vec<T, C>& operator()(size_t i, size_t j) {
 		if (i >= rows || j >= cols || i < 0 || j < 0)
@@ -126,7 +320,7 @@ public:
 				MakeString() << "Index (" << i << "," << j
 				<< ") exceeds matrix bounds [" << rows << ","
 				<< cols << "]");
-		return data[i][j];
+		return data[i * cols + j];
 	}
 
 	vec<T, C> get(size_t i, size_t j) const {
@@ -135,16 +329,23 @@ public:
 				MakeString() << "Index (" << i << "," << j
 				<< ") exceeds matrix bounds [" << rows << ","
 				<< cols << "]");
-		return data[i][j];
+		return data[i * cols + j];
 	}
 	const vec<T, C>& operator()(size_t i, size_t j) const {
-		return data[i][j];
+		return data[i * cols + j];
 	}
 	inline DenseMatrix<T, C> transpose() const {
+		const int BLOCK = 32;
 		DenseMatrix<T, C> M(cols, rows);
-		for (int i = 0; i < rows; i++) {
-			for (int j=0;j < cols;j++) {
-				M[j][i]=data[i][j];
+		for (int i0 = 0; i0 < rows; i0 += BLOCK) {
+			for (int j0 = 0; j0 < cols; j0 += BLOCK) {
+				int i1 = std::min(rows, i0 + BLOCK);
+				int j1 = std::min(cols, j0 + BLOCK);
+				for (int i = i0; i < i1; i++) {
+					for (int j = j0; j < j1; j++) {
+						M.data[j * (size_t) rows + i] = data[i * (size_t) cols + j];
+					}
+				}
 			}
 		}
 		return M;
@@ -160,11 +361,7 @@ public:
 	}
 	inline static DenseMatrix<T, C> zero(size_t M, size_t N) {
 		DenseMatrix<T, C> A(M, N);
-		for (int i = 0; i < M; i++) {
-			for (int j=0;j < N;j++) {
-				A[i][j]=vec<T, C>(T(0));
-			}
-		}
+		std::fill(A.data.begin(), A.data.end(), vec<T, C>(T(0)));
 		return A;
 	}
 	inline static DenseMatrix<T, C> diagonal(const Vector<T, C>& v) {
@@ -178,24 +375,33 @@ public:
 	}
 	inline static DenseMatrix<T, C> columnVector(const Vector<T, C>& v) {
 		DenseMatrix<T, C> A((int)v.size(),1);
-		for (int i = 0; i < A.rows; i++) {
-			A[i][0] = v[i];
-		}
+		A.data = v.data;
 		return A;
 	}
 	inline static DenseMatrix<T, C> rowVector(const Vector<T, C>& v) {
 		DenseMatrix<T, C> A(1, (int)v.size());
-		A.data[0] = v.data;
+		A.data = v.data;
 		return A;
 	}
+	void setRow(int i, const vec<T, C>* row) {
+		std::copy(row, row + cols, (*this)[i]);
+	}
+	void setRow(int i, const std::vector<vec<T, C>>& row) {
+		if (row.size() != (size_t) cols)
+		throw std::runtime_error(
+				MakeString() << "Row length " << row.size()
+				<< " does not match matrix columns " << cols);
+		setRow(i, row.data());
+	}
 	inline Vector<T, C> getRow(int i) const {
-		Vector<T, C> v(data[i].data);
+		Vector<T, C> v(cols);
+		std::copy(begin(i), end(i), v.data.begin());
 		return v;
 	}
 	inline Vector<T, C> getColumn(int j) const {
 		Vector<T, C> v(rows);
 		for (int i = 0; i < rows; i++) {
-			v[i]=data[i][j];
+			v[i]=data[i * (size_t) cols + j];
 		}
 		return v;
 	}
@@ -224,14 +430,14 @@ template<class A, class B, class T, int C> std::basic_ostream<A, B> & operator <
 
 template<class T, int C> Vector<T, C> operator*(const DenseMatrix<T, C>& A,
 		const Vector<T, C>& v) {
+	if (A.cols != v.size())
+		throw std::runtime_error(
+				MakeString()
+						<< "Cannot multiply matrix and vector. Dimensions do not match. "
+						<< "[" << A.rows << "," << A.cols << "] * [" << v.size()
+						<< "]");
 	Vector<T, C> out(A.rows);
-	for (int i = 0; i < A.rows; i++) {
-		vec<T, C> sum(0.0);
-		for (int j = 0; j < A.cols; j++) {
-			sum += A[i][j] * v[j];
-		}
-		out[i] = sum;
-	}
+	MatrixVectorMultiply(out.data.data(), A.view(), v.data.data());
 	return out;
 }
 template<class T, int C> DenseMatrix<T, C> operator*(const DenseMatrix<T, C>& A,
@@ -243,15 +449,33 @@ template<class T, int C> DenseMatrix<T, C> operator*(const DenseMatrix<T, C>& A,
 						<< "[" << A.rows << "," << A.cols << "] * [" << B.rows
 						<< "," << B.cols << "]");
 	DenseMatrix<T, C> out(A.rows, B.cols);
-	for (int i = 0; i < out.rows; i++) {
-		for (int j = 0; j < out.cols; j++) {
-			vec<T, C> sum(0.0);
-			for (int k = 0; k < A.cols; k++) {
-				sum += A[i][k] * B[k][j];
-			}
-			out[i][j] = sum;
-		}
-	}
+	MatrixMultiply(out.view(), A.view(), B.view());
+	return out;
+}
+//Computes A^T*B without forming the transpose of A.
+template<class T, int C> DenseMatrix<T, C> TransposeMultiply(
+		const DenseMatrix<T, C>& A, const DenseMatrix<T, C>& B) {
+	if (A.rows != B.rows)
+		throw std::runtime_error(
+				MakeString()
+						<< "Cannot multiply matrices. Inner dimensions do not match. "
+						<< "[" << A.cols << "," << A.rows << "] * [" << B.rows
+						<< "," << B.cols << "]");
+	DenseMatrix<T, C> out(A.cols, B.cols);
+	MatrixTransposeMultiply(out.view(), A.view(), B.view());
+	return out;
+}
+//Computes A^T*v without forming the transpose of A.
+template<class T, int C> Vector<T, C> TransposeMultiply(
+		const DenseMatrix<T, C>& A, const Vector<T, C>& v) {
+	if (A.rows != v.size())
+		throw std::runtime_error(
+				MakeString()
+						<< "Cannot multiply matrix and vector. Dimensions do not match. "
+						<< "[" << A.cols << "," << A.rows << "] * [" << v.size()
+						<< "]");
+	Vector<T, C> out(A.cols);
+	MatrixTransposeVectorMultiply(out.data.data(), A.view(), v.data.data());
 	return out;
 }
 //Slight abuse of mathematics here. Vectors are always interpreted as column vectors as a convention,
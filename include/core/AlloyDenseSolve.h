@@ -26,30 +26,278 @@
 namespace aly {
 	bool SANITY_CHECK_DENSE_SOLVE();
 	bool SANITY_CHECK_ROBUST_SOLVE();
+	enum class MultigridCycle {
+		V = 1, W = 2
+	};
+	/*
+	 * Geometric multigrid solver for the image Poisson problems behind PoissonBlend, PoissonInpaint and LaplaceFill.
+	 * Solves u - 0.25*(sum of 4-neighbors) = f at pixels where the mask is non-zero and keeps all other pixels fixed.
+	 * Coarse grid points inherit the mask of the fine pixels they coincide with, so fixed pixels stay fixed on every level.
+	 * The level buffers are kept between calls, so repeated solves at the same resolution do not reallocate.
+	 * The PoissonBlend, PoissonInpaint and LaplaceFill overloads keep one solver per thread for this reason.
+	 */
+	template<int C> class PoissonMultigrid {
+	protected:
+		typedef vec<float, C> ValueType;
+		struct Level {
+			int width = 0;
+			int height = 0;
+			std::vector<ValueType> u;
+			std::vector<ValueType> f;
+			std::vector<ValueType> r;
+			std::vector<uint8_t> mask;
+			ValueType* uPtr = nullptr;
+			const ValueType* fPtr = nullptr;
+			void resize(int w, int h) {
+				width = w;
+				height = h;
+				u.resize(w * (size_t)h);
+				f.resize(w * (size_t)h);
+				r.resize(w * (size_t)h);
+				mask.resize(w * (size_t)h);
+				uPtr = u.data();
+				fPtr = f.data();
+			}
+		};
+		std::vector<Level> levels;
+		int cycles = 0;
+		double residual = 0.0;
+		static inline ValueType neighborSum(const ValueType* u, int i, int j, int w, int h) {
+			ValueType sum(0.0f);
+			if (i > 0)
+				sum += u[i - 1 + j * w];
+			if (i < w - 1)
+				sum += u[i + 1 + j * w];
+			if (j > 0)
+				sum += u[i + (j - 1) * w];
+			if (j < h - 1)
+				sum += u[i + (j + 1) * w];
+			return sum;
+		}
+		//Red-black Gauss-Seidel sweeps over active pixels.
+		void relax(Level& level, int sweeps) {
+			const int w = level.width;
+			const int h = level.height;
+			ValueType* u = level.uPtr;
+			const ValueType* f = level.fPtr;
+			const uint8_t* mask = level.mask.data();
+			for (int iter = 0; iter < sweeps; iter++) {
+				for (int color = 0; color < 2; color++) {
+#pragma omp parallel for
+					for (int j = 0; j < h; j++) {
+						for (int i = (j + color) % 2; i < w; i += 2) {
+							size_t offset = i + j * (size_t)w;
+							if (mask[offset]) {
+								ValueType div = u[offset] - 0.25f * neighborSum(u, i, j, w, h) - f[offset];
+								u[offset] -= lambda * div;
+							}
+						}
+					}
+				}
+			}
+		}
+		//Computes r = f - A*u on active pixels and returns the sum of squared residuals.
+		double updateResidual(Level& level) {
+			const int w = level.width;
+			const int h = level.height;
+			const ValueType* u = level.uPtr;
+			const ValueType* f = level.fPtr;
+			const uint8_t* mask = level.mask.data();
+			ValueType* r = level.r.data();
+			double sum = 0.0;
+#pragma omp parallel for reduction(+:sum)
+			for (int j = 0; j < h; j++) {
+				for (int i = 0; i < w; i++) {
+					size_t offset = i + j * (size_t)w;
+					if (mask[offset]) {
+						ValueType res = f[offset] - (u[offset] - 0.25f * neighborSum(u, i, j, w, h));
+						r[offset] = res;
+						for (int c = 0; c < C; c++) {
+							sum += (double)res[c] * (double)res[c];
+						}
+					} else {
+						r[offset] = ValueType(0.0f);
+					}
+				}
+			}
+			return sum;
+		}
+		//Full-weighting restriction of the residual onto coarse grid points. The factor of 4 accounts for the doubled grid spacing.
+		void restrictResidual(const Level& fine, Level& coarse) {
+			static const float Kernel[3] = { 0.25f, 0.5f, 0.25f };
+			const int fw = fine.width;
+			const int fh = fine.height;
+#pragma omp parallel for
+			for (int j = 0; j < coarse.height; j++) {
+				for (int i = 0; i < coarse.width; i++) {
+					size_t offset = i + j * (size_t)coarse.width;
+					ValueType sum(0.0f);
+					if (coarse.mask[offset]) {
+						for (int jj = -1; jj <= 1; jj++) {
+							int y = 2 * j + jj;
+							if (y < 0 || y >= fh)
+								continue;
+							for (int ii = -1; ii <= 1; ii++) {
+								int x = 2 * i + ii;
+								if (x < 0 || x >= fw)
+									continue;
+								sum += (Kernel[ii + 1] * Kernel[jj + 1]) * fine.r[x + y * (size_t)fw];
+							}
+						}
+					}
+					coarse.f[offset] = 4.0f * sum;
+					coarse.u[offset] = ValueType(0.0f);
+				}
+			}
+		}
+		//Adds the bilinearly interpolated coarse correction to active fine pixels. Inactive coarse points hold zero error.
+		void prolongCorrection(const Level& coarse, Level& fine) {
+			const int cw = coarse.width;
+			const int ch = coarse.height;
+			const ValueType* e = coarse.uPtr;
+			ValueType* u = fine.uPtr;
+#pragma omp parallel for
+			for (int j = 0; j < fine.height; j++) {
+				int j0 = j / 2;
+				int j1 = std::min((j + 1) / 2, ch - 1);
+				for (int i = 0; i < fine.width; i++) {
+					size_t offset = i + j * (size_t)fine.width;
+					if (!fine.mask[offset])
+						continue;
+					int i0 = i / 2;
+					int i1 = std::min((i + 1) / 2, cw - 1);
+					u[offset] += 0.25f * (e[i0 + j0 * cw] + e[i1 + j0 * cw] + e[i0 + j1 * cw] + e[i1 + j1 * cw]);
+				}
+			}
+		}
+		void cycle(int l) {
+			Level& level = levels[l];
+			if (l == (int)levels.size() - 1) {
+				relax(level, coarseSmooth);
+				return;
+			}
+			relax(level, preSmooth);
+			updateResidual(level);
+			Level& coarse = levels[l + 1];
+			restrictResidual(level, coarse);
+			int visits = (type == MultigridCycle::W && l + 2 < (int)levels.size()) ? 2 : 1;
+			for (int k = 0; k < visits; k++) {
+				cycle(l + 1);
+			}
+			prolongCorrection(coarse, level);
+			relax(level, postSmooth);
+		}
+		void buildHierarchy(int w, int h, const Image1ub& mask, int maxLevels) {
+			int count = 1;
+			int cw = w;
+			int ch = h;
+			while (count < maxLevels && cw >= 5 && ch >= 5) {
+				cw = cw / 2 + 1;
+				ch = ch / 2 + 1;
+				count++;
+			}
+			levels.resize(count);
+			Level& top = levels[0];
+			top.width = w;
+			top.height = h;
+			top.r.resize(w * (size_t)h);
+			top.mask.resize(w * (size_t)h);
+			for (size_t i = 0; i < top.mask.size(); i++) {
+				top.mask[i] = (mask[i].x != 0) ? 1 : 0;
+			}
+			for (int l = 1; l < count; l++) {
+				const Level& fine = levels[l - 1];
+				Level& coarse = levels[l];
+				coarse.resize(fine.width / 2 + 1, fine.height / 2 + 1);
+				//Coarse points coincide with even fine pixels and inherit their mask, so fixed pixels stay aligned on every level.
+#pragma omp parallel for
+				for (int j = 0; j < coarse.height; j++) {
+					for (int i = 0; i < coarse.width; i++) {
+						uint8_t active = 0;
+						if (2 * i < fine.width && 2 * j < fine.height) {
+							active = fine.mask[2 * i + 2 * j * (size_t)fine.width];
+						}
+						coarse.mask[i + j * (size_t)coarse.width] = active;
+					}
+				}
+			}
+		}
+	public:
+		MultigridCycle type;
+		int preSmooth;
+		int postSmooth;
+		int coarseSmooth;
+		float lambda;
+		PoissonMultigrid(MultigridCycle type = MultigridCycle::V, float lambda = 0.99f,
+			int preSmooth = 2, int postSmooth = 2, int coarseSmooth = 32) :
+			type(type), preSmooth(preSmooth), postSmooth(postSmooth), coarseSmooth(
+				coarseSmooth), lambda(lambda) {
+		}
+		int getCycles() const {
+			return cycles;
+		}
+		//Root mean square residual after the last cycle.
+		double getResidual() const {
+			return residual;
+		}
+		/*
+		 * Runs up to maxCycles multigrid cycles on at most maxLevels levels. Stops when the residual has dropped
+		 * by a factor of tolerance relative to the initial residual. Returns the number of cycles performed.
+		 */
+		int solve(Image<float, C, ImageType::FLOAT>& u, const Image<float, C, ImageType::FLOAT>& f,
+			const Image1ub& mask, int maxCycles, int maxLevels, float tolerance = 1E-4f) {
+			if (u.dimensions() != f.dimensions() || u.dimensions() != mask.dimensions())
+				throw std::runtime_error(
+					MakeString() << "Cannot solve. Image dimensions do not match "
+					<< u.dimensions() << " " << f.dimensions() << " " << mask.dimensions());
+			cycles = 0;
+			residual = 0.0;
+			if (u.size() == 0)
+				return 0;
+			buildHierarchy(u.width, u.height, mask, maxLevels);
+			Level& top = levels[0];
+			top.uPtr = u.vecPtr();
+			top.fPtr = f.vecPtr();
+			size_t active = 0;
+			for (uint8_t m : top.mask) {
+				active += m;
+			}
+			if (active == 0)
+				return 0;
+			double initial = std::sqrt(updateResidual(top) / active);
+			residual = initial;
+			while (cycles < maxCycles && residual > tolerance * initial) {
+				cycle(0);
+				residual = std::sqrt(updateResidual(top) / active);
+				cycles++;
+			}
+			return cycles;
+		}
+	};
 	void PoissonBlend(const Image4f& in, Image4f& out, int iterations, int levels,
-		float lambda = 0.99f);
+		float lambda = 0.99f, float tolerance = 1E-4f, MultigridCycle cycle = MultigridCycle::V);
 	void PoissonBlend(const Image4f& in, Image4f& out, int iterations,
 		float lambda = 0.99f);
 	void PoissonBlend(const Image2f& in, Image2f& out, int iterations, int levels,
-		float lambda = 0.99f);
+		float lambda = 0.99f, float tolerance = 1E-4f, MultigridCycle cycle = MultigridCycle::V);
 	void PoissonBlend(const Image2f& in, Image2f& out, int iterations,
 		float lambda = 0.99f);
 	void PoissonInpaint(const Image4f& source, const Image4f& target, Image4f& out,
-		int iterations, int levels, float lambda = 0.99f);
+		int iterations, int levels, float lambda = 0.99f, float tolerance = 1E-4f, MultigridCycle cycle = MultigridCycle::V);
 	void PoissonInpaint(const Image4f& source, const Image4f& target, Image4f& out,
 		int iterations, float lambda = 0.99f);
 	void PoissonInpaint(const Image2f& source, const Image2f& target, Image2f& out,
-		int iterations, int levels, float lambda = 0.99f);
+		int iterations, int levels, float lambda = 0.99f, float tolerance = 1E-4f, MultigridCycle cycle = MultigridCycle::V);
 	void PoissonInpaint(const Image2f& source, const Image2f& target, Image2f& out,
 		int iterations, float lambda = 0.99f);
 	void LaplaceFill(const Image4f& sourceImg, Image4f& targetImg, int iterations,
-		int levels, float lambda = 0.99f);
+		int levels, float lambda = 0.99f, float tolerance = 1E-4f, MultigridCycle cycle = MultigridCycle::V);
 	void LaplaceFill(const Image4f& sourceImg, Image4f& targetImg, int iterations,
 		float lambda = 0.99f);
 	void LaplaceFill(const Image2f& sourceImg, Image2f& targetImg, int iterations,
 		float lambda = 0.99f);
 	void LaplaceFill(const Image2f& sourceImg, Image2f& targetImg, int iterations,
-		int levels, float lambda = 0.99f);
+		int levels, float lambda = 0.99f, float tolerance = 1E-4f, MultigridCycle cycle = MultigridCycle::V);
 
 	/******************************************************************************
 	 * XLISP-STAT 2.1 Copyright (c) 1990, by Luke Tierney
@@ -110,8 +358,10 @@ namespace aly {
 		double zeroTolerance = 0) {
 		const int m = M.rows;
 		const int n = M.cols;
-		std::vector<std::vector<double>> v(n, std::vector<double>(n));
-		std::vector<std::vector<double>> u(m, std::vector<double>(m));
+		std::vector<double> vData(n * (size_t)n);
+		std::vector<double> uData(m * (size_t)m);
+		DenseMatrixView<double> v(vData.data(), n, n, n);
+		DenseMatrixView<double> u(uData.data(), m, m, m);
 		std::vector<double> w(n);
 		std::vector<double> rv1(n);
 
@@ -393,9 +643,8 @@ namespace aly {
 				<< "]");
 		}
 		if (A.rows != A.cols) {
-			DenseMatrix<T, C> At = A.transpose();
-			DenseMatrix<T, C> AtA = At * A;
-			Vector<T, C> Atb = At * b;
+			DenseMatrix<T, C> AtA = TransposeMultiply(A, A);
+			Vector<T, C> Atb = TransposeMultiply(A, b);
 			return inverse(AtA) * Atb;
 		}
 		else {
@@ -419,58 +668,71 @@ namespace aly {
 	template<class T, int C> bool LU(const DenseMatrix<T, C>& A,
 		DenseMatrix<T, 1>& L, DenseMatrix<T, 1>& U, std::vector<int>& piv,
 		int cc = 0, const double zeroTolerance = 0.0) {
+		//Right-looking LU in panels of BLOCK columns. Most of the work is the trailing update, which runs through MatrixMultiply.
+		const int BLOCK = 64;
 		const int m = A.rows;
 		const int n = A.cols;
-		std::vector<std::vector<double>> LU(m, std::vector<double>(n, 0.0));
+		const int K = aly::min(m, n);
+		std::vector<double> storage(m * (size_t)n, 0.0);
+		DenseMatrixView<double> LU(storage.data(), m, n, n);
 		piv.resize(m);
-		std::vector<double> LUcolj(m, 0.0);
-		int pivsign;
-		double* LUrowi;
 		L.resize(m, n);
 		U.resize(n, n);
 		bool nonSingular = true;
 		for (int i = 0; i < m; i++) {
+			const vec<T, C>* row = A[i];
 			for (int j = 0; j < n; j++) {
-				LU[i][j] = (double)A[i][j][cc];
+				LU[i][j] = (double)row[j][cc];
 			}
 		}
 		for (int i = 0; i < m; i++) {
 			piv[i] = i;
 		}
-		pivsign = 1;
-		for (int j = 0; j < n; j++) {
-			for (int i = 0; i < m; i++) {
-				LUcolj[i] = LU[i][j];
-			}
-			for (int i = 0; i < m; i++) {
-				LUrowi = &LU[i][0];
-				int kmax = aly::min(i, j);
-				double s = 0.0;
-				for (int k = 0; k < kmax; k++) {
-					s += LUrowi[k] * LUcolj[k];
+		for (int kb = 0; kb < K; kb += BLOCK) {
+			int ke = aly::min(K, kb + BLOCK);
+			for (int k = kb; k < ke; k++) {
+				int p = k;
+				for (int i = k + 1; i < m; i++) {
+					if (std::abs(LU[i][k]) > std::abs(LU[p][k])) {
+						p = i;
+					}
 				}
-				LUrowi[j] = LUcolj[i] -= s;
-			}
-			int p = j;
-			for (int i = j + 1; i < m; i++) {
-				if (std::abs(LUcolj[i]) > std::abs(LUcolj[p])) {
-					p = i;
+				if (p != k) {
+					std::swap_ranges(LU[p], LU[p] + n, LU[k]);
+					std::swap(piv[p], piv[k]);
 				}
-			}
-			if (p != j) {
-				for (int k = 0; k < n; k++) {
-					std::swap(LU[p][k], LU[j][k]);
+				double pivot = LU[k][k];
+				if (std::abs(pivot) > zeroTolerance) {
+					const double* rowk = LU[k];
+#pragma omp parallel for if ((m - k) * (ke - k) > 32768)
+					for (int i = k + 1; i < m; i++) {
+						double* rowi = LU[i];
+						double l = (rowi[k] /= pivot);
+						for (int j = k + 1; j < ke; j++) {
+							rowi[j] -= l * rowk[j];
+						}
+					}
 				}
-				std::swap(piv[p], piv[j]);
-				pivsign = -pivsign;
 			}
-			if (j < m && std::abs(LU[j][j]) > zeroTolerance) {
-				for (int i = j + 1; i < m; i++) {
-					LU[i][j] /= LU[j][j];
+			if (ke < n) {
+				for (int i = kb + 1; i < ke; i++) {
+					double* rowi = LU[i];
+					for (int k = kb; k < i; k++) {
+						double l = rowi[k];
+						const double* rowk = LU[k];
+						for (int j = ke; j < n; j++) {
+							rowi[j] -= l * rowk[j];
+						}
+					}
+				}
+				if (ke < m) {
+					MatrixMultiply(LU.block(ke, ke, m - ke, n - ke),
+						LU.block(ke, kb, m - ke, ke - kb),
+						LU.block(kb, ke, ke - kb, n - ke), MatrixUpdate::Subtract);
 				}
 			}
 		}
-		for (int j = 0; j < n; j++) {
+		for (int j = 0; j < K; j++) {
 			if (std::abs(LU[j][j]) <= zeroTolerance) {
 				nonSingular = false;
 				break;
@@ -491,7 +753,7 @@ namespace aly {
 		}
 		for (int i = 0; i < n; i++) {
 			for (int j = 0; j < n; j++) {
-				if (i <= j) {
+				if (i <= j && i < m) {
 					U[i][j].x = T(LU[i][j]);
 				}
 				else {
@@ -501,7 +763,6 @@ namespace aly {
 		}
 		return nonSingular;
 	}
-
 	template<class T, int C> Vector<T, C> SolveLU(const DenseMatrix<T, C>& A,
 		const Vector<T, C>& b) {
 
@@ -513,9 +774,8 @@ namespace aly {
 				<< "]");
 		}
 		if (A.rows != A.cols) {
-			DenseMatrix<T, C> At = A.transpose();
-			DenseMatrix<T, C> AtA = At * A;
-			Vector<T, C> Atb = At * b;
+			DenseMatrix<T, C> AtA = TransposeMultiply(A, A);
+			Vector<T, C> Atb = TransposeMultiply(A, b);
 			int n = AtA.cols;
 			Vector<T, C> x(A.cols);
 			Vector<T, C> y(A.cols);
@@ -594,17 +854,23 @@ namespace aly {
 		DenseMatrix<T, C>& Q, DenseMatrix<T, C>& R) {
 		const int m = A.rows;
 		const int n = A.cols;
-		std::vector<std::vector<double>> QR(m, std::vector<double>(n));
+		std::vector<double> qrData(m * (size_t)n);
+		std::vector<double> qData(m * (size_t)n);
+		DenseMatrixView<double> QR(qrData.data(), m, n, n);
+		DenseMatrixView<double> Qd(qData.data(), m, n, n);
 		std::vector<double> Rdiag(m);
+		std::vector<double> s(n);
 		R.resize(n, n);
 		Q.resize(m, n);
 		bool nonSingular = true;
 		for (int cc = 0; cc < C; cc++) {
 			for (int i = 0; i < m; i++) {
+				const vec<T, C>* row = A[i];
 				for (int j = 0; j < n; j++) {
-					QR[i][j] = (double)A[i][j][cc];
+					QR[i][j] = (double)row[j][cc];
 				}
 			}
+			//Householder reflections are applied a row at a time so every pass streams contiguous memory.
 			for (int k = 0; k < n; k++) {
 				double nrm = 0;
 				for (int i = k; i < m; i++) {
@@ -618,20 +884,28 @@ namespace aly {
 						QR[i][k] /= nrm;
 					}
 					QR[k][k] += 1.0;
-					for (int j = k + 1; j < n; j++) {
-						double s = 0.0;
-						for (int i = k; i < m; i++) {
-							s += QR[i][k] * QR[i][j];
+					std::fill(s.begin() + k + 1, s.end(), 0.0);
+					for (int i = k; i < m; i++) {
+						const double* row = QR[i];
+						double qik = row[k];
+						for (int j = k + 1; j < n; j++) {
+							s[j] += qik * row[j];
 						}
-						s = -s / QR[k][k];
-						for (int i = k; i < m; i++) {
-							QR[i][j] += s * QR[i][k];
+					}
+					for (int j = k + 1; j < n; j++) {
+						s[j] = -s[j] / QR[k][k];
+					}
+#pragma omp parallel for if ((m - k) * (n - k) > 32768)
+					for (int i = k; i < m; i++) {
+						double* row = QR[i];
+						double qik = row[k];
+						for (int j = k + 1; j < n; j++) {
+							row[j] += s[j] * qik;
 						}
 					}
 				}
 				Rdiag[k] = -nrm;
 			}
-
 			for (int i = 0; i < n; i++) {
 				for (int j = 0; j < n; j++) {
 					if (i < j) {
@@ -653,26 +927,40 @@ namespace aly {
 			}
 			for (int k = n - 1; k >= 0; k--) {
 				for (int i = 0; i < m; i++) {
-					Q[i][k][cc] = T(0.0);
-				}
-				Q[k][k][cc] = T(1.0);
-				for (int j = k; j < n; j++) {
-					if (QR[k][k] != 0) {
-						double s = 0.0;
-						for (int i = k; i < m; i++) {
-							s += QR[i][k] * Q[i][j][cc];
+					Qd[i][k] = 0.0;
+				}
+				Qd[k][k] = 1.0;
+				if (QR[k][k] != 0) {
+					std::fill(s.begin() + k, s.end(), 0.0);
+					for (int i = k; i < m; i++) {
+						const double* row = Qd[i];
+						double qik = QR[i][k];
+						for (int j = k; j < n; j++) {
+							s[j] += qik * row[j];
 						}
-						s = -s / QR[k][k];
-						for (int i = k; i < m; i++) {
-							Q[i][j][cc] += T(s * QR[i][k]);
+					}
+					for (int j = k; j < n; j++) {
+						s[j] = -s[j] / QR[k][k];
+					}
+#pragma omp parallel for if ((m - k) * (n - k) > 32768)
+					for (int i = k; i < m; i++) {
+						double* row = Qd[i];
+						double qik = QR[i][k];
+						for (int j = k; j < n; j++) {
+							row[j] += s[j] * qik;
 						}
 					}
 				}
 			}
+			for (int i = 0; i < m; i++) {
+				vec<T, C>* row = Q[i];
+				for (int j = 0; j < n; j++) {
+					row[j][cc] = T(Qd[i][j]);
+				}
+			}
 		}
 		return nonSingular;
 	}
-
 	template<class T, int C> Vector<T, C> SolveQR(const DenseMatrix<T, C>& A,
 		const Vector<T, C>& b) {
 
@@ -684,9 +972,8 @@ namespace aly {
 				<< "]");
 		}
 		if (A.rows != A.cols) {
-			DenseMatrix<T, C> At = A.transpose();
-			DenseMatrix<T, C> AtA = At * A;
-			Vector<T, C> Atb = At * b;
+			DenseMatrix<T, C> AtA = TransposeMultiply(A, A);
+			Vector<T, C> Atb = TransposeMultiply(A, b);
 			int n = AtA.cols;
 			Vector<T, C> x(A.cols);
 			DenseMatrix<T, C> Q, R;
@@ -695,7 +982,7 @@ namespace aly {
 				throw std::runtime_error("Matrix is singular.");
 			}
 			// Compute Y = transpose(Q)*B
-			x = Q.transpose() * Atb;
+			x = TransposeMultiply(Q, Atb);
 			// Solve R*X = Y;
 			for (int k = n - 1; k >= 0; k--) {
 				x[k] /= R[k][k];
@@ -715,7 +1002,7 @@ namespace aly {
 				throw std::runtime_error("Matrix is singular.");
 			}
 			// Compute Y = transpose(Q)*B
-			x = Q.transpose() * b;
+			x = TransposeMultiply(Q, b);
 			// Solve R*X = Y;
 			for (int k = n - 1; k >= 0; k--) {
 				x[k] /= R[k][k];
@@ -754,6 +1041,24 @@ namespace aly {
 		}
 		return Vector<T, C>();
 	}
+	//Expression right hand sides such as W*b are evaluated once before solving.
+	template<class E, class T, int C> Vector<T, C> SolveSVD(const DenseMatrix<T, C>& A,
+		const VectorExpression<E, T, C>& b) {
+		return SolveSVD(A, b.eval());
+	}
+	template<class E, class T, int C> Vector<T, C> SolveLU(const DenseMatrix<T, C>& A,
+		const VectorExpression<E, T, C>& b) {
+		return SolveLU(A, b.eval());
+	}
+	template<class E, class T, int C> Vector<T, C> SolveQR(const DenseMatrix<T, C>& A,
+		const VectorExpression<E, T, C>& b) {
+		return SolveQR(A, b.eval());
+	}
+	template<class E, class T, int C> Vector<T, C> Solve(const DenseMatrix<T, C>& A,
+		const VectorExpression<E, T, C>& b, MatrixFactorization factor =
+		MatrixFactorization::SVD) {
+		return Solve(A, b.eval(), factor);
+	}
 	template<class T, int C> Vector<T, C> SolveRobust(const DenseMatrix<T, C>& A, const Vector<T, C>& b,
 		int p = 1, int iterations = 100, double errorTolerance = 1E-6f,
 		double zeroTolerance = 1E-16, MatrixFactorization factor = MatrixFactorization::SVD) {
@@ -811,7 +1116,7 @@ namespace aly {
 			bs.resize(sampleSize);
 			for (int i = 0;i < sampleSize;i++) {
 				int idx = order[(i + offset)%N];
-				As[i] = A[idx];
+				As.setRow(i, A[idx]);
 				bs[i] = b[idx];
 			}
 			X = SolveQR(As, bs);
@@ -850,7 +1155,7 @@ namespace aly {
 		bs.resize((int)order.size());
 		for (int i = 0;i < order.size();i++) {
 			int idx = order[i];
-			As[i] = A[idx];
+			As.setRow(i, A[idx]);
 			bs[i] = b[idx];
 		}
 		X = SolveQR(As, bs);
@@ -25,6 +25,16 @@
 #include "AlloyVolume.h"
 namespace aly {
 	bool SANITY_CHECK_DISTANCE_FIELD();
+	bool SANITY_CHECK_DISTANCE_FIELD_ACCURACY();
+	bool SANITY_CHECK_DISTANCE_TRANSFORM();
+	/*
+	 * FastMarching is serial and only visits voxels up to maxDistance in order of distance.
+	 * FastSweeping runs multithreaded Gauss-Seidel sweeps over the band within maxDistance of the interface.
+	 * FastIterative updates a narrow band active list in parallel until it converges.
+	 */
+	enum class DistanceFieldMethod {
+		FastMarching = 0, FastSweeping = 1, FastIterative = 2
+	};
 	class DistanceField3f {
 		typedef Indexable<float, 3> VoxelIndex;
 		typedef vec<int, 3> Coord;
@@ -33,10 +43,23 @@ namespace aly {
 		static const ubyte1 NARROW_BAND;
 		static const ubyte1 FAR_AWAY;
 
+		DistanceFieldMethod method;
 		float march(float Nv, float Sv, float Ev, float Wv, float Fv, float Bv, int Nl, int Sl, int El, int Wl, int Fl, int Bl);
+		size_t initialize(const Volume1f& vol, Volume1f& distVol, Volume1ub& labelVol, Volume1b& signVol);
+		void markBand(Volume1ub& labelVol, float maxDistance);
+		void solveFastMarching(Volume1f& distVol, Volume1ub& labelVol, Volume1b& signVol, size_t countAlive, float maxDistance);
+		void solveFastSweeping(const Volume1f& vol, Volume1f& distVol, Volume1ub& labelVol, Volume1b& signVol, float maxDistance);
+		void solveFastIterative(const Volume1f& vol, Volume1f& distVol, Volume1ub& labelVol, Volume1b& signVol, float maxDistance);
+		void finalize(const Volume1f& vol, Volume1f& distVol, const Volume1ub& labelVol, const Volume1b& signVol, float maxDistance);
 	public:
 		static const float DISTANCE_UNDEFINED;
-		DistanceField3f()  {}
+		DistanceField3f(DistanceFieldMethod method = DistanceFieldMethod::FastMarching) :method(method) {}
+		void setMethod(DistanceFieldMethod m) {
+			method = m;
+		}
+		DistanceFieldMethod getMethod() const {
+			return method;
+		}
 		void solve(const Volume1f& vol, Volume1f& out,float maxDistance=2.5f);
 	};
 	class DistanceField2f {
@@ -47,12 +70,40 @@ namespace aly {
 		static const ubyte1 NARROW_BAND;
 		static const ubyte1 FAR_AWAY;
 
+		DistanceFieldMethod method;
 		float march(float Nv, float Sv, float Fv, float Bv, int Nl, int Sl, int Fl, int Bl);
+		size_t initialize(const Image1f& vol, Image1f& distVol, Image1ub& labelVol, Image1b& signVol);
+		void markBand(Image1ub& labelVol, float maxDistance);
+		void solveFastMarching(Image1f& distVol, Image1ub& labelVol, Image1b& signVol, size_t countAlive, float maxDistance);
+		void solveFastSweeping(const Image1f& vol, Image1f& distVol, Image1ub& labelVol, Image1b& signVol, float maxDistance);
+		void solveFastIterative(const Image1f& vol, Image1f& distVol, Image1ub& labelVol, Image1b& signVol, float maxDistance);
+		void finalize(const Image1f& vol, Image1f& distVol, const Image1ub& labelVol, const Image1b& signVol, float maxDistance);
 	public:
 		static const float DISTANCE_UNDEFINED;
-		DistanceField2f() {}
+		DistanceField2f(DistanceFieldMethod method = DistanceFieldMethod::FastMarching) :method(method) {}
+		void setMethod(DistanceFieldMethod m) {
+			method = m;
+		}
+		DistanceFieldMethod getMethod() const {
+			return method;
+		}
 		void solve(const Image1f& vol, Image1f& out, float maxDistance = 2.5f);
 	};
+	/*
+	 * Exact Euclidean distance (in voxels) from each voxel to the nearest non-zero voxel of the mask. Voxels of a mask without any
+	 * non-zero voxels are DISTANCE_UNDEFINED. The optional feature map stores the linear index i + (j + k * cols) * rows of that
+	 * nearest voxel, or -1 if there is none.
+	 *
+	 * Rows, columns and slices are transformed one axis at a time, each line in parallel, so the run time is linear in the number of voxels.
+	 */
+	void DistanceTransform(const Volume1ub& mask, Volume1f& distVol);
+	void DistanceTransform(const Volume1ub& mask, Volume1f& distVol, Volume1i& features);
+	/*
+	 * Exact Euclidean distance (in pixels) from each pixel to the nearest non-zero pixel of the mask, see DistanceTransform(const Volume1ub&,Volume1f&).
+	 * The optional feature map stores the linear index i + j * width of the nearest pixel, or -1 if there is none.
+	 */
+	void DistanceTransform(const Image1ub& mask, Image1f& distImg);
+	void DistanceTransform(const Image1ub& mask, Image1f& distImg, Image1i& features);
 } /* namespace imagesci */
 
 #endif /* DISTANCEFIELD_H_ */
@@ -133,7 +133,7 @@ namespace aly {
 		return (isalnum(c) || (c == '+') || (c == '-'));
 	}
 
-	template<class T> std::string EncodeBase64(const std::vector<T>& in, bool pad =
+	template<class T, class A> std::string EncodeBase64(const std::vector<T, A>& in, bool pad =
 		true) {
 		int i = 0;
 		int j = 0;
@@ -181,7 +181,7 @@ namespace aly {
 		}
 		return bufferOut.str();
 	}
-	template<class T> std::string HashCode(std::vector<T> data, HashMethod method =
+	template<class T, class A> std::string HashCode(const std::vector<T, A>& data, HashMethod method =
 		HashMethod::SHA256) {
 		std::string str = EncodeBase64(data);
 		std::vector<unsigned char> hashOut;
@@ -29,8 +29,12 @@
 #include <functional>
 #include <fstream>
 #include <random>
+#include <algorithm>
+#include <memory>
 namespace aly {
 bool SANITY_CHECK_IMAGE();
+bool SANITY_CHECK_IMAGE_CONVERT();
+bool SANITY_CHECK_IMAGE_VIEW();
 bool SANITY_CHECK_IMAGE_IO();
 bool SANITY_CHECK_PYRAMID();
 enum class ImageType {
@@ -66,18 +70,171 @@ template<class L, class R> std::basic_ostream<L, R>& operator <<(
 	return ss;
 }
 template<class T, int C, ImageType I> struct Image;
+template<class T, int C, ImageType I> struct ImageView;
+template<class T, int C, ImageType I> struct ConstImageView;
 template<class T, int C, ImageType I> void WriteImageToRawFile(
 		const std::string& fileName, const Image<T, C, I>& img);
-template<class T, int C, ImageType I> struct Image {
+/*
+ Component k of an expression in the interleaved layout of the reduction engine, Images read memory directly.
+ */
+template<class E, class T, int C> struct ImageComponents {
+	const E& expr;
+	ImageComponents(const E& expr) :
+			expr(expr) {
+	}
+	T operator()(size_t k) const {
+		return vec<T, C>(expr[k / C])[k % C];
+	}
+};
+template<class T, int C, ImageType I> struct ImageComponents<Image<T, C, I>, T, C> {
+	const T* ptr;
+	ImageComponents(const Image<T, C, I>& img) :
+			ptr(img.ptr()) {
+	}
+	T operator()(size_t k) const {
+		return ptr[k];
+	}
+};
+/*
+ Lazy element-wise expressions over Images, evaluated in a single parallel loop on assignment.
+ Scalar and unary expressions keep the position of their operand, binary expressions are placed at the origin.
+ Temporary Images are moved into the expression and named ones are referenced, so an expression must not
+ outlive the named Images it reads. Statistics run on the expression, eval() gives an Image for other functions.
+ Veldhuizen, T. (1995). Expression templates. C++ Report, 7(5), 26-31.
+ */
+template<class E, class T, int C, ImageType I> struct ImageExpression {
+protected:
+	size_t components() const {
+		int2 dims = derived().dimensions();
+		return (size_t) dims.x * dims.y * C;
+	}
+public:
+	const E& derived() const {
+		return static_cast<const E&>(*this);
+	}
+	Image<T, C, I> eval() const {
+		return Image<T, C, I>(derived());
+	}
+	vec<T, C> min() const {
+		return ParallelReduce<ReduceMin, T, C>(components(),
+				ImageComponents<E, T, C>(derived()));
+	}
+	vec<T, C> max() const {
+		return ParallelReduce<ReduceMax, T, C>(components(),
+				ImageComponents<E, T, C>(derived()));
+	}
+	std::pair<vec<T, C>, vec<T, C>> range() const {
+		return ParallelRange<T, C>(components(),
+				ImageComponents<E, T, C>(derived()));
+	}
+	vec<T, C> mean(Summation method = Summation::Pairwise) const {
+		ImageComponents<E, T, C> e(derived());
+		vec<double, C> mean = ParallelSum<double, C>(components(),
+				[=](size_t k) {return (double) e(k);}, method);
+		mean = mean / (double) (components() / C);
+		return vec<T, C>(mean);
+	}
+	vec<T, C> median() const {
+		return eval().median();
+	}
+	vec<T, C> mad() const {
+		return eval().mad();
+	}
+	vec<T, C> madStdDev() const {
+		return eval().madStdDev();
+	}
+	vec<T, C> stdDev() const {
+		return eval().stdDev();
+	}
+};
+template<class E> struct ImageOperand {
+	typedef const E type;
+};
+template<class T, int C, ImageType I> struct ImageOperand<Image<T, C, I>> {
+	typedef const Image<T, C, I>& type;
+};
+template<class L, class R, class Op, class T, int C, ImageType I> struct ImageBinaryExpression: public ImageExpression<
+		ImageBinaryExpression<L, R, Op, T, C, I>, T, C, I> {
+	typename ImageOperand<L>::type lhs;
+	typename ImageOperand<R>::type rhs;
+	ImageBinaryExpression(const L& lhs, const R& rhs) :
+			lhs(lhs), rhs(rhs) {
+		if (lhs.dimensions() != rhs.dimensions())
+			throw std::runtime_error(
+					MakeString() << "Image dimensions do not match. "
+							<< lhs.dimensions() << "!=" << rhs.dimensions());
+	}
+	vec<T, C> operator[](size_t i) const {
+		return Op::apply(vec<T, C>(lhs[i]), vec<T, C>(rhs[i]));
+	}
+	int2 dimensions() const {
+		return lhs.dimensions();
+	}
+	int2 position() const {
+		return int2(0, 0);
+	}
+};
+template<class E, class Op, class T, int C, ImageType I> struct ImageScalarLeftExpression: public ImageExpression<
+		ImageScalarLeftExpression<E, Op, T, C, I>, T, C, I> {
+	const vec<T, C> scalar;
+	typename ImageOperand<E>::type expr;
+	ImageScalarLeftExpression(const vec<T, C>& scalar, const E& expr) :
+			scalar(scalar), expr(expr) {
+	}
+	vec<T, C> operator[](size_t i) const {
+		return Op::apply(scalar, vec<T, C>(expr[i]));
+	}
+	int2 dimensions() const {
+		return expr.dimensions();
+	}
+	int2 position() const {
+		return expr.position();
+	}
+};
+template<class E, class Op, class T, int C, ImageType I> struct ImageScalarRightExpression: public ImageExpression<
+		ImageScalarRightExpression<E, Op, T, C, I>, T, C, I> {
+	typename ImageOperand<E>::type expr;
+	const vec<T, C> scalar;
+	ImageScalarRightExpression(const E& expr, const vec<T, C>& scalar) :
+			expr(expr), scalar(scalar) {
+	}
+	vec<T, C> operator[](size_t i) const {
+		return Op::apply(vec<T, C>(expr[i]), scalar);
+	}
+	int2 dimensions() const {
+		return expr.dimensions();
+	}
+	int2 position() const {
+		return expr.position();
+	}
+};
+template<class E, class T, int C, ImageType I> struct ImageNegateExpression: public ImageExpression<
+		ImageNegateExpression<E, T, C, I>, T, C, I> {
+	typename ImageOperand<E>::type expr;
+	ImageNegateExpression(const E& expr) :
+			expr(expr) {
+	}
+	vec<T, C> operator[](size_t i) const {
+		return -vec<T, C>(expr[i]);
+	}
+	int2 dimensions() const {
+		return expr.dimensions();
+	}
+	int2 position() const {
+		return expr.position();
+	}
+};
+template<class T, int C, ImageType I> struct Image: public ImageExpression<Image<T, C, I>, T, C, I> {
 protected:
 	int x, y;
 	std::string hashCode;
 public:
-	std::vector<vec<T, C>> data;
 	typedef vec<T, C> ValueType;
-	typedef typename std::vector<ValueType>::iterator iterator;
-	typedef typename std::vector<ValueType>::const_iterator const_iterator;
-	typedef typename std::vector<ValueType>::reverse_iterator reverse_iterator;
+	typedef std::vector<ValueType, AlignedAllocator<ValueType>> StorageType;
+	StorageType data;
+	typedef typename StorageType::iterator iterator;
+	typedef typename StorageType::const_iterator const_iterator;
+	typedef typename StorageType::reverse_iterator reverse_iterator;
 	iterator begin() {
 		return data.begin();
 	}
@@ -140,6 +297,9 @@ public:
 		}
 	}
 	void set(const std::vector<vec<T, C>>& val) {
+		data.assign(val.begin(), val.end());
+	}
+	void set(const StorageType& val) {
 		data = val;
 	}
 	void set(vec<T, C>* val) {
@@ -157,6 +317,7 @@ public:
 		y = other.y;
 		set(other.data);
 	}
+	void set(const ConstImageView<T, C, I>& view);
 	std::string getTypeName() const {
 		return MakeString() << type << channels;
 	}
@@ -183,27 +344,74 @@ public:
 	}
 	Image(std::vector<vec<T, C>>& ref, int w, int h, int x = 0, int y = 0,
 		uint64_t id = 0) :
-		x(x), y(y), data(ref), width(w), height(h), id(id), channels(C), type(
+		x(x), y(y), data(ref.begin(), ref.end()), width(w), height(h), id(id), channels(C), type(
 			I) {
 	}
 	Image() :
 		x(0), y(0), width(0), height(0), id(0), channels(C), type(I) {
 	}
+	explicit Image(const ConstImageView<T, C, I>& view) :
+		Image() {
+		set(view);
+	}
 	Image(const Image<T, C, I>& img) :
 		Image(img.width, img.height, img.x, img.y, img.id) {
 		set(img.data);
 	}
 
+	Image(Image<T, C, I>&& img) noexcept :
+		x(img.x), y(img.y), hashCode(std::move(img.hashCode)), data(std::move(img.data)), width(img.width), height(img.height), id(img.id), channels(C), type(
+			I) {
+		img.width = 0;
+		img.height = 0;
+	}
 	Image<T, C, I>& operator=(const Image<T, C, I>& rhs) {
 		if (this == &rhs)
 			return *this;
 		this->resize(rhs.width, rhs.height);
-		this->x = x;
-		this->y = y;
-		this->id = id;
+		this->x = rhs.x;
+		this->y = rhs.y;
+		this->id = rhs.id;
 		this->set(rhs.data);
 		return *this;
 	}
+	template<class E> Image(const ImageExpression<E, T, C, I>& expr) :
+			x(0), y(0), width(0), height(0), id(0), channels(C), type(I) {
+		*this = expr;
+	}
+	const Image<T, C, I>& eval() const {
+		return *this;
+	}
+	template<class E> Image<T, C, I>& operator=(
+			const ImageExpression<E, T, C, I>& expr) {
+		const E& e = expr.derived();
+		int2 dims = e.dimensions();
+		int2 pos = e.position();
+		resize(dims.x, dims.y);
+		size_t sz = data.size();
+#pragma omp parallel for
+		for (int offset = 0; offset < (int) sz; offset++) {
+			data[offset] = e[offset];
+		}
+		x = pos.x;
+		y = pos.y;
+		return *this;
+	}
+	Image<T, C, I>& operator=(Image<T, C, I>&& rhs) noexcept {
+		if (this == &rhs)
+			return *this;
+		data = std::move(rhs.data);
+		hashCode = std::move(rhs.hashCode);
+		width = rhs.width;
+		height = rhs.height;
+		x = rhs.x;
+		y = rhs.y;
+		id = rhs.id;
+		rhs.data.clear();
+		rhs.width = 0;
+		rhs.height = 0;
+		return *this;
+	}
 	int2 dimensions() const {
 		return int2(width, height);
 	}
@@ -256,6 +464,18 @@ public:
 			return nullptr;
 		return &(data.front()[0]);
 	}
+	ImageView<T, C, I> view() {
+		return ImageView<T, C, I>(*this);
+	}
+	ConstImageView<T, C, I> view() const {
+		return ConstImageView<T, C, I>(*this);
+	}
+	ImageView<T, C, I> view(const int2& pos, const int2& dims) {
+		return ImageView<T, C, I>(*this, pos, dims);
+	}
+	ConstImageView<T, C, I> view(const int2& pos, const int2& dims) const {
+		return ConstImageView<T, C, I>(*this, pos, dims);
+	}
 	void setZero() {
 		data.assign(data.size(), vec<T, C>((T)0));
 	}
@@ -440,33 +660,24 @@ public:
 		return out;
 	}
 	vec<T, C> min() const {
-		vec<T, C> minVal(std::numeric_limits<T>::max());
-		for (const vec<T, C>& val : data) {
-			minVal = aly::minVec(val, minVal);
-		}
-		return minVal;
+		const T* ptr = this->ptr();
+		return ParallelReduce<ReduceMin, T, C>(data.size() * C,
+				[=](size_t k) {return ptr[k];});
 	}
 	vec<T, C> max() const {
-		vec<T, C> maxVal(std::numeric_limits<T>::min());
-		for (const vec<T, C>& val : data) {
-			maxVal = aly::maxVec(val, maxVal);
-		}
-		return maxVal;
+		const T* ptr = this->ptr();
+		return ParallelReduce<ReduceMax, T, C>(data.size() * C,
+				[=](size_t k) {return ptr[k];});
 	}
 	std::pair<vec<T, C>, vec<T, C>> range() const {
-		vec<T, C> maxVal(std::numeric_limits<T>::min());
-		vec<T, C> minVal(std::numeric_limits<T>::max());
-		for (const vec<T, C>& val : data) {
-			maxVal = aly::maxVec(val, maxVal);
-			minVal = aly::minVec(val, minVal);
-		}
-		return std::pair<vec<T, C>, vec<T, C>>(minVal, maxVal);
-	}
-	vec<T, C> mean() const {
-		vec<double, C> mean(0.0);
-		for (const vec<T, C>& val : data) {
-			mean += vec<double, C>(val);
-		}
+		const T* ptr = this->ptr();
+		return ParallelRange<T, C>(data.size() * C,
+				[=](size_t k) {return ptr[k];});
+	}
+	vec<T, C> mean(Summation method = Summation::Pairwise) const {
+		const T* ptr = this->ptr();
+		vec<double, C> mean = ParallelSum<double, C>(data.size() * C,
+				[=](size_t k) {return (double) ptr[k];}, method);
 		mean = mean / (double) data.size();
 		return vec<T, C>(mean);
 	}
@@ -570,6 +781,169 @@ template<class T, int C, ImageType I> std::string Image<T, C, I>::updateHashCode
 	}
 	return hashCode;
 }
+/*
+ Non-owning window into a rectangle of pixels. Consecutive rows are stride elements apart, so a view of a
+ sub-region shares memory with its parent and costs nothing to create. The parent must outlive the view and
+ must not be resized while the view is in use. Position is reported in the coordinates of the parent's owner.
+ */
+inline size_t ImageViewOffset(const int2& parent, int stride, const int2& pos,
+		const int2& dims) {
+	if (pos.x < 0 || pos.y < 0 || dims.x < 0 || dims.y < 0
+			|| pos.x + dims.x > parent.x || pos.y + dims.y > parent.y)
+		throw std::runtime_error(
+				MakeString() << "View region " << pos << " " << dims
+						<< " exceeds dimensions " << parent);
+	return pos.x + pos.y * (size_t) stride;
+}
+template<class V, class T, int C, ImageType I> struct ImageViewBase {
+protected:
+	V* start;
+	int x, y;
+	ImageViewBase(V* start, int w, int h, int stride, const int2& pos,
+			uint64_t id) :
+			start(start), x(pos.x), y(pos.y), width(w), height(h), stride(
+					stride), id(id) {
+	}
+public:
+	typedef vec<T, C> ValueType;
+	int width;
+	int height;
+	int stride;
+	uint64_t id;
+	int2 dimensions() const {
+		return int2(width, height);
+	}
+	int2 position() const {
+		return int2(x, y);
+	}
+	size_t size() const {
+		return width * (size_t) height;
+	}
+	bool isContiguous() const {
+		return (stride == width || height <= 1);
+	}
+	V* vecPtr() const {
+		return start;
+	}
+	V* row(int j) const {
+		return start + j * (size_t) stride;
+	}
+	V& operator()(int i, int j) const {
+		return start[clamp(i, 0, width - 1)
+				+ clamp(j, 0, height - 1) * (size_t) stride];
+	}
+	V& operator()(const int2& ij) const {
+		return operator()(ij.x, ij.y);
+	}
+};
+template<class T, int C, ImageType I> struct ImageView: public ImageViewBase<
+		vec<T, C>, T, C, I> {
+	ImageView() :
+			ImageViewBase<vec<T, C>, T, C, I>(nullptr, 0, 0, 0, int2(0, 0), 0) {
+	}
+	ImageView(vec<T, C>* ptr, int w, int h, int stride, const int2& pos =
+			int2(0, 0), uint64_t id = 0) :
+			ImageViewBase<vec<T, C>, T, C, I>(ptr, w, h, stride, pos, id) {
+	}
+	ImageView(Image<T, C, I>& img) :
+			ImageViewBase<vec<T, C>, T, C, I>(img.vecPtr(), img.width,
+					img.height, img.width, img.position(), img.id) {
+	}
+	ImageView(Image<T, C, I>& img, const int2& pos, const int2& dims) :
+			ImageViewBase<vec<T, C>, T, C, I>(
+					img.vecPtr()
+							+ ImageViewOffset(img.dimensions(), img.width, pos,
+									dims), dims.x, dims.y, img.width,
+					img.position() + pos, img.id) {
+	}
+	ImageView<T, C, I> view(const int2& pos, const int2& dims) const {
+		return ImageView<T, C, I>(
+				this->start
+						+ ImageViewOffset(this->dimensions(), this->stride, pos,
+								dims), dims.x, dims.y, this->stride,
+				this->position() + pos, this->id);
+	}
+	void set(const vec<T, C>& val) const {
+		for (int j = 0; j < this->height; j++) {
+			std::fill(this->row(j), this->row(j) + this->width, val);
+		}
+	}
+};
+template<class T, int C, ImageType I> struct ConstImageView: public ImageViewBase<
+		const vec<T, C>, T, C, I> {
+	ConstImageView() :
+			ImageViewBase<const vec<T, C>, T, C, I>(nullptr, 0, 0, 0,
+					int2(0, 0), 0) {
+	}
+	ConstImageView(const vec<T, C>* ptr, int w, int h, int stride,
+			const int2& pos = int2(0, 0), uint64_t id = 0) :
+			ImageViewBase<const vec<T, C>, T, C, I>(ptr, w, h, stride, pos, id) {
+	}
+	ConstImageView(const Image<T, C, I>& img) :
+			ImageViewBase<const vec<T, C>, T, C, I>(img.vecPtr(), img.width,
+					img.height, img.width, img.position(), img.id) {
+	}
+	ConstImageView(const Image<T, C, I>& img, const int2& pos,
+			const int2& dims) :
+			ImageViewBase<const vec<T, C>, T, C, I>(
+					img.vecPtr()
+							+ ImageViewOffset(img.dimensions(), img.width, pos,
+									dims), dims.x, dims.y, img.width,
+					img.position() + pos, img.id) {
+	}
+	ConstImageView(const ImageView<T, C, I>& view) :
+			ImageViewBase<const vec<T, C>, T, C, I>(view.vecPtr(), view.width,
+					view.height, view.stride, view.position(), view.id) {
+	}
+	ConstImageView<T, C, I> view(const int2& pos, const int2& dims) const {
+		return ConstImageView<T, C, I>(
+				this->start
+						+ ImageViewOffset(this->dimensions(), this->stride, pos,
+								dims), dims.x, dims.y, this->stride,
+				this->position() + pos, this->id);
+	}
+};
+template<class T, int C, ImageType I> void Image<T, C, I>::set(
+		const ConstImageView<T, C, I>& view) {
+	if (data.size() > 0 && view.vecPtr() >= &data.front()
+			&& view.vecPtr() <= &data.back()) {
+		//View into this image, copy out before resizing
+		Image<T, C, I> tmp(view);
+		*this = std::move(tmp);
+		return;
+	}
+	resize(view.width, view.height);
+	id = view.id;
+	setPosition(view.position());
+	if (data.size() == 0)
+		return;
+#pragma omp parallel for
+	for (int j = 0; j < height; j++) {
+		std::copy(view.row(j), view.row(j) + width, &data[j * (size_t) width]);
+	}
+}
+/*
+ Applies func to every pixel of a view and stores the results in out, one row at a time so strided
+ views are read sequentially. func is inlined, unlike the std::function overloads of Transform.
+ */
+template<class T, int C, ImageType I, class S, int D, ImageType J, class F> void ConvertPixels(
+		const ConstImageView<T, C, I>& in, Image<S, D, J>& out, const F& func) {
+	out.resize(in.width, in.height);
+	out.id = in.id;
+	out.setPosition(in.position());
+#pragma omp parallel for
+	for (int j = 0; j < in.height; j++) {
+		const vec<T, C>* src = in.row(j);
+		vec<S, D>* dst = &out.data[j * (size_t) in.width];
+		for (int i = 0; i < in.width; i++) {
+			dst[i] = func(src[i]);
+		}
+	}
+}
+template<class T, int C, ImageType I, class S, int D, ImageType J, class F> void ConvertPixels(
+		const ImageView<T, C, I>& in, Image<S, D, J>& out, const F& func) {
+	ConvertPixels(ConstImageView<T, C, I>(in), out, func);
+}
 template<class T, int C, ImageType I> void Transform(Image<T, C, I>& im1,
 		Image<T, C, I>& im2,
 		const std::function<void(vec<T, C>&, vec<T, C>&)>& func) {
@@ -670,164 +1044,222 @@ template<class T, class L, class R, int C, ImageType I> std::basic_ostream<L, R>
 			<< "]";
 	return ss;
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator+(
-		const vec<T, C>& scalar, const Image<T, C, I>& img) {
-	Image<T, C, I> out(img.width, img.height, img.position());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2) {val1=scalar+val2;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C, ImageType I> ImageScalarLeftExpression<E, ElementAdd, T, C, I> operator+(
+		const vec<T, C>& scalar, const ImageExpression<E, T, C, I>& expr) {
+	return ImageScalarLeftExpression<E, ElementAdd, T, C, I>(scalar, expr.derived());
 }
-
-template<class T, int C, ImageType I> Image<T, C, I> operator-(
-		const vec<T, C>& scalar, const Image<T, C, I>& img) {
-	Image<T, C, I> out(img.width, img.height, img.position());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2) {val1=scalar-val2;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C, ImageType I> ImageScalarLeftExpression<E, ElementSubtract, T, C, I> operator-(
+		const vec<T, C>& scalar, const ImageExpression<E, T, C, I>& expr) {
+	return ImageScalarLeftExpression<E, ElementSubtract, T, C, I>(scalar, expr.derived());
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator*(
-		const vec<T, C>& scalar, const Image<T, C, I>& img) {
-	Image<T, C, I> out(img.width, img.height, img.position());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2) {val1=scalar*val2;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C, ImageType I> ImageScalarLeftExpression<E, ElementMultiply, T, C, I> operator*(
+		const vec<T, C>& scalar, const ImageExpression<E, T, C, I>& expr) {
+	return ImageScalarLeftExpression<E, ElementMultiply, T, C, I>(scalar, expr.derived());
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator/(
-		const vec<T, C>& scalar, const Image<T, C, I>& img) {
-	Image<T, C, I> out(img.width, img.height, img.position());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2) {val1=scalar/val2;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C, ImageType I> ImageScalarLeftExpression<E, ElementDivide, T, C, I> operator/(
+		const vec<T, C>& scalar, const ImageExpression<E, T, C, I>& expr) {
+	return ImageScalarLeftExpression<E, ElementDivide, T, C, I>(scalar, expr.derived());
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator+(
-		const Image<T, C, I>& img, const vec<T, C>& scalar) {
-	Image<T, C, I> out(img.width, img.height, img.position());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2) {val1=val2+scalar;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C, ImageType I> ImageScalarRightExpression<E, ElementAdd, T, C, I> operator+(
+		const ImageExpression<E, T, C, I>& expr, const vec<T, C>& scalar) {
+	return ImageScalarRightExpression<E, ElementAdd, T, C, I>(expr.derived(), scalar);
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator-(
-		const Image<T, C, I>& img, const vec<T, C>& scalar) {
-	Image<T, C, I> out(img.width, img.height, img.position());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2) {val1=val2-scalar;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C, ImageType I> ImageScalarRightExpression<E, ElementSubtract, T, C, I> operator-(
+		const ImageExpression<E, T, C, I>& expr, const vec<T, C>& scalar) {
+	return ImageScalarRightExpression<E, ElementSubtract, T, C, I>(expr.derived(), scalar);
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator*(
-		const Image<T, C, I>& img, const vec<T, C>& scalar) {
-	Image<T, C, I> out(img.width, img.height, img.position());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2) {val1=val2*scalar;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C, ImageType I> ImageScalarRightExpression<E, ElementMultiply, T, C, I> operator*(
+		const ImageExpression<E, T, C, I>& expr, const vec<T, C>& scalar) {
+	return ImageScalarRightExpression<E, ElementMultiply, T, C, I>(expr.derived(), scalar);
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator/(
-		const Image<T, C, I>& img, const vec<T, C>& scalar) {
-	Image<T, C, I> out(img.width, img.height, img.position());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2) {val1=val2/scalar;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C, ImageType I> ImageScalarRightExpression<E, ElementDivide, T, C, I> operator/(
+		const ImageExpression<E, T, C, I>& expr, const vec<T, C>& scalar) {
+	return ImageScalarRightExpression<E, ElementDivide, T, C, I>(expr.derived(), scalar);
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator-(
-		const Image<T, C, I>& img) {
-	Image<T, C, I> out(img.width, img.height, img.position());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2) {val1=-val2;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C, ImageType I> ImageNegateExpression<E, T, C, I> operator-(
+		const ImageExpression<E, T, C, I>& expr) {
+	return ImageNegateExpression<E, T, C, I>(expr.derived());
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator+=(
-		Image<T, C, I>& out, const Image<T, C, I>& img) {
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2) {val1+=val2;};
-	Transform(out, img, f);
-	return out;
+/*
+ Owns an rvalue Image used as an operand, so expressions built from function results stay valid.
+ */
+template<class T, int C, ImageType I> struct ImageTemporary: public ImageExpression<
+		ImageTemporary<T, C, I>, T, C, I> {
+	std::shared_ptr<const Image<T, C, I>> value;
+	ImageTemporary(Image<T, C, I>&& img) :
+			value(std::make_shared<const Image<T, C, I>>(std::move(img))) {
+	}
+	const vec<T, C>& operator[](size_t i) const {
+		return value->data[i];
+	}
+	int2 dimensions() const {
+		return value->dimensions();
+	}
+	int2 position() const {
+		return value->position();
+	}
+};
+template<class T, int C, ImageType I> ImageScalarLeftExpression<ImageTemporary<T, C, I>, ElementAdd, T, C, I> operator+(
+		const vec<T, C>& scalar, Image<T, C, I>&& img) {
+	return ImageScalarLeftExpression<ImageTemporary<T, C, I>, ElementAdd, T, C, I>(scalar, ImageTemporary<T, C, I>(std::move(img)));
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator-=(
-		Image<T, C, I>& out, const Image<T, C, I>& img) {
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2) {val1-=val2;};
-	Transform(out, img, f);
-	return out;
+template<class T, int C, ImageType I> ImageScalarLeftExpression<ImageTemporary<T, C, I>, ElementSubtract, T, C, I> operator-(
+		const vec<T, C>& scalar, Image<T, C, I>&& img) {
+	return ImageScalarLeftExpression<ImageTemporary<T, C, I>, ElementSubtract, T, C, I>(scalar, ImageTemporary<T, C, I>(std::move(img)));
+}
+template<class T, int C, ImageType I> ImageScalarLeftExpression<ImageTemporary<T, C, I>, ElementMultiply, T, C, I> operator*(
+		const vec<T, C>& scalar, Image<T, C, I>&& img) {
+	return ImageScalarLeftExpression<ImageTemporary<T, C, I>, ElementMultiply, T, C, I>(scalar, ImageTemporary<T, C, I>(std::move(img)));
+}
+template<class T, int C, ImageType I> ImageScalarLeftExpression<ImageTemporary<T, C, I>, ElementDivide, T, C, I> operator/(
+		const vec<T, C>& scalar, Image<T, C, I>&& img) {
+	return ImageScalarLeftExpression<ImageTemporary<T, C, I>, ElementDivide, T, C, I>(scalar, ImageTemporary<T, C, I>(std::move(img)));
+}
+template<class T, int C, ImageType I> ImageScalarRightExpression<ImageTemporary<T, C, I>, ElementAdd, T, C, I> operator+(
+		Image<T, C, I>&& img, const vec<T, C>& scalar) {
+	return ImageScalarRightExpression<ImageTemporary<T, C, I>, ElementAdd, T, C, I>(ImageTemporary<T, C, I>(std::move(img)), scalar);
+}
+template<class T, int C, ImageType I> ImageScalarRightExpression<ImageTemporary<T, C, I>, ElementSubtract, T, C, I> operator-(
+		Image<T, C, I>&& img, const vec<T, C>& scalar) {
+	return ImageScalarRightExpression<ImageTemporary<T, C, I>, ElementSubtract, T, C, I>(ImageTemporary<T, C, I>(std::move(img)), scalar);
+}
+template<class T, int C, ImageType I> ImageScalarRightExpression<ImageTemporary<T, C, I>, ElementMultiply, T, C, I> operator*(
+		Image<T, C, I>&& img, const vec<T, C>& scalar) {
+	return ImageScalarRightExpression<ImageTemporary<T, C, I>, ElementMultiply, T, C, I>(ImageTemporary<T, C, I>(std::move(img)), scalar);
+}
+template<class T, int C, ImageType I> ImageScalarRightExpression<ImageTemporary<T, C, I>, ElementDivide, T, C, I> operator/(
+		Image<T, C, I>&& img, const vec<T, C>& scalar) {
+	return ImageScalarRightExpression<ImageTemporary<T, C, I>, ElementDivide, T, C, I>(ImageTemporary<T, C, I>(std::move(img)), scalar);
+}
+template<class T, int C, ImageType I> ImageNegateExpression<ImageTemporary<T, C, I>, T, C, I> operator-(
+		Image<T, C, I>&& img) {
+	return ImageNegateExpression<ImageTemporary<T, C, I>, T, C, I>(ImageTemporary<T, C, I>(std::move(img)));
+}
+template<class R, class T, int C, ImageType I> ImageBinaryExpression<ImageTemporary<T, C, I>, R, ElementAdd, T, C, I> operator+(
+		Image<T, C, I>&& lhs, const ImageExpression<R, T, C, I>& rhs) {
+	return ImageBinaryExpression<ImageTemporary<T, C, I>, R, ElementAdd, T, C, I>(ImageTemporary<T, C, I>(std::move(lhs)), rhs.derived());
+}
+template<class L, class T, int C, ImageType I> ImageBinaryExpression<L, ImageTemporary<T, C, I>, ElementAdd, T, C, I> operator+(
+		const ImageExpression<L, T, C, I>& lhs, Image<T, C, I>&& rhs) {
+	return ImageBinaryExpression<L, ImageTemporary<T, C, I>, ElementAdd, T, C, I>(lhs.derived(), ImageTemporary<T, C, I>(std::move(rhs)));
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator*=(
-		Image<T, C, I>& out, const Image<T, C, I>& img) {
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2) {val1*=val2;};
-	Transform(out, img, f);
+template<class T, int C, ImageType I> ImageBinaryExpression<ImageTemporary<T, C, I>, ImageTemporary<T, C, I>, ElementAdd, T, C, I> operator+(
+		Image<T, C, I>&& lhs, Image<T, C, I>&& rhs) {
+	return ImageBinaryExpression<ImageTemporary<T, C, I>, ImageTemporary<T, C, I>, ElementAdd, T, C, I>(ImageTemporary<T, C, I>(std::move(lhs)),
+			ImageTemporary<T, C, I>(std::move(rhs)));
+}
+template<class R, class T, int C, ImageType I> ImageBinaryExpression<ImageTemporary<T, C, I>, R, ElementSubtract, T, C, I> operator-(
+		Image<T, C, I>&& lhs, const ImageExpression<R, T, C, I>& rhs) {
+	return ImageBinaryExpression<ImageTemporary<T, C, I>, R, ElementSubtract, T, C, I>(ImageTemporary<T, C, I>(std::move(lhs)), rhs.derived());
+}
+template<class L, class T, int C, ImageType I> ImageBinaryExpression<L, ImageTemporary<T, C, I>, ElementSubtract, T, C, I> operator-(
+		const ImageExpression<L, T, C, I>& lhs, Image<T, C, I>&& rhs) {
+	return ImageBinaryExpression<L, ImageTemporary<T, C, I>, ElementSubtract, T, C, I>(lhs.derived(), ImageTemporary<T, C, I>(std::move(rhs)));
+}
+template<class T, int C, ImageType I> ImageBinaryExpression<ImageTemporary<T, C, I>, ImageTemporary<T, C, I>, ElementSubtract, T, C, I> operator-(
+		Image<T, C, I>&& lhs, Image<T, C, I>&& rhs) {
+	return ImageBinaryExpression<ImageTemporary<T, C, I>, ImageTemporary<T, C, I>, ElementSubtract, T, C, I>(ImageTemporary<T, C, I>(std::move(lhs)),
+			ImageTemporary<T, C, I>(std::move(rhs)));
+}
+template<class R, class T, int C, ImageType I> ImageBinaryExpression<ImageTemporary<T, C, I>, R, ElementMultiply, T, C, I> operator*(
+		Image<T, C, I>&& lhs, const ImageExpression<R, T, C, I>& rhs) {
+	return ImageBinaryExpression<ImageTemporary<T, C, I>, R, ElementMultiply, T, C, I>(ImageTemporary<T, C, I>(std::move(lhs)), rhs.derived());
+}
+template<class L, class T, int C, ImageType I> ImageBinaryExpression<L, ImageTemporary<T, C, I>, ElementMultiply, T, C, I> operator*(
+		const ImageExpression<L, T, C, I>& lhs, Image<T, C, I>&& rhs) {
+	return ImageBinaryExpression<L, ImageTemporary<T, C, I>, ElementMultiply, T, C, I>(lhs.derived(), ImageTemporary<T, C, I>(std::move(rhs)));
+}
+template<class T, int C, ImageType I> ImageBinaryExpression<ImageTemporary<T, C, I>, ImageTemporary<T, C, I>, ElementMultiply, T, C, I> operator*(
+		Image<T, C, I>&& lhs, Image<T, C, I>&& rhs) {
+	return ImageBinaryExpression<ImageTemporary<T, C, I>, ImageTemporary<T, C, I>, ElementMultiply, T, C, I>(ImageTemporary<T, C, I>(std::move(lhs)),
+			ImageTemporary<T, C, I>(std::move(rhs)));
+}
+template<class R, class T, int C, ImageType I> ImageBinaryExpression<ImageTemporary<T, C, I>, R, ElementDivide, T, C, I> operator/(
+		Image<T, C, I>&& lhs, const ImageExpression<R, T, C, I>& rhs) {
+	return ImageBinaryExpression<ImageTemporary<T, C, I>, R, ElementDivide, T, C, I>(ImageTemporary<T, C, I>(std::move(lhs)), rhs.derived());
+}
+template<class L, class T, int C, ImageType I> ImageBinaryExpression<L, ImageTemporary<T, C, I>, ElementDivide, T, C, I> operator/(
+		const ImageExpression<L, T, C, I>& lhs, Image<T, C, I>&& rhs) {
+	return ImageBinaryExpression<L, ImageTemporary<T, C, I>, ElementDivide, T, C, I>(lhs.derived(), ImageTemporary<T, C, I>(std::move(rhs)));
+}
+template<class T, int C, ImageType I> ImageBinaryExpression<ImageTemporary<T, C, I>, ImageTemporary<T, C, I>, ElementDivide, T, C, I> operator/(
+		Image<T, C, I>&& lhs, Image<T, C, I>&& rhs) {
+	return ImageBinaryExpression<ImageTemporary<T, C, I>, ImageTemporary<T, C, I>, ElementDivide, T, C, I>(ImageTemporary<T, C, I>(std::move(lhs)),
+			ImageTemporary<T, C, I>(std::move(rhs)));
+}
+//Compound assignment evaluates the right hand side in place, element i only reads element i so aliasing is safe.
+template<class Op, class E, class T, int C, ImageType I> Image<T, C, I>& ApplyInPlace(
+		Image<T, C, I>& out, const ImageExpression<E, T, C, I>& expr) {
+	const E& e = expr.derived();
+	if (out.dimensions() != e.dimensions())
+		throw std::runtime_error(
+				MakeString() << "Image dimensions do not match. "
+						<< out.dimensions() << "!=" << e.dimensions());
+	size_t sz = out.size();
+#pragma omp parallel for
+	for (int offset = 0; offset < (int) sz; offset++) {
+		out.data[offset] = Op::apply(out.data[offset], vec<T, C>(e[offset]));
+	}
 	return out;
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator/=(
-		Image<T, C, I>& out, const Image<T, C, I>& img) {
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2) {val1/=val2;};
-	Transform(out, img, f);
+template<class Op, class T, int C, ImageType I> Image<T, C, I>& ApplyInPlace(
+		Image<T, C, I>& out, const vec<T, C>& scalar) {
+	size_t sz = out.size();
+#pragma omp parallel for
+	for (int offset = 0; offset < (int) sz; offset++) {
+		out.data[offset] = Op::apply(out.data[offset], scalar);
+	}
 	return out;
 }
+template<class E, class T, int C, ImageType I> Image<T, C, I>& operator+=(
+		Image<T, C, I>& out, const ImageExpression<E, T, C, I>& expr) {
+	return ApplyInPlace<ElementAdd>(out, expr);
+}
+template<class E, class T, int C, ImageType I> Image<T, C, I>& operator-=(
+		Image<T, C, I>& out, const ImageExpression<E, T, C, I>& expr) {
+	return ApplyInPlace<ElementSubtract>(out, expr);
+}
+template<class E, class T, int C, ImageType I> Image<T, C, I>& operator*=(
+		Image<T, C, I>& out, const ImageExpression<E, T, C, I>& expr) {
+	return ApplyInPlace<ElementMultiply>(out, expr);
+}
+template<class E, class T, int C, ImageType I> Image<T, C, I>& operator/=(
+		Image<T, C, I>& out, const ImageExpression<E, T, C, I>& expr) {
+	return ApplyInPlace<ElementDivide>(out, expr);
+}
 
-template<class T, int C, ImageType I> Image<T, C, I> operator+=(
+template<class T, int C, ImageType I> Image<T, C, I>& operator+=(
 		Image<T, C, I>& out, const vec<T, C>& scalar) {
-	std::function<void(vec<T, C>&)> f = [=](vec<T,C>& val1) {val1+=scalar;};
-	Transform(out, f);
-	return out;
+	return ApplyInPlace<ElementAdd>(out, scalar);
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator-=(
+template<class T, int C, ImageType I> Image<T, C, I>& operator-=(
 		Image<T, C, I>& out, const vec<T, C>& scalar) {
-	std::function<void(vec<T, C>&)> f = [=](vec<T,C>& val1) {val1-=scalar;};
-	Transform(out, f);
-	return out;
+	return ApplyInPlace<ElementSubtract>(out, scalar);
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator*=(
+template<class T, int C, ImageType I> Image<T, C, I>& operator*=(
 		Image<T, C, I>& out, const vec<T, C>& scalar) {
-	std::function<void(vec<T, C>&)> f = [=](vec<T,C>& val1) {val1*=scalar;};
-	Transform(out, f);
-	return out;
+	return ApplyInPlace<ElementMultiply>(out, scalar);
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator/=(
+template<class T, int C, ImageType I> Image<T, C, I>& operator/=(
 		Image<T, C, I>& out, const vec<T, C>& scalar) {
-	std::function<void(vec<T, C>&)> f = [=](vec<T,C>& val1) {val1/=scalar;};
-	Transform(out, f);
-	return out;
+	return ApplyInPlace<ElementDivide>(out, scalar);
 }
 
-template<class T, int C, ImageType I> Image<T, C, I> operator+(
-		const Image<T, C, I>& img1, const Image<T, C, I>& img2) {
-	Image<T, C, I> out(img1.width, img1.height);
-	std::function<void(vec<T, C>&, const vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2,const vec<T,C>& val3) {val1=val2+val3;};
-	Transform(out, img1, img2, f);
-	return out;
+template<class L, class R, class T, int C, ImageType I> ImageBinaryExpression<L, R, ElementAdd, T, C, I> operator+(
+		const ImageExpression<L, T, C, I>& lhs, const ImageExpression<R, T, C, I>& rhs) {
+	return ImageBinaryExpression<L, R, ElementAdd, T, C, I>(lhs.derived(), rhs.derived());
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator-(
-		const Image<T, C, I>& img1, const Image<T, C, I>& img2) {
-	Image<T, C, I> out(img1.width, img1.height);
-	std::function<void(vec<T, C>&, const vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2,const vec<T,C>& val3) {val1=val2-val3;};
-	Transform(out, img1, img2, f);
-	return out;
+template<class L, class R, class T, int C, ImageType I> ImageBinaryExpression<L, R, ElementSubtract, T, C, I> operator-(
+		const ImageExpression<L, T, C, I>& lhs, const ImageExpression<R, T, C, I>& rhs) {
+	return ImageBinaryExpression<L, R, ElementSubtract, T, C, I>(lhs.derived(), rhs.derived());
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator*(
-		const Image<T, C, I>& img1, const Image<T, C, I>& img2) {
-	Image<T, C, I> out(img1.width, img1.height);
-	std::function<void(vec<T, C>&, const vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2,const vec<T,C>& val3) {val1=val2*val3;};
-	Transform(out, img1, img2, f);
-	return out;
+template<class L, class R, class T, int C, ImageType I> ImageBinaryExpression<L, R, ElementMultiply, T, C, I> operator*(
+		const ImageExpression<L, T, C, I>& lhs, const ImageExpression<R, T, C, I>& rhs) {
+	return ImageBinaryExpression<L, R, ElementMultiply, T, C, I>(lhs.derived(), rhs.derived());
 }
-template<class T, int C, ImageType I> Image<T, C, I> operator/(
-		const Image<T, C, I>& img1, const Image<T, C, I>& img2) {
-	Image<T, C, I> out(img1.width, img1.height);
-	std::function<void(vec<T, C>&, const vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T,C>& val1,const vec<T,C>& val2,const vec<T,C>& val3) {val1=val2/val3;};
-	Transform(out, img1, img2, f);
-	return out;
+template<class L, class R, class T, int C, ImageType I> ImageBinaryExpression<L, R, ElementDivide, T, C, I> operator/(
+		const ImageExpression<L, T, C, I>& lhs, const ImageExpression<R, T, C, I>& rhs) {
+	return ImageBinaryExpression<L, R, ElementDivide, T, C, I>(lhs.derived(), rhs.derived());
 }
 template<class T, int C, ImageType I> void WriteImageToRawFile(
 		const std::string& file, const Image<T, C, I>& img) {
@@ -968,6 +1400,98 @@ typedef Image<int, 1, ImageType::INT> Image1i;
 typedef Image<uint32_t, 1, ImageType::UINT> Image1ui;
 typedef Image<float, 1, ImageType::FLOAT> Image1f;
 
+typedef ImageView<uint8_t, 4, ImageType::UBYTE> ImageViewRGBA;
+typedef ImageView<int, 4, ImageType::INT> ImageViewRGBAi;
+typedef ImageView<float, 4, ImageType::FLOAT> ImageViewRGBAf;
+
+typedef ImageView<uint8_t, 3, ImageType::UBYTE> ImageViewRGB;
+typedef ImageView<int, 3, ImageType::INT> ImageViewRGBi;
+typedef ImageView<float, 3, ImageType::FLOAT> ImageViewRGBf;
+
+typedef ImageView<uint8_t, 1, ImageType::UBYTE> ImageViewA;
+typedef ImageView<int, 1, ImageType::INT> ImageViewAi;
+typedef ImageView<float, 1, ImageType::FLOAT> ImageViewAf;
+
+typedef ImageView<int8_t, 4, ImageType::BYTE> ImageView4b;
+typedef ImageView<uint8_t, 4, ImageType::UBYTE> ImageView4ub;
+typedef ImageView<uint16_t, 4, ImageType::USHORT> ImageView4us;
+typedef ImageView<int16_t, 4, ImageType::SHORT> ImageView4s;
+typedef ImageView<int, 4, ImageType::INT> ImageView4i;
+typedef ImageView<uint32_t, 4, ImageType::UINT> ImageView4ui;
+typedef ImageView<float, 4, ImageType::FLOAT> ImageView4f;
+
+typedef ImageView<int8_t, 3, ImageType::BYTE> ImageView3b;
+typedef ImageView<uint8_t, 3, ImageType::UBYTE> ImageView3ub;
+typedef ImageView<uint16_t, 3, ImageType::USHORT> ImageView3us;
+typedef ImageView<int16_t, 3, ImageType::SHORT> ImageView3s;
+typedef ImageView<int, 3, ImageType::INT> ImageView3i;
+typedef ImageView<uint32_t, 3, ImageType::UINT> ImageView3ui;
+typedef ImageView<float, 3, ImageType::FLOAT> ImageView3f;
+
+typedef ImageView<int8_t, 2, ImageType::BYTE> ImageView2b;
+typedef ImageView<uint8_t, 2, ImageType::UBYTE> ImageView2ub;
+typedef ImageView<uint16_t, 2, ImageType::USHORT> ImageView2us;
+typedef ImageView<int16_t, 2, ImageType::SHORT> ImageView2s;
+typedef ImageView<int, 2, ImageType::INT> ImageView2i;
+typedef ImageView<uint32_t, 2, ImageType::UINT> ImageView2ui;
+typedef ImageView<float, 2, ImageType::FLOAT> ImageView2f;
+
+
+typedef ImageView<int8_t, 1, ImageType::BYTE> ImageView1b;
+typedef ImageView<uint8_t, 1, ImageType::UBYTE> ImageView1ub;
+typedef ImageView<uint16_t, 1, ImageType::USHORT> ImageView1us;
+typedef ImageView<int16_t, 1, ImageType::SHORT> ImageView1s;
+
+typedef ImageView<int, 1, ImageType::INT> ImageView1i;
+typedef ImageView<uint32_t, 1, ImageType::UINT> ImageView1ui;
+typedef ImageView<float, 1, ImageType::FLOAT> ImageView1f;
+
+typedef ConstImageView<uint8_t, 4, ImageType::UBYTE> ConstImageViewRGBA;
+typedef ConstImageView<int, 4, ImageType::INT> ConstImageViewRGBAi;
+typedef ConstImageView<float, 4, ImageType::FLOAT> ConstImageViewRGBAf;
+
+typedef ConstImageView<uint8_t, 3, ImageType::UBYTE> ConstImageViewRGB;
+typedef ConstImageView<int, 3, ImageType::INT> ConstImageViewRGBi;
+typedef ConstImageView<float, 3, ImageType::FLOAT> ConstImageViewRGBf;
+
+typedef ConstImageView<uint8_t, 1, ImageType::UBYTE> ConstImageViewA;
+typedef ConstImageView<int, 1, ImageType::INT> ConstImageViewAi;
+typedef ConstImageView<float, 1, ImageType::FLOAT> ConstImageViewAf;
+
+typedef ConstImageView<int8_t, 4, ImageType::BYTE> ConstImageView4b;
+typedef ConstImageView<uint8_t, 4, ImageType::UBYTE> ConstImageView4ub;
+typedef ConstImageView<uint16_t, 4, ImageType::USHORT> ConstImageView4us;
+typedef ConstImageView<int16_t, 4, ImageType::SHORT> ConstImageView4s;
+typedef ConstImageView<int, 4, ImageType::INT> ConstImageView4i;
+typedef ConstImageView<uint32_t, 4, ImageType::UINT> ConstImageView4ui;
+typedef ConstImageView<float, 4, ImageType::FLOAT> ConstImageView4f;
+
+typedef ConstImageView<int8_t, 3, ImageType::BYTE> ConstImageView3b;
+typedef ConstImageView<uint8_t, 3, ImageType::UBYTE> ConstImageView3ub;
+typedef ConstImageView<uint16_t, 3, ImageType::USHORT> ConstImageView3us;
+typedef ConstImageView<int16_t, 3, ImageType::SHORT> ConstImageView3s;
+typedef ConstImageView<int, 3, ImageType::INT> ConstImageView3i;
+typedef ConstImageView<uint32_t, 3, ImageType::UINT> ConstImageView3ui;
+typedef ConstImageView<float, 3, ImageType::FLOAT> ConstImageView3f;
+
+typedef ConstImageView<int8_t, 2, ImageType::BYTE> ConstImageView2b;
+typedef ConstImageView<uint8_t, 2, ImageType::UBYTE> ConstImageView2ub;
+typedef ConstImageView<uint16_t, 2, ImageType::USHORT> ConstImageView2us;
+typedef ConstImageView<int16_t, 2, ImageType::SHORT> ConstImageView2s;
+typedef ConstImageView<int, 2, ImageType::INT> ConstImageView2i;
+typedef ConstImageView<uint32_t, 2, ImageType::UINT> ConstImageView2ui;
+typedef ConstImageView<float, 2, ImageType::FLOAT> ConstImageView2f;
+
+
+typedef ConstImageView<int8_t, 1, ImageType::BYTE> ConstImageView1b;
+typedef ConstImageView<uint8_t, 1, ImageType::UBYTE> ConstImageView1ub;
+typedef ConstImageView<uint16_t, 1, ImageType::USHORT> ConstImageView1us;
+typedef ConstImageView<int16_t, 1, ImageType::SHORT> ConstImageView1s;
+
+typedef ConstImageView<int, 1, ImageType::INT> ConstImageView1i;
+typedef ConstImageView<uint32_t, 1, ImageType::UINT> ConstImageView1ui;
+typedef ConstImageView<float, 1, ImageType::FLOAT> ConstImageView1f;
+
 void WriteImageToFile(const std::string& file, const ImageRGBA& img);
 void WriteImageToFile(const std::string& file, const ImageRGB& img);
 void WriteImageToFile(const std::string& file, const ImageRGBAf& img);
@@ -983,106 +1507,146 @@ void ReadImageFromFile(const std::string& file, ImageRGB& img);
 void ReadImageFromFile(const std::string& file, ImageRGBAf& img);
 void ReadImageFromFile(const std::string& file, ImageRGBf& img);
 
-void ConvertImage(const ImageRGBAf& in, ImageRGBA& out);
-void ConvertImage(const ImageRGBf& in, ImageRGB& out);
-void ConvertImage(const ImageRGBA& in, ImageRGBAf& out);
-void ConvertImage(const ImageRGB& in, ImageRGBf& out);
-void ConvertImage(const ImageRGBA& in, ImageRGB& out);
-void ConvertImage(const ImageRGBAf& in, ImageRGBf& out);
-void ConvertImage(const ImageRGB& in, ImageRGBA& out);
-void ConvertImage(const ImageRGBf& in, ImageRGBAf& out);
-
-template<class T, ImageType I> void ConvertImage(const Image<T, 4, I>& in,
-		Image<T, 1, I>& out, bool sRGB = true) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	int N = (int) out.size();
+void ConvertImage(const ConstImageViewRGBAf& in, ImageRGBA& out);
+void ConvertImage(const ConstImageViewRGBf& in, ImageRGB& out);
+void ConvertImage(const ConstImageViewRGBA& in, ImageRGBAf& out);
+void ConvertImage(const ConstImageViewRGB& in, ImageRGBf& out);
+void ConvertImage(const ConstImageViewRGBA& in, ImageRGB& out);
+void ConvertImage(const ConstImageViewRGBAf& in, ImageRGBf& out);
+void ConvertImage(const ConstImageViewRGB& in, ImageRGBA& out);
+void ConvertImage(const ConstImageViewRGBf& in, ImageRGBAf& out);
+/*
+ Apply the sRGB transfer function (IEC 61966-2-1) through lookup tables. Color
+ channels are decoded to or encoded from linear light, alpha is kept linear.
+ */
+void ConvertSRGBToLinear(const ConstImageViewRGBA& in, ImageRGBAf& out);
+void ConvertLinearToSRGB(const ConstImageViewRGBAf& in, ImageRGBA& out);
 
+template<class T, ImageType I> void ConvertImage(
+		const ConstImageView<T, 4, I>& in, Image<T, 1, I>& out, bool sRGB =
+				true) {
 	if (sRGB) {
-#pragma omp parallel for
-		for (int i = 0; i < N; i++) {
-			vec<T, 4> c = in[i];
-			out[i] = vec<T, 1>(T(0.21 * c.x + 0.72 * c.y + 0.07 * c.z));
-		}
+		ConvertPixels(in, out, [](const vec<T, 4>& c) {
+			return vec<T, 1>(T(0.21 * c.x + 0.72 * c.y + 0.07 * c.z));
+		});
 	} else {
-#pragma omp parallel for
-		for (int i = 0; i < N; i++) {
-			vec<T, 4> c = in[i];
-			out[i] = vec<T, 1>(T(0.30 * c.x + 0.59 * c.y + 0.11 * c.z));
-		}
+		ConvertPixels(in, out, [](const vec<T, 4>& c) {
+			return vec<T, 1>(T(0.30 * c.x + 0.59 * c.y + 0.11 * c.z));
+		});
 	}
 }
-template<class T, ImageType I> void ConvertImage(const Image<T, 4, I>& in,
-		Image<T, 2, I>& out, bool sRGB = true) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	int N = out.size();
-
+template<class T, ImageType I> void ConvertImage(
+		const ConstImageView<T, 4, I>& in, Image<T, 2, I>& out, bool sRGB =
+				true) {
 	if (sRGB) {
-#pragma omp parallel for
-		for (int i = 0; i < N; i++) {
-			vec<T, 4> c = in[i];
-			out[i] = vec<T, 2>(T(0.21 * c.x + 0.72 * c.y + 0.07 * c.z), c.w);
-		}
+		ConvertPixels(in, out, [](const vec<T, 4>& c) {
+			return vec<T, 2>(T(0.21 * c.x + 0.72 * c.y + 0.07 * c.z), c.w);
+		});
 	} else {
-#pragma omp parallel for
-		for (int i = 0; i < N; i++) {
-			vec<T, 4> c = in[i];
-			out[i] = vec<T, 2>(T(0.30 * c.x + 0.59 * c.y + 0.11 * c.z), c.w);
-		}
+		ConvertPixels(in, out, [](const vec<T, 4>& c) {
+			return vec<T, 2>(T(0.30 * c.x + 0.59 * c.y + 0.11 * c.z), c.w);
+		});
 	}
 }
-template<class T, ImageType I> void ConvertImage(const Image<T, 3, I>& in,
-		Image<T, 1, I>& out, bool sRGB = true) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	int N = (int) out.size();
-
+template<class T, ImageType I> void ConvertImage(
+		const ConstImageView<T, 3, I>& in, Image<T, 1, I>& out, bool sRGB =
+				true) {
 	if (sRGB) {
-#pragma omp parallel for
-		for (int i = 0; i < N; i++) {
-			vec<T, 3> c = in[i];
-			out[i] = vec<T, 1>(T(0.21 * c.x + 0.72 * c.y + 0.07 * c.z));
-		}
+		ConvertPixels(in, out, [](const vec<T, 3>& c) {
+			return vec<T, 1>(T(0.21 * c.x + 0.72 * c.y + 0.07 * c.z));
+		});
 	} else {
-#pragma omp parallel for
-		for (int i = 0; i < N; i++) {
-			vec<T, 3> c = in[i];
-			out[i] = vec<T, 1>(T(0.30 * c.x + 0.59 * c.y + 0.11 * c.z));
-		}
+		ConvertPixels(in, out, [](const vec<T, 3>& c) {
+			return vec<T, 1>(T(0.30 * c.x + 0.59 * c.y + 0.11 * c.z));
+		});
 	}
 }
+template<class T, ImageType I> void ConvertImage(const Image<T, 4, I>& in,
+		Image<T, 1, I>& out, bool sRGB = true) {
+	ConvertImage(in.view(), out, sRGB);
+}
+template<class T, ImageType I> void ConvertImage(const Image<T, 4, I>& in,
+		Image<T, 2, I>& out, bool sRGB = true) {
+	ConvertImage(in.view(), out, sRGB);
+}
+template<class T, ImageType I> void ConvertImage(const Image<T, 3, I>& in,
+		Image<T, 1, I>& out, bool sRGB = true) {
+	ConvertImage(in.view(), out, sRGB);
+}
+template<class T, ImageType I> void ConvertImage(const ImageView<T, 4, I>& in,
+		Image<T, 1, I>& out, bool sRGB = true) {
+	ConvertImage(ConstImageView<T, 4, I>(in), out, sRGB);
+}
+template<class T, ImageType I> void ConvertImage(const ImageView<T, 4, I>& in,
+		Image<T, 2, I>& out, bool sRGB = true) {
+	ConvertImage(ConstImageView<T, 4, I>(in), out, sRGB);
+}
+template<class T, ImageType I> void ConvertImage(const ImageView<T, 3, I>& in,
+		Image<T, 1, I>& out, bool sRGB = true) {
+	ConvertImage(ConstImageView<T, 3, I>(in), out, sRGB);
+}
+/*
+ Copies the pixels of in into out with in's top-left corner at pos. Pixels that fall outside out are skipped.
+ */
+template<class T, int C, ImageType I> void Set(const ConstImageView<T, C, I>& in,
+		const ImageView<T, C, I>& out, int2 pos) {
+	int i0 = std::max(0, -pos.x);
+	int j0 = std::max(0, -pos.y);
+	int i1 = std::min(in.width, out.width - pos.x);
+	int j1 = std::min(in.height, out.height - pos.y);
+	if (i1 <= i0)
+		return;
+	for (int j = j0; j < j1; j++) {
+		const vec<T, C>* src = in.row(j);
+		std::copy(src + i0, src + i1, out.row(pos.y + j) + pos.x + i0);
+	}
+}
+template<class T, int C, ImageType I> void Set(const ImageView<T, C, I>& in,
+		const ImageView<T, C, I>& out, int2 pos) {
+	Set(ConstImageView<T, C, I>(in), out, pos);
+}
+template<class T, int C, ImageType I> void Set(const Image<T, C, I>& in,
+		Image<T, C, I>& out, int2 pos) {
+	Set(in.view(), out.view(), pos);
+}
 template<class T, int C, ImageType I> void Crop(const Image<T, C, I>& in,
 		Image<T, C, I>& out, int2 pos, int2 dims) {
 	out.setPosition(pos);
 	out.resize(dims.x, dims.y);
-	for (int i = 0; i < dims.x; i++) {
+	if (pos.x >= 0 && pos.y >= 0 && pos.x + dims.x <= in.width
+			&& pos.y + dims.y <= in.height) {
+		Set(in.view(pos, dims), out.view(), int2(0, 0));
+	} else {
 		for (int j = 0; j < dims.y; j++) {
-			out(i, j) = in(pos.x + i, pos.y + j);
+			for (int i = 0; i < dims.x; i++) {
+				out(i, j) = in(pos.x + i, pos.y + j);
+			}
 		}
 	}
 }
-template<class T, int C, ImageType I> void FlipVertical(Image<T, C, I>& in) {
+template<class T, int C, ImageType I> void FlipVertical(
+		const ImageView<T, C, I>& in) {
 #pragma omp parallel for
-	for (int i = 0; i < in.width; i++) {
-		for (int j = 0; j < in.height / 2; j++) {
-			std::swap(in(i, j), in(i, in.height - 1 - j));
-		}
+	for (int j = 0; j < in.height / 2; j++) {
+		std::swap_ranges(in.row(j), in.row(j) + in.width,
+				in.row(in.height - 1 - j));
 	}
 }
-template<class T, int C, ImageType I> void FlipHorizontal(Image<T, C, I>& in) {
+template<class T, int C, ImageType I> void FlipVertical(Image<T, C, I>& in) {
+	FlipVertical(in.view());
+}
+template<class T, int C, ImageType I> void FlipHorizontal(
+		const ImageView<T, C, I>& in) {
 #pragma omp parallel for
 	for (int j = 0; j < in.height; j++) {
-		for (int i = 0; i < in.width / 2; i++) {
-			std::swap(in(i, j), in(in.width - 1 - i, j));
-		}
+		std::reverse(in.row(j), in.row(j) + in.width);
 	}
 }
-template<class T, int C, ImageType I> void DownSample(const Image<T, C, I>& in,
-		Image<T, C, I>& out) {
+template<class T, int C, ImageType I> void FlipHorizontal(Image<T, C, I>& in) {
+	FlipHorizontal(in.view());
+}
+template<class T, int C, ImageType I> void DownSample(
+		const ConstImageView<T, C, I>& in, Image<T, C, I>& out) {
 	static const double Kernel[5][5] = { { 1, 4, 6, 4, 1 },
 			{ 4, 16, 24, 16, 4 }, { 6, 24, 36, 24, 6 }, { 4, 16, 24, 16, 4 }, {
 					1, 4, 6, 4, 1 } };
@@ -1102,8 +1666,16 @@ template<class T, int C, ImageType I> void DownSample(const Image<T, C, I>& in,
 		}
 	}
 }
-template<class T, int C, ImageType I> void UpSample(const Image<T, C, I>& in,
+template<class T, int C, ImageType I> void DownSample(const Image<T, C, I>& in,
 		Image<T, C, I>& out) {
+	DownSample(in.view(), out);
+}
+template<class T, int C, ImageType I> void DownSample(
+		const ImageView<T, C, I>& in, Image<T, C, I>& out) {
+	DownSample(ConstImageView<T, C, I>(in), out);
+}
+template<class T, int C, ImageType I> void UpSample(
+		const ConstImageView<T, C, I>& in, Image<T, C, I>& out) {
 	static const double Kernel[5][5] = { { 1, 4, 6, 4, 1 },
 			{ 4, 16, 24, 16, 4 }, { 6, 24, 36, 24, 6 }, { 4, 16, 24, 16, 4 }, {
 					1, 4, 6, 4, 1 } };
@@ -1127,16 +1699,13 @@ template<class T, int C, ImageType I> void UpSample(const Image<T, C, I>& in,
 		}
 	}
 }
-template<class T, int C, ImageType I> void Set(const Image<T, C, I>& in,
-		Image<T, C, I>& out, int2 pos) {
-	for (int i = 0; i < in.width; i++) {
-		for (int j = 0; j < in.height; j++) {
-			if (pos.x + i >= 0 && pos.x + i < out.width && pos.y + j >= 0
-					&& pos.y + j < out.height) {
-				out(pos.x + i, pos.y + j) = in(i, j);
-			}
-		}
-	}
+template<class T, int C, ImageType I> void UpSample(const Image<T, C, I>& in,
+		Image<T, C, I>& out) {
+	UpSample(in.view(), out);
+}
+template<class T, int C, ImageType I> void UpSample(
+		const ImageView<T, C, I>& in, Image<T, C, I>& out) {
+	UpSample(ConstImageView<T, C, I>(in), out);
 }
 template<class T, int C, ImageType I> void Tile(
 		const std::vector<Image<T, C, I>>& in, Image<T, C, I>& out, int rows,
@@ -1224,20 +1793,24 @@ template<class T, int C, ImageType I> void Tile(
 		}
 	}
 }
-void ConvertImage(const ImageRGBAf& in, Image1ub& out, bool sRGB = true);
-void ConvertImage(const ImageRGBf& in, Image1ub& out, bool sRGB = true);
-void ConvertImage(const ImageRGB& in, Image1f& out, bool sRGB = true);
-void ConvertImage(const ImageRGBA& in, Image1f& out, bool sRGB = true);
+void ConvertImage(const ConstImageViewRGBAf& in, Image1ub& out, bool sRGB = true);
+void ConvertImage(const ConstImageViewRGBf& in, Image1ub& out, bool sRGB = true);
+void ConvertImage(const ConstImageViewRGB& in, Image1f& out, bool sRGB = true);
+void ConvertImage(const ConstImageViewRGBA& in, Image1f& out, bool sRGB = true);
 
-void ConvertImage(const Image1f& in, ImageRGBAf& out);
-void ConvertImage(const Image2f& in, ImageRGBAf& out);
-void ConvertImage(const Image1f& in, ImageRGBf& out);
-void ConvertImage(const Image1b& in, ImageRGBAf& out);
-void ConvertImage(const Image1b& in, ImageRGBf& out);
-void ConvertImage(const Image1b& in, ImageRGBA& out);
-void ConvertImage(const Image1b& in, ImageRGB& out);
-void ConvertImage(const Image1f& in, ImageRGBA& out);
-void ConvertImage(const Image1f& in, ImageRGB& out);
+void ConvertImage(const ConstImageView1f& in, ImageRGBAf& out);
+void ConvertImage(const ConstImageView2f& in, ImageRGBAf& out);
+void ConvertImage(const ConstImageView1f& in, ImageRGBf& out);
+void ConvertImage(const ConstImageView1b& in, ImageRGBAf& out);
+void ConvertImage(const ConstImageView1b& in, ImageRGBf& out);
+void ConvertImage(const ConstImageView1b& in, ImageRGBA& out);
+void ConvertImage(const ConstImageView1b& in, ImageRGB& out);
+void ConvertImage(const ConstImageView1ub& in, ImageRGBAf& out);
+void ConvertImage(const ConstImageView1ub& in, ImageRGBf& out);
+void ConvertImage(const ConstImageView1ub& in, ImageRGBA& out);
+void ConvertImage(const ConstImageView1ub& in, ImageRGB& out);
+void ConvertImage(const ConstImageView1f& in, ImageRGBA& out);
+void ConvertImage(const ConstImageView1f& in, ImageRGB& out);
 }
 ;
 
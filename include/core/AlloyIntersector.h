@@ -22,41 +22,35 @@
 #ifndef ALLOYMESHKDTREE_H_
 #define ALLOYMESHKDTREE_H_
 #include "AlloyMath.h"
+#include "AlloyVector.h"
 
-//Mesh intersection implemented with a KD-tree of triangles.
-//The term "Intersector" is used to disambiguate this KD-tree from the one used for points.
+//Mesh intersection implemented with a bounding volume hierarchy (BVH) of triangles.
+//The term "Intersector" is used to disambiguate this tree from the KD-tree used for points.
 
 namespace aly {
 	bool SANITY_CHECK_KDTREE();
+	bool SANITY_CHECK_RAY_INTERSECT();
+	bool SANITY_CHECK_OCCLUSION();
 	class Mesh;
 	static const float3 NO_HIT_POINT = float3(
 		std::numeric_limits<float>::infinity());
 	static const float NO_HIT_DISTANCE=std::numeric_limits<float>::infinity();
-	class KDBox {
-	protected:
-		int depth;
-		float3 minPoint, maxPoint;
-		std::vector<KDBox*> children;
+	/*
+	 * Node of a flattened BVH. Nodes are stored depth-first, so the left child of an interior node
+	 * immediately follows it and "offset" is the index of the right child. For leaves, "offset" is the first
+	 * triangle and "count" the number of triangles.
+	 */
+	struct BVHNode {
+		float3 minPoint;
+		uint32_t offset;
+		float3 maxPoint;
+		uint32_t count;
 		static const int LEFT = 0, RIGHT = 1, MIDDLE = 2;
-	public:
-		const bool isLeaf;
-		KDBox(int depth = 0) :
-			depth(depth), isLeaf(false) {
-			minPoint = float3(0, 0, 0);
-			maxPoint = float3(0, 0, 0);
-			children = std::vector<KDBox*>();
-		}
-		KDBox(int depth, bool isLeaf) :
-			depth(depth), isLeaf(isLeaf) {
-			minPoint = float3(0, 0, 0);
-			maxPoint = float3(0, 0, 0);
-			children = std::vector<KDBox*>();
+		BVHNode() :
+			minPoint(0.0f), offset(0), maxPoint(0.0f), count(0) {
 		}
-		int getDepth() const {
-			return depth;
-		}
-		void setDepth(int d) {
-			depth = d;
+		bool isLeaf() const {
+			return (count > 0);
 		}
 		float3 getMin() const {
 			return minPoint;
@@ -64,58 +58,39 @@ namespace aly {
 		float3 getMax() const {
 			return maxPoint;
 		}
-		std::vector<KDBox*>& getChildren() {
-			return children;
-		}
-		const std::vector<KDBox*>& getChildren() const {
-			return children;
-		}
 		double volume() const {
 			return (maxPoint.z - minPoint.z) * (maxPoint.y - minPoint.y)
 				* (maxPoint.x - minPoint.x);
 		}
-		template<class C, class R> friend std::basic_ostream<C, R> & operator <<(std::basic_ostream<C, R> & ss, const KDBox& a);
-		bool intersects(const KDBox& test) const;
+		//Slab test against the ray org+t*dir for t in [0,tmax], where invDir is the reciprocal of dir.
+		//On a hit, tnear is where the ray enters the box (0 if it starts inside).
+		bool intersectRay(const float3& org, const float3& invDir, float tmax, float& tnear) const {
+			float t0 = 0.0f, t1 = tmax;
+			for (int i = 0; i < 3; i++) {
+				float tn = (minPoint[i] - org[i]) * invDir[i];
+				float tf = (maxPoint[i] - org[i]) * invDir[i];
+				if (tn > tf) {
+					std::swap(tn, tf);
+				}
+				//Widen the far side so flat boxes are not lost to round-off.
+				tf *= 1.0000004f;
+				t0 = std::max(t0, tn);
+				t1 = std::min(t1, tf);
+				if (t0 > t1) {
+					return false;
+				}
+			}
+			tnear = t0;
+			return true;
+		}
 		bool inside(const float3& test) const;
-		virtual void update();
 		double distanceToBox(const float3& p) const;
 		bool intersectRayBox(const float3& org, const float3& dr) const;
 		bool intersectSegmentBox(const float3& org, const float3& end) const;
-		virtual ~KDBox() {
-		}
 	};
 	template<class C, class R> std::basic_ostream<C, R> & operator <<(
-		std::basic_ostream<C, R> & ss, const KDBox& a) {
-		return ss << "[" << a.minPoint << "," << a.maxPoint << ","<<a.children.size()<<"]";
-	}
-	class KDBoxEdge {
-	protected:
-		double value;
-		bool start;
-		KDBox* box;
-	public:
-		template<class C, class R> friend std::basic_ostream<C, R> & operator <<(std::basic_ostream<C, R> & ss, const KDBoxEdge& a);
-		KDBox* getBox() {
-			return box;
-		}
-		double getValue() const {
-			return value;
-		}
-		bool isMin() const {
-			return start;
-		}
-		void set(KDBox* b, int dim, bool start);
-		KDBoxEdge() :
-			value(1E30), start(true), box(nullptr) {
-		}
-		KDBoxEdge(KDBox* b, int dim, bool start) {
-			set(b, dim, start);
-		}
-		~KDBoxEdge() {}
-	};
-	template<class C, class R> std::basic_ostream<C, R> & operator <<(
-		std::basic_ostream<C, R> & ss, const KDBoxEdge& a) {
-		return ss << "<" << *a.box << ": " << ((a.start) ? "start" : "") << ": " << a.value << ">";
+		std::basic_ostream<C, R> & ss, const BVHNode& a) {
+		return ss << "[" << a.minPoint << "," << a.maxPoint << "," << a.offset << "," << a.count << "]";
 	}
 	class KDSegment {
 	public:
@@ -132,22 +107,30 @@ namespace aly {
 		float3 intersectionPointRay(const float3& center,
 			const float3& kNormal) const;
 	};
-	class KDTriangle : public KDBox {
+	class KDTriangle {
 	protected:
 		float3 pts[3];
 	public:
-		const uint64_t id;
+		uint64_t id;
+		KDTriangle() :
+			id(0) {
+			pts[0] = pts[1] = pts[2] = float3(0.0f);
+		}
 		KDTriangle(const float3& pt1, const float3& pt2, const float3& pt3,
-			uint64_t id = 0, int depth = 0) :
-			KDBox(depth, true), id(id) {
+			uint64_t id = 0) :
+			id(id) {
 			pts[0] = pt1;
 			pts[1] = pt2;
 			pts[2] = pt3;
-			update();
 		}
-		virtual void update() override {
-			minPoint = aly::min(aly::min(pts[0], pts[1]), pts[2]);
-			maxPoint = aly::max(aly::max(pts[0], pts[1]), pts[2]);
+		const float3& operator[](size_t i) const {
+			return pts[i];
+		}
+		float3 getMin() const {
+			return aly::min(aly::min(pts[0], pts[1]), pts[2]);
+		}
+		float3 getMax() const {
+			return aly::max(aly::max(pts[0], pts[1]), pts[2]);
 		}
 		float3 getNormal() const {
 			return normalize(cross(pts[1] - pts[0], pts[2] - pts[0]));
@@ -169,149 +152,212 @@ namespace aly {
 		float3 intersectionPointRay(const float3& org, const float3& v) const;
 		double distance(const float3& p, float3& lastIntersect) const;
 	};
-
-	struct KDBoxDistance {
-		KDBox* box;
+	struct BVHNodeDistance {
+		uint32_t node;
 		double dist;
-		KDBoxDistance(const float3& ref, KDBox* tri) :
-			box(tri) {
-			dist = tri->distanceToBox(ref);
+		BVHNodeDistance(uint32_t node, double dist) :
+			node(node), dist(dist) {
 		}
-
 	};
-	template<class C, class R> std::basic_ostream<C, R> & operator <<(
-		std::basic_ostream<C, R> & ss, const KDBoxDistance& a) {
-		return ss << a.box << ": " << a.dist;
-	}
-	inline bool operator<(const KDBoxDistance& a, const KDBoxDistance& b) {
+	inline bool operator<(const BVHNodeDistance& a, const BVHNodeDistance& b) {
 		//Priority queue puts largest first, so we need to use a >= operator to get ascending order.
 		return (a.dist > b.dist);
 	}
-
+	/*
+	 * Triangles are kept as a shared vertex array plus one index triple per triangle, sorted so that every
+	 * leaf references a contiguous range. Quads are split along their shorter diagonal and both halves keep
+	 * the quad's face id.
+	 */
 	class Intersector {
 	protected:
-		std::shared_ptr<KDBox> root;
-		std::vector<std::shared_ptr<KDBox>> storage;
+		std::vector<BVHNode> nodes;
+		std::vector<float3> vertexes;
+		std::vector<uint3> triangles;
+		std::vector<uint32_t> faceIds;
+		//Normalized SAH cost of each node when it was built, used to decide when refitted subtrees need rebuilding.
+		std::vector<float> costs;
+		int maxLeafSize = 4;
 		const double intersectCost = 80;
 		const double traversalCost = 1;
-		const double emptyBonus = 0.2;
-		int splitPosition(std::vector<KDBox*>& children,
-			std::vector<KDBoxEdge>& edges, KDBox* box);
-		void buildTree(int maxDepth);
+		static const int BIN_COUNT = 16;
+		//Traversal stack and queue, kept per thread so batched queries do not allocate per query.
+		struct Traversal {
+			std::vector<std::pair<uint32_t, float>> stack;
+			std::vector<BVHNodeDistance> queue;
+		};
+		void buildTree();
+		void buildNodes(uint32_t first, uint32_t last, std::vector<BVHNode>& out);
+		void updateCosts(uint32_t first, uint32_t last, std::vector<float>& out) const;
+		void refitBounds();
+		void rebuildSubtrees(const std::vector<uint32_t>& roots);
+		template<class F> int64_t traverseRay(const float3& org, const float3& dir, float tmax,
+			bool anyHit, const F& intersect, Traversal& traversal, float3& lastPoint, double& mind) const;
+		int64_t closestTriangle(const float3& pt, double maxDistance, Traversal& traversal,
+			float3& lastPoint, double& triangleDist) const;
+		double signedDistance(const float3& pt, double d, uint32_t t) const {
+			KDTriangle tri = getTriangle(t);
+			return sign(dot(pt - tri.getCentroid(), tri.getNormal())) * d;
+		}
+		KDTriangle getTriangle(uint32_t t) const {
+			const uint3& tri = triangles[t];
+			return KDTriangle(vertexes[tri.x], vertexes[tri.y], vertexes[tri.z], faceIds[t]);
+		}
 	public:
 		void reset() {
-			root.reset();
-			storage.clear();
-			storage.shrink_to_fit();
-		}
-		KDBox* getRoot() const {
-			return root.get();
-		}
-
-		void build(const Mesh& mesh, int maxDepth = 16);
-		Intersector(const Mesh& mesh, int maxDepth = 16) {
-			build(mesh, maxDepth);
+			nodes.clear();
+			nodes.shrink_to_fit();
+			vertexes.clear();
+			vertexes.shrink_to_fit();
+			triangles.clear();
+			triangles.shrink_to_fit();
+			faceIds.clear();
+			faceIds.shrink_to_fit();
+			costs.clear();
+			costs.shrink_to_fit();
+		}
+		const std::vector<BVHNode>& getNodes() const {
+			return nodes;
+		}
+		size_t getTriangleCount() const {
+			return triangles.size();
+		}
+		//Leaves with at most maxLeafSize triangles are not split further. Larger leaves are only split where the SAH cost improves.
+		void build(const Mesh& mesh, int maxLeafSize = 4);
+		/*
+		 * Updates node bounds for new vertex positions of the mesh the tree was built from, keeping the tree topology.
+		 * If rebuildRatio > 0, subtrees whose SAH cost has grown by more than that factor since they were built are
+		 * rebuilt from scratch. Returns the number of subtrees rebuilt.
+		 */
+		int refit(const Mesh& mesh, float rebuildRatio = 0.0f);
+		Intersector(const Mesh& mesh, int maxLeafSize = 4) {
+			build(mesh, maxLeafSize);
 		}
 		Intersector() {
 		}
 		double intersectRayDistance(const float3& p1, const float3& v,
-			float3& lastPoint, KDTriangle*& lastTriangle) const;
+			float3& lastPoint, KDTriangle& lastTriangle) const;
 		double intersectSegmentDistance(const float3& p1, const float3& p2,
-			float3& lastPoint, KDTriangle*& lastTriangle) const;
+			float3& lastPoint, KDTriangle& lastTriangle) const;
 		double closestPointSignedDistance(const float3& r, float3& lastPoint,
-			KDTriangle*& lastTriangle) const;
+			KDTriangle& lastTriangle) const;
 		double closestPoint(const float3& pt, float3& lastPoint,
-			KDTriangle*& lastTriangle) const;
+			KDTriangle& lastTriangle) const;
 		double closestPoint(const float3& pt,const float& maxDistance, float3& lastPoint,
-			KDTriangle*& lastTriangle) const;
-		double closestPointSignedDistance(const float3& r, const float& maxDistance, float3& lastPoint, KDTriangle*& lastTriangle) const;
+			KDTriangle& lastTriangle) const;
+		double closestPointSignedDistance(const float3& r, const float& maxDistance, float3& lastPoint, KDTriangle& lastTriangle) const;
 		double closestPointOutside(const float3& r, const float3& v,
-			float3& lastPoint, KDTriangle*& lastTriangle) const;
+			float3& lastPoint, KDTriangle& lastTriangle) const;
+		//Any-hit queries for visibility and shadow rays. They stop at the first triangle found instead of the closest one.
+		bool intersectsRay(const float3& p1, const float3& v) const;
+		bool intersectsSegment(const float3& p1, const float3& p2) const;
+
+		/*
+		 * Batched queries, evaluated in parallel. Missed queries get NO_HIT_DISTANCE, NO_HIT_POINT and a face id of -1.
+		 * Face ids refer to the mesh the Intersector was built from, with quads numbered before triangles.
+		 */
+		void intersectRayDistance(const Vector3f& origins, const Vector3f& directions,
+			Vector1f& distances, Vector3f& lastPoints, Vector1i& hitIds) const;
+		void intersectRayDistance(const Vector3f& origins, const Vector3f& directions,
+			Vector1f& distances) const;
+		void intersectSegmentDistance(const Vector3f& starts, const Vector3f& ends,
+			Vector1f& distances, Vector3f& lastPoints, Vector1i& hitIds) const;
+		void intersectSegmentDistance(const Vector3f& starts, const Vector3f& ends,
+			Vector1f& distances) const;
+		void intersectsRay(const Vector3f& origins, const Vector3f& directions, Vector1b& hits) const;
+		void intersectsSegment(const Vector3f& starts, const Vector3f& ends, Vector1b& hits) const;
+		void closestPoint(const Vector3f& points, Vector1f& distances, Vector3f& lastPoints,
+			Vector1i& hitIds, float maxDistance = NO_HIT_DISTANCE) const;
+		void closestPoint(const Vector3f& points, Vector1f& distances,
+			float maxDistance = NO_HIT_DISTANCE) const;
+		void closestPointSignedDistance(const Vector3f& points, Vector1f& distances,
+			Vector3f& lastPoints, Vector1i& hitIds, float maxDistance = NO_HIT_DISTANCE) const;
+		void closestPointSignedDistance(const Vector3f& points, Vector1f& distances,
+			float maxDistance = NO_HIT_DISTANCE) const;
 
 		double intersectRayDistance(const float3& p1, const float3& v,
 			float3& lastPoint) const {
-			KDTriangle* lastTriangle;
+			KDTriangle lastTriangle;
 			return intersectRayDistance(p1, v, lastPoint, lastTriangle);
 		}
 		double intersectSegmentDistance(const float3& p1, const float3& p2,
 			float3& lastPoint) const {
-			KDTriangle* lastTriangle;
+			KDTriangle lastTriangle;
 			return intersectSegmentDistance(p1, p2, lastPoint, lastTriangle);
 		}
 		double closestPointSignedDistance(const float3& r,
 			float3& lastPoint) const {
-			KDTriangle* lastTriangle;
+			KDTriangle lastTriangle;
 			return closestPointSignedDistance(r, lastPoint, lastTriangle);
 		}
 		double closestPoint(const float3& pt,const float& maxDistance, float3& lastPoint) const{
-			KDTriangle* lastTriangle;
+			KDTriangle lastTriangle;
 			return closestPoint(pt,maxDistance,lastPoint,lastTriangle);
 		}
 		double closestPoint(const float3& pt, float3& lastPoint) const {
-			KDTriangle* lastTriangle;
+			KDTriangle lastTriangle;
 			return closestPoint(pt, lastPoint, lastTriangle);
 		}
 		double closestPointOutside(const float3& r, const float3& v,
 			float3& lastPoint) const {
-			KDTriangle* lastTriangle;
+			KDTriangle lastTriangle;
 			return closestPointOutside(r, v, lastPoint, lastTriangle);
 		}
 		double intersectRayDistance(const float3& p1, const float3& v) const {
 			float3 lastPoint;
-			KDTriangle* lastTriangle;
+			KDTriangle lastTriangle;
 			return intersectRayDistance(p1, v, lastPoint, lastTriangle);
 		}
 		double intersectSegmentDistance(const float3& p1, const float3& p2) const {
 			float3 lastPoint;
-			KDTriangle* lastTriangle;
+			KDTriangle lastTriangle;
 			return intersectSegmentDistance(p1, p2, lastPoint, lastTriangle);
 		}
 		double closestPointSignedDistance(const float3& r) const {
 			float3 lastPoint;
-			KDTriangle* lastTriangle;
+			KDTriangle lastTriangle;
 			return closestPointSignedDistance(r, lastPoint, lastTriangle);
 		}
 		double closestPointSignedDistance(const float3& r, const float& maxDistance) const {
 			float3 lastPoint;
-			KDTriangle* lastTriangle;
+			KDTriangle lastTriangle;
 			return closestPointSignedDistance(r, maxDistance, lastPoint, lastTriangle);
 		}
 		double closestPoint(const float3& pt,const float& maxDistance) const{
 			float3 lastPoint;
-			KDTriangle* lastTriangle;
+			KDTriangle lastTriangle;
 			return closestPoint(pt,maxDistance,lastPoint,lastTriangle);
 		}
 		double closestPoint(const float3& pt) const {
 			float3 lastPoint;
-			KDTriangle* lastTriangle;
+			KDTriangle lastTriangle;
 			return closestPoint(pt, lastPoint, lastTriangle);
 		}
 		double closestPointOutside(const float3& r, const float3& v) const {
 			float3 lastPoint;
-			KDTriangle* lastTriangle;
+			KDTriangle lastTriangle;
 			return closestPointOutside(r, v, lastPoint, lastTriangle);
 		}
 
 		double intersectRayDistance(const float3& p1, const float3& v,
-			KDTriangle*& lastTriangle) const {
+			KDTriangle& lastTriangle) const {
 			float3 lastPoint;
 			return intersectRayDistance(p1, v, lastPoint, lastTriangle);
 		}
 		double intersectSegmentDistance(const float3& p1, const float3& p2,
-			KDTriangle*& lastTriangle) const {
+			KDTriangle& lastTriangle) const {
 			float3 lastPoint;
 			return intersectSegmentDistance(p1, p2, lastPoint, lastTriangle);
 		}
-		double closestPointSignedDistance(const float3& r, KDTriangle*& lastTriangle) const {
+		double closestPointSignedDistance(const float3& r, KDTriangle& lastTriangle) const {
 			float3 lastPoint;
 			return closestPointSignedDistance(r, lastPoint, lastTriangle);
 		}
-		double closestPoint(const float3& pt, KDTriangle*& lastTriangle) const {
+		double closestPoint(const float3& pt, KDTriangle& lastTriangle) const {
 			float3 lastPoint;
 			return closestPoint(pt, lastPoint, lastTriangle);
 		}
 		double closestPointOutside(const float3& r, const float3& v,
-			KDTriangle*& lastTriangle) const {
+			KDTriangle& lastTriangle) const {
 			float3 lastPoint;
 			return closestPointOutside(r, v, lastPoint, lastTriangle);
 		}
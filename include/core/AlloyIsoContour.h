@@ -22,11 +22,13 @@
 #ifndef ALLOYISOCONTOUR_H_
 #define ALLOYISOCONTOUR_H_
 #include "AlloyImage.h"
+#include "AlloyVolume.h"
 #include "AlloyVector.h"
 #include <memory>
 #include <list>
 #include <map>
 namespace aly {
+	bool SANITY_CHECK_ISO_SURFACE();
 	enum class TopologyRule2D {Unconstrained, Connect4, Connect8 };
 	enum class Winding { Clockwise, CounterClockwise };
 	typedef uint2 Edge;
@@ -66,7 +68,25 @@ namespace aly {
 
 	class IsoContour {
 	protected:
-		uint32_t vertCount = 0;
+		/*
+		 * Squares in rows [start,end) of the image. Splits are keyed by (x + y * (width + 1)) * 3 + type, where type 0 is a grid point,
+		 * 1 the edge to (x+1,y) and 2 the edge to (x,y+1). Splits on row end belong to the next band and are referenced through seamSplits.
+		 */
+		struct Band {
+			int start = 0;
+			int end = 0;
+			uint32_t splitOffset = 0;
+			uint32_t edgeOffset = 0;
+			std::vector<size_t> splits;
+			std::vector<size_t> seamSplits;
+			std::vector<uint32_t> seamIds;
+			std::vector<uint2> edges;
+		};
+		static const uint32_t SEAM_FLAG;
+		static const uint32_t NO_SPLIT;
+		std::vector<Band> bands;
+		//Band local split index for every key, NO_SPLIT when unused. Kept between calls and only reset where it was written.
+		std::vector<uint32_t> splitIds;
 		Vector2f points;
 		Vector2ui indexes;
 		const int a2fVertex1Offset[4][2] = { { 0, 0 },{ 1, 0 },{ 1, 1 },{ 0, 1 } };
@@ -109,19 +129,18 @@ namespace aly {
 		};
 		const float LEVEL_SET_TOLERANCE = 1E-3f;
 		float isoLevel=0.0f;
-		EdgeSplitPtr lastSplit1;
-		EdgeSplitPtr lastSplit2;
 		bool nudgeLevelSet = true;
 		TopologyRule2D rule= TopologyRule2D::Unconstrained;
 		const Image1f* img;
 		int rows,  cols;
-		float getValue(int x, int y);
-		float fGetOffset(uint2 v1, uint2 v2);
-		EdgeSplitPtr createSplit(std::map<uint64_t, EdgeSplitPtr>& splits, int p1x,int p1y, int p2x, int p2y);
-		void addEdge(std::map<uint64_t, EdgeSplitPtr>& splits, std::list<EdgePtr>& edges, int p1x, int p1y, int p2x, int p2y,int p3x, int p3y, int p4x, int p4y);
-		void processSquare2(int x, int y,std::map<uint64_t, EdgeSplitPtr>& splits, std::list<EdgePtr>& edges);
-		void processSquare1(int x, int y, std::map<uint64_t, EdgeSplitPtr>& splits, std::list<EdgePtr>& edges);
-		void processSquare(int x, int y, std::map<uint64_t, EdgeSplitPtr>& splits, std::list<EdgePtr>& edges);
+		float getValue(int x, int y) const;
+		float fGetOffset(uint2 v1, uint2 v2) const;
+		float2 getSplitPoint(size_t key) const;
+		uint32_t createSplit(Band& band, int p1x,int p1y, int p2x, int p2y);
+		void addEdge(Band& band, int p1x, int p1y, int p2x, int p2y,int p3x, int p3y, int p4x, int p4y);
+		void processSquare2(int x, int y, Band& band);
+		void processSquare1(int x, int y, Band& band);
+		void processSquare(int x, int y, Band& band);
 		bool orient(const Image1f& img,const EdgeSplit& split1,const EdgeSplit& split2,Edge& edge);
 	public:
 		IsoContour(bool nudgeLevelSet=true,float levelSetTolerance=1E-3f):nudgeLevelSet(nudgeLevelSet), LEVEL_SET_TOLERANCE(levelSetTolerance){
@@ -142,5 +161,30 @@ namespace aly {
 		virtual ~IsoContour() {}
 		void solve(const Image1f& levelset, float isoLevel=0.0f, const TopologyRule2D& rule=TopologyRule2D::Unconstrained, const Winding& winding=Winding::CounterClockwise);
 	};
+	class Mesh;
+	/*
+	 * Marching cubes extraction of a level set from a volume into a triangle mesh with vertexes in voxel coordinates.
+	 * Triangles are wound counter-clockwise when viewed from the side with values above the iso-level.
+	 *
+	 * Slabs between consecutive slices are processed in parallel. Vertexes are placed on grid edges and shared between cells through
+	 * per-slab edge caches, so each thread only holds vertex ids for two slices at a time. Vertex normals are not computed.
+	 */
+	class IsoSurface {
+	protected:
+		const float LEVEL_SET_TOLERANCE;
+		bool nudgeLevelSet;
+		float isoLevel = 0.0f;
+		const Volume1f* vol = nullptr;
+		float getValue(int i, int j, int k) const;
+		uint32_t countVertexes(int k, uint32_t& xyCount) const;
+		uint32_t countTriangles(int k) const;
+		void processSlab(int k, uint32_t vertexOffset, uint32_t xyCount, uint32_t nextVertexOffset, uint32_t triangleOffset,
+			std::vector<uint32_t>& cache, Mesh& mesh) const;
+	public:
+		IsoSurface(bool nudgeLevelSet = true, float levelSetTolerance = 1E-3f) :LEVEL_SET_TOLERANCE(levelSetTolerance), nudgeLevelSet(nudgeLevelSet) {
+		}
+		virtual ~IsoSurface() {}
+		void solve(const Volume1f& levelset, Mesh& mesh, float isoLevel = 0.0f);
+	};
 }
 #endif 
\ No newline at end of file
@@ -29,6 +29,8 @@
 #include <iostream>
 #include <limits>
 #include <cmath>
+#include <vector>
+#include <algorithm>
 #include "AlloyCommon.h"
 
 #include "cereal/cereal.hpp"
@@ -39,6 +41,7 @@ namespace aly {
 bool SANITY_CHECK_MATH();
 bool SANITY_CHECK_CEREAL();
 bool SANITY_CHECK_SVD();
+bool SANITY_CHECK_REDUCTION();
 template<typename T> T min(const T& x, const T& y) {
 	return ((x) < (y) ? (x) : (y));
 }
@@ -513,7 +516,235 @@ template<class T, int M, int N> struct elem_type<matrix<T, M, N>> {
 };
 template<class T> using elem_t = typename elem_type<T>::type;
 
+// Element-wise operations evaluated by the lazy Image and Vector expressions
+struct ElementAdd {
+	template<class A> static A apply(const A& a, const A& b) {
+		return a + b;
+	}
+};
+struct ElementSubtract {
+	template<class A> static A apply(const A& a, const A& b) {
+		return a - b;
+	}
+};
+struct ElementMultiply {
+	template<class A> static A apply(const A& a, const A& b) {
+		return a * b;
+	}
+};
+struct ElementDivide {
+	template<class A> static A apply(const A& a, const A& b) {
+		return a / b;
+	}
+};
+
+/*
+ Parallel reduction engine shared by Vector, Image and Volume statistics. Inputs are
+ flat arrays of interleaved components, so component k belongs to channel k % C.
+ Work is split into fixed size blocks that are reduced in parallel. Inside a block
+ 8*C independent lanes are accumulated, which keeps each channel in a fixed lane
+ and gives the compiler a dependency free loop to vectorize. Block results are
+ merged in block order, so results do not depend on the number of threads.
+ */
+enum class Summation {
+	Naive, Pairwise, Kahan
+};
+// Values accumulated per lane in one block, 128 matches the base case of common pairwise summation schemes
+static const int REDUCE_BLOCK = 128;
+struct ReduceSum {
+	template<class A> static A identity() {
+		return A(0);
+	}
+	template<class A> static A apply(const A& a, const A& b) {
+		return a + b;
+	}
+};
+struct ReduceMin {
+	template<class A> static A identity() {
+		return std::numeric_limits<A>::max();
+	}
+	template<class A> static A apply(const A& a, const A& b) {
+		return (b < a) ? b : a;
+	}
+};
+struct ReduceMax {
+	template<class A> static A identity() {
+		return std::numeric_limits<A>::lowest();
+	}
+	template<class A> static A apply(const A& a, const A& b) {
+		return (a < b) ? b : a;
+	}
+};
+template<class Op, class A, int C, class F> vec<A, C> ReduceBlock(
+		const F& func, size_t start, size_t end) {
+	const int W = 8 * C;
+	A lanes[W];
+	for (int l = 0; l < W; l++) {
+		lanes[l] = Op::template identity<A>();
+	}
+	size_t k = start;
+	for (; k + W <= end; k += W) {
+		for (int l = 0; l < W; l++) {
+			lanes[l] = Op::apply(lanes[l], (A) func(k + l));
+		}
+	}
+	for (int l = 0; k < end; k++, l++) {
+		lanes[l] = Op::apply(lanes[l], (A) func(k));
+	}
+	vec<A, C> out(Op::template identity<A>());
+	for (int l = 0; l < W; l++) {
+		out[l % C] = Op::apply(out[l % C], lanes[l]);
+	}
+	return out;
+}
+template<class A> inline void KahanAdd(A& sum, A& comp, const A& val) {
+	A y = val - comp;
+	A t = sum + y;
+	comp = (t - sum) - y;
+	sum = t;
+}
+template<class A, int C, class F> vec<A, C> KahanBlock(const F& func,
+		size_t start, size_t end) {
+	const int W = 8 * C;
+	A sum[W], comp[W];
+	for (int l = 0; l < W; l++) {
+		sum[l] = comp[l] = A(0);
+	}
+	size_t k = start;
+	for (; k + W <= end; k += W) {
+		for (int l = 0; l < W; l++) {
+			KahanAdd(sum[l], comp[l], (A) func(k + l));
+		}
+	}
+	for (int l = 0; k < end; k++, l++) {
+		KahanAdd(sum[l], comp[l], (A) func(k));
+	}
+	vec<A, C> out(A(0)), outComp(A(0));
+	for (int l = 0; l < W; l++) {
+		KahanAdd(out[l % C], outComp[l % C], sum[l] - comp[l]);
+	}
+	return out - outComp;
+}
+/*
+ Reduce count components with Op, func(k) supplies the value of component k.
+ Returns one result per channel.
+ */
+template<class Op, class A, int C, class F> vec<A, C> ParallelReduce(
+		size_t count, const F& func) {
+	const size_t block = (size_t) REDUCE_BLOCK * 8 * C;
+	const int blocks = (int) ((count + block - 1) / block);
+	std::vector<vec<A, C>> partial(blocks);
+#pragma omp parallel for
+	for (int b = 0; b < blocks; b++) {
+		size_t start = b * block;
+		partial[b] = ReduceBlock<Op, A, C>(func, start,
+				std::min(count, start + block));
+	}
+	vec<A, C> out(Op::template identity<A>());
+	for (int b = 0; b < blocks; b++) {
+		for (int c = 0; c < C; c++) {
+			out[c] = Op::apply(out[c], partial[b][c]);
+		}
+	}
+	return out;
+}
+/*
+ Per channel sum of count components. Naive adds block sums in sequence, Pairwise
+ merges them as a binary tree for O(log n) error growth (Higham 1993), and Kahan
+ compensates both the lanes and the merge (Kahan 1965).
+ */
+template<class A, int C, class F> vec<A, C> ParallelSum(size_t count,
+		const F& func, Summation method = Summation::Pairwise) {
+	const size_t block = (size_t) REDUCE_BLOCK * 8 * C;
+	const int blocks = (int) ((count + block - 1) / block);
+	std::vector<vec<A, C>> partial(blocks);
+#pragma omp parallel for
+	for (int b = 0; b < blocks; b++) {
+		size_t start = b * block;
+		size_t end = std::min(count, start + block);
+		partial[b] =
+				(method == Summation::Kahan) ?
+						KahanBlock<A, C>(func, start, end) :
+						ReduceBlock<ReduceSum, A, C>(func, start, end);
+	}
+	vec<A, C> out(A(0));
+	if (method == Summation::Pairwise) {
+		for (int stride = 1; stride < blocks; stride *= 2) {
+			for (int b = 0; b + stride < blocks; b += 2 * stride) {
+				partial[b] += partial[b + stride];
+			}
+		}
+		if (blocks > 0)
+			out = partial[0];
+	} else if (method == Summation::Kahan) {
+		vec<A, C> comp(A(0));
+		for (int b = 0; b < blocks; b++) {
+			for (int c = 0; c < C; c++) {
+				KahanAdd(out[c], comp[c], partial[b][c]);
+			}
+		}
+	} else {
+		for (int b = 0; b < blocks; b++) {
+			out += partial[b];
+		}
+	}
+	return out;
+}
+/*
+ Per channel minimum and maximum in a single pass.
+ */
+template<class A, int C, class F> std::pair<vec<A, C>, vec<A, C>> ParallelRange(
+		size_t count, const F& func) {
+	const int W = 8 * C;
+	const size_t block = (size_t) REDUCE_BLOCK * W;
+	const int blocks = (int) ((count + block - 1) / block);
+	std::vector<vec<A, C>> partialMin(blocks), partialMax(blocks);
+#pragma omp parallel for
+	for (int b = 0; b < blocks; b++) {
+		size_t start = b * block;
+		size_t end = std::min(count, start + block);
+		A minLanes[W], maxLanes[W];
+		for (int l = 0; l < W; l++) {
+			minLanes[l] = ReduceMin::identity<A>();
+			maxLanes[l] = ReduceMax::identity<A>();
+		}
+		size_t k = start;
+		for (; k + W <= end; k += W) {
+			for (int l = 0; l < W; l++) {
+				A val = (A) func(k + l);
+				minLanes[l] = ReduceMin::apply(minLanes[l], val);
+				maxLanes[l] = ReduceMax::apply(maxLanes[l], val);
+			}
+		}
+		for (int l = 0; k < end; k++, l++) {
+			A val = (A) func(k);
+			minLanes[l] = ReduceMin::apply(minLanes[l], val);
+			maxLanes[l] = ReduceMax::apply(maxLanes[l], val);
+		}
+		vec<A, C> minVal(ReduceMin::identity<A>()), maxVal(
+				ReduceMax::identity<A>());
+		for (int l = 0; l < W; l++) {
+			minVal[l % C] = ReduceMin::apply(minVal[l % C], minLanes[l]);
+			maxVal[l % C] = ReduceMax::apply(maxVal[l % C], maxLanes[l]);
+		}
+		partialMin[b] = minVal;
+		partialMax[b] = maxVal;
+	}
+	std::pair<vec<A, C>, vec<A, C>> out(vec<A, C>(ReduceMin::identity<A>()),
+			vec<A, C>(ReduceMax::identity<A>()));
+	for (int b = 0; b < blocks; b++) {
+		for (int c = 0; c < C; c++) {
+			out.first[c] = ReduceMin::apply(out.first[c], partialMin[b][c]);
+			out.second[c] = ReduceMax::apply(out.second[c], partialMax[b][c]);
+		}
+	}
+	return out;
+}
+
 // Form a scalar by applying function f to adjacent components of vector or matrix v
+template<class T, class F> T reduce(const vec<T, 1> & v, F f) {
+	return v.x;
+}
 template<class T, class F> T reduce(const vec<T, 2> & v, F f) {
 	return f(v.x, v.y);
 }
@@ -117,6 +117,9 @@ public:
 	}
 
 	Mesh(std::shared_ptr<AlloyContext>& context = AlloyDefaultContext());
+	//Moves attribute arrays without copying, GL buffers stay with their owner and are rebuilt on the next update.
+	Mesh(Mesh&& mesh);
+	Mesh& operator=(Mesh&& mesh);
 	inline box3f getBoundingBox() const {
 		return boundingBox;
 	}
@@ -175,6 +178,58 @@ void WriteMeshToFile(const std::string& file, const Mesh& mesh);
 void WriteObjMeshToFile(const std::string& file,const Mesh& mesh);
 typedef std::vector<std::set<uint32_t>> MeshSetNeighborTable;
 typedef std::vector<std::list<uint32_t>> MeshListNeighborTable;
+/*
+ * Compressed (CSR) neighbor table. The neighbors of element i are indexes[offsets[i]..offsets[i+1]),
+ * so the whole table is two allocations regardless of mesh size. table[i] is an iterable range.
+ */
+struct MeshNeighborTable {
+	struct Range {
+		const uint32_t* first;
+		const uint32_t* last;
+		const uint32_t* begin() const {
+			return first;
+		}
+		const uint32_t* end() const {
+			return last;
+		}
+		size_t size() const {
+			return last - first;
+		}
+		bool empty() const {
+			return first == last;
+		}
+		uint32_t operator[](size_t i) const {
+			return first[i];
+		}
+		uint32_t front() const {
+			return *first;
+		}
+		uint32_t back() const {
+			return *(last - 1);
+		}
+	};
+	std::vector<size_t> offsets;
+	std::vector<uint32_t> indexes;
+	MeshNeighborTable() :
+			offsets(1, 0) {
+	}
+	size_t size() const {
+		return offsets.size() - 1;
+	}
+	void clear() {
+		offsets.assign(1, 0);
+		indexes.clear();
+	}
+	Range operator[](size_t i) const {
+		Range r;
+		r.first = indexes.data() + offsets[i];
+		r.last = indexes.data() + offsets[i + 1];
+		return r;
+	}
+};
+void CreateVertexNeighborTable(const Mesh& mesh, MeshNeighborTable& vertNbrs);
+void CreateOrderedVertexNeighborTable(const Mesh& mesh,
+	MeshNeighborTable& vertNbrs, bool leaveTail = false);
 void CreateVertexNeighborTable(const Mesh& mesh, MeshSetNeighborTable& vertNbrs);
 void CreateOrderedVertexNeighborTable(const Mesh& mesh,
 	MeshListNeighborTable& vertNbrs, bool leaveTail = false);
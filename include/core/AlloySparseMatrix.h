@@ -29,6 +29,13 @@
 #include <vector>
 #include <list>
 #include <map>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <cstring>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 namespace aly {
 
 template<class T, int C> struct SparseMatrix {
@@ -123,6 +130,318 @@ public:
 		return A;
 	}
 };
+/*
+ * Compressed sparse row (CSR) form of a SparseMatrix. Row i stores its column indexes and values in
+ * columns[rowOffsets[i]..rowOffsets[i+1]) and values[rowOffsets[i]..rowOffsets[i+1]), sorted by column.
+ * Entries are vec<T,C>, so for C>1 each non-zero is a C-channel diagonal block stored contiguously.
+ * Build it once after assembly and reuse it for repeated products and solves.
+ */
+template<class T, int C> struct CompressedSparseMatrix {
+	std::vector<size_t> rowOffsets;
+	std::vector<uint32_t> columns;
+	std::vector<vec<T, C>> values;
+	size_t rows, cols;
+	CompressedSparseMatrix() :
+			rowOffsets(1, 0), rows(0), cols(0) {
+	}
+	CompressedSparseMatrix(const SparseMatrix<T, C>& A) :
+			rows(0), cols(0) {
+		set(A);
+	}
+	template<class Archive> void serialize(Archive & archive) {
+		archive(CEREAL_NVP(rows), CEREAL_NVP(cols), CEREAL_NVP(rowOffsets),
+				CEREAL_NVP(columns),
+				cereal::make_nvp(MakeString() << "values" << C, values));
+	}
+	void set(const SparseMatrix<T, C>& A) {
+		if (A.cols > std::numeric_limits<uint32_t>::max())
+			throw std::runtime_error(
+					MakeString() << "Cannot compress matrix with " << A.cols
+							<< " columns.");
+		rows = A.rows;
+		cols = A.cols;
+		rowOffsets.resize(rows + 1);
+		rowOffsets[0] = 0;
+		for (size_t i = 0; i < rows; i++) {
+			rowOffsets[i + 1] = rowOffsets[i] + A[i].size();
+		}
+		columns.resize(rowOffsets[rows]);
+		values.resize(rowOffsets[rows]);
+#pragma omp parallel for
+		for (int i = 0; i < (int) rows; i++) {
+			size_t offset = rowOffsets[i];
+			for (const std::pair<size_t, vec<T, C>>& pr : A[i]) {
+				columns[offset] = (uint32_t) pr.first;
+				values[offset] = pr.second;
+				offset++;
+			}
+		}
+	}
+	size_t nonZeros() const {
+		return values.size();
+	}
+	vec<T, C> get(size_t i, size_t j) const {
+		if (i >= rows || j >= cols)
+			throw std::runtime_error(
+					MakeString() << "Index (" << i << "," << j
+							<< ") exceeds matrix bounds [" << rows << ","
+							<< cols << "]");
+		auto start = columns.begin() + rowOffsets[i];
+		auto end = columns.begin() + rowOffsets[i + 1];
+		auto iter = std::lower_bound(start, end, (uint32_t) j);
+		if (iter == end || *iter != j) {
+			return vec<T, C>(T(0));
+		}
+		return values[iter - columns.begin()];
+	}
+	vec<T, C> operator()(size_t i, size_t j) const {
+		return get(i, j);
+	}
+};
+template<class T, int C> struct SparseTriplet {
+	uint32_t row, col;
+	vec<T, C> value;
+	SparseTriplet() :
+			row(0), col(0) {
+	}
+	SparseTriplet(uint32_t row, uint32_t col, const vec<T, C>& value) :
+			row(row), col(col), value(value) {
+	}
+};
+/*
+ * Coordinate (COO) form used to assemble large systems. Each OpenMP thread appends to its own buffer,
+ * so add() can be called from inside a parallel loop without locks. Callers that cannot own a buffer
+ * (threads beyond the slots allocated by resize(), nested parallel regions and threads other than the
+ * one that called resize()) fall back to a shared buffer guarded by a mutex, which is correct but slower.
+ * Buffers are indexed by OpenMP thread number, so only one parallel region may add at a time.
+ * compress() sorts the entries by row and column, sums duplicates and emits the CSR matrix directly.
+ * Duplicates are summed in a canonical order, so the result does not depend on which thread added them.
+ */
+template<class T, int C> struct TripletMatrix {
+protected:
+	typedef SparseTriplet<T, C> Triplet;
+	std::vector<std::vector<Triplet>> buffers;
+	std::vector<Triplet> shared;
+	std::mutex sharedLock;
+	std::thread::id owner;
+	//Buffer owned by the calling thread, or -1 if the caller has to use the shared buffer.
+	int threadSlot() const {
+#ifdef _OPENMP
+#if _OPENMP >= 200805
+		if (omp_get_level() > 1)
+			return -1;
+#else
+		//Nested regions are serialized by default in OpenMP 2.0, but still report thread 0.
+		if (omp_in_parallel() && omp_get_num_threads() == 1)
+			return -1;
+#endif
+		if (omp_in_parallel()) {
+			int slot = omp_get_thread_num();
+			return (slot < (int) buffers.size()) ? slot : -1;
+		}
+#endif
+		return (std::this_thread::get_id() == owner) ? 0 : -1;
+	}
+	//Total order for duplicate entries. Values are compared bytewise so the summation order is fixed.
+	static bool entryLess(uint32_t colA, const vec<T, C>& valA, uint32_t colB,
+			const vec<T, C>& valB) {
+		if (colA != colB)
+			return colA < colB;
+		return std::memcmp(&valA, &valB, sizeof(vec<T, C>)) < 0;
+	}
+public:
+	size_t rows, cols;
+	TripletMatrix() :
+			rows(0), cols(0) {
+		resize(0, 0);
+	}
+	TripletMatrix(size_t rows, size_t cols, size_t reserved = 0) :
+			rows(rows), cols(cols) {
+		resize(rows, cols, reserved);
+	}
+	TripletMatrix(const TripletMatrix<T, C>&) = delete;
+	TripletMatrix<T, C>& operator=(const TripletMatrix<T, C>&) = delete;
+	//Allocates one buffer per OpenMP thread and makes the calling thread the owner of buffer 0 outside parallel regions.
+	void resize(size_t r, size_t c, size_t reserved = 0) {
+		if (c > std::numeric_limits<uint32_t>::max()
+				|| r > std::numeric_limits<uint32_t>::max())
+			throw std::runtime_error(
+					MakeString() << "Cannot assemble matrix with dimensions ["
+							<< r << "," << c << "].");
+		rows = r;
+		cols = c;
+#ifdef _OPENMP
+		int threads = std::max(std::max(omp_get_max_threads(), omp_get_num_procs()), 1);
+#else
+		int threads = 1;
+#endif
+		owner = std::this_thread::get_id();
+		buffers.clear();
+		buffers.resize(threads);
+		shared.clear();
+		for (std::vector<Triplet>& buffer : buffers) {
+			buffer.reserve(reserved / threads);
+		}
+	}
+	//Safe to call concurrently from any thread. Duplicate entries are summed. Indexes that do not fit the
+	//32 bit triplets throw here, other out of bounds entries are reported by compress().
+	void add(size_t i, size_t j, const vec<T, C>& value) {
+		if (i > std::numeric_limits<uint32_t>::max()
+				|| j > std::numeric_limits<uint32_t>::max())
+			throw std::runtime_error(
+					MakeString() << "Index (" << i << "," << j
+							<< ") exceeds matrix bounds [" << rows << ","
+							<< cols << "]");
+		int slot = threadSlot();
+		if (slot >= 0) {
+			buffers[slot].push_back(Triplet((uint32_t) i, (uint32_t) j, value));
+		} else {
+			std::lock_guard<std::mutex> lockMe(sharedLock);
+			shared.push_back(Triplet((uint32_t) i, (uint32_t) j, value));
+		}
+	}
+	void add(size_t i, size_t j, const T& value) {
+		add(i, j, vec<T, C>(value));
+	}
+	size_t size() const {
+		size_t count = shared.size();
+		for (const std::vector<Triplet>& buffer : buffers) {
+			count += buffer.size();
+		}
+		return count;
+	}
+	void clear() {
+		for (std::vector<Triplet>& buffer : buffers) {
+			buffer.clear();
+		}
+		shared.clear();
+	}
+	void compress(CompressedSparseMatrix<T, C>& A) const {
+		//Split all buffers into blocks so the count and scatter passes balance even if one thread added everything.
+		static const size_t BLOCK = 1 << 16;
+		std::vector<std::pair<const Triplet*, size_t>> blocks;
+		for (int b = 0; b <= (int) buffers.size(); b++) {
+			const std::vector<Triplet>& buffer =
+					(b < (int) buffers.size()) ? buffers[b] : shared;
+			for (size_t k = 0; k < buffer.size(); k += BLOCK) {
+				blocks.push_back(
+						std::pair<const Triplet*, size_t>(buffer.data() + k,
+								std::min(BLOCK, buffer.size() - k)));
+			}
+		}
+		std::vector<std::atomic<size_t>> counts(rows + 1);
+		bool outOfBounds = false;
+		Triplet bad;
+#pragma omp parallel for
+		for (int b = 0; b < (int) blocks.size(); b++) {
+			const Triplet* entries = blocks[b].first;
+			for (size_t k = 0; k < blocks[b].second; k++) {
+				const Triplet& t = entries[k];
+				if (t.row >= rows || t.col >= cols) {
+#pragma omp critical
+					{
+						outOfBounds = true;
+						bad = t;
+					}
+					continue;
+				}
+				counts[t.row + 1]++;
+			}
+		}
+		if (outOfBounds)
+			throw std::runtime_error(
+					MakeString() << "Index (" << bad.row << "," << bad.col
+							<< ") exceeds matrix bounds [" << rows << ","
+							<< cols << "]");
+		std::vector<size_t> starts(rows + 1, 0);
+		for (size_t i = 0; i < rows; i++) {
+			starts[i + 1] = starts[i] + counts[i + 1];
+			counts[i] = starts[i];
+		}
+		//Scatter order within a row is arbitrary, the per row sort below restores a canonical order.
+		std::vector<uint32_t> columns(starts[rows]);
+		std::vector<vec<T, C>> values(starts[rows]);
+#pragma omp parallel for
+		for (int b = 0; b < (int) blocks.size(); b++) {
+			const Triplet* entries = blocks[b].first;
+			for (size_t k = 0; k < blocks[b].second; k++) {
+				const Triplet& t = entries[k];
+				size_t pos = counts[t.row]++;
+				columns[pos] = t.col;
+				values[pos] = t.value;
+			}
+		}
+		std::vector<size_t> merged(rows + 1, 0);
+#pragma omp parallel for
+		for (int i = 0; i < (int) rows; i++) {
+			size_t start = starts[i];
+			size_t end = starts[i + 1];
+			if (end - start > 32) {
+				std::vector<std::pair<uint32_t, vec<T, C>>> row(end - start);
+				for (size_t k = start; k < end; k++) {
+					row[k - start] = std::pair<uint32_t, vec<T, C>>(columns[k], values[k]);
+				}
+				std::sort(row.begin(), row.end(),
+						[](const std::pair<uint32_t, vec<T, C>>& a,const std::pair<uint32_t, vec<T, C>>& b) {
+							return entryLess(a.first, a.second, b.first, b.second);
+						});
+				for (size_t k = start; k < end; k++) {
+					columns[k] = row[k - start].first;
+					values[k] = row[k - start].second;
+				}
+			} else {
+				//Most rows are short, so sort columns and values together in place.
+				for (size_t k = start + 1; k < end; k++) {
+					uint32_t col = columns[k];
+					vec<T, C> val = values[k];
+					size_t n = k;
+					while (n > start
+							&& entryLess(col, val, columns[n - 1], values[n - 1])) {
+						columns[n] = columns[n - 1];
+						values[n] = values[n - 1];
+						n--;
+					}
+					columns[n] = col;
+					values[n] = val;
+				}
+			}
+			size_t last = start;
+			for (size_t k = start + 1; k < end; k++) {
+				if (columns[k] == columns[last]) {
+					values[last] += values[k];
+				} else {
+					last++;
+					columns[last] = columns[k];
+					values[last] = values[k];
+				}
+			}
+			merged[i + 1] = (end > start) ? last - start + 1 : 0;
+		}
+		A.rows = rows;
+		A.cols = cols;
+		A.rowOffsets.resize(rows + 1);
+		A.rowOffsets[0] = 0;
+		for (size_t i = 0; i < rows; i++) {
+			A.rowOffsets[i + 1] = A.rowOffsets[i] + merged[i + 1];
+		}
+		A.columns.resize(A.rowOffsets[rows]);
+		A.values.resize(A.rowOffsets[rows]);
+#pragma omp parallel for
+		for (int i = 0; i < (int) rows; i++) {
+			std::copy(columns.begin() + starts[i],
+					columns.begin() + starts[i] + merged[i + 1],
+					A.columns.begin() + A.rowOffsets[i]);
+			std::copy(values.begin() + starts[i],
+					values.begin() + starts[i] + merged[i + 1],
+					A.values.begin() + A.rowOffsets[i]);
+		}
+	}
+	CompressedSparseMatrix<T, C> compress() const {
+		CompressedSparseMatrix<T, C> A;
+		compress(A);
+		return A;
+	}
+};
 template<class A, class B, class T, int C> std::basic_ostream<A, B> & operator <<(
 		std::basic_ostream<A, B> & ss, const SparseMatrix<T, C>& M) {
 	for (int i = 0; i < M.rows; i++) {
@@ -595,6 +914,131 @@ template<class T, int C> void SubtractMultiplyVec(Vector<T, C>& out,
 		out[i] = b[i] - vec<T, C>(sum);
 	}
 }
+template<class T, int C> void Multiply(Vector<T, C>& out,
+		const CompressedSparseMatrix<T, 1>& A, const Vector<T, C>& v) {
+	out.resize(A.rows);
+	const size_t* offsets = A.rowOffsets.data();
+	const uint32_t* columns = A.columns.data();
+	const vec<T, 1>* values = A.values.data();
+	const vec<T, C>* x = v.data.data();
+	vec<T, C>* y = out.data.data();
+#pragma omp parallel for
+	for (int i = 0; i < (int) A.rows; i++) {
+		vec<double, C> sum(0.0);
+		for (size_t k = offsets[i]; k < offsets[i + 1]; k++) {
+			sum += vec<double, C>(x[columns[k]]) * (double) values[k].x;
+		}
+		y[i] = vec<T, C>(sum);
+	}
+}
+template<class T, int C> void AddMultiply(Vector<T, C>& out,
+		const Vector<T, C>& b, const CompressedSparseMatrix<T, 1>& A,
+		const Vector<T, C>& v) {
+	out.resize(A.rows);
+	const size_t* offsets = A.rowOffsets.data();
+	const uint32_t* columns = A.columns.data();
+	const vec<T, 1>* values = A.values.data();
+	const vec<T, C>* x = v.data.data();
+	vec<T, C>* y = out.data.data();
+#pragma omp parallel for
+	for (int i = 0; i < (int) A.rows; i++) {
+		vec<double, C> sum(0.0);
+		for (size_t k = offsets[i]; k < offsets[i + 1]; k++) {
+			sum += vec<double, C>(x[columns[k]]) * (double) values[k].x;
+		}
+		y[i] = b.data[i] + vec<T, C>(sum);
+	}
+}
+template<class T, int C> void SubtractMultiply(Vector<T, C>& out,
+		const Vector<T, C>& b, const CompressedSparseMatrix<T, 1>& A,
+		const Vector<T, C>& v) {
+	out.resize(A.rows);
+	const size_t* offsets = A.rowOffsets.data();
+	const uint32_t* columns = A.columns.data();
+	const vec<T, 1>* values = A.values.data();
+	const vec<T, C>* x = v.data.data();
+	vec<T, C>* y = out.data.data();
+#pragma omp parallel for
+	for (int i = 0; i < (int) A.rows; i++) {
+		vec<double, C> sum(0.0);
+		for (size_t k = offsets[i]; k < offsets[i + 1]; k++) {
+			sum += vec<double, C>(x[columns[k]]) * (double) values[k].x;
+		}
+		y[i] = b.data[i] - vec<T, C>(sum);
+	}
+}
+template<class T, int C> void MultiplyVec(Vector<T, C>& out,
+		const CompressedSparseMatrix<T, C>& A, const Vector<T, C>& v) {
+	out.resize(A.rows);
+	const size_t* offsets = A.rowOffsets.data();
+	const uint32_t* columns = A.columns.data();
+	const vec<T, C>* values = A.values.data();
+	const vec<T, C>* x = v.data.data();
+	vec<T, C>* y = out.data.data();
+#pragma omp parallel for
+	for (int i = 0; i < (int) A.rows; i++) {
+		vec<double, C> sum(0.0);
+		for (size_t k = offsets[i]; k < offsets[i + 1]; k++) {
+			sum += vec<double, C>(x[columns[k]]) * vec<double, C>(values[k]);
+		}
+		y[i] = vec<T, C>(sum);
+	}
+}
+template<class T, int C> void AddMultiplyVec(Vector<T, C>& out,
+		const Vector<T, C>& b, const CompressedSparseMatrix<T, C>& A,
+		const Vector<T, C>& v) {
+	out.resize(A.rows);
+	const size_t* offsets = A.rowOffsets.data();
+	const uint32_t* columns = A.columns.data();
+	const vec<T, C>* values = A.values.data();
+	const vec<T, C>* x = v.data.data();
+	vec<T, C>* y = out.data.data();
+#pragma omp parallel for
+	for (int i = 0; i < (int) A.rows; i++) {
+		vec<double, C> sum(0.0);
+		for (size_t k = offsets[i]; k < offsets[i + 1]; k++) {
+			sum += vec<double, C>(x[columns[k]]) * vec<double, C>(values[k]);
+		}
+		y[i] = b.data[i] + vec<T, C>(sum);
+	}
+}
+template<class T, int C> void SubtractMultiplyVec(Vector<T, C>& out,
+		const Vector<T, C>& b, const CompressedSparseMatrix<T, C>& A,
+		const Vector<T, C>& v) {
+	out.resize(A.rows);
+	const size_t* offsets = A.rowOffsets.data();
+	const uint32_t* columns = A.columns.data();
+	const vec<T, C>* values = A.values.data();
+	const vec<T, C>* x = v.data.data();
+	vec<T, C>* y = out.data.data();
+#pragma omp parallel for
+	for (int i = 0; i < (int) A.rows; i++) {
+		vec<double, C> sum(0.0);
+		for (size_t k = offsets[i]; k < offsets[i + 1]; k++) {
+			sum += vec<double, C>(x[columns[k]]) * vec<double, C>(values[k]);
+		}
+		y[i] = b.data[i] - vec<T, C>(sum);
+	}
+}
+template<class T, int C> Vector<T, C> operator*(
+		const CompressedSparseMatrix<T, 1>& A, const Vector<T, C>& v) {
+	Vector<T, C> out(A.rows);
+	Multiply(out, A, v);
+	return out;
+}
+template<class T, int C> Vector<T, C> operator*(
+		const CompressedSparseMatrix<T, C>& A, const Vector<T, C>& v) {
+	Vector<T, C> out(A.rows);
+	MultiplyVec(out, A, v);
+	return out;
+}
+//Single channel products match both overloads above.
+template<class T> Vector<T, 1> operator*(const CompressedSparseMatrix<T, 1>& A,
+		const Vector<T, 1>& v) {
+	Vector<T, 1> out(A.rows);
+	Multiply(out, A, v);
+	return out;
+}
 typedef SparseMatrix<float, 4> SparseMatrix4f;
 typedef SparseMatrix<float, 3> SparseMatrix3f;
 typedef SparseMatrix<float, 2> SparseMatrix2f;
@@ -604,6 +1048,26 @@ typedef SparseMatrix<double, 4> SparseMatrix4d;
 typedef SparseMatrix<double, 3> SparseMatrix3d;
 typedef SparseMatrix<double, 2> SparseMatrix2d;
 typedef SparseMatrix<double, 1> SparseMatrix1d;
+
+typedef CompressedSparseMatrix<float, 4> CompressedSparseMatrix4f;
+typedef CompressedSparseMatrix<float, 3> CompressedSparseMatrix3f;
+typedef CompressedSparseMatrix<float, 2> CompressedSparseMatrix2f;
+typedef CompressedSparseMatrix<float, 1> CompressedSparseMatrix1f;
+
+typedef CompressedSparseMatrix<double, 4> CompressedSparseMatrix4d;
+typedef CompressedSparseMatrix<double, 3> CompressedSparseMatrix3d;
+typedef CompressedSparseMatrix<double, 2> CompressedSparseMatrix2d;
+typedef CompressedSparseMatrix<double, 1> CompressedSparseMatrix1d;
+
+typedef TripletMatrix<float, 4> TripletMatrix4f;
+typedef TripletMatrix<float, 3> TripletMatrix3f;
+typedef TripletMatrix<float, 2> TripletMatrix2f;
+typedef TripletMatrix<float, 1> TripletMatrix1f;
+
+typedef TripletMatrix<double, 4> TripletMatrix4d;
+typedef TripletMatrix<double, 3> TripletMatrix3d;
+typedef TripletMatrix<double, 2> TripletMatrix2d;
+typedef TripletMatrix<double, 1> TripletMatrix1d;
 }
 
 #endif
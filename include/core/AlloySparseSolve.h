@@ -23,170 +23,443 @@
 #include "AlloyMath.h"
 #include "AlloyVector.h"
 #include "AlloySparseMatrix.h"
+#include <set>
 namespace aly {
 bool SANITY_CHECK_ALGO();
 bool SANITY_CHECK_SPARSE_SOLVE();
-template<class T, int C> void SolveVecCG(const Vector<T, C>& b,
-		const SparseMatrix<T, C>& A, Vector<T, C>& x, int iters = 100,
-		T tolerance = 1E-6f,
-		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+//Signature for preconditioners. The callback writes z = M^-1 r for an approximation M of the system matrix.
+template<class T, int C> struct Preconditioner {
+	typedef std::function<void(Vector<T, C>& z, const Vector<T, C>& r)> Function;
+};
+enum class PreconditionerType {
+	Identity = 0, Jacobi = 1, IncompleteCholesky = 2, IncompleteLU = 3
+};
+//Preconditioners are built from a matrix with either one channel or the same number of channels as the vectors they are applied to.
+template<class T, int CM> class JacobiPreconditioner {
+protected:
+	std::vector<vec<T, CM>> inverseDiagonal;
+public:
+	JacobiPreconditioner() {
+	}
+	JacobiPreconditioner(const CompressedSparseMatrix<T, CM>& A) {
+		set(A);
+	}
+	void set(const CompressedSparseMatrix<T, CM>& A) {
+		inverseDiagonal.resize(A.rows);
+#pragma omp parallel for
+		for (int i = 0; i < (int) A.rows; i++) {
+			vec<T, CM> d = A.get(i, i);
+			for (int c = 0; c < CM; c++) {
+				inverseDiagonal[i][c] =
+						(std::abs(d[c]) > T(1E-16)) ? T(1) / d[c] : T(1);
+			}
+		}
+	}
+	template<int C> void operator()(Vector<T, C>& z,
+			const Vector<T, C>& r) const {
+		z.resize(r.size());
+		vec<T, C>* zptr = z.data.data();
+		const vec<T, C>* rptr = r.data.data();
+		const vec<T, CM>* dptr = inverseDiagonal.data();
+#pragma omp parallel for
+		for (int i = 0; i < (int) r.size(); i++) {
+			for (int c = 0; c < C; c++) {
+				zptr[i][c] = dptr[i][(CM == 1) ? 0 : c] * rptr[i][c];
+			}
+		}
+	}
+};
+//Zero fill-in incomplete Cholesky factorization A ~ L*L^T for symmetric positive definite matrices.
+template<class T, int CM> class IncompleteCholeskyPreconditioner {
+protected:
+	CompressedSparseMatrix<T, CM> L;
+public:
+	IncompleteCholeskyPreconditioner() {
+	}
+	IncompleteCholeskyPreconditioner(const CompressedSparseMatrix<T, CM>& A) {
+		set(A);
+	}
+	void set(const CompressedSparseMatrix<T, CM>& A) {
+		const size_t NONE = std::numeric_limits<size_t>::max();
+		size_t N = A.rows;
+		L.rows = N;
+		L.cols = N;
+		L.rowOffsets.resize(N + 1);
+		L.rowOffsets[0] = 0;
+		for (size_t i = 0; i < N; i++) {
+			size_t count = 0;
+			for (size_t idx = A.rowOffsets[i]; idx < A.rowOffsets[i + 1];
+					idx++) {
+				if (A.columns[idx] <= i)
+					count++;
+			}
+			L.rowOffsets[i + 1] = L.rowOffsets[i] + count;
+		}
+		L.columns.resize(L.rowOffsets[N]);
+		L.values.resize(L.rowOffsets[N]);
+		for (size_t i = 0; i < N; i++) {
+			size_t offset = L.rowOffsets[i];
+			for (size_t idx = A.rowOffsets[i]; idx < A.rowOffsets[i + 1];
+					idx++) {
+				if (A.columns[idx] <= i) {
+					L.columns[offset] = A.columns[idx];
+					L.values[offset] = A.values[idx];
+					offset++;
+				}
+			}
+			if (offset == L.rowOffsets[i] || L.columns[offset - 1] != i)
+				throw std::runtime_error(
+						MakeString() << "Incomplete Cholesky requires a diagonal entry in row " << i << ".");
+		}
+		std::vector<size_t> position(N, NONE);
+		for (size_t i = 0; i < N; i++) {
+			size_t start = L.rowOffsets[i];
+			size_t diag = L.rowOffsets[i + 1] - 1;
+			for (size_t idx = start; idx < diag; idx++) {
+				position[L.columns[idx]] = idx;
+			}
+			vec<double, CM> sumSqr(0.0);
+			for (size_t idx = start; idx < diag; idx++) {
+				size_t k = L.columns[idx];
+				vec<double, CM> sum(L.values[idx]);
+				size_t kdiag = L.rowOffsets[k + 1] - 1;
+				for (size_t kdx = L.rowOffsets[k]; kdx < kdiag; kdx++) {
+					size_t pos = position[L.columns[kdx]];
+					if (pos != NONE && pos < idx) {
+						sum -= vec<double, CM>(L.values[pos])
+								* vec<double, CM>(L.values[kdx]);
+					}
+				}
+				vec<T, CM> lik = vec<T, CM>(sum / vec<double, CM>(L.values[kdiag]));
+				L.values[idx] = lik;
+				sumSqr += vec<double, CM>(lik) * vec<double, CM>(lik);
+			}
+			vec<T, CM>& lii = L.values[diag];
+			for (int c = 0; c < CM; c++) {
+				double d = (double) lii[c] - sumSqr[c];
+				//Fall back to the unmodified diagonal if the factorization breaks down.
+				if (d <= 0.0)
+					d = std::abs((double) lii[c]);
+				lii[c] = (d > 0.0) ? (T) std::sqrt(d) : T(1);
+			}
+			for (size_t idx = start; idx < diag; idx++) {
+				position[L.columns[idx]] = NONE;
+			}
+		}
+	}
+	template<int C> void operator()(Vector<T, C>& z,
+			const Vector<T, C>& r) const {
+		size_t N = L.rows;
+		z.resize(r.size());
+		vec<T, C>* zptr = z.data.data();
+		const vec<T, C>* rptr = r.data.data();
+		for (size_t i = 0; i < N; i++) {
+			vec<double, C> sum(rptr[i]);
+			size_t diag = L.rowOffsets[i + 1] - 1;
+			for (size_t idx = L.rowOffsets[i]; idx < diag; idx++) {
+				const vec<T, CM>& w = L.values[idx];
+				const vec<T, C>& zk = zptr[L.columns[idx]];
+				for (int c = 0; c < C; c++) {
+					sum[c] -= (double) w[(CM == 1) ? 0 : c] * (double) zk[c];
+				}
+			}
+			for (int c = 0; c < C; c++) {
+				zptr[i][c] = (T) (sum[c] / L.values[diag][(CM == 1) ? 0 : c]);
+			}
+		}
+		for (size_t i = N; i > 0; i--) {
+			size_t row = i - 1;
+			size_t diag = L.rowOffsets[i] - 1;
+			vec<T, C>& zi = zptr[row];
+			for (int c = 0; c < C; c++) {
+				zi[c] /= L.values[diag][(CM == 1) ? 0 : c];
+			}
+			for (size_t idx = L.rowOffsets[row]; idx < diag; idx++) {
+				const vec<T, CM>& w = L.values[idx];
+				vec<T, C>& zk = zptr[L.columns[idx]];
+				for (int c = 0; c < C; c++) {
+					zk[c] -= w[(CM == 1) ? 0 : c] * zi[c];
+				}
+			}
+		}
+	}
+};
+//Zero fill-in incomplete LU factorization A ~ L*U for general square matrices. L has a unit diagonal.
+template<class T, int CM> class IncompleteLUPreconditioner {
+protected:
+	CompressedSparseMatrix<T, CM> LU;
+	std::vector<size_t> diagonal;
+public:
+	IncompleteLUPreconditioner() {
+	}
+	IncompleteLUPreconditioner(const CompressedSparseMatrix<T, CM>& A) {
+		set(A);
+	}
+	void set(const CompressedSparseMatrix<T, CM>& A) {
+		const size_t NONE = std::numeric_limits<size_t>::max();
+		const double ZERO_TOLERANCE = 1E-16;
+		size_t N = A.rows;
+		LU = A;
+		diagonal.resize(N);
+		std::vector<size_t> position(A.cols, NONE);
+		for (size_t i = 0; i < N; i++) {
+			size_t start = LU.rowOffsets[i];
+			size_t end = LU.rowOffsets[i + 1];
+			for (size_t idx = start; idx < end; idx++) {
+				position[LU.columns[idx]] = idx;
+			}
+			if (i >= A.cols || position[i] == NONE)
+				throw std::runtime_error(
+						MakeString() << "Incomplete LU requires a diagonal entry in row " << i << ".");
+			diagonal[i] = position[i];
+			for (size_t idx = start; idx < diagonal[i]; idx++) {
+				size_t k = LU.columns[idx];
+				const vec<T, CM>& ukk = LU.values[diagonal[k]];
+				vec<T, CM>& lik = LU.values[idx];
+				lik /= ukk;
+				for (size_t kdx = diagonal[k] + 1; kdx < LU.rowOffsets[k + 1];
+						kdx++) {
+					size_t pos = position[LU.columns[kdx]];
+					if (pos != NONE) {
+						LU.values[pos] -= lik * LU.values[kdx];
+					}
+				}
+			}
+			vec<T, CM>& uii = LU.values[diagonal[i]];
+			for (int c = 0; c < CM; c++) {
+				if (std::abs((double) uii[c]) < ZERO_TOLERANCE) {
+					uii[c] = (uii[c] < 0) ? T(-ZERO_TOLERANCE) : T(ZERO_TOLERANCE);
+				}
+			}
+			for (size_t idx = start; idx < end; idx++) {
+				position[LU.columns[idx]] = NONE;
+			}
+		}
+	}
+	template<int C> void operator()(Vector<T, C>& z,
+			const Vector<T, C>& r) const {
+		size_t N = LU.rows;
+		z.resize(r.size());
+		vec<T, C>* zptr = z.data.data();
+		const vec<T, C>* rptr = r.data.data();
+		for (size_t i = 0; i < N; i++) {
+			vec<double, C> sum(rptr[i]);
+			for (size_t idx = LU.rowOffsets[i]; idx < diagonal[i]; idx++) {
+				const vec<T, CM>& w = LU.values[idx];
+				const vec<T, C>& zk = zptr[LU.columns[idx]];
+				for (int c = 0; c < C; c++) {
+					sum[c] -= (double) w[(CM == 1) ? 0 : c] * (double) zk[c];
+				}
+			}
+			zptr[i] = vec<T, C>(sum);
+		}
+		for (size_t i = N; i > 0; i--) {
+			size_t row = i - 1;
+			vec<double, C> sum(zptr[row]);
+			for (size_t idx = diagonal[row] + 1; idx < LU.rowOffsets[i];
+					idx++) {
+				const vec<T, CM>& w = LU.values[idx];
+				const vec<T, C>& zk = zptr[LU.columns[idx]];
+				for (int c = 0; c < C; c++) {
+					sum[c] -= (double) w[(CM == 1) ? 0 : c] * (double) zk[c];
+				}
+			}
+			const vec<T, CM>& uii = LU.values[diagonal[row]];
+			for (int c = 0; c < C; c++) {
+				zptr[row][c] = (T) (sum[c] / uii[(CM == 1) ? 0 : c]);
+			}
+		}
+	}
+};
+template<int C> void ClampDenominator(vec<double, C>& denom) {
 	const double ZERO_TOLERANCE = 1E-16;
-	vec<double, C> err(0.0);
+	for (int c = 0; c < C; c++) {
+		if (std::abs(denom[c]) < ZERO_TOLERANCE) {
+			denom[c] = (denom[c] < 0) ? -ZERO_TOLERANCE : ZERO_TOLERANCE;
+		}
+	}
+}
+/*
+ * Preconditioned solvers return the number of iterations performed. The iteration monitor receives
+ * the mean squared residual before the first iteration and after every iteration thereafter.
+ */
+template<class T, int C> int SolveVecCG(const Vector<T, C>& b,
+		const CompressedSparseMatrix<T, C>& A, Vector<T, C>& x,
+		const typename Preconditioner<T, C>::Function& preconditioner,
+		int iters = 100, T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
 	size_t N = b.size();
 	Vector<T, C> p(N);
 	Vector<T, C> Ap(N);
-	MultiplyVec(Ap, A, x);
-	Vector<T, C> tmp1(N), tmp2(N);
-	Vector<T, C>* rcurrent = &tmp1;
-	Vector<T, C>* rnext = &tmp2;
-	Subtract(*rcurrent, b, Ap);
-	p = *rcurrent;
-	err = lengthVecSqr(*rcurrent);
-	double e = lengthL1(err) / N;
+	Vector<T, C> r(N);
+	Vector<T, C> z;
+	Vector<T, C>* zptr = &r;
+	SubtractMultiplyVec(r, b, A, x);
+	if (preconditioner) {
+		preconditioner(z, r);
+		zptr = &z;
+	}
+	p = *zptr;
+	vec<double, C> rz = dotVec(r, *zptr);
+	double e = lengthL1(lengthVecSqr(r)) / N;
 	if (iterationMonitor)
 		iterationMonitor(0, e);
-	for (int iter = 0; iter < iters; iter++) {
+	if (e < tolerance)
+		return 0;
+	int iter = 0;
+	while (iter < iters) {
 		MultiplyVec(Ap, A, p);
 		vec<double, C> denom = dotVec(p, Ap);
-		for (int c = 0; c < C; c++) {
-			if (std::abs(denom[c]) < ZERO_TOLERANCE) {
-				denom[c] = (denom[c] < 0) ? -ZERO_TOLERANCE : ZERO_TOLERANCE;
-			}
-		}
-		vec<double, C> alpha = lengthVecSqr(*rcurrent) / denom;
+		ClampDenominator(denom);
+		vec<double, C> alpha = rz / denom;
 		ScaleAdd(x, vec<T, C>(alpha), p);
-		ScaleSubtract(*rnext, *rcurrent, vec<T, C>(alpha), Ap);
-		vec<double, C> err = lengthVecSqr(*rnext);
-		double e = lengthL1(err) / N;
+		ScaleSubtract(r, vec<T, C>(alpha), Ap);
+		iter++;
+		e = lengthL1(lengthVecSqr(r)) / N;
 		if (iterationMonitor)
-			iterationMonitor(iter + 1, e);
+			iterationMonitor(iter, e);
 		if (e < tolerance)
 			break;
-		denom = lengthVecSqr(*rcurrent);
-		for (int c = 0; c < C; c++) {
-			if (std::abs(denom[c]) < ZERO_TOLERANCE) {
-				denom[c] = (denom[c] < 0) ? -ZERO_TOLERANCE : ZERO_TOLERANCE;
-			}
-		}
-		vec<double, C> beta = err / denom;
-		ScaleAdd(p, *rnext, vec<T, C>(beta), p);
-		std::swap(rcurrent, rnext);
+		if (preconditioner)
+			preconditioner(z, r);
+		vec<double, C> rzNext = dotVec(r, *zptr);
+		ClampDenominator(rz);
+		vec<double, C> beta = rzNext / rz;
+		ScaleAdd(p, *zptr, vec<T, C>(beta), p);
+		rz = rzNext;
 	}
+	return iter;
 }
-template<class T, int C> void SolveCG(const Vector<T, C>& b,
-		const SparseMatrix<T, 1>& A, Vector<T, C>& x, int iters = 100,
-		T tolerance = 1E-6f,
+template<class T, int C> int SolveCG(const Vector<T, C>& b,
+		const CompressedSparseMatrix<T, 1>& A, Vector<T, C>& x,
+		const typename Preconditioner<T, C>::Function& preconditioner,
+		int iters = 100, T tolerance = 1E-6f,
 		const std::function<void(int, double)>& iterationMonitor = nullptr) {
-	const double ZERO_TOLERANCE = 1E-16;
-	vec<double, C> err(0.0);
 	size_t N = b.size();
 	Vector<T, C> p(N);
 	Vector<T, C> Ap(N);
-	Multiply(Ap, A, x);
-	Vector<T, C> tmp1(N), tmp2(N);
-	Vector<T, C>* rcurrent = &tmp1;
-	Vector<T, C>* rnext = &tmp2;
-	Subtract(*rcurrent, b, Ap);
-	p = *rcurrent;
-	err = lengthVecSqr(*rcurrent);
-	double e = lengthL1(err) / N;
+	Vector<T, C> r(N);
+	Vector<T, C> z;
+	Vector<T, C>* zptr = &r;
+	SubtractMultiply(r, b, A, x);
+	if (preconditioner) {
+		preconditioner(z, r);
+		zptr = &z;
+	}
+	p = *zptr;
+	vec<double, C> rz = dotVec(r, *zptr);
+	double e = lengthL1(lengthVecSqr(r)) / N;
 	if (iterationMonitor)
 		iterationMonitor(0, e);
-	for (int iter = 0; iter < iters; iter++) {
+	if (e < tolerance)
+		return 0;
+	int iter = 0;
+	while (iter < iters) {
 		Multiply(Ap, A, p);
 		vec<double, C> denom = dotVec(p, Ap);
-		for (int c = 0; c < C; c++) {
-			if (std::abs(denom[c]) < ZERO_TOLERANCE) {
-				denom[c] = (denom[c] < 0) ? -ZERO_TOLERANCE : ZERO_TOLERANCE;
-			}
-		}
-		vec<double, C> alpha = lengthVecSqr(*rcurrent) / denom;
+		ClampDenominator(denom);
+		vec<double, C> alpha = rz / denom;
 		ScaleAdd(x, vec<T, C>(alpha), p);
-		ScaleSubtract(*rnext, *rcurrent, vec<T, C>(alpha), Ap);
-		vec<double, C> err = lengthVecSqr(*rnext);
-		double e = lengthL1(err) / N;
+		ScaleSubtract(r, vec<T, C>(alpha), Ap);
+		iter++;
+		e = lengthL1(lengthVecSqr(r)) / N;
 		if (iterationMonitor)
-			iterationMonitor(iter + 1, e);
+			iterationMonitor(iter, e);
 		if (e < tolerance)
 			break;
-		denom = lengthVecSqr(*rcurrent);
-		for (int c = 0; c < C; c++) {
-			if (std::abs(denom[c]) < ZERO_TOLERANCE) {
-				denom[c] = (denom[c] < 0) ? -ZERO_TOLERANCE : ZERO_TOLERANCE;
-			}
-		}
-		vec<double, C> beta = err / denom;
-		ScaleAdd(p, *rnext, vec<T, C>(beta), p);
-		std::swap(rcurrent, rnext);
+		if (preconditioner)
+			preconditioner(z, r);
+		vec<double, C> rzNext = dotVec(r, *zptr);
+		ClampDenominator(rz);
+		vec<double, C> beta = rzNext / rz;
+		ScaleAdd(p, *zptr, vec<T, C>(beta), p);
+		rz = rzNext;
 	}
+	return iter;
 }
-template<class T, int C> void SolveVecBICGStab(const Vector<T, C>& b,
-		const SparseMatrix<T, C>& A, Vector<T, C>& x, int iters = 100,
-		T tolerance = 1E-6f,
+template<class T, int C> int SolveVecBICGStab(const Vector<T, C>& b,
+		const CompressedSparseMatrix<T, C>& A, Vector<T, C>& x,
+		const typename Preconditioner<T, C>::Function& preconditioner,
+		int iters = 100, T tolerance = 1E-6f,
 		const std::function<void(int, double)>& iterationMonitor = nullptr) {
 	const double ZERO_TOLERANCE = 1E-16;
 	size_t N = b.size();
 	Vector<T, C> p(N);
-	Vector<T, C> Ap(N);
-
 	Vector<T, C> r(N);
 	Vector<T, C> rinit;
 	Vector<T, C> delta(N);
 	Vector<T, C> v(N);
 	Vector<T, C> s(N);
 	Vector<T, C> t(N);
-
-	vec<double, C> err(T(0));
+	Vector<T, C> phat, shat;
+	Vector<T, C>* phatptr = &p;
+	Vector<T, C>* shatptr = &s;
+	if (preconditioner) {
+		phatptr = &phat;
+		shatptr = &shat;
+	}
 	v.set(vec<T, C>(T(0)));
 	p.set(vec<T, C>(T(0)));
 
-	vec<double, C> rhoNext;
+	vec<double, C> rhoNext(1);
 	vec<double, C> rho(1);
-	vec<T, C> alpha(1), beta;
-	vec<T, C> omega(1);
+	vec<double, C> alpha(1), beta(1);
+	vec<double, C> omega(1);
 
-	MultiplyVec(Ap, A, x);
-	Subtract(r, b, Ap);
+	SubtractMultiplyVec(r, b, A, x);
 	rinit = r;
-	err = lengthVecSqr(r);
-	double e = lengthL1(err) / N;
+	double e = lengthL1(lengthVecSqr(r)) / N;
 	if (iterationMonitor)
 		iterationMonitor(0, e);
-
-	for (int iter = 0; iter < iters; iter++) {
+	if (e < tolerance)
+		return 0;
+	int iter = 0;
+	while (iter < iters) {
 		rhoNext = dotVec(rinit, r);
-		beta = vec<T, C>((rhoNext / rho)) * (alpha / omega);
-		ScaleAdd(p, r, beta, p, -beta * omega, v);
-		MultiplyVec(v, A, p);
-		alpha = vec<T, C>(rhoNext / dotVec(rinit, v));
-		ScaleSubtract(s, r, alpha, v);
+		vec<double, C> denom = rho * omega;
+		ClampDenominator(denom);
+		beta = rhoNext * alpha / denom;
+		ScaleAdd(p, r, vec<T, C>(beta), p, vec<T, C>(-beta * omega), v);
+		if (preconditioner)
+			preconditioner(phat, p);
+		MultiplyVec(v, A, *phatptr);
+		denom = dotVec(rinit, v);
+		ClampDenominator(denom);
+		alpha = rhoNext / denom;
+		ScaleSubtract(s, r, vec<T, C>(alpha), v);
+		iter++;
 		if (lengthL1(s) < N * ZERO_TOLERANCE) {
-			ScaleAdd(x, x, alpha, p);
+			ScaleAdd(x, vec<T, C>(alpha), *phatptr);
+			if (iterationMonitor)
+				iterationMonitor(iter, lengthL1(lengthVecSqr(s)) / N);
 			break;
 		}
-		MultiplyVec(t, A, s);
-		omega = vec<T, C>(dotVec(t, s) / dotVec(t, t));
-		ScaleAdd(x, x, alpha, p, omega, s);
+		if (preconditioner)
+			preconditioner(shat, s);
+		MultiplyVec(t, A, *shatptr);
+		denom = dotVec(t, t);
+		ClampDenominator(denom);
+		omega = dotVec(t, s) / denom;
+		ScaleAdd(x, x, vec<T, C>(alpha), *phatptr, vec<T, C>(omega), *shatptr);
 
-		ScaleSubtract(r, s, omega, t);
+		ScaleSubtract(r, s, vec<T, C>(omega), t);
 		rho = rhoNext;
 
 		SubtractMultiplyVec(delta, b, A, x);
-		vec<double, C> err = lengthVecSqr(delta);
-		double e = lengthL1(err) / N;
+		e = lengthL1(lengthVecSqr(delta)) / N;
 		if (iterationMonitor)
-			iterationMonitor(iter + 1, e);
+			iterationMonitor(iter, e);
 		if (e < tolerance)
 			break;
-
 	}
+	return iter;
 }
-template<class T, int C> void SolveBICGStab(const Vector<T, C>& b,
-		const SparseMatrix<T, 1>& A, Vector<T, C>& x, int iters = 100,
-		T tolerance = 1E-6f,
+template<class T, int C> int SolveBICGStab(const Vector<T, C>& b,
+		const CompressedSparseMatrix<T, 1>& A, Vector<T, C>& x,
+		const typename Preconditioner<T, C>::Function& preconditioner,
+		int iters = 100, T tolerance = 1E-6f,
 		const std::function<void(int, double)>& iterationMonitor = nullptr) {
 	const double ZERO_TOLERANCE = 1E-16;
-
 	size_t N = b.size();
 	Vector<T, C> p(N);
 	Vector<T, C> r(N);
@@ -195,49 +468,621 @@ template<class T, int C> void SolveBICGStab(const Vector<T, C>& b,
 	Vector<T, C> v(N);
 	Vector<T, C> s(N);
 	Vector<T, C> t(N);
-
-	vec<double, C> err(T(0));
+	Vector<T, C> phat, shat;
+	Vector<T, C>* phatptr = &p;
+	Vector<T, C>* shatptr = &s;
+	if (preconditioner) {
+		phatptr = &phat;
+		shatptr = &shat;
+	}
 	v.set(vec<T, C>(T(0)));
 	p.set(vec<T, C>(T(0)));
 
 	vec<double, C> rhoNext(1);
 	vec<double, C> rho(1);
-	vec<T, C> alpha(1), beta(1);
-	vec<T, C> omega(1);
+	vec<double, C> alpha(1), beta(1);
+	vec<double, C> omega(1);
 
 	SubtractMultiply(r, b, A, x);
 	rinit = r;
-	err = lengthVecSqr(r);
-	double e = lengthL1(err) / N;
+	double e = lengthL1(lengthVecSqr(r)) / N;
 	if (iterationMonitor)
 		iterationMonitor(0, e);
-	for (int iter = 0; iter < iters; iter++) {
+	if (e < tolerance)
+		return 0;
+	int iter = 0;
+	while (iter < iters) {
 		rhoNext = dotVec(rinit, r);
-		beta = vec<T, C>((rhoNext / rho)) * (alpha / omega);
-		ScaleAdd(p, r, beta, p, -beta * omega, v);
-		Multiply(v, A, p);
-		alpha = vec<T, C>(rhoNext / dotVec(rinit, v));
-		ScaleSubtract(s, r, alpha, v);
+		vec<double, C> denom = rho * omega;
+		ClampDenominator(denom);
+		beta = rhoNext * alpha / denom;
+		ScaleAdd(p, r, vec<T, C>(beta), p, vec<T, C>(-beta * omega), v);
+		if (preconditioner)
+			preconditioner(phat, p);
+		Multiply(v, A, *phatptr);
+		denom = dotVec(rinit, v);
+		ClampDenominator(denom);
+		alpha = rhoNext / denom;
+		ScaleSubtract(s, r, vec<T, C>(alpha), v);
+		iter++;
 		if (lengthL1(s) < N * ZERO_TOLERANCE) {
-			ScaleAdd(x, alpha, p);
+			ScaleAdd(x, vec<T, C>(alpha), *phatptr);
+			if (iterationMonitor)
+				iterationMonitor(iter, lengthL1(lengthVecSqr(s)) / N);
 			break;
 		}
-		Multiply(t, A, s);
-		omega = vec<T, C>(dotVec(t, s) / dotVec(t, t));
-		ScaleAdd(x, x, alpha, p, omega, s);
+		if (preconditioner)
+			preconditioner(shat, s);
+		Multiply(t, A, *shatptr);
+		denom = dotVec(t, t);
+		ClampDenominator(denom);
+		omega = dotVec(t, s) / denom;
+		ScaleAdd(x, x, vec<T, C>(alpha), *phatptr, vec<T, C>(omega), *shatptr);
 
-		ScaleSubtract(r, s, omega, t);
+		ScaleSubtract(r, s, vec<T, C>(omega), t);
 		rho = rhoNext;
 
 		SubtractMultiply(delta, b, A, x);
-		vec<double, C> err = lengthVecSqr(delta);
-		double e = lengthL1(err) / N;
+		e = lengthL1(lengthVecSqr(delta)) / N;
 		if (iterationMonitor)
-			iterationMonitor(iter + 1, e);
+			iterationMonitor(iter, e);
 		if (e < tolerance)
 			break;
-
 	}
+	return iter;
+}
+template<class T, int C> int SolveVecCG(const Vector<T, C>& b,
+		const CompressedSparseMatrix<T, C>& A, Vector<T, C>& x, int iters = 100,
+		T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	return SolveVecCG(b, A, x, nullptr, iters, tolerance, iterationMonitor);
+}
+template<class T, int C> int SolveCG(const Vector<T, C>& b,
+		const CompressedSparseMatrix<T, 1>& A, Vector<T, C>& x, int iters = 100,
+		T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	return SolveCG(b, A, x, nullptr, iters, tolerance, iterationMonitor);
+}
+template<class T, int C> int SolveVecBICGStab(const Vector<T, C>& b,
+		const CompressedSparseMatrix<T, C>& A, Vector<T, C>& x, int iters = 100,
+		T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	return SolveVecBICGStab(b, A, x, nullptr, iters, tolerance, iterationMonitor);
+}
+template<class T, int C> int SolveBICGStab(const Vector<T, C>& b,
+		const CompressedSparseMatrix<T, 1>& A, Vector<T, C>& x, int iters = 100,
+		T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	return SolveBICGStab(b, A, x, nullptr, iters, tolerance, iterationMonitor);
+}
+template<class T, int C> int SolveVecCG(const Vector<T, C>& b,
+		const CompressedSparseMatrix<T, C>& A, Vector<T, C>& x,
+		PreconditionerType type, int iters = 100, T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	switch (type) {
+	case PreconditionerType::Jacobi: {
+		JacobiPreconditioner<T, C> M(A);
+		return SolveVecCG(b, A, x, [&M](Vector<T, C>& z, const Vector<T, C>& r) {M(z, r);},
+				iters, tolerance, iterationMonitor);
+	}
+	case PreconditionerType::IncompleteCholesky: {
+		IncompleteCholeskyPreconditioner<T, C> M(A);
+		return SolveVecCG(b, A, x, [&M](Vector<T, C>& z, const Vector<T, C>& r) {M(z, r);},
+				iters, tolerance, iterationMonitor);
+	}
+	case PreconditionerType::IncompleteLU: {
+		IncompleteLUPreconditioner<T, C> M(A);
+		return SolveVecCG(b, A, x, [&M](Vector<T, C>& z, const Vector<T, C>& r) {M(z, r);},
+				iters, tolerance, iterationMonitor);
+	}
+	default:
+		return SolveVecCG(b, A, x, nullptr, iters, tolerance, iterationMonitor);
+	}
+}
+template<class T, int C> int SolveCG(const Vector<T, C>& b,
+		const CompressedSparseMatrix<T, 1>& A, Vector<T, C>& x,
+		PreconditionerType type, int iters = 100, T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	switch (type) {
+	case PreconditionerType::Jacobi: {
+		JacobiPreconditioner<T, 1> M(A);
+		return SolveCG(b, A, x, [&M](Vector<T, C>& z, const Vector<T, C>& r) {M(z, r);},
+				iters, tolerance, iterationMonitor);
+	}
+	case PreconditionerType::IncompleteCholesky: {
+		IncompleteCholeskyPreconditioner<T, 1> M(A);
+		return SolveCG(b, A, x, [&M](Vector<T, C>& z, const Vector<T, C>& r) {M(z, r);},
+				iters, tolerance, iterationMonitor);
+	}
+	case PreconditionerType::IncompleteLU: {
+		IncompleteLUPreconditioner<T, 1> M(A);
+		return SolveCG(b, A, x, [&M](Vector<T, C>& z, const Vector<T, C>& r) {M(z, r);},
+				iters, tolerance, iterationMonitor);
+	}
+	default:
+		return SolveCG(b, A, x, nullptr, iters, tolerance, iterationMonitor);
+	}
+}
+template<class T, int C> int SolveVecBICGStab(const Vector<T, C>& b,
+		const CompressedSparseMatrix<T, C>& A, Vector<T, C>& x,
+		PreconditionerType type, int iters = 100, T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	switch (type) {
+	case PreconditionerType::Jacobi: {
+		JacobiPreconditioner<T, C> M(A);
+		return SolveVecBICGStab(b, A, x, [&M](Vector<T, C>& z, const Vector<T, C>& r) {M(z, r);},
+				iters, tolerance, iterationMonitor);
+	}
+	case PreconditionerType::IncompleteCholesky: {
+		IncompleteCholeskyPreconditioner<T, C> M(A);
+		return SolveVecBICGStab(b, A, x, [&M](Vector<T, C>& z, const Vector<T, C>& r) {M(z, r);},
+				iters, tolerance, iterationMonitor);
+	}
+	case PreconditionerType::IncompleteLU: {
+		IncompleteLUPreconditioner<T, C> M(A);
+		return SolveVecBICGStab(b, A, x, [&M](Vector<T, C>& z, const Vector<T, C>& r) {M(z, r);},
+				iters, tolerance, iterationMonitor);
+	}
+	default:
+		return SolveVecBICGStab(b, A, x, nullptr, iters, tolerance, iterationMonitor);
+	}
+}
+template<class T, int C> int SolveBICGStab(const Vector<T, C>& b,
+		const CompressedSparseMatrix<T, 1>& A, Vector<T, C>& x,
+		PreconditionerType type, int iters = 100, T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	switch (type) {
+	case PreconditionerType::Jacobi: {
+		JacobiPreconditioner<T, 1> M(A);
+		return SolveBICGStab(b, A, x, [&M](Vector<T, C>& z, const Vector<T, C>& r) {M(z, r);},
+				iters, tolerance, iterationMonitor);
+	}
+	case PreconditionerType::IncompleteCholesky: {
+		IncompleteCholeskyPreconditioner<T, 1> M(A);
+		return SolveBICGStab(b, A, x, [&M](Vector<T, C>& z, const Vector<T, C>& r) {M(z, r);},
+				iters, tolerance, iterationMonitor);
+	}
+	case PreconditionerType::IncompleteLU: {
+		IncompleteLUPreconditioner<T, 1> M(A);
+		return SolveBICGStab(b, A, x, [&M](Vector<T, C>& z, const Vector<T, C>& r) {M(z, r);},
+				iters, tolerance, iterationMonitor);
+	}
+	default:
+		return SolveBICGStab(b, A, x, nullptr, iters, tolerance, iterationMonitor);
+	}
+}
+enum class SparseOrdering {
+	Natural = 0, MinimumDegree = 1, NestedDissection = 2
+};
+/*
+ * Simplicial sparse LDL^T factorization P*A*P^T = L*D*L^T for symmetric matrices. analyze() computes the
+ * fill-reducing ordering and the symbolic structure of L, factor() computes the numeric values, and solve()
+ * only runs the triangular solves. When the sparsity pattern stays fixed, call analyze() once and factor()
+ * again whenever the values change. A must be symmetric, but it may be indefinite as long as no pivot is zero.
+ */
+template<class T> class SparseLDLT {
+protected:
+	size_t N;
+	std::vector<uint32_t> permutation;
+	std::vector<uint32_t> inversePermutation;
+	std::vector<int> parent;
+	std::vector<size_t> columnOffsets;
+	std::vector<size_t> columnCounts;
+	std::vector<uint32_t> rowIndexes;
+	std::vector<double> lowerValues;
+	std::vector<double> diagonal;
+	size_t patternNonZeros;
+	bool analyzed;
+	bool factored;
+	void minimumDegree(const CompressedSparseMatrix<T, 1>& A) {
+		std::vector<std::vector<uint32_t>> adjacency(N);
+		for (size_t i = 0; i < N; i++) {
+			for (size_t idx = A.rowOffsets[i]; idx < A.rowOffsets[i + 1];
+					idx++) {
+				uint32_t j = A.columns[idx];
+				if (j < i) {
+					adjacency[i].push_back(j);
+					adjacency[j].push_back((uint32_t) i);
+				}
+			}
+		}
+		std::set<std::pair<size_t, uint32_t>> queue;
+		for (size_t i = 0; i < N; i++) {
+			std::vector<uint32_t>& nbrs = adjacency[i];
+			std::sort(nbrs.begin(), nbrs.end());
+			nbrs.erase(std::unique(nbrs.begin(), nbrs.end()), nbrs.end());
+			queue.insert(std::pair<size_t, uint32_t>(nbrs.size(), (uint32_t) i));
+		}
+		//Eliminating a vertex connects its remaining neighbors into a clique.
+		std::vector<uint32_t> nbrs, merged;
+		for (size_t k = 0; k < N; k++) {
+			uint32_t v = queue.begin()->second;
+			queue.erase(queue.begin());
+			permutation[k] = v;
+			nbrs.swap(adjacency[v]);
+			std::vector<uint32_t>().swap(adjacency[v]);
+			for (uint32_t u : nbrs) {
+				std::vector<uint32_t>& unbrs = adjacency[u];
+				queue.erase(std::pair<size_t, uint32_t>(unbrs.size(), u));
+				merged.clear();
+				merged.reserve(unbrs.size() + nbrs.size());
+				auto a = unbrs.begin(), b = nbrs.begin();
+				while (a != unbrs.end() || b != nbrs.end()) {
+					uint32_t w;
+					if (b == nbrs.end() || (a != unbrs.end() && *a < *b)) {
+						w = *a++;
+					} else if (a == unbrs.end() || *b < *a) {
+						w = *b++;
+					} else {
+						w = *a++;
+						b++;
+					}
+					if (w != u && w != v)
+						merged.push_back(w);
+				}
+				unbrs.swap(merged);
+				queue.insert(std::pair<size_t, uint32_t>(unbrs.size(), u));
+			}
+		}
+	}
+	//George's automatic nested dissection. The middle BFS level from a pseudo-peripheral vertex separates each region and is numbered last.
+	void nestedDissection(const CompressedSparseMatrix<T, 1>& A) {
+		const size_t LEAF_SIZE = 64;
+		std::vector<size_t> offsets(N + 1, 0);
+		for (size_t i = 0; i < N; i++) {
+			for (size_t idx = A.rowOffsets[i]; idx < A.rowOffsets[i + 1];
+					idx++) {
+				uint32_t j = A.columns[idx];
+				if (j < i) {
+					offsets[i + 1]++;
+					offsets[j + 1]++;
+				}
+			}
+		}
+		for (size_t i = 0; i < N; i++) {
+			offsets[i + 1] += offsets[i];
+		}
+		std::vector<uint32_t> adjacency(offsets[N]);
+		{
+			std::vector<size_t> pos(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < N; i++) {
+				for (size_t idx = A.rowOffsets[i]; idx < A.rowOffsets[i + 1];
+						idx++) {
+					uint32_t j = A.columns[idx];
+					if (j < i) {
+						adjacency[pos[i]++] = j;
+						adjacency[pos[j]++] = (uint32_t) i;
+					}
+				}
+			}
+		}
+		std::vector<uint32_t> region(N, 0);
+		std::vector<int> level(N, -1);
+		std::vector<uint32_t> queue;
+		queue.reserve(N);
+		uint32_t regionCount = 1;
+		auto bfs = [&](uint32_t root, uint32_t id) {
+			queue.clear();
+			queue.push_back(root);
+			level[root] = 0;
+			for (size_t q = 0; q < queue.size(); q++) {
+				uint32_t u = queue[q];
+				for (size_t idx = offsets[u]; idx < offsets[u + 1]; idx++) {
+					uint32_t w = adjacency[idx];
+					if (region[w] == id && level[w] < 0) {
+						level[w] = level[u] + 1;
+						queue.push_back(w);
+					}
+				}
+			}
+		};
+		std::vector<std::pair<std::vector<uint32_t>, size_t>> stack;
+		{
+			std::vector<uint32_t> all(N);
+			for (size_t i = 0; i < N; i++) {
+				all[i] = (uint32_t) i;
+			}
+			stack.push_back(std::make_pair(std::move(all), N));
+		}
+		while (!stack.empty()) {
+			std::vector<uint32_t> nodes = std::move(stack.back().first);
+			size_t last = stack.back().second;
+			stack.pop_back();
+			uint32_t id = regionCount++;
+			for (uint32_t v : nodes) {
+				region[v] = id;
+				level[v] = -1;
+			}
+			uint32_t root = nodes.front();
+			bfs(root, id);
+			if (queue.size() < nodes.size()) {
+				//Disconnected region. Each connected component is ordered independently.
+				stack.push_back(std::make_pair(queue, last));
+				last -= queue.size();
+				for (uint32_t v : nodes) {
+					if (level[v] < 0) {
+						bfs(v, id);
+						stack.push_back(std::make_pair(queue, last));
+						last -= queue.size();
+					}
+				}
+				continue;
+			}
+			if (nodes.size() > LEAF_SIZE) {
+				for (int pass = 0; pass < 2; pass++) {
+					uint32_t next = queue.back();
+					if (level[next] <= level[root])
+						break;
+					for (uint32_t v : queue) {
+						level[v] = -1;
+					}
+					root = next;
+					bfs(root, id);
+				}
+			}
+			int depth = level[queue.back()];
+			if (nodes.size() <= LEAF_SIZE || depth < 2) {
+				size_t first = last - queue.size();
+				for (size_t q = 0; q < queue.size(); q++) {
+					permutation[first + q] = queue[q];
+				}
+				continue;
+			}
+			int mid = depth / 2;
+			std::vector<uint32_t> lower, upper;
+			size_t sepCount = 0;
+			for (uint32_t v : queue) {
+				if (level[v] < mid) {
+					lower.push_back(v);
+				} else if (level[v] > mid) {
+					upper.push_back(v);
+				} else {
+					permutation[last - (++sepCount)] = v;
+				}
+			}
+			size_t upperLast = last - sepCount;
+			size_t lowerLast = upperLast - upper.size();
+			stack.push_back(std::make_pair(std::move(upper), upperLast));
+			stack.push_back(std::make_pair(std::move(lower), lowerLast));
+		}
+	}
+public:
+	SparseLDLT() :
+			N(0), patternNonZeros(0), analyzed(false), factored(false) {
+	}
+	SparseLDLT(const CompressedSparseMatrix<T, 1>& A, SparseOrdering ordering =
+			SparseOrdering::NestedDissection) :
+			N(0), patternNonZeros(0), analyzed(false), factored(false) {
+		compute(A, ordering);
+	}
+	SparseLDLT(const SparseMatrix<T, 1>& A, SparseOrdering ordering =
+			SparseOrdering::NestedDissection) :
+			N(0), patternNonZeros(0), analyzed(false), factored(false) {
+		compute(CompressedSparseMatrix<T, 1>(A), ordering);
+	}
+	void compute(const CompressedSparseMatrix<T, 1>& A,
+			SparseOrdering ordering = SparseOrdering::NestedDissection) {
+		analyze(A, ordering);
+		factor(A);
+	}
+	//Symbolic factorization. Depends only on the sparsity pattern of A.
+	void analyze(const CompressedSparseMatrix<T, 1>& A,
+			SparseOrdering ordering = SparseOrdering::NestedDissection) {
+		if (A.rows != A.cols)
+			throw std::runtime_error(
+					MakeString() << "LDLT requires a square matrix, not ["
+							<< A.rows << "," << A.cols << "]");
+		N = A.rows;
+		analyzed = false;
+		factored = false;
+		permutation.resize(N);
+		inversePermutation.resize(N);
+		if (ordering == SparseOrdering::MinimumDegree) {
+			minimumDegree(A);
+		} else if (ordering == SparseOrdering::NestedDissection) {
+			nestedDissection(A);
+		} else {
+			for (size_t k = 0; k < N; k++) {
+				permutation[k] = (uint32_t) k;
+			}
+		}
+		for (size_t k = 0; k < N; k++) {
+			inversePermutation[permutation[k]] = (uint32_t) k;
+		}
+		//Elimination tree and column counts of L, row by row.
+		std::vector<uint32_t> flag(N);
+		parent.assign(N, -1);
+		columnCounts.assign(N, 0);
+		for (size_t k = 0; k < N; k++) {
+			flag[k] = (uint32_t) k;
+			uint32_t kk = permutation[k];
+			for (size_t idx = A.rowOffsets[kk]; idx < A.rowOffsets[kk + 1];
+					idx++) {
+				size_t i = inversePermutation[A.columns[idx]];
+				if (i >= k)
+					continue;
+				for (; flag[i] != k; i = parent[i]) {
+					if (parent[i] == -1)
+						parent[i] = (int) k;
+					columnCounts[i]++;
+					flag[i] = (uint32_t) k;
+				}
+			}
+		}
+		columnOffsets.resize(N + 1);
+		columnOffsets[0] = 0;
+		for (size_t k = 0; k < N; k++) {
+			columnOffsets[k + 1] = columnOffsets[k] + columnCounts[k];
+		}
+		rowIndexes.resize(columnOffsets[N]);
+		lowerValues.resize(columnOffsets[N]);
+		diagonal.resize(N);
+		patternNonZeros = A.nonZeros();
+		analyzed = true;
+	}
+	//Numeric factorization. A must have the sparsity pattern passed to analyze().
+	void factor(const CompressedSparseMatrix<T, 1>& A) {
+		if (!analyzed || A.rows != N || A.nonZeros() != patternNonZeros)
+			throw std::runtime_error(
+					"LDLT numeric factorization requires analyze() with the same sparsity pattern.");
+		factored = false;
+		std::vector<double> y(N, 0.0);
+		std::vector<uint32_t> pattern(N);
+		std::vector<uint32_t> flag(N);
+		for (size_t k = 0; k < N; k++) {
+			size_t top = N;
+			flag[k] = (uint32_t) k;
+			columnCounts[k] = 0;
+			uint32_t kk = permutation[k];
+			for (size_t idx = A.rowOffsets[kk]; idx < A.rowOffsets[kk + 1];
+					idx++) {
+				size_t i = inversePermutation[A.columns[idx]];
+				if (i > k)
+					continue;
+				y[i] += A.values[idx].x;
+				size_t len = 0;
+				for (; flag[i] != k; i = parent[i]) {
+					pattern[len++] = (uint32_t) i;
+					flag[i] = (uint32_t) k;
+				}
+				while (len > 0) {
+					pattern[--top] = pattern[--len];
+				}
+			}
+			double d = y[k];
+			y[k] = 0.0;
+			for (; top < N; top++) {
+				size_t i = pattern[top];
+				double yi = y[i];
+				y[i] = 0.0;
+				size_t end = columnOffsets[i] + columnCounts[i];
+				for (size_t p = columnOffsets[i]; p < end; p++) {
+					y[rowIndexes[p]] -= lowerValues[p] * yi;
+				}
+				double lki = yi / diagonal[i];
+				d -= lki * yi;
+				rowIndexes[end] = (uint32_t) k;
+				lowerValues[end] = lki;
+				columnCounts[i]++;
+			}
+			if (d == 0.0)
+				throw std::runtime_error(
+						MakeString() << "LDLT encountered a zero pivot in row "
+								<< kk << ".");
+			diagonal[k] = d;
+		}
+		factored = true;
+	}
+	void factor(const SparseMatrix<T, 1>& A) {
+		factor(CompressedSparseMatrix<T, 1>(A));
+	}
+	template<int C> void solve(const Vector<T, C>& b, Vector<T, C>& x) const {
+		if (!factored)
+			throw std::runtime_error("LDLT solve requires a numeric factorization.");
+		if (b.size() != N)
+			throw std::runtime_error(
+					MakeString() << "Vector dimensions do not match. "
+							<< b.size() << "!=" << N);
+		std::vector<vec<double, C>> y(N);
+		for (size_t k = 0; k < N; k++) {
+			y[k] = vec<double, C>(b.data[permutation[k]]);
+		}
+		for (size_t j = 0; j < N; j++) {
+			const vec<double, C> yj = y[j];
+			for (size_t p = columnOffsets[j]; p < columnOffsets[j + 1]; p++) {
+				y[rowIndexes[p]] -= lowerValues[p] * yj;
+			}
+		}
+		for (size_t j = 0; j < N; j++) {
+			y[j] /= diagonal[j];
+		}
+		for (size_t j = N; j > 0; j--) {
+			vec<double, C>& yj = y[j - 1];
+			for (size_t p = columnOffsets[j - 1]; p < columnOffsets[j]; p++) {
+				yj -= lowerValues[p] * y[rowIndexes[p]];
+			}
+		}
+		x.resize(N);
+		for (size_t k = 0; k < N; k++) {
+			x.data[permutation[k]] = vec<T, C>(y[k]);
+		}
+	}
+	template<int C> Vector<T, C> solve(const Vector<T, C>& b) const {
+		Vector<T, C> x;
+		solve(b, x);
+		return x;
+	}
+	size_t size() const {
+		return N;
+	}
+	//Number of stored entries of L and D.
+	size_t nonZeros() const {
+		return columnOffsets.empty() ? 0 : columnOffsets[N] + N;
+	}
+	bool isAnalyzed() const {
+		return analyzed;
+	}
+	bool isFactored() const {
+		return factored;
+	}
+	const std::vector<uint32_t>& getPermutation() const {
+		return permutation;
+	}
+};
+typedef SparseLDLT<float> SparseLDLTf;
+typedef SparseLDLT<double> SparseLDLTd;
+//Compresses the matrix once so every product inside the solver runs on CSR storage.
+template<class T, int C> int SolveVecCG(const Vector<T, C>& b,
+		const SparseMatrix<T, C>& A, Vector<T, C>& x, int iters = 100,
+		T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	return SolveVecCG(b, CompressedSparseMatrix<T, C>(A), x, iters, tolerance, iterationMonitor);
+}
+template<class T, int C> int SolveCG(const Vector<T, C>& b,
+		const SparseMatrix<T, 1>& A, Vector<T, C>& x, int iters = 100,
+		T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	return SolveCG(b, CompressedSparseMatrix<T, 1>(A), x, iters, tolerance, iterationMonitor);
+}
+template<class T, int C> int SolveVecBICGStab(const Vector<T, C>& b,
+		const SparseMatrix<T, C>& A, Vector<T, C>& x, int iters = 100,
+		T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	return SolveVecBICGStab(b, CompressedSparseMatrix<T, C>(A), x, iters, tolerance, iterationMonitor);
+}
+template<class T, int C> int SolveBICGStab(const Vector<T, C>& b,
+		const SparseMatrix<T, 1>& A, Vector<T, C>& x, int iters = 100,
+		T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	return SolveBICGStab(b, CompressedSparseMatrix<T, 1>(A), x, iters, tolerance, iterationMonitor);
+}
+template<class T, int C> int SolveVecCG(const Vector<T, C>& b,
+		const SparseMatrix<T, C>& A, Vector<T, C>& x, PreconditionerType type,
+		int iters = 100, T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	return SolveVecCG(b, CompressedSparseMatrix<T, C>(A), x, type, iters, tolerance,
+			iterationMonitor);
+}
+template<class T, int C> int SolveCG(const Vector<T, C>& b,
+		const SparseMatrix<T, 1>& A, Vector<T, C>& x, PreconditionerType type,
+		int iters = 100, T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	return SolveCG(b, CompressedSparseMatrix<T, 1>(A), x, type, iters, tolerance,
+			iterationMonitor);
+}
+template<class T, int C> int SolveVecBICGStab(const Vector<T, C>& b,
+		const SparseMatrix<T, C>& A, Vector<T, C>& x, PreconditionerType type,
+		int iters = 100, T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	return SolveVecBICGStab(b, CompressedSparseMatrix<T, C>(A), x, type, iters, tolerance,
+			iterationMonitor);
+}
+template<class T, int C> int SolveBICGStab(const Vector<T, C>& b,
+		const SparseMatrix<T, 1>& A, Vector<T, C>& x, PreconditionerType type,
+		int iters = 100, T tolerance = 1E-6f,
+		const std::function<void(int, double)>& iterationMonitor = nullptr) {
+	return SolveBICGStab(b, CompressedSparseMatrix<T, 1>(A), x, type, iters, tolerance,
+			iterationMonitor);
 }
 }
 #endif
@@ -22,6 +22,8 @@
 #define ALLOYSPLINE_H_
 #include "tinysplinecpp.h"
 #include "AlloyVector.h"
+#include <algorithm>
+#include <cstring>
 namespace aly {
 	enum class SplineType {
 		Open = TS_OPENED,
@@ -32,6 +34,77 @@ namespace aly {
 	template<int C> class BSpline {
 	protected:
 		TsBSpline spline;
+		static const size_t EVALUATE_BATCH_SIZE = 1024;
+		//Knot span k with knots[k] <= u < knots[k+1], starting from the span of the previous sample.
+		size_t findSpan(float u, size_t hint) const {
+			const float* knots = spline.knots();
+			const size_t deg = spline.deg();
+			const size_t last = spline.nCtrlp() - 1;
+			if (hint >= deg && hint <= last && u >= knots[hint] && (u < knots[hint + 1] || hint == last)) {
+				return hint;
+			}
+			if (hint >= deg && hint < last && u >= knots[hint + 1] && (u < knots[hint + 2] || hint + 1 == last)) {
+				return hint + 1;
+			}
+			size_t k = (size_t)(std::upper_bound(knots + deg, knots + last + 1, u) - knots) - 1;
+			k = std::max(deg, std::min(k, last));
+			while (k > deg && knots[k] == knots[k + 1]) {
+				k--;
+			}
+			return k;
+		}
+		/*
+		 De Boor's algorithm on a caller supplied scratch buffer of order() points. The derivative
+		 is p*(d1-d0)/(u[k+1]-u[k]) from the two points left before the last step.
+		 */
+		vec<float, C> evaluate(float u, size_t k, vec<float, C>* d, vec<float, C>* derivative) const {
+			const float* knots = spline.knots();
+			const vec<float, C>* ctrlp = reinterpret_cast<const vec<float, C>*>(spline.ctrlp());
+			const size_t p = spline.deg();
+			for (size_t j = 0; j <= p; j++) {
+				d[j] = ctrlp[j + k - p];
+			}
+			for (size_t r = 1; r <= p; r++) {
+				if (r == p && derivative != nullptr) {
+					*derivative = (d[p] - d[p - 1]) * (p / (knots[k + 1] - knots[k]));
+				}
+				for (size_t j = p; j >= r; j--) {
+					const float ul = knots[j + k - p];
+					const float alpha = (u - ul) / (knots[j + 1 + k - r] - ul);
+					d[j] = (1.0f - alpha) * d[j - 1] + alpha * d[j];
+				}
+			}
+			if (p == 0 && derivative != nullptr) {
+				*derivative = vec<float, C>(0.0f);
+			}
+			return d[p];
+		}
+		void evaluate(const float* u, size_t N, Vector<float, C>& out, Vector<float, C>* derivatives) const {
+			const size_t order = spline.order();
+			const float umin = spline.knots()[spline.deg()];
+			const float umax = spline.knots()[spline.nCtrlp()];
+			for (size_t n = 0; n < N; n++) {
+				if ((u[n] < umin && !ts_fequals(u[n], umin)) || (u[n] > umax && !ts_fequals(u[n], umax))) {
+					throw std::runtime_error(MakeString() << "Error: Spline parameter " << u[n] << " outside domain [" << umin << "," << umax << "]");
+				}
+			}
+			out.resize(N);
+			if (derivatives != nullptr) {
+				derivatives->resize(N);
+			}
+			const int batches = (int)((N + EVALUATE_BATCH_SIZE - 1) / EVALUATE_BATCH_SIZE);
+#pragma omp parallel for if(batches > 1)
+			for (int b = 0; b < batches; b++) {
+				std::vector<vec<float, C>> scratch(order);
+				size_t k = spline.deg();
+				const size_t end = std::min(N, (b + 1) * EVALUATE_BATCH_SIZE);
+				for (size_t n = b * EVALUATE_BATCH_SIZE; n < end; n++) {
+					const float un = clamp(u[n], umin, umax);
+					k = findSpan(un, k);
+					out[n] = evaluate(un, k, scratch.data(), (derivatives != nullptr) ? &(*derivatives)[n] : nullptr);
+				}
+			}
+		}
 	public:
 		size_t getDegree() const {
 			return spline.deg();
@@ -63,6 +136,23 @@ namespace aly {
 			std::memcpy(&out[0], net.result(), sizeof(vec<float, C>));
 			return out;
 		}
+		/*
+		 Evaluates the curve (and optionally its first derivative) at many parameters without per-sample
+		 allocation. Sorted parameters reuse the knot span of the previous sample and large batches are
+		 evaluated in parallel.
+		 */
+		void evaluate(const std::vector<float>& u, Vector<float, C>& out) const {
+			evaluate(u.data(), u.size(), out, nullptr);
+		}
+		void evaluate(const std::vector<float>& u, Vector<float, C>& out, Vector<float, C>& derivatives) const {
+			evaluate(u.data(), u.size(), out, &derivatives);
+		}
+		void evaluate(const Vector1f& u, Vector<float, C>& out) const {
+			evaluate(u.ptr(), u.size(), out, nullptr);
+		}
+		void evaluate(const Vector1f& u, Vector<float, C>& out, Vector<float, C>& derivatives) const {
+			evaluate(u.ptr(), u.size(), out, &derivatives);
+		}
 		float getKnot(size_t n) const {
 			if (n >= spline.nKnots()) {
 				throw std::runtime_error(MakeString()<<"Knot index out of range " << n << "/" << spline.nKnots());
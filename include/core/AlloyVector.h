@@ -28,12 +28,147 @@
 #include <iomanip>
 #include <limits>
 #include <algorithm>
+#include <memory>
 #include "cereal/types/vector.hpp"
 #include "cereal/types/string.hpp"
 namespace aly {
 bool SANITY_CHECK_LINALG();
 
-template<class T, int C> struct Vector {
+template<class T, int C> struct Vector;
+/*
+ Component k of an expression in the interleaved layout of the reduction engine, Vectors read memory directly.
+ */
+template<class E, class T, int C> struct VectorComponents {
+	const E& expr;
+	VectorComponents(const E& expr) :
+			expr(expr) {
+	}
+	T operator()(size_t k) const {
+		return vec<T, C>(expr[k / C])[k % C];
+	}
+};
+template<class T, int C> struct VectorComponents<Vector<T, C>, T, C> {
+	const T* ptr;
+	VectorComponents(const Vector<T, C>& v) :
+			ptr(v.ptr()) {
+	}
+	T operator()(size_t k) const {
+		return ptr[k];
+	}
+};
+/*
+ Lazy element-wise expressions over Vectors. Operators build a tree of expression nodes and assignment
+ evaluates the whole tree in one parallel loop, so a*x+b*y-z streams memory once without temporaries.
+ Nested nodes and temporary Vectors are held by value, named Vectors by reference, so an expression
+ must not outlive the named Vectors it reads. Reductions run directly on the expression, eval() gives
+ a Vector for functions that need one.
+ Veldhuizen, T. (1995). Expression templates. C++ Report, 7(5), 26-31.
+ */
+template<class E, class T, int C> struct VectorExpression {
+	const E& derived() const {
+		return static_cast<const E&>(*this);
+	}
+	Vector<T, C> eval() const {
+		return Vector<T, C>(derived());
+	}
+	vec<T, C> min() const {
+		return ParallelReduce<ReduceMin, T, C>(derived().size() * C,
+				VectorComponents<E, T, C>(derived()));
+	}
+	vec<T, C> max() const {
+		return ParallelReduce<ReduceMax, T, C>(derived().size() * C,
+				VectorComponents<E, T, C>(derived()));
+	}
+	std::pair<vec<T, C>, vec<T, C>> range() const {
+		return ParallelRange<T, C>(derived().size() * C,
+				VectorComponents<E, T, C>(derived()));
+	}
+	vec<T, C> mean(Summation method = Summation::Pairwise) const {
+		VectorComponents<E, T, C> e(derived());
+		vec<double, C> mean = ParallelSum<double, C>(derived().size() * C,
+				[=](size_t k) {return (double) e(k);}, method);
+		mean = mean / (double) derived().size();
+		return vec<T, C>(mean);
+	}
+	vec<T, C> median() const {
+		return eval().median();
+	}
+	vec<T, C> mad() const {
+		return eval().mad();
+	}
+	vec<T, C> madStdDev() const {
+		return eval().madStdDev();
+	}
+	vec<T, C> stdDev() const {
+		return eval().stdDev();
+	}
+};
+template<class E> struct VectorOperand {
+	typedef const E type;
+};
+template<class T, int C> struct VectorOperand<Vector<T, C>> {
+	typedef const Vector<T, C>& type;
+};
+template<class L, class R, class Op, class T, int C> struct VectorBinaryExpression: public VectorExpression<
+		VectorBinaryExpression<L, R, Op, T, C>, T, C> {
+	typename VectorOperand<L>::type lhs;
+	typename VectorOperand<R>::type rhs;
+	VectorBinaryExpression(const L& lhs, const R& rhs) :
+			lhs(lhs), rhs(rhs) {
+		if (lhs.size() != rhs.size())
+			throw std::runtime_error(
+					MakeString() << "Vector dimensions do not match. "
+							<< lhs.size() << "!=" << rhs.size());
+	}
+	vec<T, C> operator[](size_t i) const {
+		return Op::apply(vec<T, C>(lhs[i]), vec<T, C>(rhs[i]));
+	}
+	size_t size() const {
+		return lhs.size();
+	}
+};
+template<class E, class Op, class T, int C> struct VectorScalarLeftExpression: public VectorExpression<
+		VectorScalarLeftExpression<E, Op, T, C>, T, C> {
+	const vec<T, C> scalar;
+	typename VectorOperand<E>::type expr;
+	VectorScalarLeftExpression(const vec<T, C>& scalar, const E& expr) :
+			scalar(scalar), expr(expr) {
+	}
+	vec<T, C> operator[](size_t i) const {
+		return Op::apply(scalar, vec<T, C>(expr[i]));
+	}
+	size_t size() const {
+		return expr.size();
+	}
+};
+template<class E, class Op, class T, int C> struct VectorScalarRightExpression: public VectorExpression<
+		VectorScalarRightExpression<E, Op, T, C>, T, C> {
+	typename VectorOperand<E>::type expr;
+	const vec<T, C> scalar;
+	VectorScalarRightExpression(const E& expr, const vec<T, C>& scalar) :
+			expr(expr), scalar(scalar) {
+	}
+	vec<T, C> operator[](size_t i) const {
+		return Op::apply(vec<T, C>(expr[i]), scalar);
+	}
+	size_t size() const {
+		return expr.size();
+	}
+};
+template<class E, class T, int C> struct VectorNegateExpression: public VectorExpression<
+		VectorNegateExpression<E, T, C>, T, C> {
+	typename VectorOperand<E>::type expr;
+	VectorNegateExpression(const E& expr) :
+			expr(expr) {
+	}
+	vec<T, C> operator[](size_t i) const {
+		return -vec<T, C>(expr[i]);
+	}
+	size_t size() const {
+		return expr.size();
+	}
+};
+template<class T, int C> struct Vector: public VectorExpression<Vector<T, C>, T, C> {
 public:
 	std::vector<vec<T, C>> data;
 	const int channels = C;
@@ -117,6 +252,25 @@ public:
 			Vector(img.size()) {
 		set(img.data);
 	}
+	Vector(Vector<T, C>&& img) noexcept :
+			data(std::move(img.data)) {
+	}
+	template<class E> Vector(const VectorExpression<E, T, C>& expr) {
+		*this = expr;
+	}
+	const Vector<T, C>& eval() const {
+		return *this;
+	}
+	template<class E> Vector<T, C>& operator=(const VectorExpression<E, T, C>& expr) {
+		const E& e = expr.derived();
+		size_t sz = e.size();
+		data.resize(sz);
+#pragma omp parallel for
+		for (int offset = 0; offset < (int) sz; offset++) {
+			data[offset] = e[offset];
+		}
+		return *this;
+	}
 	Vector<T, C>& operator=(const Vector<T, C>& rhs) {
 		if (this == &rhs)
 			return *this;
@@ -127,6 +281,13 @@ public:
 		}
 		return *this;
 	}
+	Vector<T, C>& operator=(Vector<T, C>&& rhs) noexcept {
+		if (this == &rhs)
+			return *this;
+		data = std::move(rhs.data);
+		rhs.data.clear();
+		return *this;
+	}
 	Vector() {
 	}
 	Vector(T* ptr, size_t sz) :
@@ -192,33 +353,24 @@ public:
 		data.shrink_to_fit();
 	}
 	vec<T, C> min() const {
-		vec<T, C> minVal(std::numeric_limits<T>::max());
-		for (const vec<T, C>& val : data) {
-			minVal = aly::minVec(val, minVal);
-		}
-		return minVal;
+		const T* ptr = this->ptr();
+		return ParallelReduce<ReduceMin, T, C>(data.size() * C,
+				[=](size_t k) {return ptr[k];});
 	}
 	vec<T, C> max() const {
-		vec<T, C> maxVal(std::numeric_limits<T>::min());
-		for (const vec<T, C>& val : data) {
-			maxVal = aly::maxVec(val, maxVal);
-		}
-		return maxVal;
+		const T* ptr = this->ptr();
+		return ParallelReduce<ReduceMax, T, C>(data.size() * C,
+				[=](size_t k) {return ptr[k];});
 	}
 	std::pair<vec<T, C>, vec<T, C>> range() const {
-		vec<T, C> maxVal(std::numeric_limits<T>::min());
-		vec<T, C> minVal(std::numeric_limits<T>::max());
-		for (const vec<T, C>& val : data) {
-			maxVal = aly::maxVec(val, maxVal);
-			minVal = aly::minVec(val, minVal);
-		}
-		return std::pair<vec<T, C>, vec<T, C>>(minVal, maxVal);
-	}
-	vec<T, C> mean() const {
-		vec<double, C> mean(0.0);
-		for (const vec<T, C>& val : data) {
-			mean += vec<double, C>(val);
-		}
+		const T* ptr = this->ptr();
+		return ParallelRange<T, C>(data.size() * C,
+				[=](size_t k) {return ptr[k];});
+	}
+	vec<T, C> mean(Summation method = Summation::Pairwise) const {
+		const T* ptr = this->ptr();
+		vec<double, C> mean = ParallelSum<double, C>(data.size() * C,
+				[=](size_t k) {return (double) ptr[k];}, method);
 		mean = mean / (double) data.size();
 		return vec<T, C>(mean);
 	}
@@ -306,6 +458,23 @@ public:
 	}
 };
 
+/*
+ Owns an rvalue Vector used as an operand, so expressions such as auto e = A * x - b stay valid.
+ */
+template<class T, int C> struct VectorTemporary: public VectorExpression<
+		VectorTemporary<T, C>, T, C> {
+	std::shared_ptr<const Vector<T, C>> value;
+	VectorTemporary(Vector<T, C>&& v) :
+			value(std::make_shared<const Vector<T, C>>(std::move(v))) {
+	}
+	const vec<T, C>& operator[](size_t i) const {
+		return value->data[i];
+	}
+	size_t size() const {
+		return value->size();
+	}
+};
+
 template<class T, int C> void Transform(Vector<T, C>& im1, Vector<T, C>& im2,
 		const std::function<void(vec<T, C>&, vec<T, C>&)>& func) {
 	if (im1.size() != im2.size())
@@ -382,379 +551,329 @@ template<class T, int C> void Transform(Vector<T, C>& im1, Vector<T, C>& im2,
 		func(offset, im1.data[offset], im2.data[offset]);
 	}
 }
-template<class T, class L, class R, int C> std::basic_ostream<L, R> & operator <<(
-		std::basic_ostream<L, R> & ss, const Vector<T, C> & A) {
-	size_t index = 0;
-	for (const vec<T, C>& val : A.data) {
-		ss << std::setw(5) << index++ << ": " << val << std::endl;
+template<class E, class T, class L, class R, int C> std::basic_ostream<L, R> & operator <<(
+		std::basic_ostream<L, R> & ss, const VectorExpression<E, T, C> & expr) {
+	const E& A = expr.derived();
+	for (size_t index = 0; index < A.size(); index++) {
+		ss << std::setw(5) << index << ": " << vec<T, C>(A[index]) << std::endl;
 	}
 	return ss;
 }
-template<class T, int C> Vector<T, C> operator+(const vec<T, C>& scalar,
-		const Vector<T, C>& img) {
-	Vector<T, C> out(img.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 = scalar + val2;};
-	Transform(out, img, f);
-	return out;
-}
-template<class T, int C> void ScaleAdd(Vector<T, C>& out,
-		const vec<T, C>& scalar, const Vector<T, C>& in) {
-	out.resize(in.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 += scalar * val2;};
-	Transform(out, in, f);
-}
-template<class T, int C> void ScaleAdd(Vector<T, C>& out,
-		const Vector<T, C>& in1, const vec<T, C>& scalar,
-		const Vector<T, C>& in2) {
-	out.resize(in1.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2, const vec<T, C>& val3) {val1 = val2+scalar * val3;};
-	Transform(out, in1, in2, f);
+template<class E, class T, int C> VectorScalarLeftExpression<E, ElementAdd, T, C> operator+(
+		const vec<T, C>& scalar, const VectorExpression<E, T, C>& expr) {
+	return VectorScalarLeftExpression<E, ElementAdd, T, C>(scalar, expr.derived());
 }
-template<class T, int C> void ScaleAdd(Vector<T, C>& out,
-		const Vector<T, C>& in1, const vec<T, C>& scalar2,
-		const Vector<T, C>& in2, const vec<T, C>& scalar3,
-		const Vector<T, C>& in3) {
-	out.resize(in1.size());
-	std::function<
-			void(vec<T, C>&, const vec<T, C>&, const vec<T, C>&,
-					const vec<T, C>&)> f = [=](vec<T, C>& out,
-			const vec<T, C>& val1,
-			const vec<T, C>& val2,
-			const vec<T, C>& val3) {
-		out = val1+scalar2*val2+scalar3 * val3;};
-	Transform(out, in1, in2, in3, f);
+template<class E, class T, int C> VectorScalarLeftExpression<E, ElementSubtract, T, C> operator-(
+		const vec<T, C>& scalar, const VectorExpression<E, T, C>& expr) {
+	return VectorScalarLeftExpression<E, ElementSubtract, T, C>(scalar, expr.derived());
 }
-template<class T, int C> void ScaleSubtract(Vector<T, C>& out,
-		const vec<T, C>& scalar, const Vector<T, C>& in) {
-	out.resize(in.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 -= scalar * val2;};
-	Transform(out, in, f);
+template<class E, class T, int C> VectorScalarLeftExpression<E, ElementMultiply, T, C> operator*(
+		const vec<T, C>& scalar, const VectorExpression<E, T, C>& expr) {
+	return VectorScalarLeftExpression<E, ElementMultiply, T, C>(scalar, expr.derived());
 }
-template<class T, int C> void ScaleSubtract(Vector<T, C>& out,
-		const Vector<T, C>& in1, const vec<T, C>& scalar,
-		const Vector<T, C>& in2) {
-	out.resize(in1.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2, const vec<T, C>& val3) {val1 = val2 - scalar * val3;};
-	Transform(out, in1, in2, f);
+template<class E, class T, int C> VectorScalarLeftExpression<E, ElementMultiply, T, C> operator*(
+		const T& scalar, const VectorExpression<E, T, C>& expr) {
+	return VectorScalarLeftExpression<E, ElementMultiply, T, C>(vec<T, C>(scalar), expr.derived());
 }
-template<class T, int C> void Subtract(Vector<T, C>& out,
-		const Vector<T, C>& v1, const Vector<T, C>& v2) {
-	out.resize(v1.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2, const vec<T, C>& val3) {val1 = val2-val3;};
-	Transform(out, v1, v2, f);
+template<class E, class T, int C> VectorScalarLeftExpression<E, ElementDivide, T, C> operator/(
+		const vec<T, C>& scalar, const VectorExpression<E, T, C>& expr) {
+	return VectorScalarLeftExpression<E, ElementDivide, T, C>(scalar, expr.derived());
 }
-template<class T, int C> void Add(Vector<T, C>& out, const Vector<T, C>& v1,
-		const Vector<T, C>& v2) {
-	out.resize(v1.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2, const vec<T, C>& val3) {val1 = val2 + val3;};
-	Transform(out, v1, v2, f);
-}
-template<class T, int C> Vector<T, C> operator-(const vec<T, C>& scalar,
-		const Vector<T, C>& img) {
-	Vector<T, C> out(img.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 = scalar - val2;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C> VectorScalarRightExpression<E, ElementAdd, T, C> operator+(
+		const VectorExpression<E, T, C>& expr, const vec<T, C>& scalar) {
+	return VectorScalarRightExpression<E, ElementAdd, T, C>(expr.derived(), scalar);
 }
-template<class T, int C> Vector<T, C> operator*(const vec<T, C>& scalar,
-		const Vector<T, C>& img) {
-	Vector<T, C> out(img.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 = scalar*val2;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C> VectorScalarRightExpression<E, ElementSubtract, T, C> operator-(
+		const VectorExpression<E, T, C>& expr, const vec<T, C>& scalar) {
+	return VectorScalarRightExpression<E, ElementSubtract, T, C>(expr.derived(), scalar);
 }
-template<class T, int C> Vector<T, C> operator*(const T& scalar,
-		const Vector<T, C>& img) {
-	Vector<T, C> out(img.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 = scalar*val2;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C> VectorScalarRightExpression<E, ElementMultiply, T, C> operator*(
+		const VectorExpression<E, T, C>& expr, const vec<T, C>& scalar) {
+	return VectorScalarRightExpression<E, ElementMultiply, T, C>(expr.derived(), scalar);
 }
-template<class T, int C> Vector<T, C> operator/(const vec<T, C>& scalar,
-		const Vector<T, C>& img) {
-	Vector<T, C> out(img.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 = scalar / val2;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C> VectorScalarRightExpression<E, ElementDivide, T, C> operator/(
+		const VectorExpression<E, T, C>& expr, const vec<T, C>& scalar) {
+	return VectorScalarRightExpression<E, ElementDivide, T, C>(expr.derived(), scalar);
 }
-template<class T, int C> Vector<T, C> operator+(const Vector<T, C>& img,
-		const vec<T, C>& scalar) {
-	Vector<T, C> out(img.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 = val2 + scalar;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C> VectorNegateExpression<E, T, C> operator-(
+		const VectorExpression<E, T, C>& expr) {
+	return VectorNegateExpression<E, T, C>(expr.derived());
 }
-template<class T, int C> Vector<T, C> operator-(const Vector<T, C>& img,
-		const vec<T, C>& scalar) {
-	Vector<T, C> out(img.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 = val2 - scalar;};
-	Transform(out, img, f);
-	return out;
+template<class L, class R, class T, int C> VectorBinaryExpression<L, R, ElementAdd, T, C> operator+(
+		const VectorExpression<L, T, C>& lhs, const VectorExpression<R, T, C>& rhs) {
+	return VectorBinaryExpression<L, R, ElementAdd, T, C>(lhs.derived(), rhs.derived());
 }
-template<class T, int C> Vector<T, C> operator*(const Vector<T, C>& img,
-		const vec<T, C>& scalar) {
-	Vector<T, C> out(img.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 = val2*scalar;};
-	Transform(out, img, f);
+template<class L, class R, class T, int C> VectorBinaryExpression<L, R, ElementSubtract, T, C> operator-(
+		const VectorExpression<L, T, C>& lhs, const VectorExpression<R, T, C>& rhs) {
+	return VectorBinaryExpression<L, R, ElementSubtract, T, C>(lhs.derived(), rhs.derived());
+}
+template<class L, class R, class T, int C> VectorBinaryExpression<L, R, ElementMultiply, T, C> operator*(
+		const VectorExpression<L, T, C>& lhs, const VectorExpression<R, T, C>& rhs) {
+	return VectorBinaryExpression<L, R, ElementMultiply, T, C>(lhs.derived(), rhs.derived());
+}
+template<class L, class R, class T, int C> VectorBinaryExpression<L, R, ElementDivide, T, C> operator/(
+		const VectorExpression<L, T, C>& lhs, const VectorExpression<R, T, C>& rhs) {
+	return VectorBinaryExpression<L, R, ElementDivide, T, C>(lhs.derived(), rhs.derived());
+}
+//Temporary Vector operands are moved into the expression instead of referenced.
+template<class T, int C> VectorScalarLeftExpression<VectorTemporary<T, C>, ElementAdd, T, C> operator+(
+		const vec<T, C>& scalar, Vector<T, C>&& v) {
+	return VectorScalarLeftExpression<VectorTemporary<T, C>, ElementAdd, T, C>(scalar, VectorTemporary<T, C>(std::move(v)));
+}
+template<class T, int C> VectorScalarLeftExpression<VectorTemporary<T, C>, ElementSubtract, T, C> operator-(
+		const vec<T, C>& scalar, Vector<T, C>&& v) {
+	return VectorScalarLeftExpression<VectorTemporary<T, C>, ElementSubtract, T, C>(scalar, VectorTemporary<T, C>(std::move(v)));
+}
+template<class T, int C> VectorScalarLeftExpression<VectorTemporary<T, C>, ElementMultiply, T, C> operator*(
+		const vec<T, C>& scalar, Vector<T, C>&& v) {
+	return VectorScalarLeftExpression<VectorTemporary<T, C>, ElementMultiply, T, C>(scalar, VectorTemporary<T, C>(std::move(v)));
+}
+template<class T, int C> VectorScalarLeftExpression<VectorTemporary<T, C>, ElementMultiply, T, C> operator*(
+		const T& scalar, Vector<T, C>&& v) {
+	return VectorScalarLeftExpression<VectorTemporary<T, C>, ElementMultiply, T, C>(vec<T, C>(scalar), VectorTemporary<T, C>(std::move(v)));
+}
+template<class T, int C> VectorScalarLeftExpression<VectorTemporary<T, C>, ElementDivide, T, C> operator/(
+		const vec<T, C>& scalar, Vector<T, C>&& v) {
+	return VectorScalarLeftExpression<VectorTemporary<T, C>, ElementDivide, T, C>(scalar, VectorTemporary<T, C>(std::move(v)));
+}
+template<class T, int C> VectorScalarRightExpression<VectorTemporary<T, C>, ElementAdd, T, C> operator+(
+		Vector<T, C>&& v, const vec<T, C>& scalar) {
+	return VectorScalarRightExpression<VectorTemporary<T, C>, ElementAdd, T, C>(VectorTemporary<T, C>(std::move(v)), scalar);
+}
+template<class T, int C> VectorScalarRightExpression<VectorTemporary<T, C>, ElementSubtract, T, C> operator-(
+		Vector<T, C>&& v, const vec<T, C>& scalar) {
+	return VectorScalarRightExpression<VectorTemporary<T, C>, ElementSubtract, T, C>(VectorTemporary<T, C>(std::move(v)), scalar);
+}
+template<class T, int C> VectorScalarRightExpression<VectorTemporary<T, C>, ElementMultiply, T, C> operator*(
+		Vector<T, C>&& v, const vec<T, C>& scalar) {
+	return VectorScalarRightExpression<VectorTemporary<T, C>, ElementMultiply, T, C>(VectorTemporary<T, C>(std::move(v)), scalar);
+}
+template<class T, int C> VectorScalarRightExpression<VectorTemporary<T, C>, ElementDivide, T, C> operator/(
+		Vector<T, C>&& v, const vec<T, C>& scalar) {
+	return VectorScalarRightExpression<VectorTemporary<T, C>, ElementDivide, T, C>(VectorTemporary<T, C>(std::move(v)), scalar);
+}
+template<class T, int C> VectorNegateExpression<VectorTemporary<T, C>, T, C> operator-(
+		Vector<T, C>&& v) {
+	return VectorNegateExpression<VectorTemporary<T, C>, T, C>(VectorTemporary<T, C>(std::move(v)));
+}
+template<class R, class T, int C> VectorBinaryExpression<VectorTemporary<T, C>, R, ElementAdd, T, C> operator+(
+		Vector<T, C>&& lhs, const VectorExpression<R, T, C>& rhs) {
+	return VectorBinaryExpression<VectorTemporary<T, C>, R, ElementAdd, T, C>(VectorTemporary<T, C>(std::move(lhs)), rhs.derived());
+}
+template<class L, class T, int C> VectorBinaryExpression<L, VectorTemporary<T, C>, ElementAdd, T, C> operator+(
+		const VectorExpression<L, T, C>& lhs, Vector<T, C>&& rhs) {
+	return VectorBinaryExpression<L, VectorTemporary<T, C>, ElementAdd, T, C>(lhs.derived(), VectorTemporary<T, C>(std::move(rhs)));
+}
+template<class T, int C> VectorBinaryExpression<VectorTemporary<T, C>, VectorTemporary<T, C>, ElementAdd, T, C> operator+(
+		Vector<T, C>&& lhs, Vector<T, C>&& rhs) {
+	return VectorBinaryExpression<VectorTemporary<T, C>, VectorTemporary<T, C>, ElementAdd, T, C>(VectorTemporary<T, C>(std::move(lhs)),
+			VectorTemporary<T, C>(std::move(rhs)));
+}
+template<class R, class T, int C> VectorBinaryExpression<VectorTemporary<T, C>, R, ElementSubtract, T, C> operator-(
+		Vector<T, C>&& lhs, const VectorExpression<R, T, C>& rhs) {
+	return VectorBinaryExpression<VectorTemporary<T, C>, R, ElementSubtract, T, C>(VectorTemporary<T, C>(std::move(lhs)), rhs.derived());
+}
+template<class L, class T, int C> VectorBinaryExpression<L, VectorTemporary<T, C>, ElementSubtract, T, C> operator-(
+		const VectorExpression<L, T, C>& lhs, Vector<T, C>&& rhs) {
+	return VectorBinaryExpression<L, VectorTemporary<T, C>, ElementSubtract, T, C>(lhs.derived(), VectorTemporary<T, C>(std::move(rhs)));
+}
+template<class T, int C> VectorBinaryExpression<VectorTemporary<T, C>, VectorTemporary<T, C>, ElementSubtract, T, C> operator-(
+		Vector<T, C>&& lhs, Vector<T, C>&& rhs) {
+	return VectorBinaryExpression<VectorTemporary<T, C>, VectorTemporary<T, C>, ElementSubtract, T, C>(VectorTemporary<T, C>(std::move(lhs)),
+			VectorTemporary<T, C>(std::move(rhs)));
+}
+template<class R, class T, int C> VectorBinaryExpression<VectorTemporary<T, C>, R, ElementMultiply, T, C> operator*(
+		Vector<T, C>&& lhs, const VectorExpression<R, T, C>& rhs) {
+	return VectorBinaryExpression<VectorTemporary<T, C>, R, ElementMultiply, T, C>(VectorTemporary<T, C>(std::move(lhs)), rhs.derived());
+}
+template<class L, class T, int C> VectorBinaryExpression<L, VectorTemporary<T, C>, ElementMultiply, T, C> operator*(
+		const VectorExpression<L, T, C>& lhs, Vector<T, C>&& rhs) {
+	return VectorBinaryExpression<L, VectorTemporary<T, C>, ElementMultiply, T, C>(lhs.derived(), VectorTemporary<T, C>(std::move(rhs)));
+}
+template<class T, int C> VectorBinaryExpression<VectorTemporary<T, C>, VectorTemporary<T, C>, ElementMultiply, T, C> operator*(
+		Vector<T, C>&& lhs, Vector<T, C>&& rhs) {
+	return VectorBinaryExpression<VectorTemporary<T, C>, VectorTemporary<T, C>, ElementMultiply, T, C>(VectorTemporary<T, C>(std::move(lhs)),
+			VectorTemporary<T, C>(std::move(rhs)));
+}
+template<class R, class T, int C> VectorBinaryExpression<VectorTemporary<T, C>, R, ElementDivide, T, C> operator/(
+		Vector<T, C>&& lhs, const VectorExpression<R, T, C>& rhs) {
+	return VectorBinaryExpression<VectorTemporary<T, C>, R, ElementDivide, T, C>(VectorTemporary<T, C>(std::move(lhs)), rhs.derived());
+}
+template<class L, class T, int C> VectorBinaryExpression<L, VectorTemporary<T, C>, ElementDivide, T, C> operator/(
+		const VectorExpression<L, T, C>& lhs, Vector<T, C>&& rhs) {
+	return VectorBinaryExpression<L, VectorTemporary<T, C>, ElementDivide, T, C>(lhs.derived(), VectorTemporary<T, C>(std::move(rhs)));
+}
+template<class T, int C> VectorBinaryExpression<VectorTemporary<T, C>, VectorTemporary<T, C>, ElementDivide, T, C> operator/(
+		Vector<T, C>&& lhs, Vector<T, C>&& rhs) {
+	return VectorBinaryExpression<VectorTemporary<T, C>, VectorTemporary<T, C>, ElementDivide, T, C>(VectorTemporary<T, C>(std::move(lhs)),
+			VectorTemporary<T, C>(std::move(rhs)));
+}
+//Compound assignment evaluates the right hand side in place, element i only reads element i so aliasing is safe.
+template<class Op, class E, class T, int C> Vector<T, C>& ApplyInPlace(Vector<T, C>& out,
+		const VectorExpression<E, T, C>& expr) {
+	const E& e = expr.derived();
+	if (out.size() != e.size())
+		throw std::runtime_error(
+				MakeString() << "Vector dimensions do not match. " << out.size()
+						<< "!=" << e.size());
+	size_t sz = out.size();
+#pragma omp parallel for
+	for (int offset = 0; offset < (int) sz; offset++) {
+		out.data[offset] = Op::apply(out.data[offset], vec<T, C>(e[offset]));
+	}
 	return out;
 }
-template<class T, int C> Vector<T, C> operator/(const Vector<T, C>& img,
+template<class Op, class T, int C> Vector<T, C>& ApplyInPlace(Vector<T, C>& out,
 		const vec<T, C>& scalar) {
-	Vector<T, C> out(img.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 = val2 / scalar;};
-	Transform(out, img, f);
+	size_t sz = out.size();
+#pragma omp parallel for
+	for (int offset = 0; offset < (int) sz; offset++) {
+		out.data[offset] = Op::apply(out.data[offset], scalar);
+	}
 	return out;
 }
-template<class T, int C> Vector<T, C> operator-(const Vector<T, C>& img) {
-	Vector<T, C> out(img.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 = -val2;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C> Vector<T, C>& operator+=(Vector<T, C>& out,
+		const VectorExpression<E, T, C>& expr) {
+	return ApplyInPlace<ElementAdd>(out, expr);
 }
-template<class T, int C> Vector<T, C> operator+=(Vector<T, C>& out,
-		const Vector<T, C>& img) {
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 += val2;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C> Vector<T, C>& operator-=(Vector<T, C>& out,
+		const VectorExpression<E, T, C>& expr) {
+	return ApplyInPlace<ElementSubtract>(out, expr);
 }
-template<class T, int C> Vector<T, C> operator-=(Vector<T, C>& out,
-		const Vector<T, C>& img) {
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 -= val2;};
-	Transform(out, img, f);
-	return out;
-}
-template<class T, int C> Vector<T, C> operator*=(Vector<T, C>& out,
-		const Vector<T, C>& img) {
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 *= val2;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C> Vector<T, C>& operator*=(Vector<T, C>& out,
+		const VectorExpression<E, T, C>& expr) {
+	return ApplyInPlace<ElementMultiply>(out, expr);
 }
-template<class T, int C> Vector<T, C> operator/=(Vector<T, C>& out,
-		const Vector<T, C>& img) {
-	std::function<void(vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2) {val1 /= val2;};
-	Transform(out, img, f);
-	return out;
+template<class E, class T, int C> Vector<T, C>& operator/=(Vector<T, C>& out,
+		const VectorExpression<E, T, C>& expr) {
+	return ApplyInPlace<ElementDivide>(out, expr);
 }
-
-template<class T, int C> Vector<T, C> operator+=(Vector<T, C>& out,
+template<class T, int C> Vector<T, C>& operator+=(Vector<T, C>& out,
 		const vec<T, C>& scalar) {
-	std::function<void(vec<T, C>&)> f = [=](vec<T, C>& val1) {val1 += scalar;};
-	Transform(out, f);
-	return out;
+	return ApplyInPlace<ElementAdd>(out, scalar);
 }
-template<class T, int C> Vector<T, C> operator-=(Vector<T, C>& out,
+template<class T, int C> Vector<T, C>& operator-=(Vector<T, C>& out,
 		const vec<T, C>& scalar) {
-	std::function<void(vec<T, C>&)> f = [=](vec<T, C>& val1) {val1 -= scalar;};
-	Transform(out, f);
-	return out;
+	return ApplyInPlace<ElementSubtract>(out, scalar);
 }
-template<class T, int C> Vector<T, C> operator*=(Vector<T, C>& out,
+template<class T, int C> Vector<T, C>& operator*=(Vector<T, C>& out,
 		const vec<T, C>& scalar) {
-	std::function<void(vec<T, C>&)> f = [=](vec<T, C>& val1) {val1 *= scalar;};
-	Transform(out, f);
-	return out;
+	return ApplyInPlace<ElementMultiply>(out, scalar);
 }
-template<class T, int C> Vector<T, C> operator/=(Vector<T, C>& out,
+template<class T, int C> Vector<T, C>& operator/=(Vector<T, C>& out,
 		const vec<T, C>& scalar) {
-	std::function<void(vec<T, C>&)> f = [=](vec<T, C>& val1) {val1 /= scalar;};
-	Transform(out, f);
-	return out;
-}
-
-template<class T, int C> Vector<T, C> operator+(const Vector<T, C>& img1,
-		const Vector<T, C>& img2) {
-	Vector<T, C> out(img1.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2, const vec<T, C>& val3) {val1 = val2 + val3;};
-	Transform(out, img1, img2, f);
-	return out;
+	return ApplyInPlace<ElementDivide>(out, scalar);
 }
-template<class T, int C> Vector<T, C> operator-(const Vector<T, C>& img1,
-		const Vector<T, C>& img2) {
-	Vector<T, C> out(img1.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2, const vec<T, C>& val3) {val1 = val2 - val3;};
-	Transform(out, img1, img2, f);
-	return out;
-}
-template<class T, int C> Vector<T, C> operator*(const Vector<T, C>& img1,
-		const Vector<T, C>& img2) {
-	Vector<T, C> out(img1.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2, const vec<T, C>& val3) {val1 = val2*val3;};
-	Transform(out, img1, img2, f);
-	return out;
+template<class T, int C> void ScaleAdd(Vector<T, C>& out,
+		const vec<T, C>& scalar, const Vector<T, C>& in) {
+	out.resize(in.size());
+	out += scalar * in;
 }
-template<class T, int C> Vector<T, C> operator/(const Vector<T, C>& img1,
-		const Vector<T, C>& img2) {
-	Vector<T, C> out(img1.size());
-	std::function<void(vec<T, C>&, const vec<T, C>&, const vec<T, C>&)> f =
-			[=](vec<T, C>& val1, const vec<T, C>& val2, const vec<T, C>& val3) {val1 = val2 / val3;};
-	Transform(out, img1, img2, f);
-	return out;
+template<class T, int C> void ScaleAdd(Vector<T, C>& out,
+		const Vector<T, C>& in1, const vec<T, C>& scalar,
+		const Vector<T, C>& in2) {
+	out = in1 + scalar * in2;
 }
-template<class T, int C> vec<double, C> dotVec(const Vector<T, C>& a,
-		const Vector<T, C>& b) {
-	vec<double, C> ans(0.0);
-	if (a.size() != b.size())
-		throw std::runtime_error(
-				MakeString() << "Vector dimensions do not match. " << a.size()
-						<< "!=" << b.size());
-	size_t sz = a.size();
-#pragma omp parallel for
-	for (int c = 0; c < C; c++) {
-		double cans = 0;
-#pragma omp parallel for reduction(+:cans)
-		for (int i = 0; i < (int) sz; i++) {
-			cans += (double) a[i][c] * (double) b[i][c];
-		}
-		ans[c] = cans;
-	}
-	return ans;
+template<class T, int C> void ScaleAdd(Vector<T, C>& out,
+		const Vector<T, C>& in1, const vec<T, C>& scalar2,
+		const Vector<T, C>& in2, const vec<T, C>& scalar3,
+		const Vector<T, C>& in3) {
+	out = in1 + scalar2 * in2 + scalar3 * in3;
 }
-template<class T, int C> double dot(const Vector<T, C>& a,
-		const Vector<T, C>& b) {
-	double ans = 0.0;
-	if (a.size() != b.size())
-		throw std::runtime_error(
-				MakeString() << "Vector dimensions do not match. " << a.size()
-						<< "!=" << b.size());
-	size_t sz = a.size();
-#pragma omp parallel for reduction(+:ans)
-	for (int i = 0; i < (int) sz; i++) {
-		ans += dot(vec<double, C>(a[i]), vec<double, C>(b[i]));
-	}
-	return ans;
+template<class T, int C> void ScaleSubtract(Vector<T, C>& out,
+		const vec<T, C>& scalar, const Vector<T, C>& in) {
+	out.resize(in.size());
+	out -= scalar * in;
 }
-
-template<class T, int C> T lengthSqr(const Vector<T, C>& a) {
-	T ans(0);
-	size_t sz = a.size();
-#pragma omp parallel for reduction(+:ans)
-	for (int i = 0; i < (int) sz; i++) {
-		ans += dot(a[i], a[i]);
-	}
-	return ans;
+template<class T, int C> void ScaleSubtract(Vector<T, C>& out,
+		const Vector<T, C>& in1, const vec<T, C>& scalar,
+		const Vector<T, C>& in2) {
+	out = in1 - scalar * in2;
 }
-template<class T, int C> T lengthL1(const Vector<T, C>& a) {
-	T ans(0);
-	size_t sz = a.size();
-#pragma omp parallel for reduction(+:ans)
-	for (int i = 0; i < (int) sz; i++) {
-		for (int c = 0; c < C; c++) {
-			ans += std::abs(a[i][c]);
-		}
-	}
-	return ans;
+template<class T, int C> void Subtract(Vector<T, C>& out,
+		const Vector<T, C>& v1, const Vector<T, C>& v2) {
+	out = v1 - v2;
 }
-template<class T, int C> vec<T, C> lengthVecL1(const Vector<T, C>& a) {
-	vec<T, C> ans((T) 0);
-	size_t sz = a.size();
-#pragma omp parallel for
-	for (int c = 0; c < C; c++) {
-		T cans = 0;
-#pragma omp parallel for reduction(+:cans)
-		for (int i = 0; i < (int) sz; i++) {
-			cans += std::abs(a[i][c]);
-		}
-		ans[c] = cans;
-	}
-	return ans;
+template<class T, int C> void Add(Vector<T, C>& out, const Vector<T, C>& v1,
+		const Vector<T, C>& v2) {
+	out = v1 + v2;
 }
-template<class T, int C> vec<T, C> maxVec(const Vector<T, C>& a) {
-	vec<T, C> ans((T) 0);
-	size_t sz = a.size();
-#pragma omp parallel for
-	for (int c = 0; c < C; c++) {
-		T tmp(std::numeric_limits<T>::min());
-//#pragma omp parallel for reduction(max:tmp)
-		for (int i = 0; i < (int) sz; i++) {
-			if (a[i][c] > tmp)
-				tmp = a[i][c];
-		}
-		ans[c] = tmp;
+//Reductions accept Vectors and expressions alike, an expression is evaluated element by element without a temporary.
+template<class A, class B, class T, int C> vec<double, C> dotVec(
+		const VectorExpression<A, T, C>& a, const VectorExpression<B, T, C>& b,
+		Summation method = Summation::Pairwise) {
+	if (a.derived().size() != b.derived().size())
+		throw std::runtime_error(
+				MakeString() << "Vector dimensions do not match. "
+						<< a.derived().size() << "!=" << b.derived().size());
+	VectorComponents<A, T, C> pa(a.derived());
+	VectorComponents<B, T, C> pb(b.derived());
+	return ParallelSum<double, C>(a.derived().size() * C, [=](size_t k) {
+		return (double) pa(k) * (double) pb(k);
+	}, method);
+}
+template<class A, class B, class T, int C> double dot(
+		const VectorExpression<A, T, C>& a, const VectorExpression<B, T, C>& b,
+		Summation method = Summation::Pairwise) {
+	return aly::sum(dotVec(a, b, method));
+}
+template<class E, class T, int C> vec<double, C> lengthVecSqr(
+		const VectorExpression<E, T, C>& a, Summation method = Summation::Pairwise) {
+	VectorComponents<E, T, C> pa(a.derived());
+	return ParallelSum<double, C>(a.derived().size() * C, [=](size_t k) {
+		double val = pa(k);
+		return val * val;
+	}, method);
+}
+template<class E, class T, int C> T lengthSqr(const VectorExpression<E, T, C>& a,
+		Summation method = Summation::Pairwise) {
+	return (T) aly::sum(lengthVecSqr(a, method));
+}
+template<class E, class T, int C> vec<T, C> lengthVecL1(
+		const VectorExpression<E, T, C>& a, Summation method = Summation::Pairwise) {
+	VectorComponents<E, T, C> pa(a.derived());
+	return vec<T, C>(ParallelSum<double, C>(a.derived().size() * C, [=](size_t k) {
+		return std::abs((double) pa(k));
+	}, method));
+}
+template<class E, class T, int C> T lengthL1(const VectorExpression<E, T, C>& a,
+		Summation method = Summation::Pairwise) {
+	VectorComponents<E, T, C> pa(a.derived());
+	return (T) aly::sum(ParallelSum<double, C>(a.derived().size() * C, [=](size_t k) {
+		return std::abs((double) pa(k));
+	}, method));
+}
+template<class E, class T, int C> vec<T, C> maxVec(const VectorExpression<E, T, C>& a) {
+	return ParallelReduce<ReduceMax, T, C>(a.derived().size() * C,
+			VectorComponents<E, T, C>(a.derived()));
+}
+template<class E, class T, int C> vec<T, C> minVec(const VectorExpression<E, T, C>& a) {
+	return ParallelReduce<ReduceMin, T, C>(a.derived().size() * C,
+			VectorComponents<E, T, C>(a.derived()));
+}
+template<class E, class T, int C> T max(const VectorExpression<E, T, C>& a) {
+	vec<T, C> tmp = maxVec(a);
+	T ans = tmp[0];
+	for (int c = 1; c < C; c++) {
+		ans = ReduceMax::apply(ans, tmp[c]);
 	}
 	return ans;
 }
-template<class T, int C> vec<T, C> minVec(const Vector<T, C>& a) {
-	vec<T, C> ans((T) 0);
-	size_t sz = a.size();
-#pragma omp parallel for
-	for (int c = 0; c < C; c++) {
-		T tmp(std::numeric_limits<T>::max());
-//#pragma omp parallel for reduction(min:tmp)
-		for (int i = 0; i < (int) sz; i++) {
-			if (a[i][c] < tmp)
-				tmp = a[i][c];
-		}
-		ans[c] = tmp;
+template<class E, class T, int C> T min(const VectorExpression<E, T, C>& a) {
+	vec<T, C> tmp = minVec(a);
+	T ans = tmp[0];
+	for (int c = 1; c < C; c++) {
+		ans = ReduceMin::apply(ans, tmp[c]);
 	}
 	return ans;
 }
-template<class T, int C> T max(const Vector<T, C>& a) {
-	size_t sz = a.size();
-	T tmp(std::numeric_limits<T>::min());
-//#pragma omp parallel for reduction(max:tmp)
-	for (int i = 0; i < (int) sz; i++) {
-		for (int c = 0; c < C; c++) {
-			if (a[i][c] > tmp)
-				tmp = a[i][c];
-		}
-	}
-	return tmp;
-}
-template<class T, int C> T min(const Vector<T, C>& a) {
-	size_t sz = a.size();
-	T tmp(std::numeric_limits<T>::max());
-//#pragma omp parallel for reduction(min:tmp)
-	for (int i = 0; i < (int) sz; i++) {
-		for (int c = 0; c < C; c++) {
-			if (a[i][c] < tmp)
-				tmp = a[i][c];
-		}
-	}
-	return tmp;
-}
-template<class T, int C> T length(const Vector<T, C>& a) {
-	return std::sqrt(lengthSqr(a));
-}
-template<class T, int C> vec<double, C> lengthVecSqr(const Vector<T, C>& a) {
-	vec<double, C> ans(0.0);
-	size_t sz = a.size();
-#pragma omp parallel for
-	for (int c = 0; c < C; c++) {
-		double cans = 0;
-#pragma omp parallel for reduction(+:cans)
-		for (int i = 0; i < (int) sz; i++) {
-			double val = a[i][c];
-			cans += val * val;
-		}
-		ans[c] = cans;
-	}
-	return ans;
+template<class E, class T, int C> T length(const VectorExpression<E, T, C>& a,
+		Summation method = Summation::Pairwise) {
+	return std::sqrt(lengthSqr(a, method));
 }
-template<class T, int C> vec<double, C> lengthVec(const Vector<T, C>& a) {
-	return aly::sqrt(lengthVecSqr(a));
+template<class E, class T, int C> vec<double, C> lengthVec(
+		const VectorExpression<E, T, C>& a, Summation method = Summation::Pairwise) {
+	return aly::sqrt(lengthVecSqr(a, method));
 }
 typedef Vector<uint8_t, 4> VectorRGBA;
 typedef Vector<int, 4> VectorRGBAi;
@@ -31,6 +31,8 @@
 #include <fstream>
 #include <random>
 namespace aly {
+	template<class T, int C, ImageType I> struct VolumeView;
+	template<class T, int C, ImageType I> struct ConstVolumeView;
 	template<class T, int C, ImageType I> struct Volume {
 	private:
 		std::string hashCode;
@@ -132,6 +134,7 @@ namespace aly {
 			z = other.z;
 			set(&other.data[0]);
 		}
+		void set(const ConstVolumeView<T, C, I>& view);
 		std::string getTypeName() const {
 			return MakeString() << type << channels;
 		}
@@ -161,10 +164,20 @@ namespace aly {
 		Volume() :
 			x(0), y(0), z(0), rows(0), cols(0), slices(0), id(0) {
 		}
+		explicit Volume(const ConstVolumeView<T, C, I>& view) :
+			Volume() {
+			set(view);
+		}
 		Volume(const Volume<T, C, I>& img) :
 			Volume(img.rows, img.cols, img.slices, img.position(), img.id) {
 			set(img.data);
 		}
+		Volume(Volume<T, C, I>&& img) noexcept :
+			hashCode(std::move(img.hashCode)), x(img.x), y(img.y), z(img.z), data(std::move(img.data)), rows(img.rows), cols(img.cols), slices(img.slices), id(img.id) {
+			img.rows = 0;
+			img.cols = 0;
+			img.slices = 0;
+		}
 		Volume<T, C, I>& operator=(const Volume<T, C, I>& rhs) {
 			if (this == &rhs)
 				return *this;
@@ -174,6 +187,24 @@ namespace aly {
 			this->set(rhs.data);
 			return *this;
 		}
+		Volume<T, C, I>& operator=(Volume<T, C, I>&& rhs) noexcept {
+			if (this == &rhs)
+				return *this;
+			data = std::move(rhs.data);
+			hashCode = std::move(rhs.hashCode);
+			rows = rhs.rows;
+			cols = rhs.cols;
+			slices = rhs.slices;
+			x = rhs.x;
+			y = rhs.y;
+			z = rhs.z;
+			id = rhs.id;
+			rhs.data.clear();
+			rhs.rows = 0;
+			rhs.cols = 0;
+			rhs.slices = 0;
+			return *this;
+		}
 		int3 dimensions() const {
 			return int3(rows, cols, slices);
 		}
@@ -218,6 +249,24 @@ namespace aly {
 				return nullptr;
 			return &(data.front()[0]);
 		}
+		VolumeView<T, C, I> view() {
+			return VolumeView<T, C, I>(*this);
+		}
+		ConstVolumeView<T, C, I> view() const {
+			return ConstVolumeView<T, C, I>(*this);
+		}
+		VolumeView<T, C, I> view(const int3& pos, const int3& dims) {
+			return VolumeView<T, C, I>(*this, pos, dims);
+		}
+		ConstVolumeView<T, C, I> view(const int3& pos, const int3& dims) const {
+			return ConstVolumeView<T, C, I>(*this, pos, dims);
+		}
+		ImageView<T, C, I> slice(int k) {
+			return view().slice(k);
+		}
+		ConstImageView<T, C, I> slice(int k) const {
+			return view().slice(k);
+		}
 		void setZero() {
 			data.assign(data.size(), vec<T, C>((T)0));
 		}
@@ -355,34 +404,25 @@ namespace aly {
 			return out;
 		}
 		vec<T, C> min() const {
-			vec<T, C> minVal(std::numeric_limits<T>::max());
-			for (vec<T, C>& val : data) {
-				minVal = aly::minVec(val, minVal);
-			}
-			return minVal;
+			const T* ptr = this->ptr();
+			return ParallelReduce<ReduceMin, T, C>(data.size() * C,
+					[=](size_t k) {return ptr[k];});
 		}
 		vec<T, C> max() const {
-			vec<T, C> maxVal(std::numeric_limits<T>::min());
-			for (vec<T, C>& val : data) {
-				maxVal = aly::maxVec(val, maxVal);
-			}
-			return maxVal;
+			const T* ptr = this->ptr();
+			return ParallelReduce<ReduceMax, T, C>(data.size() * C,
+					[=](size_t k) {return ptr[k];});
 		}
 		std::pair<vec<T, C>, vec<T, C>> range() const {
-			vec<T, C> maxVal(std::numeric_limits<T>::min());
-			vec<T, C> minVal(std::numeric_limits<T>::max());
-			for (vec<T, C>& val : data) {
-				maxVal = aly::maxVec(val, maxVal);
-				minVal = aly::minVec(val, minVal);
-			}
-			return std::pair<vec<T, C>, vec<T, C>>(minVal, maxVal);
-		}
-		vec<T, C> mean() const {
-			vec<double, C> mean(0.0);
-			for (vec<T, C>& val : data) {
-				mean += vec<double, C>(val);
-			}
-			mean = mean / (double)data.size();
+			const T* ptr = this->ptr();
+			return ParallelRange<T, C>(data.size() * C,
+					[=](size_t k) {return ptr[k];});
+		}
+		vec<T, C> mean(Summation method = Summation::Pairwise) const {
+			const T* ptr = this->ptr();
+			vec<double, C> mean = ParallelSum<double, C>(data.size() * C,
+					[=](size_t k) {return (double) ptr[k];}, method);
+			mean = mean / (double) data.size();
 			return vec<T, C>(mean);
 		}
 		vec<T, C> median() const {
@@ -491,6 +531,170 @@ namespace aly {
 		}
 		return hashCode;
 	}
+	/*
+	 Non-owning window into a box of voxels, the volume counterpart of ImageView. Voxel (i,j,k) lives at
+	 i + j*rowStride + k*sliceStride, so slice(k) is an ImageView of rows x cols that shares memory with the volume.
+	 */
+	inline size_t VolumeViewOffset(const int3& parent, size_t rowStride,
+		size_t sliceStride, const int3& pos, const int3& dims) {
+		if (pos.x < 0 || pos.y < 0 || pos.z < 0 || dims.x < 0 || dims.y < 0
+			|| dims.z < 0 || pos.x + dims.x > parent.x
+			|| pos.y + dims.y > parent.y || pos.z + dims.z > parent.z)
+			throw std::runtime_error(
+				MakeString() << "View region " << pos << " " << dims
+				<< " exceeds dimensions " << parent);
+		return pos.x + pos.y * rowStride + pos.z * sliceStride;
+	}
+	template<class V, class T, int C, ImageType I> struct VolumeViewBase {
+	protected:
+		V* start;
+		int x, y, z;
+		VolumeViewBase(V* start, int r, int c, int s, size_t rowStride,
+			size_t sliceStride, const int3& pos, uint64_t id) :
+			start(start), x(pos.x), y(pos.y), z(pos.z), rows(r), cols(c), slices(
+				s), rowStride(rowStride), sliceStride(sliceStride), id(id) {
+		}
+	public:
+		typedef vec<T, C> ValueType;
+		int rows;
+		int cols;
+		int slices;
+		size_t rowStride;
+		size_t sliceStride;
+		uint64_t id;
+		int3 dimensions() const {
+			return int3(rows, cols, slices);
+		}
+		int3 position() const {
+			return int3(x, y, z);
+		}
+		size_t size() const {
+			return rows * (size_t)cols * slices;
+		}
+		V* vecPtr() const {
+			return start;
+		}
+		V& operator()(int i, int j, int k) const {
+			return start[clamp(i, 0, rows - 1)
+				+ clamp(j, 0, cols - 1) * rowStride
+				+ clamp(k, 0, slices - 1) * sliceStride];
+		}
+		V& operator()(const int3& ijk) const {
+			return operator()(ijk.x, ijk.y, ijk.z);
+		}
+	};
+	template<class T, int C, ImageType I> struct VolumeView : public VolumeViewBase<
+		vec<T, C>, T, C, I> {
+		VolumeView() :
+			VolumeViewBase<vec<T, C>, T, C, I>(nullptr, 0, 0, 0, 0, 0,
+				int3(0, 0, 0), 0) {
+		}
+		VolumeView(vec<T, C>* ptr, int r, int c, int s, size_t rowStride,
+			size_t sliceStride, const int3& pos = int3(0, 0, 0), uint64_t id =
+			0) :
+			VolumeViewBase<vec<T, C>, T, C, I>(ptr, r, c, s, rowStride,
+				sliceStride, pos, id) {
+		}
+		VolumeView(Volume<T, C, I>& vol) :
+			VolumeViewBase<vec<T, C>, T, C, I>(vol.vecPtr(), vol.rows, vol.cols,
+				vol.slices, vol.rows, vol.rows * (size_t)vol.cols,
+				vol.position(), vol.id) {
+		}
+		VolumeView(Volume<T, C, I>& vol, const int3& pos, const int3& dims) :
+			VolumeViewBase<vec<T, C>, T, C, I>(
+				vol.vecPtr()
+				+ VolumeViewOffset(vol.dimensions(), vol.rows,
+					vol.rows * (size_t)vol.cols, pos, dims), dims.x,
+				dims.y, dims.z, vol.rows, vol.rows * (size_t)vol.cols,
+				vol.position() + pos, vol.id) {
+		}
+		VolumeView<T, C, I> view(const int3& pos, const int3& dims) const {
+			return VolumeView<T, C, I>(
+				this->start
+				+ VolumeViewOffset(this->dimensions(), this->rowStride,
+					this->sliceStride, pos, dims), dims.x, dims.y, dims.z,
+				this->rowStride, this->sliceStride, this->position() + pos,
+				this->id);
+		}
+		ImageView<T, C, I> slice(int k) const {
+			VolumeViewOffset(this->dimensions(), this->rowStride,
+				this->sliceStride, int3(0, 0, k), int3(this->rows, this->cols, 1));
+			return ImageView<T, C, I>(this->start + k * this->sliceStride,
+				this->rows, this->cols, (int)this->rowStride,
+				int2(this->x, this->y), this->id);
+		}
+	};
+	template<class T, int C, ImageType I> struct ConstVolumeView : public VolumeViewBase<
+		const vec<T, C>, T, C, I> {
+		ConstVolumeView() :
+			VolumeViewBase<const vec<T, C>, T, C, I>(nullptr, 0, 0, 0, 0, 0,
+				int3(0, 0, 0), 0) {
+		}
+		ConstVolumeView(const vec<T, C>* ptr, int r, int c, int s,
+			size_t rowStride, size_t sliceStride, const int3& pos = int3(0, 0,
+				0), uint64_t id = 0) :
+			VolumeViewBase<const vec<T, C>, T, C, I>(ptr, r, c, s, rowStride,
+				sliceStride, pos, id) {
+		}
+		ConstVolumeView(const Volume<T, C, I>& vol) :
+			VolumeViewBase<const vec<T, C>, T, C, I>(vol.vecPtr(), vol.rows,
+				vol.cols, vol.slices, vol.rows, vol.rows * (size_t)vol.cols,
+				vol.position(), vol.id) {
+		}
+		ConstVolumeView(const Volume<T, C, I>& vol, const int3& pos,
+			const int3& dims) :
+			VolumeViewBase<const vec<T, C>, T, C, I>(
+				vol.vecPtr()
+				+ VolumeViewOffset(vol.dimensions(), vol.rows,
+					vol.rows * (size_t)vol.cols, pos, dims), dims.x,
+				dims.y, dims.z, vol.rows, vol.rows * (size_t)vol.cols,
+				vol.position() + pos, vol.id) {
+		}
+		ConstVolumeView(const VolumeView<T, C, I>& view) :
+			VolumeViewBase<const vec<T, C>, T, C, I>(view.vecPtr(), view.rows,
+				view.cols, view.slices, view.rowStride, view.sliceStride,
+				view.position(), view.id) {
+		}
+		ConstVolumeView<T, C, I> view(const int3& pos, const int3& dims) const {
+			return ConstVolumeView<T, C, I>(
+				this->start
+				+ VolumeViewOffset(this->dimensions(), this->rowStride,
+					this->sliceStride, pos, dims), dims.x, dims.y, dims.z,
+				this->rowStride, this->sliceStride, this->position() + pos,
+				this->id);
+		}
+		ConstImageView<T, C, I> slice(int k) const {
+			VolumeViewOffset(this->dimensions(), this->rowStride,
+				this->sliceStride, int3(0, 0, k), int3(this->rows, this->cols, 1));
+			return ConstImageView<T, C, I>(this->start + k * this->sliceStride,
+				this->rows, this->cols, (int)this->rowStride,
+				int2(this->x, this->y), this->id);
+		}
+	};
+	template<class T, int C, ImageType I> void Volume<T, C, I>::set(
+		const ConstVolumeView<T, C, I>& view) {
+		if (data.size() > 0 && view.vecPtr() >= &data.front()
+			&& view.vecPtr() <= &data.back()) {
+			//View into this volume, copy out before resizing
+			Volume<T, C, I> tmp(view);
+			*this = std::move(tmp);
+			return;
+		}
+		resize(view.rows, view.cols, view.slices);
+		id = view.id;
+		setPosition(view.position());
+		if (data.size() == 0)
+			return;
+#pragma omp parallel for
+		for (int k = 0; k < slices; k++) {
+			for (int j = 0; j < cols; j++) {
+				const vec<T, C>* src = view.vecPtr() + j * view.rowStride
+					+ k * view.sliceStride;
+				std::copy(src, src + rows,
+					&data[(j + k * (size_t)cols) * rows]);
+			}
+		}
+	}
 	template<class T, int C, ImageType I> void Transform(Volume<T, C, I>& im1,
 		Volume<T, C, I>& im2,
 		const std::function<void(vec<T, C>&, vec<T, C>&)>& func) {
@@ -901,6 +1105,100 @@ namespace aly {
 	typedef Volume<int, 1, ImageType::INT> Volume1i;
 	typedef Volume<uint32_t, 1, ImageType::UINT> Volume1ui;
 	typedef Volume<float, 1, ImageType::FLOAT> Volume1f;
+
+	typedef VolumeView<uint8_t, 4, ImageType::UBYTE> VolumeViewRGBA;
+	typedef VolumeView<int, 4, ImageType::INT> VolumeViewRGBAi;
+	typedef VolumeView<float, 4, ImageType::FLOAT> VolumeViewRGBAf;
+
+	typedef VolumeView<uint8_t, 3, ImageType::UBYTE> VolumeViewRGB;
+	typedef VolumeView<int, 3, ImageType::INT> VolumeViewRGBi;
+	typedef VolumeView<float, 3, ImageType::FLOAT> VolumeViewRGBf;
+
+	typedef VolumeView<uint8_t, 1, ImageType::UBYTE> VolumeViewA;
+	typedef VolumeView<int, 1, ImageType::INT> VolumeViewAi;
+	typedef VolumeView<float, 1, ImageType::FLOAT> VolumeViewAf;
+
+	typedef VolumeView<int8_t, 4, ImageType::BYTE> VolumeView4b;
+	typedef VolumeView<uint8_t, 4, ImageType::UBYTE> VolumeView4ub;
+	typedef VolumeView<uint16_t, 4, ImageType::USHORT> VolumeView4us;
+	typedef VolumeView<int16_t, 4, ImageType::SHORT> VolumeView4s;
+	typedef VolumeView<int, 4, ImageType::INT> VolumeView4i;
+	typedef VolumeView<uint32_t, 4, ImageType::UINT> VolumeView4ui;
+	typedef VolumeView<float, 4, ImageType::FLOAT> VolumeView4f;
+
+	typedef VolumeView<int8_t, 3, ImageType::BYTE> VolumeView3b;
+	typedef VolumeView<uint8_t, 3, ImageType::UBYTE> VolumeView3ub;
+	typedef VolumeView<uint16_t, 3, ImageType::USHORT> VolumeView3us;
+	typedef VolumeView<int16_t, 3, ImageType::SHORT> VolumeView3s;
+	typedef VolumeView<int, 3, ImageType::INT> VolumeView3i;
+	typedef VolumeView<uint32_t, 3, ImageType::UINT> VolumeView3ui;
+	typedef VolumeView<float, 3, ImageType::FLOAT> VolumeView3f;
+
+
+	typedef VolumeView<int8_t, 2, ImageType::BYTE> VolumeView2b;
+	typedef VolumeView<uint8_t, 2, ImageType::UBYTE> VolumeView2ub;
+	typedef VolumeView<uint16_t, 2, ImageType::USHORT> VolumeView2us;
+	typedef VolumeView<int16_t, 2, ImageType::SHORT> VolumeView2s;
+	typedef VolumeView<int, 2, ImageType::INT> VolumeView2i;
+	typedef VolumeView<uint32_t, 2, ImageType::UINT> VolumeView2ui;
+	typedef VolumeView<float, 2, ImageType::FLOAT> VolumeView2f;
+
+
+	typedef VolumeView<int8_t, 1, ImageType::BYTE> VolumeView1b;
+	typedef VolumeView<uint8_t, 1, ImageType::UBYTE> VolumeView1ub;
+	typedef VolumeView<uint16_t, 1, ImageType::USHORT> VolumeView1us;
+	typedef VolumeView<int16_t, 1, ImageType::SHORT> VolumeView1s;
+
+	typedef VolumeView<int, 1, ImageType::INT> VolumeView1i;
+	typedef VolumeView<uint32_t, 1, ImageType::UINT> VolumeView1ui;
+	typedef VolumeView<float, 1, ImageType::FLOAT> VolumeView1f;
+
+	typedef ConstVolumeView<uint8_t, 4, ImageType::UBYTE> ConstVolumeViewRGBA;
+	typedef ConstVolumeView<int, 4, ImageType::INT> ConstVolumeViewRGBAi;
+	typedef ConstVolumeView<float, 4, ImageType::FLOAT> ConstVolumeViewRGBAf;
+
+	typedef ConstVolumeView<uint8_t, 3, ImageType::UBYTE> ConstVolumeViewRGB;
+	typedef ConstVolumeView<int, 3, ImageType::INT> ConstVolumeViewRGBi;
+	typedef ConstVolumeView<float, 3, ImageType::FLOAT> ConstVolumeViewRGBf;
+
+	typedef ConstVolumeView<uint8_t, 1, ImageType::UBYTE> ConstVolumeViewA;
+	typedef ConstVolumeView<int, 1, ImageType::INT> ConstVolumeViewAi;
+	typedef ConstVolumeView<float, 1, ImageType::FLOAT> ConstVolumeViewAf;
+
+	typedef ConstVolumeView<int8_t, 4, ImageType::BYTE> ConstVolumeView4b;
+	typedef ConstVolumeView<uint8_t, 4, ImageType::UBYTE> ConstVolumeView4ub;
+	typedef ConstVolumeView<uint16_t, 4, ImageType::USHORT> ConstVolumeView4us;
+	typedef ConstVolumeView<int16_t, 4, ImageType::SHORT> ConstVolumeView4s;
+	typedef ConstVolumeView<int, 4, ImageType::INT> ConstVolumeView4i;
+	typedef ConstVolumeView<uint32_t, 4, ImageType::UINT> ConstVolumeView4ui;
+	typedef ConstVolumeView<float, 4, ImageType::FLOAT> ConstVolumeView4f;
+
+	typedef ConstVolumeView<int8_t, 3, ImageType::BYTE> ConstVolumeView3b;
+	typedef ConstVolumeView<uint8_t, 3, ImageType::UBYTE> ConstVolumeView3ub;
+	typedef ConstVolumeView<uint16_t, 3, ImageType::USHORT> ConstVolumeView3us;
+	typedef ConstVolumeView<int16_t, 3, ImageType::SHORT> ConstVolumeView3s;
+	typedef ConstVolumeView<int, 3, ImageType::INT> ConstVolumeView3i;
+	typedef ConstVolumeView<uint32_t, 3, ImageType::UINT> ConstVolumeView3ui;
+	typedef ConstVolumeView<float, 3, ImageType::FLOAT> ConstVolumeView3f;
+
+
+	typedef ConstVolumeView<int8_t, 2, ImageType::BYTE> ConstVolumeView2b;
+	typedef ConstVolumeView<uint8_t, 2, ImageType::UBYTE> ConstVolumeView2ub;
+	typedef ConstVolumeView<uint16_t, 2, ImageType::USHORT> ConstVolumeView2us;
+	typedef ConstVolumeView<int16_t, 2, ImageType::SHORT> ConstVolumeView2s;
+	typedef ConstVolumeView<int, 2, ImageType::INT> ConstVolumeView2i;
+	typedef ConstVolumeView<uint32_t, 2, ImageType::UINT> ConstVolumeView2ui;
+	typedef ConstVolumeView<float, 2, ImageType::FLOAT> ConstVolumeView2f;
+
+
+	typedef ConstVolumeView<int8_t, 1, ImageType::BYTE> ConstVolumeView1b;
+	typedef ConstVolumeView<uint8_t, 1, ImageType::UBYTE> ConstVolumeView1ub;
+	typedef ConstVolumeView<uint16_t, 1, ImageType::USHORT> ConstVolumeView1us;
+	typedef ConstVolumeView<int16_t, 1, ImageType::SHORT> ConstVolumeView1s;
+
+	typedef ConstVolumeView<int, 1, ImageType::INT> ConstVolumeView1i;
+	typedef ConstVolumeView<uint32_t, 1, ImageType::UINT> ConstVolumeView1ui;
+	typedef ConstVolumeView<float, 1, ImageType::FLOAT> ConstVolumeView1f;
 }
 ;
 
@@ -24,16 +24,164 @@
 #include <thread>
 #include <functional>
 #include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <deque>
+#include <map>
+#include <vector>
+#include <memory>
 namespace aly {
+/*
+ Shared work-stealing executor. Each thread pops tasks from the back of its own deque and idle
+ threads steal from the front of the others, tasks submitted from outside the pool are dealt
+ round-robin. Delayed tasks wait in a single scheduler thread instead of sleeping on a pool thread.
+ Blumofe, R. D., & Leiserson, C. E. (1999). Scheduling multithreaded computations by work stealing. Journal of the ACM, 46(5), 720-748.
+ */
+class WorkerPool {
+protected:
+	struct TaskQueue {
+		std::mutex lock;
+		std::deque<std::function<void()>> tasks;
+	};
+	template<class R> struct Continuation {
+		template<class F, class G> static auto run(F& func, G& continuation) -> decltype(continuation(func())) {
+			return continuation(func());
+		}
+	};
+	std::vector<std::unique_ptr<TaskQueue>> queues;
+	std::vector<std::thread> threads;
+	std::thread scheduler;
+	std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> delayed;
+	std::mutex idleLock;
+	std::condition_variable idleCondition;
+	std::mutex delayLock;
+	std::condition_variable delayCondition;
+	std::atomic<size_t> pending;
+	std::atomic<size_t> nextQueue;
+	std::atomic<bool> stopped;
+	bool pop(size_t index, std::function<void()>& task);
+	void run(size_t index);
+	void schedule();
+public:
+	//Zero threads uses max(4, hardware concurrency) so blocking UI tasks cannot starve background jobs.
+	WorkerPool(size_t threadCount = 0);
+	~WorkerPool();
+	size_t size() const {
+		return threads.size();
+	}
+	void enqueue(const std::function<void()>& task);
+	void enqueue(const std::function<void()>& task, long milliseconds);
+	template<class F> std::future<typename std::result_of<F()>::type> submit(F func) {
+		typedef typename std::result_of<F()>::type R;
+		std::shared_ptr<std::packaged_task<R()>> task(new std::packaged_task<R()>(func));
+		std::future<R> result = task->get_future();
+		enqueue([task] {(*task)();});
+		return result;
+	}
+	//Runs continuation on the result of func (or after func if it returns void) on the same pool thread.
+	template<class F, class G> auto submit(F func, G continuation) -> std::future<decltype(Continuation<typename std::result_of<F()>::type>::run(func, continuation))> {
+		return submit([func, continuation]() mutable {
+			return Continuation<typename std::result_of<F()>::type>::run(func, continuation);
+		});
+	}
+};
+template<> struct WorkerPool::Continuation<void> {
+	template<class F, class G> static auto run(F& func, G& continuation) -> decltype(continuation()) {
+		func();
+		return continuation();
+	}
+};
+WorkerPool& AlloyWorkerPool();
+/*
+ Unbounded lock-free multi-producer single-consumer queue. Producers swap themselves into the head
+ with one atomic exchange, only the consumer thread may call pop().
+ Vyukov, D. Intrusive MPSC node-based queue. http://www.1024cores.net/home/lock-free-algorithms/queues/intrusive-mpsc-node-based-queue
+ */
+template<class T> class MPSCQueue {
+protected:
+	struct Node {
+		std::atomic<Node*> next;
+		T value;
+		Node() :next(nullptr) {
+		}
+		Node(T&& value) :next(nullptr), value(std::move(value)) {
+		}
+	};
+	std::atomic<Node*> head;
+	Node* tail;
+public:
+	MPSCQueue() {
+		Node* stub = new Node();
+		head = stub;
+		tail = stub;
+	}
+	MPSCQueue(const MPSCQueue&) = delete;
+	MPSCQueue& operator=(const MPSCQueue&) = delete;
+	~MPSCQueue() {
+		T value;
+		while (pop(value)) {
+		}
+		delete tail;
+	}
+	void push(T&& value) {
+		Node* node = new Node(std::move(value));
+		Node* prev = head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+	//Returns false when empty, or while a concurrent push has not linked its node yet.
+	bool pop(T& value) {
+		Node* next = tail->next.load(std::memory_order_acquire);
+		if (next == nullptr) {
+			return false;
+		}
+		value = std::move(next->value);
+		delete tail;
+		tail = next;
+		return true;
+	}
+};
+/*
+ Workers are handles to tasks queued on AlloyWorkerPool(). The status word holds a generation count
+ and the run state, so a queued run that was canceled or superseded never touches its worker again.
+ */
+struct WorkerState {
+	std::atomic<uint64_t> status;
+	std::mutex lock;
+	std::condition_variable condition;
+	WorkerState() :status(0) {
+	}
+	void notify() {
+		{
+			std::lock_guard<std::mutex> lockMe(lock);
+		}
+		condition.notify_all();
+	}
+};
 class Worker {
 protected:
-	std::thread workerThread;
+	static const uint64_t IDLE;
+	static const uint64_t QUEUED;
+	static const uint64_t RUNNING;
+	std::shared_ptr<WorkerState> state;
 	const std::function<void()> executionTask;
 	const std::function<void()> endTask;
-	bool running = false;
-	bool complete = false;
-	bool requestCancel = false;
+	std::atomic<bool> running;
+	std::atomic<bool> complete;
+	std::atomic<bool> requestCancel;
+	long rescheduleDelay = -1;
 	virtual void task();
+	//Called before each execution, returns the delay in milliseconds before the first run.
+	virtual long prepare() {
+		return 0;
+	}
+	//Runs on a pool thread in place of a queued run that cancel() withdrew before it started.
+	virtual void canceled() {
+	}
+	//Sleeps before a blocking run, returns early once cancel() is requested.
+	virtual void wait(long milliseconds);
+	void queue(long milliseconds);
 	void done();
 public:
 	inline bool isRunning() const {
@@ -42,7 +190,7 @@ public:
 	inline bool isCanceled() const {
 		return requestCancel;
 	}
-	inline bool* isCanceledPtr() {
+	inline std::atomic<bool>* isCanceledPtr() {
 		return &requestCancel;
 	}
 	inline bool isComplete() const {
@@ -59,7 +207,10 @@ class RecurrentWorker: public Worker {
 protected:
 	const std::function<bool(uint64_t iteration)> recurrentTask;
 	long timeout;
-	void step();
+	uint64_t iteration = 0;
+	virtual void task() override;
+	virtual long prepare() override;
+	virtual void canceled() override;
 public:
 	void setTimeout(long milliseconds) {
 		timeout = milliseconds;
@@ -68,12 +219,16 @@ public:
 			long milliseconds);
 	RecurrentWorker(const std::function<bool(uint64_t iteration)>& func,
 			const std::function<void()>& end, long milliseconds);
+	virtual ~RecurrentWorker();
 };
 class Timer: public Worker {
 protected:
 	long timeout;
-	long samplingTime;
+	long samplingTime;//Poll interval of a blocking execute(), queued timers are scheduled instead.
 	virtual void task() override;
+	virtual long prepare() override;
+	virtual void canceled() override;
+	virtual void wait(long milliseconds) override;
 public:
 	void setTimeout(long milliseconds) {
 		timeout = milliseconds;
@@ -81,6 +236,7 @@ public:
 	Timer(const std::function<void()>& successFunc,
 			const std::function<void()>& failureFunc, long milliseconds,
 			long samplingTime);
+	virtual ~Timer();
 };
 typedef std::shared_ptr<Worker> WorkerTaskPtr;
 }
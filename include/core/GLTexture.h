@@ -354,6 +354,59 @@ public:
 		update();
 	}
 
+	void load(const ConstImageView<T, C, I>& image, bool mipmap = false) {
+		textureImage.set(image);
+		bounds = box2i( { 0, 0 }, { textureImage.width, textureImage.height });
+		setEnableMipmap(mipmap);
+		update();
+	}
+	void load(const ConstImageView<T, C, I>& image, int x, int y, int width,
+			int height, bool mipmap = false) {
+		textureImage.set(image);
+		bounds = box2i( { x, y }, { width, height });
+		setEnableMipmap(mipmap);
+		update();
+	}
+	/*
+	 Replaces the pixels at offset with a region, uploading straight from the view's rows with
+	 GL_UNPACK_ROW_LENGTH instead of packing them into a temporary first. Keeps the CPU copy in sync.
+	 */
+	void update(const ConstImageView<T, C, I>& region, const int2& offset) {
+		if (textureId == 0) {
+			throw std::runtime_error(
+					"Could not update image, texture buffer not allocated.");
+		}
+		if (offset.x < 0 || offset.y < 0
+				|| offset.x + region.width > textureImage.width
+				|| offset.y + region.height > textureImage.height) {
+			throw std::runtime_error(
+					MakeString() << "Texture region " << offset << " "
+							<< region.dimensions() << " exceeds dimensions "
+							<< textureImage.dimensions());
+		}
+		Set(region, textureImage.view(), offset);
+		if (isMultiSample()) {
+			update();
+			return;
+		}
+		context->begin(onScreen);
+		GLint rowLength = 0, alignment = 4;
+		glGetIntegerv(GL_UNPACK_ROW_LENGTH, &rowLength);
+		glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, region.stride);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glBindTexture(GL_TEXTURE_2D, textureId);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, offset.x, offset.y, region.width,
+				region.height, externalFormat, dataType, region.vecPtr());
+		if (mipmap) {
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+		context->end();
+		CHECK_GL_ERROR();
+	}
 	void load(const std::string& fileName, bool mipmap = false) {
 		ReadImageFromFile(fileName, textureImage);
 		bounds = box2i( { 0, 0 }, { textureImage.width, textureImage.height });
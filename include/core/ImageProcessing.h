@@ -138,122 +138,420 @@ template<class T, size_t M, size_t N> struct GaussianOperators {
 		}
 	}
 };
-template<size_t M, size_t N, class T, int C, ImageType I> void Gradient(
-		const Image<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY, double sigmaX = (0.607902736 * (M - 1) * 0.5),
-	double sigmaY = (0.607902736 * (N - 1) * 0.5)) {
-
-	double filterX[M][N], filterY[M][N];
-	GaussianKernelDerivative(filterX, filterY,sigmaX,sigmaY);
-
-	gX.resize(image.width, image.height);
-	gY.resize(image.width, image.height);
-#pragma omp parallel for
-	for (int i = 0; i < image.width; i++) {
-		for (int j = 0; j < image.height; j++) {
-			vec<double, C> vsumX(0.0);
-			vec<double, C> vsumY(0.0);
-			for (int ii = 0; ii < M; ii++) {
-				for (int jj = 0; jj < N; jj++) {
-					vec<T, C> val = image(i + ii - (int)M / 2, j + jj - (int)N / 2);
-					vsumX += filterX[ii][jj] * vec<double, C>(val);
-					vsumY += filterY[ii][jj] * vec<double, C>(val);
+template<class T, size_t M> void GaussianKernel(T (&kernel)[M],
+		T sigma = T(0.607902736 * (M - 1) * 0.5)) {
+	T sum = 0;
+	for (int i = 0; i < M; i++) {
+		double xn = (i - 0.5 * (M - 1)) / sigma;
+		T w = T(std::exp(-0.5 * xn * xn));
+		sum += w;
+		kernel[i] = w;
+	}
+	sum = T(1) / sum;
+	for (int i = 0; i < M; i++) {
+		kernel[i] *= sum;
+	}
+}
+template<class T, size_t M> void GaussianKernelDerivative(T (&kernel)[M],
+		T sigma = T(0.607902736 * (M - 1) * 0.5)) {
+	T sum = 0;
+	for (int i = 0; i < M; i++) {
+		double xn = (i - 0.5 * (M - 1)) / sigma;
+		T w = T(std::exp(-0.5 * xn * xn));
+		sum += w;
+		kernel[i] = T(w * xn / sigma);
+	}
+	sum = T(1) / sum;
+	for (int i = 0; i < M; i++) {
+		kernel[i] *= sum;
+	}
+}
+//Second derivative along one axis, normalized by the sum of the Gaussian. The 2D Laplacian is the sum of two of these separable terms.
+template<class T, size_t M> void GaussianKernelLaplacian(T (&kernel)[M],
+		T sigma = T(0.607902736 * (M - 1) * 0.5)) {
+	T sum = 0;
+	for (int i = 0; i < M; i++) {
+		double xn = (i - 0.5 * (M - 1)) / sigma;
+		T w = T(std::exp(-0.5 * xn * xn));
+		sum += w;
+		kernel[i] = T(w * (xn * xn - 1) / (sigma * sigma));
+	}
+	sum = T(1) / sum;
+	for (int i = 0; i < M; i++) {
+		kernel[i] *= sum;
+	}
+}
+/*
+ * Horizontal pass of a separable filter over source rows [s0,s1). Applies L row filters of length M
+ * and stores row s of filter l at out[l][(s-s0)*width]. Each row is copied once into a padded line with
+ * the same edge clamping as Image::operator(), so the inner loop runs without bounds checks.
+ */
+template<size_t L, size_t M, class K, class T, int C, ImageType I> void ConvolveRows(
+		const ConstImageView<T, C, I>& image, const K (&filter)[L][M], int s0,
+		int s1, std::vector<vec<K, C>> (&out)[L]) {
+	const int w = image.width;
+	std::vector<vec<K, C>> line(w + M - 1);
+	for (int l = 0; l < (int) L; l++) {
+		out[l].resize((s1 - s0) * (size_t) w);
+	}
+	for (int j = s0; j < s1; j++) {
+		const vec<T, C>* src = image.row(j);
+		for (int i = 0; i < (int) line.size(); i++) {
+			line[i] = vec<K, C>(src[clamp(i - (int) M / 2, 0, w - 1)]);
+		}
+		for (int l = 0; l < (int) L; l++) {
+			vec<K, C>* dst = &out[l][(j - s0) * (size_t) w];
+			for (int i = 0; i < w; i++) {
+				vec<K, C> vsum(K(0));
+				for (int ii = 0; ii < (int) M; ii++) {
+					vsum += filter[l][ii] * line[i + ii];
 				}
+				dst[i] = vsum;
 			}
-			gX(i, j) = vec<T, C>(vsumX);
-			gY(i, j) = vec<T, C>(vsumY);
 		}
 	}
 }
-template<size_t M, size_t N, class T, int C, ImageType I> void Laplacian(
-		const Image<T, C, I>& image, Image<T, C, I>& L, double sigmaX = (0.607902736 * (M - 1) * 0.5),
-	double sigmaY = (0.607902736 * (N - 1) * 0.5)) {
-	double filter[M][N];
-	GaussianKernelLaplacian(filter,sigmaX,sigmaY);
-	L.resize(image.width, image.height);
-#pragma omp parallel for
-	for (int i = 0; i < image.width; i++) {
-		for (int j = 0; j < image.height; j++) {
-			vec<double, C> vsum(0.0);
-			for (int ii = 0; ii < M; ii++) {
-				for (int jj = 0; jj < N; jj++) {
-					vec<T, C> val = image(i + ii - (int)M / 2, j + jj - (int)N / 2);
-					vsum += filter[ii][jj] * vec<double, C>(val);
+/*
+ * Vertical pass of a separable filter for output rows [j0,j1). Sums L column filters of length N
+ * applied to the row buffers produced by ConvolveRows, whose first row is source row s0. Output rows
+ * are accumulated from whole input rows, so all reads are sequential in memory.
+ */
+template<size_t L, size_t N, class K, class T, int C, ImageType I> void ConvolveColumns(
+		const vec<K, C>* const (&in)[L], int s0, const K (&filter)[L][N],
+		int j0, int j1, Image<T, C, I>& out) {
+	const int w = out.width;
+	const int h = out.height;
+	std::vector<vec<K, C>> line(w);
+	for (int j = j0; j < j1; j++) {
+		line.assign(w, vec<K, C>(K(0)));
+		for (int l = 0; l < (int) L; l++) {
+			for (int jj = 0; jj < (int) N; jj++) {
+				const vec<K, C>* src = in[l]
+						+ (clamp(j + jj - (int) N / 2, 0, h - 1) - s0)
+								* (size_t) w;
+				const K f = filter[l][jj];
+				for (int i = 0; i < w; i++) {
+					line[i] += f * src[i];
 				}
 			}
-			L(i, j) = vec<T, C>(vsum);
+		}
+		vec<T, C>* dst = &out.data[j * (size_t) w];
+		for (int i = 0; i < w; i++) {
+			dst[i] = vec<T, C>(line[i]);
 		}
 	}
 }
-template<size_t M, size_t N, class T, int C, ImageType I> void Smooth(
-		const Image<T, C, I>& image, Image<T, C, I>& B, double sigmaX = (0.607902736 * (M - 1) * 0.5),
-	double sigmaY = (0.607902736 * (N - 1) * 0.5)) {
-	double filter[M][N];
-	GaussianKernel(filter,sigmaX,sigmaY);
-	B.resize(image.width, image.height);
-#pragma omp parallel for
-	for (int i = 0; i < image.width; i++) {
-		for (int j = 0; j < image.height; j++) {
-			vec<double, C> vsum(0.0);
-			for (int ii = 0; ii < M; ii++) {
-				for (int jj = 0; jj < N; jj++) {
-					vec<T, C> val = image(i + ii - (int)M / 2, j + jj - (int)N / 2);
-					vsum += filter[ii][jj] * vec<double, C>(val);
-				}
+/*
+ * Runs the row pass in bands of CONVOLVE_BAND output rows plus the N-1 rows of overlap the column
+ * filter needs, then hands each band to columns(rows, s0, j0, j1). Temporaries are bounded by the
+ * band size instead of L full images of vec<K,C>, so double accumulators stay cheap.
+ */
+static const int CONVOLVE_BAND = 32;
+template<size_t L, size_t M, size_t N, class K, class T, int C, ImageType I, class F> void ConvolveBands(
+		const ConstImageView<T, C, I>& image, const K (&filter)[L][M],
+		const F& columns) {
+	const int h = image.height;
+	if (image.size() == 0)
+		return;
+	const int bands = (h + CONVOLVE_BAND - 1) / CONVOLVE_BAND;
+#pragma omp parallel
+	{
+		std::vector<vec<K, C>> tmp[L];
+#pragma omp for
+		for (int b = 0; b < bands; b++) {
+			const int j0 = b * CONVOLVE_BAND;
+			const int j1 = std::min(h, j0 + CONVOLVE_BAND);
+			const int s0 = std::max(0, j0 - (int) N / 2);
+			const int s1 = std::min(h, j1 + (int) (N - 1 - N / 2));
+			ConvolveRows(image, filter, s0, s1, tmp);
+			const vec<K, C>* rows[L];
+			for (int l = 0; l < (int) L; l++) {
+				rows[l] = tmp[l].data();
 			}
-			B(i, j) = vec<T, C>(vsum);
+			columns(rows, s0, j0, j1);
 		}
 	}
 }
+/*
+ * True if the view reads pixels stored in img. Banded filters write output rows while later bands
+ * still read the input, so in place calls work from a copy.
+ */
+template<class T, int C, ImageType I> bool Aliases(
+		const ConstImageView<T, C, I>& view, const Image<T, C, I>& img) {
+	if (view.size() == 0 || img.size() == 0)
+		return false;
+	const vec<T, C>* begin = img.data.data();
+	return view.vecPtr() >= begin && view.vecPtr() < begin + img.size();
+}
+/*
+ * Convolves an image with the separable kernel filterX[i]*filterY[j]. Produces the same result as
+ * a full MxN convolution with M+N instead of M*N taps per pixel. K is the accumulator type, use
+ * float for speed or double for accuracy.
+ */
+template<class K, size_t M, size_t N, class T, int C, ImageType I> void ConvolveSeparable(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& out,
+		const K (&filterX)[M], const K (&filterY)[N]) {
+	K fX[1][M], fY[1][N];
+	std::copy(filterX, filterX + M, fX[0]);
+	std::copy(filterY, filterY + N, fY[0]);
+	if (Aliases(image, out)) {
+		const Image<T, C, I> copy(image);
+		ConvolveSeparable(copy.view(), out, filterX, filterY);
+		return;
+	}
+	out.resize(image.width, image.height);
+	ConvolveBands<1, M, N>(image, fX,
+			[&](const vec<K, C>* const (&rows)[1], int s0, int j0, int j1) {
+				ConvolveColumns(rows, s0, fY, j0, j1, out);
+			});
+}
+template<class K, size_t M, size_t N, class T, int C, ImageType I> void ConvolveSeparable(
+		const Image<T, C, I>& image, Image<T, C, I>& out,
+		const K (&filterX)[M], const K (&filterY)[N]) {
+	ConvolveSeparable(image.view(), out, filterX, filterY);
+}
+template<class K, size_t M, size_t N, class T, int C, ImageType I> void ConvolveSeparable(
+		const ImageView<T, C, I>& image, Image<T, C, I>& out,
+		const K (&filterX)[M], const K (&filterY)[N]) {
+	ConvolveSeparable(ConstImageView<T, C, I>(image), out, filterX, filterY);
+}
+template<size_t M, size_t N, class K = double, class T, int C, ImageType I> void Gradient(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY, double sigmaX = (0.607902736 * (M - 1) * 0.5),
+	double sigmaY = (0.607902736 * (N - 1) * 0.5)) {
+	if (Aliases(image, gX) || Aliases(image, gY)) {
+		const Image<T, C, I> copy(image);
+		Gradient<M, N, K>(copy.view(), gX, gY, sigmaX, sigmaY);
+		return;
+	}
+	K filterX[2][M], filterY[1][N], filterDY[1][N];
+	GaussianKernelDerivative(filterX[0], K(sigmaX));
+	GaussianKernel(filterX[1], K(sigmaX));
+	GaussianKernel(filterY[0], K(sigmaY));
+	GaussianKernelDerivative(filterDY[0], K(sigmaY));
+	gX.resize(image.width, image.height);
+	gY.resize(image.width, image.height);
+	ConvolveBands<2, M, N>(image, filterX,
+			[&](const vec<K, C>* const (&rows)[2], int s0, int j0, int j1) {
+				const vec<K, C>* const rowsX[1] = {rows[0]};
+				const vec<K, C>* const rowsY[1] = {rows[1]};
+				ConvolveColumns(rowsX, s0, filterY, j0, j1, gX);
+				ConvolveColumns(rowsY, s0, filterDY, j0, j1, gY);
+			});
+}
+template<size_t M, size_t N, class K = double, class T, int C, ImageType I> void Gradient(
+		const Image<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY, double sigmaX = (0.607902736 * (M - 1) * 0.5),
+	double sigmaY = (0.607902736 * (N - 1) * 0.5)) {
+	Gradient<M, N, K>(image.view(), gX, gY, sigmaX, sigmaY);
+}
+template<size_t M, size_t N, class K = double, class T, int C, ImageType I> void Gradient(
+		const ImageView<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY, double sigmaX = (0.607902736 * (M - 1) * 0.5),
+	double sigmaY = (0.607902736 * (N - 1) * 0.5)) {
+	Gradient<M, N, K>(ConstImageView<T, C, I>(image), gX, gY, sigmaX, sigmaY);
+}
+template<size_t M, size_t N, class K = double, class T, int C, ImageType I> void Laplacian(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& L, double sigmaX = (0.607902736 * (M - 1) * 0.5),
+	double sigmaY = (0.607902736 * (N - 1) * 0.5)) {
+	if (Aliases(image, L)) {
+		const Image<T, C, I> copy(image);
+		Laplacian<M, N, K>(copy.view(), L, sigmaX, sigmaY);
+		return;
+	}
+	//Laplacian of Gaussian with zero mean, split into three separable terms: Lxx*G + G*Lyy - mean
+	K filterX[3][M], filterY[3][N];
+	GaussianKernelLaplacian(filterX[0], K(sigmaX));
+	GaussianKernel(filterY[0], K(sigmaY));
+	GaussianKernel(filterX[1], K(sigmaX));
+	GaussianKernelLaplacian(filterY[1], K(sigmaY));
+	double mean = 0;
+	for (int i = 0; i < (int) M; i++) {
+		mean += filterX[0][i];
+	}
+	for (int j = 0; j < (int) N; j++) {
+		mean += filterY[1][j];
+	}
+	mean /= (double) (M * N);
+	std::fill(filterX[2], filterX[2] + M, K(-mean));
+	std::fill(filterY[2], filterY[2] + N, K(1));
+	L.resize(image.width, image.height);
+	ConvolveBands<3, M, N>(image, filterX,
+			[&](const vec<K, C>* const (&rows)[3], int s0, int j0, int j1) {
+				ConvolveColumns(rows, s0, filterY, j0, j1, L);
+			});
+}
+template<size_t M, size_t N, class K = double, class T, int C, ImageType I> void Laplacian(
+		const Image<T, C, I>& image, Image<T, C, I>& L, double sigmaX = (0.607902736 * (M - 1) * 0.5),
+	double sigmaY = (0.607902736 * (N - 1) * 0.5)) {
+	Laplacian<M, N, K>(image.view(), L, sigmaX, sigmaY);
+}
+template<size_t M, size_t N, class K = double, class T, int C, ImageType I> void Laplacian(
+		const ImageView<T, C, I>& image, Image<T, C, I>& L, double sigmaX = (0.607902736 * (M - 1) * 0.5),
+	double sigmaY = (0.607902736 * (N - 1) * 0.5)) {
+	Laplacian<M, N, K>(ConstImageView<T, C, I>(image), L, sigmaX, sigmaY);
+}
+template<size_t M, size_t N, class K = double, class T, int C, ImageType I> void Smooth(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& B, double sigmaX = (0.607902736 * (M - 1) * 0.5),
+	double sigmaY = (0.607902736 * (N - 1) * 0.5)) {
+	K filterX[M], filterY[N];
+	GaussianKernel(filterX, K(sigmaX));
+	GaussianKernel(filterY, K(sigmaY));
+	ConvolveSeparable(image, B, filterX, filterY);
+}
+template<size_t M, size_t N, class K = double, class T, int C, ImageType I> void Smooth(
+		const Image<T, C, I>& image, Image<T, C, I>& B, double sigmaX = (0.607902736 * (M - 1) * 0.5),
+	double sigmaY = (0.607902736 * (N - 1) * 0.5)) {
+	Smooth<M, N, K>(image.view(), B, sigmaX, sigmaY);
+}
+template<size_t M, size_t N, class K = double, class T, int C, ImageType I> void Smooth(
+		const ImageView<T, C, I>& image, Image<T, C, I>& B, double sigmaX = (0.607902736 * (M - 1) * 0.5),
+	double sigmaY = (0.607902736 * (N - 1) * 0.5)) {
+	Smooth<M, N, K>(ConstImageView<T, C, I>(image), B, sigmaX, sigmaY);
+}
 template<class T, int C, ImageType I> void Smooth3x3(
 		const Image<T, C, I>& image, Image<T, C, I>& B) {
 	Smooth<3, 3>(image, B);
 }
+template<class T, int C, ImageType I> void Smooth3x3(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& B) {
+	Smooth<3, 3>(image, B);
+}
+template<class T, int C, ImageType I> void Smooth3x3(
+		const ImageView<T, C, I>& image, Image<T, C, I>& B) {
+	Smooth<3, 3>(ConstImageView<T, C, I>(image), B);
+}
 template<class T, int C, ImageType I> void Smooth5x5(
 		const Image<T, C, I>& image, Image<T, C, I>& B) {
 	Smooth<5, 5>(image, B);
 }
+template<class T, int C, ImageType I> void Smooth5x5(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& B) {
+	Smooth<5, 5>(image, B);
+}
+template<class T, int C, ImageType I> void Smooth5x5(
+		const ImageView<T, C, I>& image, Image<T, C, I>& B) {
+	Smooth<5, 5>(ConstImageView<T, C, I>(image), B);
+}
 template<class T, int C, ImageType I> void Smooth7x7(
 		const Image<T, C, I>& image, Image<T, C, I>& B) {
 	Smooth<7, 7>(image, B);
 }
+template<class T, int C, ImageType I> void Smooth7x7(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& B) {
+	Smooth<7, 7>(image, B);
+}
+template<class T, int C, ImageType I> void Smooth7x7(
+		const ImageView<T, C, I>& image, Image<T, C, I>& B) {
+	Smooth<7, 7>(ConstImageView<T, C, I>(image), B);
+}
 template<class T, int C, ImageType I> void Smooth11x11(
 		const Image<T, C, I>& image, Image<T, C, I>& B) {
 	Smooth<11, 11>(image, B);
 }
+template<class T, int C, ImageType I> void Smooth11x11(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& B) {
+	Smooth<11, 11>(image, B);
+}
+template<class T, int C, ImageType I> void Smooth11x11(
+		const ImageView<T, C, I>& image, Image<T, C, I>& B) {
+	Smooth<11, 11>(ConstImageView<T, C, I>(image), B);
+}
 
 template<class T, int C, ImageType I> void Laplacian3x3(
 		const Image<T, C, I>& image, Image<T, C, I>& L) {
 	Laplacian<3, 3>(image, L);
 }
+template<class T, int C, ImageType I> void Laplacian3x3(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& L) {
+	Laplacian<3, 3>(image, L);
+}
+template<class T, int C, ImageType I> void Laplacian3x3(
+		const ImageView<T, C, I>& image, Image<T, C, I>& L) {
+	Laplacian<3, 3>(ConstImageView<T, C, I>(image), L);
+}
 template<class T, int C, ImageType I> void Laplacian5x5(
 		const Image<T, C, I>& image, Image<T, C, I>& L) {
 	Laplacian<5, 5>(image, L);
 }
+template<class T, int C, ImageType I> void Laplacian5x5(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& L) {
+	Laplacian<5, 5>(image, L);
+}
+template<class T, int C, ImageType I> void Laplacian5x5(
+		const ImageView<T, C, I>& image, Image<T, C, I>& L) {
+	Laplacian<5, 5>(ConstImageView<T, C, I>(image), L);
+}
 template<class T, int C, ImageType I> void Laplacian7x7(
 		const Image<T, C, I>& image, Image<T, C, I>& L) {
 	Laplacian<7, 7>(image, L);
 }
+template<class T, int C, ImageType I> void Laplacian7x7(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& L) {
+	Laplacian<7, 7>(image, L);
+}
+template<class T, int C, ImageType I> void Laplacian7x7(
+		const ImageView<T, C, I>& image, Image<T, C, I>& L) {
+	Laplacian<7, 7>(ConstImageView<T, C, I>(image), L);
+}
 template<class T, int C, ImageType I> void Laplacian11x11(
 		const Image<T, C, I>& image, Image<T, C, I>& L) {
 	Laplacian<11, 11>(image, L);
 }
+template<class T, int C, ImageType I> void Laplacian11x11(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& L) {
+	Laplacian<11, 11>(image, L);
+}
+template<class T, int C, ImageType I> void Laplacian11x11(
+		const ImageView<T, C, I>& image, Image<T, C, I>& L) {
+	Laplacian<11, 11>(ConstImageView<T, C, I>(image), L);
+}
 
 template<class T, int C, ImageType I> void Gradient3x3(
 		const Image<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY) {
 	Gradient<3, 3>(image, gX, gY);
 }
+template<class T, int C, ImageType I> void Gradient3x3(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY) {
+	Gradient<3, 3>(image, gX, gY);
+}
+template<class T, int C, ImageType I> void Gradient3x3(
+		const ImageView<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY) {
+	Gradient<3, 3>(ConstImageView<T, C, I>(image), gX, gY);
+}
 template<class T, int C, ImageType I> void Gradient5x5(
 		const Image<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY) {
 	Gradient<5, 5>(image, gX, gY);
 }
+template<class T, int C, ImageType I> void Gradient5x5(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY) {
+	Gradient<5, 5>(image, gX, gY);
+}
+template<class T, int C, ImageType I> void Gradient5x5(
+		const ImageView<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY) {
+	Gradient<5, 5>(ConstImageView<T, C, I>(image), gX, gY);
+}
 template<class T, int C, ImageType I> void Gradient7x7(
 		const Image<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY) {
 	Gradient<7, 7>(image, gX, gY);
 }
+template<class T, int C, ImageType I> void Gradient7x7(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY) {
+	Gradient<7, 7>(image, gX, gY);
+}
+template<class T, int C, ImageType I> void Gradient7x7(
+		const ImageView<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY) {
+	Gradient<7, 7>(ConstImageView<T, C, I>(image), gX, gY);
+}
 template<class T, int C, ImageType I> void Gradient11x11(
 		const Image<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY) {
 	Gradient<11, 11>(image, gX, gY);
 }
+template<class T, int C, ImageType I> void Gradient11x11(
+		const ConstImageView<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY) {
+	Gradient<11, 11>(image, gX, gY);
+}
+template<class T, int C, ImageType I> void Gradient11x11(
+		const ImageView<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY) {
+	Gradient<11, 11>(ConstImageView<T, C, I>(image), gX, gY);
+}
 
 }
 
@@ -351,7 +351,7 @@ namespace aly {
 	}
 	AlloyContext::AlloyContext(int width, int height, const std::string& title,
 		const Theme& theme) :
-		nvgContext(nullptr), window(nullptr), theme(theme) {
+		deferredTaskCount(0), nvgContext(nullptr), window(nullptr), theme(theme) {
 
 		threadId=std::this_thread::get_id();
 		if (glfwInit() != GL_TRUE) {
@@ -474,33 +474,45 @@ namespace aly {
 		lastUpdateTime = std::chrono::steady_clock::now();
 		cursor = &Cursor::Normal;
 	}
-	void AlloyContext::addDeferredTask(const std::function<void()>& func,bool block) {
-		std::lock_guard<std::mutex> guard(taskLock);
-		deferredTasks.push_back(func);
+	std::shared_future<void> AlloyContext::addDeferredTask(const std::function<void()>& func,bool block) {
+		if (block && std::this_thread::get_id() == threadId) {
+			throw std::runtime_error("Cannot block and wait for deferred task on same thread as Alloy context.");
+		}
+		DeferredTask task;
+		task.func = func;
+		task.block = block;
+		std::shared_future<void> result = task.promise.get_future().share();
+		deferredTaskCount++;
+		deferredTasks.push(std::move(task));
 		if (block) {
-			std::thread::id currentThread=std::this_thread::get_id();
-			if (currentThread != threadId) {
-				std::this_thread::yield();
-				while (deferredTasks.size() > 0) {
-					std::this_thread::yield();
-					std::this_thread::sleep_for(std::chrono::milliseconds(100));
-				}
-			}
-			else {
-				throw std::runtime_error("Cannot block and wait for deferred task on same thread as Alloy context.");
-			}
+			result.get();
 		}
+		return result;
 	}
-	bool AlloyContext::executeDeferredTasks() {
-		std::lock_guard<std::mutex> guard(taskLock);
-		if (deferredTasks.size() > 0) {
-			for (std::function<void()>& func : deferredTasks) {
-				func();
+	bool AlloyContext::executeDeferredTasks(double timeBudget) {
+		size_t count = deferredTaskCount;
+		if (count == 0) {
+			return false;
+		}
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		DeferredTask task;
+		for (size_t n = 0; n < count && deferredTasks.pop(task); n++) {
+			deferredTaskCount--;
+			try {
+				task.func();
+				task.promise.set_value();
+			} catch (...) {
+				task.promise.set_exception(std::current_exception());
+				//Nobody is waiting on a non-blocking task, so report its failure on the context thread as before.
+				if (!task.block) {
+					throw;
+				}
+			}
+			if (timeBudget > 0.0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() > timeBudget) {
+				break;
 			}
-			deferredTasks.clear();
-			return true;
 		}
-		return false;
+		return true;
 	}
 	bool AlloyContext::isMouseContainedIn(Region* region) const {
 		return (region->getBounds().contains(cursorPosition));
@@ -615,8 +627,8 @@ namespace aly {
 			endTime - lastAnimateTime).count();
 		double cursorElapsed = std::chrono::duration<double>(
 			endTime - lastCursorTime).count();
-		if (deferredTasks.size() > 0) {
-			executeDeferredTasks();
+		if (deferredTaskCount > 0) {
+			executeDeferredTasks(DEFERRED_TASK_BUDGET_SEC);
 			cursorLocator.reset(viewSize);
 			rootNode.update(&cursorLocator);
 			dirtyCursorLocator = false;
@@ -19,11 +19,150 @@
 * THE SOFTWARE.
 */
 
-//Re-implementation of Paul Bourke's incremental Delaunay construction algorithm.
-//http://paulbourke.net/papers/triangulate/cpp.zip
+/*
+ Bowyer-Watson incremental Delaunay triangulation with ghost triangles for the convex hull,
+ visibility walk point location and exact orientation/incircle predicates.
+ Bowyer, A. (1981). Computing dirichlet tessellations. The Computer Journal, 24(2), 162-166.
+ Shewchuk, J. R. (1997). Adaptive precision floating-point arithmetic and fast robust geometric predicates.
+ Discrete & Computational Geometry, 18(3), 305-363.
+ */
 #include "AlloyDelaunay.h"
 #include <algorithm>
+#include <random>
+#include <cmath>
 namespace aly {
+	static const uint32_t NO_TRIANGLE = 0xFFFFFFFF;
+	static const double PREDICATE_EPSILON = 1.1102230246251565E-16;//2^-53
+	static const double ORIENT_ERROR_BOUND = (3.0 + 16.0 * PREDICATE_EPSILON) * PREDICATE_EPSILON;
+	static const double INCIRCLE_ERROR_BOUND = (10.0 + 96.0 * PREDICATE_EPSILON) * PREDICATE_EPSILON;
+	/*
+	 Floating-point expansions stored in increasing order of magnitude with zeros eliminated,
+	 so the sign of an expansion is the sign of its last component.
+	 */
+	typedef std::vector<double> Expansion;
+	static inline void TwoSum(double a, double b, double& x, double& y) {
+		x = a + b;
+		double bv = x - a;
+		double av = x - bv;
+		y = (a - av) + (b - bv);
+	}
+	static void GrowExpansion(Expansion& e, double b) {
+		double q = b, h;
+		size_t k = 0;
+		for (size_t i = 0; i < e.size(); i++) {
+			TwoSum(q, e[i], q, h);
+			if (h != 0.0) {
+				e[k++] = h;
+			}
+		}
+		e.resize(k);
+		if (q != 0.0) {
+			e.push_back(q);
+		}
+	}
+	static Expansion ExpansionDifference(double a, double b) {
+		Expansion e;
+		GrowExpansion(e, a);
+		GrowExpansion(e, -b);
+		return e;
+	}
+	static Expansion ExpansionSum(Expansion e, const Expansion& f) {
+		for (double b : f) {
+			GrowExpansion(e, b);
+		}
+		return e;
+	}
+	static Expansion ExpansionProduct(const Expansion& e, const Expansion& f) {
+		Expansion h;
+		for (double a : e) {
+			for (double b : f) {
+				double x = a * b;
+				GrowExpansion(h, std::fma(a, b, -x));
+				GrowExpansion(h, x);
+			}
+		}
+		return h;
+	}
+	static Expansion ExpansionNegate(Expansion e) {
+		for (double& a : e) {
+			a = -a;
+		}
+		return e;
+	}
+	static inline int ExpansionSign(const Expansion& e) {
+		return (e.empty()) ? 0 : ((e.back() > 0.0) ? 1 : -1);
+	}
+	/*
+	 Positive if a, b, c are in counter-clockwise order, negative if clockwise and zero if collinear.
+	 */
+	static int Orient(const double2& a, const double2& b, const double2& c) {
+		double left = (a.x - c.x) * (b.y - c.y);
+		double right = (a.y - c.y) * (b.x - c.x);
+		double det = left - right;
+		double errBound = ORIENT_ERROR_BOUND * (std::abs(left) + std::abs(right));
+		if (det > errBound) {
+			return 1;
+		} else if (-det > errBound) {
+			return -1;
+		}
+		Expansion acx = ExpansionDifference(a.x, c.x);
+		Expansion acy = ExpansionDifference(a.y, c.y);
+		Expansion bcx = ExpansionDifference(b.x, c.x);
+		Expansion bcy = ExpansionDifference(b.y, c.y);
+		return ExpansionSign(ExpansionSum(ExpansionProduct(acx, bcy), ExpansionNegate(ExpansionProduct(acy, bcx))));
+	}
+	/*
+	 Positive if d lies inside the circle through the counter-clockwise triangle a, b, c,
+	 negative if outside and zero if cocircular.
+	 */
+	static int InCircle(const double2& a, const double2& b, const double2& c, const double2& d) {
+		double adx = a.x - d.x, ady = a.y - d.y;
+		double bdx = b.x - d.x, bdy = b.y - d.y;
+		double cdx = c.x - d.x, cdy = c.y - d.y;
+		double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+		double cdxady = cdx * ady, adxcdy = adx * cdy;
+		double adxbdy = adx * bdy, bdxady = bdx * ady;
+		double alift = adx * adx + ady * ady;
+		double blift = bdx * bdx + bdy * bdy;
+		double clift = cdx * cdx + cdy * cdy;
+		double det = alift * (bdxcdy - cdxbdy) + blift * (cdxady - adxcdy) + clift * (adxbdy - bdxady);
+		double permanent = (std::abs(bdxcdy) + std::abs(cdxbdy)) * alift
+			+ (std::abs(cdxady) + std::abs(adxcdy)) * blift
+			+ (std::abs(adxbdy) + std::abs(bdxady)) * clift;
+		double errBound = INCIRCLE_ERROR_BOUND * permanent;
+		if (det > errBound) {
+			return 1;
+		} else if (-det > errBound) {
+			return -1;
+		}
+		Expansion eadx = ExpansionDifference(a.x, d.x), eady = ExpansionDifference(a.y, d.y);
+		Expansion ebdx = ExpansionDifference(b.x, d.x), ebdy = ExpansionDifference(b.y, d.y);
+		Expansion ecdx = ExpansionDifference(c.x, d.x), ecdy = ExpansionDifference(c.y, d.y);
+		Expansion ealift = ExpansionSum(ExpansionProduct(eadx, eadx), ExpansionProduct(eady, eady));
+		Expansion eblift = ExpansionSum(ExpansionProduct(ebdx, ebdx), ExpansionProduct(ebdy, ebdy));
+		Expansion eclift = ExpansionSum(ExpansionProduct(ecdx, ecdx), ExpansionProduct(ecdy, ecdy));
+		Expansion bc = ExpansionSum(ExpansionProduct(ebdx, ecdy), ExpansionNegate(ExpansionProduct(ecdx, ebdy)));
+		Expansion ca = ExpansionSum(ExpansionProduct(ecdx, eady), ExpansionNegate(ExpansionProduct(eadx, ecdy)));
+		Expansion ab = ExpansionSum(ExpansionProduct(eadx, ebdy), ExpansionNegate(ExpansionProduct(ebdx, eady)));
+		return ExpansionSign(ExpansionSum(ExpansionSum(ExpansionProduct(ealift, bc), ExpansionProduct(eblift, ca)), ExpansionProduct(eclift, ab)));
+	}
+	//Distance of (x,y) along a Hilbert curve filling a 2^16 x 2^16 grid.
+	static uint32_t HilbertIndex(uint32_t x, uint32_t y) {
+		uint32_t d = 0;
+		for (uint32_t s = 1 << 15; s > 0; s >>= 1) {
+			uint32_t rx = (x & s) ? 1 : 0;
+			uint32_t ry = (y & s) ? 1 : 0;
+			d += s * s * ((3 * rx) ^ ry);
+			if (ry == 0) {
+				if (rx == 1) {
+					x = 0xFFFF - x;
+					y = 0xFFFF - y;
+				}
+				std::swap(x, y);
+			}
+		}
+		return d;
+	}
 	bool CircumCircle(float xp, float yp, float x1, float y1, float x2,
 		float y2, float x3, float y3, float &xc, float &yc, float &r) {
 
@@ -67,123 +206,261 @@ namespace aly {
 		drsqr = dx * dx + dy * dy;
 		return((drsqr <= rsqr) ? true : false);
 	}
-	void Triangulate(std::vector<float2>& pxyz, std::vector<int3>& triangles) {
-		int nv = (int)pxyz.size();
-		std::vector<int2> edges;
-		bool inside;
-		int i, j, k;
-		float xp, yp, x1, y1, x2, y2, x3, y3, xc, yc, r;
-		float xmin, xmax, ymin, ymax, xmid, ymid;
-		float dx, dy, dmax;
-		std::vector<bool> complete;
-		/*
-		Find the maximum and minimum vertex bounds.
-		This is to allow calculation of the bounding triangle
-		*/
-		xmin = pxyz[0].x;
-		ymin = pxyz[0].y;
-		xmax = xmin;
-		ymax = ymin;
-		for (i = 1; i < nv; i++) {
-			if (pxyz[i].x < xmin) xmin = pxyz[i].x;
-			if (pxyz[i].x > xmax) xmax = pxyz[i].x;
-			if (pxyz[i].y < ymin) ymin = pxyz[i].y;
-			if (pxyz[i].y > ymax) ymax = pxyz[i].y;
-		}
-		dx = xmax - xmin;
-		dy = ymax - ymin;
-		dmax = (dx > dy) ? dx : dy;
-		xmid = (xmax + xmin) *0.5f;
-		ymid = (ymax + ymin) *0.5f;
-		float scale = 20.0f;
-		triangles.clear();
-		pxyz.push_back(float2(xmid - scale * dmax, ymid - dmax));
-		pxyz.push_back(float2(xmid, ymid + scale * dmax));
-		pxyz.push_back(float2(xmid + scale * dmax, ymid - dmax));
-		triangles.push_back(int3( nv, nv + 1, nv + 2 ));
-		complete.push_back(false);
-		for (i = 0; i < (int)pxyz.size(); i++) {
-			xp = pxyz[i].x;
-			yp = pxyz[i].y;
-			edges.clear();
-			for (j = 0; j < (int)triangles.size(); j++) {
-				if (complete[j])
-					continue;
-				x1 = pxyz[triangles[j].x].x;
-				y1 = pxyz[triangles[j].x].y;
-				x2 = pxyz[triangles[j].y].x;
-				y2 = pxyz[triangles[j].y].y;
-				x3 = pxyz[triangles[j].z].x;
-				y3 = pxyz[triangles[j].z].y;
-				inside = CircumCircle(xp, yp, x1, y1, x2, y2, x3, y3, xc, yc, r);
-				if (xc + r < xp)complete[j] = true;
-				if (inside) {
-					edges.push_back(int2( triangles[j].x, triangles[j].y ));
-					edges.push_back(int2(triangles[j].y, triangles[j].z ));
-					edges.push_back(int2(triangles[j].z, triangles[j].x ));
-					triangles.erase(triangles.begin() + j);
-					complete.erase(complete.begin() + j);
-					j--;
+	/*
+	 Triangles are stored counter-clockwise with neighbors[t][i] the triangle across the edge opposite vertex i.
+	 Hull edges are closed by ghost triangles that share the vertex "ghost" (index points.size()), so every
+	 triangle has three neighbors and points outside the hull are located and inserted like any other.
+	 */
+	void Triangulate(const std::vector<float2>& points, const std::vector<uint32_t>& order, std::vector<uint3>& output) {
+		output.clear();
+		const uint32_t N = (uint32_t)points.size();
+		const uint32_t ghost = N;
+		if (order.size() < 3) {
+			return;
+		}
+		std::vector<double2> pts(N);
+		for (uint32_t n = 0; n < N; n++) {
+			pts[n] = double2(points[n].x, points[n].y);
+		}
+		//Find a non-degenerate seed triangle.
+		uint32_t a = order[0], b = NO_TRIANGLE, c = NO_TRIANGLE;
+		size_t bi = 0, ci = 0;
+		for (size_t i = 1; i < order.size() && b == NO_TRIANGLE; i++) {
+			if (pts[order[i]] != pts[a]) {
+				b = order[i];
+				bi = i;
+			}
+		}
+		if (b == NO_TRIANGLE) {
+			return;
+		}
+		for (size_t i = 1; i < order.size() && c == NO_TRIANGLE; i++) {
+			if (Orient(pts[a], pts[b], pts[order[i]]) != 0) {
+				c = order[i];
+				ci = i;
+			}
+		}
+		if (c == NO_TRIANGLE) {
+			return;
+		}
+		if (Orient(pts[a], pts[b], pts[c]) < 0) {
+			std::swap(b, c);
+		}
+		std::vector<uint3> vertexes;
+		std::vector<uint3> neighbors;
+		vertexes.reserve(2 * order.size() + 2);
+		neighbors.reserve(2 * order.size() + 2);
+		vertexes.push_back(uint3(a, b, c));
+		vertexes.push_back(uint3(b, a, ghost));
+		vertexes.push_back(uint3(c, b, ghost));
+		vertexes.push_back(uint3(a, c, ghost));
+		neighbors.push_back(uint3(2, 3, 1));
+		neighbors.push_back(uint3(3, 2, 0));
+		neighbors.push_back(uint3(1, 3, 0));
+		neighbors.push_back(uint3(2, 1, 0));
+		std::vector<uint32_t> visited(vertexes.size(), 0);
+		std::vector<char> conflicts(vertexes.size(), 0);
+		std::vector<uint32_t> links(N + 1, NO_TRIANGLE);
+		std::vector<uint32_t> cavity;
+		std::vector<uint3> boundary;//edge start, edge end, outside triangle
+		std::vector<uint32_t> created;
+		auto isGhost = [&](uint32_t t) {
+			const uint3& v = vertexes[t];
+			return (v.x == ghost || v.y == ghost || v.z == ghost);
+		};
+		//Ghost triangles conflict with points strictly outside their hull edge, or inside the edge itself.
+		auto inConflict = [&](uint32_t t, const double2& p) {
+			const uint3& v = vertexes[t];
+			if (v.x != ghost && v.y != ghost && v.z != ghost) {
+				return InCircle(pts[v.x], pts[v.y], pts[v.z], p) > 0;
+			}
+			int k = (v.x == ghost) ? 0 : ((v.y == ghost) ? 1 : 2);
+			const double2& q1 = pts[v[(k + 1) % 3]];
+			const double2& q2 = pts[v[(k + 2) % 3]];
+			int o = Orient(q1, q2, p);
+			if (o != 0) {
+				return o > 0;
+			}
+			if (q1.x != q2.x) {
+				return (p.x > std::min(q1.x, q2.x) && p.x < std::max(q1.x, q2.x));
+			}
+			return (p.y > std::min(q1.y, q2.y) && p.y < std::max(q1.y, q2.y));
+		};
+		auto contains = [&](uint32_t t, const double2& p) {
+			const uint3& v = vertexes[t];
+			for (int i = 0; i < 3; i++) {
+				if (Orient(pts[v[(i + 1) % 3]], pts[v[(i + 2) % 3]], p) < 0) {
+					return false;
 				}
 			}
-			/*
-			Tag multiple edges
-			Note: if all triangles are specified anticlockwise then all
-			interior edges are opposite pointing in direction.
-			*/
-			for (j = 0; j < (int)edges.size() - 1; j++) {
-				for (k = j + 1; k < (int)edges.size(); k++) {
-					if ((edges[j].x == edges[k].y) && (edges[j].y == edges[k].x)) {
-						edges[j] = int2(-1, -1 );
-						edges[k] = int2(-1, -1 );
+			return true;
+		};
+		uint32_t start = 0;
+		uint32_t seed = 0x9E3779B9;
+		uint32_t stamp = 0;
+		for (size_t idx = 1; idx < order.size(); idx++) {
+			if (idx == bi || idx == ci) {
+				continue;
+			}
+			const uint32_t pid = order[idx];
+			const double2& p = pts[pid];
+			//Visibility walk from the most recently created triangle.
+			uint32_t t = start;
+			size_t steps = 0;
+			while (t != NO_TRIANGLE) {
+				if (++steps > vertexes.size()) {
+					t = NO_TRIANGLE;
+					break;
+				}
+				const uint3& v = vertexes[t];
+				if (isGhost(t)) {
+					if (inConflict(t, p)) {
+						break;
 					}
-					/* Shouldn't need the following, see note above */
-					if ((edges[j].x == edges[k].x) && (edges[j].y == edges[k].y)) {
-						edges[j] = int2(-1, -1 );
-						edges[k] = int2(-1, -1 );
+					t = neighbors[t][(v.x == ghost) ? 0 : ((v.y == ghost) ? 1 : 2)];
+					continue;
+				}
+				seed = seed * 1664525u + 1013904223u;
+				int rot = (int)((seed >> 16) % 3);
+				uint32_t next = t;
+				for (int e = 0; e < 3; e++) {
+					int i = (rot + e) % 3;
+					if (Orient(pts[v[(i + 1) % 3]], pts[v[(i + 2) % 3]], p) < 0) {
+						next = neighbors[t][i];
+						break;
+					}
+				}
+				if (next == t) {
+					break;
+				}
+				t = next;
+			}
+			if (t == NO_TRIANGLE) {
+				for (uint32_t s = 0; s < (uint32_t)vertexes.size(); s++) {
+					if ((isGhost(s)) ? inConflict(s, p) : contains(s, p)) {
+						t = s;
+						break;
 					}
 				}
+				if (t == NO_TRIANGLE) {
+					continue;
+				}
 			}
-			/*
-			Form new triangles for the current point
-			Skipping over any tagged edges.
-			All edges are arranged in clockwise order.
-			*/
-			for (j = 0; j < (int)edges.size(); j++) {
-				if (edges[j].x < 0 || edges[j].y < 0)
+			if (!isGhost(t)) {
+				const uint3& v = vertexes[t];
+				if (pts[v.x] == p || pts[v.y] == p || pts[v.z] == p) {
 					continue;
-				triangles.push_back(int3(edges[j].x, edges[j].y, i ));
-				complete.push_back(false);
+				}
+			}
+			//Grow the cavity of triangles whose circumcircle contains p.
+			stamp++;
+			cavity.clear();
+			boundary.clear();
+			cavity.push_back(t);
+			visited[t] = stamp;
+			conflicts[t] = 1;
+			for (size_t n = 0; n < cavity.size(); n++) {
+				uint32_t ct = cavity[n];
+				for (int i = 0; i < 3; i++) {
+					uint32_t nt = neighbors[ct][i];
+					if (visited[nt] != stamp) {
+						visited[nt] = stamp;
+						conflicts[nt] = inConflict(nt, p);
+						if (conflicts[nt]) {
+							cavity.push_back(nt);
+						}
+					}
+					if (!conflicts[nt]) {
+						boundary.push_back(uint3(vertexes[ct][(i + 1) % 3], vertexes[ct][(i + 2) % 3], nt));
+					}
+				}
+			}
+			//Connect p to the cavity boundary, reusing the slots of deleted triangles.
+			created.resize(boundary.size());
+			for (size_t n = 0; n < boundary.size(); n++) {
+				const uint3& edge = boundary[n];
+				uint32_t nt;
+				if (n < cavity.size()) {
+					nt = cavity[n];
+				} else {
+					nt = (uint32_t)vertexes.size();
+					vertexes.push_back(uint3());
+					neighbors.push_back(uint3());
+					visited.push_back(0);
+					conflicts.push_back(0);
+				}
+				created[n] = nt;
+				vertexes[nt] = uint3(edge.x, edge.y, pid);
+				neighbors[nt].z = edge.z;
+				uint3& outside = neighbors[edge.z];
+				const uint3& ov = vertexes[edge.z];
+				for (int i = 0; i < 3; i++) {
+					if (ov[(i + 1) % 3] == edge.y && ov[(i + 2) % 3] == edge.x) {
+						outside[i] = nt;
+						break;
+					}
+				}
+				links[edge.x] = nt;
+			}
+			start = created.front();
+			for (uint32_t nt : created) {
+				uint32_t next = links[vertexes[nt].y];
+				neighbors[nt].x = next;
+				neighbors[next].y = nt;
+				if (!isGhost(nt)) {
+					start = nt;
+				}
+			}
+		}
+		//Emit clockwise triangles to match the winding of the original implementation.
+		output.reserve(vertexes.size() / 2);
+		for (uint32_t t = 0; t < (uint32_t)vertexes.size(); t++) {
+			if (!isGhost(t)) {
+				const uint3& v = vertexes[t];
+				output.push_back(uint3(v.x, v.z, v.y));
 			}
 		}
 	}
-	void MakeDelaunay(const std::vector<float2>& vertexes, std::vector<uint3>& output)
-	{
+	void MakeDelaunay(const std::vector<float2>& vertexes, std::vector<uint3>& output) {
 		output.clear();
 		if (vertexes.size() < 3) {
 			return;
 		}
-		int N = (int)vertexes.size();
-		std::vector<std::pair<float2, int>> vertPairs(N);
-		int index = 0;
-		for (const float2& vert : vertexes) {
-			vertPairs[index] = std::pair<float2, int>(vert, index);
-			index++;
+		const uint32_t N = (uint32_t)vertexes.size();
+		float2 minPt = vertexes[0];
+		float2 maxPt = vertexes[0];
+		for (const float2& pt : vertexes) {
+			minPt = aly::min(minPt, pt);
+			maxPt = aly::max(maxPt, pt);
 		}
-		std::sort(vertPairs.begin(), vertPairs.end());
-		std::vector<float2> tmp;
-		tmp.reserve(vertPairs.size());
-		for (std::pair<float2, int>& pr : vertPairs) {
-			tmp.push_back(pr.first);
+		float2 scale = maxPt - minPt;
+		scale.x = (scale.x > 0.0f) ? 65535.0f / scale.x : 0.0f;
+		scale.y = (scale.y > 0.0f) ? 65535.0f / scale.y : 0.0f;
+		std::vector<uint32_t> order(N);
+		for (uint32_t n = 0; n < N; n++) {
+			order[n] = n;
 		}
-		std::vector<int3>	cTriangles;
-		Triangulate(tmp, cTriangles);
-		for (int3& triangle : cTriangles) {
-			if (triangle.x < N &&
-				triangle.y < N &&
-				triangle.z < N) {
-				output.push_back(uint3((uint32_t)vertPairs[triangle.x].second, (uint32_t)vertPairs[triangle.y].second, vertPairs[triangle.z].second));
-			}
+		//Fixed seed so the triangulation of degenerate (cocircular) input is reproducible.
+		std::mt19937 gen(1234567);
+		std::shuffle(order.begin(), order.end(), gen);
+		std::vector<std::pair<uint32_t, uint32_t>> keys(N);
+		for (uint32_t n = 0; n < N; n++) {
+			float2 pt = (vertexes[order[n]] - minPt) * scale;
+			keys[n] = std::pair<uint32_t, uint32_t>(HilbertIndex((uint32_t)clamp(pt.x, 0.0f, 65535.0f), (uint32_t)clamp(pt.y, 0.0f, 65535.0f)), order[n]);
+		}
+		//BRIO rounds: the last half of the shuffled points, the quarter before it and so on, each sorted along the curve.
+		uint32_t end = N;
+		while (end > 0) {
+			uint32_t begin = (end > 64) ? end / 2 : 0;
+			std::sort(keys.begin() + begin, keys.begin() + end);
+			end = begin;
 		}
+		for (uint32_t n = 0; n < N; n++) {
+			order[n] = keys[n].second;
+		}
+		Triangulate(vertexes, order, output);
+	}
+	void Triangulate(std::vector<float2>& pts, std::vector<uint3>& triangles) {
+		MakeDelaunay(pts, triangles);
 	}
 }
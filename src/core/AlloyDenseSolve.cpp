@@ -21,8 +21,188 @@
 #include "AlloyDenseSolve.h"
 #include "AlloyFileUtil.h"
 namespace aly {
+template<int C> static void LaplaceFillDivergence(
+		const Image<float, C, ImageType::FLOAT>& sourceImg,
+		Image<float, C, ImageType::FLOAT>& targetImg,
+		Image<float, C, ImageType::FLOAT>& divergence) {
+	typedef vec<float, C> ValueType;
+	divergence.resize(sourceImg.width, sourceImg.height);
+	divergence.set(ValueType(0.0f));
+#pragma omp parallel for
+	for (int j = 1; j < sourceImg.height - 1; j++) {
+		for (int i = 1; i < sourceImg.width - 1; i++) {
+			ValueType src = sourceImg(i, j);
+			ValueType tar = targetImg(i, j);
+			float alpha = src[C - 1];
+			src[C - 1] = 1.0f;
+			ValueType val1 = sourceImg(i, j);
+			ValueType val2 = sourceImg(i, j + 1);
+			ValueType val3 = sourceImg(i, j - 1);
+			ValueType val4 = sourceImg(i + 1, j);
+			ValueType val5 = sourceImg(i - 1, j);
+			ValueType div(0.0f);
+			if (val1[C - 1] > 0 && val2[C - 1] > 0 && val3[C - 1] > 0
+					&& val4[C - 1] > 0 && val5[C - 1] > 0) {
+				div = val1 - 0.25f * (val2 + val3 + val4 + val5);
+				div[C - 1] = 0.0f;
+			}
+			divergence(i, j) = alpha * div;
+			targetImg(i, j) = mix(tar, src, alpha);
+		}
+	}
+}
+template<int C> static void PoissonInpaintDivergence(
+		const Image<float, C, ImageType::FLOAT>& sourceImg,
+		const Image<float, C, ImageType::FLOAT>& targetImg,
+		Image<float, C, ImageType::FLOAT>& divergence) {
+	typedef vec<float, C> ValueType;
+	divergence.resize(sourceImg.width, sourceImg.height);
+	divergence.set(ValueType(0.0f));
+#pragma omp parallel for
+	for (int j = 1; j < sourceImg.height - 1; j++) {
+		for (int i = 1; i < sourceImg.width - 1; i++) {
+			ValueType src = sourceImg(i, j);
+			float alpha = src[C - 1];
+			ValueType val1 = sourceImg(i, j);
+			ValueType val2 = sourceImg(i, j + 1);
+			ValueType val3 = sourceImg(i, j - 1);
+			ValueType val4 = sourceImg(i + 1, j);
+			ValueType val5 = sourceImg(i - 1, j);
+			ValueType divSrc(0.0f);
+			if (val1[C - 1] > 0 && val2[C - 1] > 0 && val3[C - 1] > 0
+					&& val4[C - 1] > 0 && val5[C - 1] > 0) {
+				divSrc = val1 - 0.25f * (val2 + val3 + val4 + val5);
+				divSrc[C - 1] = 0.0f;
+			}
+			val1 = targetImg(i, j);
+			val2 = targetImg(i, j + 1);
+			val3 = targetImg(i, j - 1);
+			val4 = targetImg(i + 1, j);
+			val5 = targetImg(i - 1, j);
+			ValueType divTar(0.0f);
+			if (val1[C - 1] > 0 && val2[C - 1] > 0 && val3[C - 1] > 0
+					&& val4[C - 1] > 0 && val5[C - 1] > 0) {
+				divTar = val1 - 0.25f * (val2 + val3 + val4 + val5);
+				divTar[C - 1] = 0.0f;
+			}
+			divergence(i, j) = mix(divTar, divSrc, alpha);
+		}
+	}
+}
+template<int C> static void PoissonBlendDivergence(
+		const Image<float, C, ImageType::FLOAT>& sourceImg,
+		Image<float, C, ImageType::FLOAT>& divergence) {
+	typedef vec<float, C> ValueType;
+	divergence.resize(sourceImg.width, sourceImg.height);
+	divergence.set(ValueType(0.0f));
+#pragma omp parallel for
+	for (int j = 1; j < sourceImg.height - 1; j++) {
+		for (int i = 1; i < sourceImg.width - 1; i++) {
+			ValueType val1 = sourceImg(i, j);
+			ValueType val2 = sourceImg(i, j + 1);
+			ValueType val3 = sourceImg(i, j - 1);
+			ValueType val4 = sourceImg(i + 1, j);
+			ValueType val5 = sourceImg(i - 1, j);
+			ValueType div(0.0f);
+			if (val1[C - 1] > 0 && val2[C - 1] > 0 && val3[C - 1] > 0
+					&& val4[C - 1] > 0 && val5[C - 1] > 0) {
+				div = val1 - 0.25f * (val2 + val3 + val4 + val5);
+				div[C - 1] = 0.0f;
+			}
+			divergence(i, j) = div;
+		}
+	}
+}
+//Every pixel except the image border is solved for. Border colors stay fixed.
+static void InteriorMask(int w, int h, Image1ub& mask) {
+	mask.resize(w, h);
+	mask.setZero();
+#pragma omp parallel for
+	for (int j = 1; j < h - 1; j++) {
+		for (int i = 1; i < w - 1; i++) {
+			mask(i, j).x = 1;
+		}
+	}
+}
+//Pixels whose 4-neighborhood lies inside the target alpha mask are solved for.
+template<int C> static void BlendMask(
+		const Image<float, C, ImageType::FLOAT>& targetImg, float threshold,
+		Image1ub& mask) {
+	mask.resize(targetImg.width, targetImg.height);
+	mask.setZero();
+#pragma omp parallel for
+	for (int j = 1; j < targetImg.height - 1; j++) {
+		for (int i = 1; i < targetImg.width - 1; i++) {
+			if (targetImg(i, j)[C - 1] >= threshold
+					&& targetImg(i, j + 1)[C - 1] >= threshold
+					&& targetImg(i, j - 1)[C - 1] >= threshold
+					&& targetImg(i + 1, j)[C - 1] >= threshold
+					&& targetImg(i - 1, j)[C - 1] >= threshold) {
+				mask(i, j).x = 1;
+			}
+		}
+	}
+}
+/*
+ * Solver and right hand side kept per thread and channel count. Repeated solves at the same
+ * resolution reuse the level hierarchy and the fine grid buffers instead of reallocating them.
+ */
+template<int C> struct MultigridWorkspace {
+	PoissonMultigrid<C> solver;
+	Image<float, C, ImageType::FLOAT> divergence;
+	Image1ub mask;
+	std::vector<float> alpha;
+};
+template<int C> static MultigridWorkspace<C>& GetMultigridWorkspace(
+		MultigridCycle cycle, float lambda) {
+	static thread_local MultigridWorkspace<C> workspace;
+	workspace.solver.type = cycle;
+	workspace.solver.lambda = lambda;
+	return workspace;
+}
+template<int C> static void LaplaceFillMultigrid(
+		const Image<float, C, ImageType::FLOAT>& sourceImg,
+		Image<float, C, ImageType::FLOAT>& targetImg, int iterations,
+		int levels, float lambda, float tolerance, MultigridCycle cycle) {
+	MultigridWorkspace<C>& ws = GetMultigridWorkspace<C>(cycle, lambda);
+	LaplaceFillDivergence(sourceImg, targetImg, ws.divergence);
+	InteriorMask(sourceImg.width, sourceImg.height, ws.mask);
+	ws.solver.solve(targetImg, ws.divergence, ws.mask, iterations, levels,
+			tolerance);
+}
+template<int C> static void PoissonInpaintMultigrid(
+		const Image<float, C, ImageType::FLOAT>& sourceImg,
+		const Image<float, C, ImageType::FLOAT>& targetImg,
+		Image<float, C, ImageType::FLOAT>& outImg, int iterations, int levels,
+		float lambda, float tolerance, MultigridCycle cycle) {
+	MultigridWorkspace<C>& ws = GetMultigridWorkspace<C>(cycle, lambda);
+	PoissonInpaintDivergence(sourceImg, targetImg, ws.divergence);
+	InteriorMask(sourceImg.width, sourceImg.height, ws.mask);
+	ws.solver.solve(outImg, ws.divergence, ws.mask, iterations, levels,
+			tolerance);
+}
+template<int C> static void PoissonBlendMultigrid(
+		const Image<float, C, ImageType::FLOAT>& sourceImg,
+		Image<float, C, ImageType::FLOAT>& targetImg, int iterations,
+		int levels, float lambda, float tolerance, MultigridCycle cycle) {
+	const float THRESHOLD = 0.5f;
+	MultigridWorkspace<C>& ws = GetMultigridWorkspace<C>(cycle, lambda);
+	std::vector<float>& alpha = ws.alpha;
+	PoissonBlendDivergence(sourceImg, ws.divergence);
+	BlendMask(targetImg, THRESHOLD, ws.mask);
+	alpha.resize(targetImg.size());
+	for (size_t i = 0; i < alpha.size(); i++) {
+		alpha[i] = targetImg[i][C - 1];
+	}
+	ws.solver.solve(targetImg, ws.divergence, ws.mask, iterations, levels,
+			tolerance);
+	//Alpha channel is part of the mask and is not blended.
+	for (size_t i = 0; i < alpha.size(); i++) {
+		targetImg[i][C - 1] = alpha[i];
+	}
+}
 void LaplaceFill(const Image4f& sourceImg, Image4f& targetImg, int iterations,
-		int levels, float lambda) {
+		int levels, float lambda, float tolerance, MultigridCycle cycle) {
 	if (sourceImg.dimensions() != targetImg.dimensions())
 		throw std::runtime_error(
 				MakeString() << "Cannot solve. Image dimensions do not match "
@@ -31,24 +211,12 @@ void LaplaceFill(const Image4f& sourceImg, Image4f& targetImg, int iterations,
 	if (levels <= 1) {
 		LaplaceFill(sourceImg, targetImg, iterations, lambda);
 	} else {
-		std::vector<Image4f> srcPyramid(levels);
-		std::vector<Image4f> tarPyramid(levels);
-		srcPyramid[0] = sourceImg;
-		tarPyramid[0] = targetImg;
-		for (int l = 1; l < levels; l++) {
-			srcPyramid[l - 1].downSample(srcPyramid[l]);
-			tarPyramid[l - 1].downSample(tarPyramid[l]);
-		}
-		for (int l = levels - 1; l >= 1; l--) {
-			LaplaceFill(srcPyramid[l], tarPyramid[l], iterations, lambda);
-			tarPyramid[l].upSample(tarPyramid[l - 1]);
-		}
-		targetImg = tarPyramid[0];
-		LaplaceFill(sourceImg, targetImg, iterations, lambda);
+		LaplaceFillMultigrid(sourceImg, targetImg, iterations, levels, lambda,
+				tolerance, cycle);
 	}
 }
 void LaplaceFill(const Image2f& sourceImg, Image2f& targetImg, int iterations,
-		int levels, float lambda) {
+		int levels, float lambda, float tolerance, MultigridCycle cycle) {
 	if (sourceImg.dimensions() != targetImg.dimensions())
 		throw std::runtime_error(
 				MakeString() << "Cannot solve. Image dimensions do not match "
@@ -57,20 +225,8 @@ void LaplaceFill(const Image2f& sourceImg, Image2f& targetImg, int iterations,
 	if (levels <= 1) {
 		LaplaceFill(sourceImg, targetImg, iterations, lambda);
 	} else {
-		std::vector<Image2f> srcPyramid(levels);
-		std::vector<Image2f> tarPyramid(levels);
-		srcPyramid[0] = sourceImg;
-		tarPyramid[0] = targetImg;
-		for (int l = 1; l < levels; l++) {
-			srcPyramid[l - 1].downSample(srcPyramid[l]);
-			tarPyramid[l - 1].downSample(tarPyramid[l]);
-		}
-		for (int l = levels - 1; l >= 1; l--) {
-			LaplaceFill(srcPyramid[l], tarPyramid[l], iterations, lambda);
-			tarPyramid[l].upSample(tarPyramid[l - 1]);
-		}
-		targetImg = tarPyramid[0];
-		LaplaceFill(sourceImg, targetImg, iterations, lambda);
+		LaplaceFillMultigrid(sourceImg, targetImg, iterations, levels, lambda,
+				tolerance, cycle);
 	}
 }
 void LaplaceFill(const Image2f& sourceImg, Image2f& targetImg, int iterations,
@@ -80,30 +236,8 @@ void LaplaceFill(const Image2f& sourceImg, Image2f& targetImg, int iterations,
 				MakeString() << "Cannot solve. Image dimensions do not match "
 						<< sourceImg.dimensions() << " "
 						<< targetImg.dimensions());
-	Image2f divergence(sourceImg.width, sourceImg.height);
-	divergence.set(float2(0.0f));
-#pragma omp parallel for
-	for (int j = 1; j < sourceImg.height - 1; j++) {
-		for (int i = 1; i < sourceImg.width - 1; i++) {
-			float2 src = sourceImg(i, j);
-			float2 tar = targetImg(i, j);
-			float alpha = src.y;
-			src.y = 1.0f;
-			float2 val1 = sourceImg(i, j);
-			float2 val2 = sourceImg(i, j + 1);
-			float2 val3 = sourceImg(i, j - 1);
-			float2 val4 = sourceImg(i + 1, j);
-			float2 val5 = sourceImg(i - 1, j);
-			float2 div(0.0f);
-			if (val1.y > 0 && val2.y > 0 && val3.y > 0 && val4.y > 0
-					&& val5.y > 0) {
-				div = val1 - 0.25f * (val2 + val3 + val4 + val5);
-				div.y = 0.0f;
-			}
-			divergence(i, j) = alpha * div;
-			targetImg(i, j) = mix(tar, src, alpha);
-		}
-	}
+	Image2f divergence;
+	LaplaceFillDivergence(sourceImg, targetImg, divergence);
 	const int xShift[] = { 0, 0, 1, 1 };
 	const int yShift[] = { 0, 1, 0, 1 };
 	for (int iter = 0; iter < iterations; iter++) {
@@ -131,30 +265,8 @@ void LaplaceFill(const Image4f& sourceImg, Image4f& targetImg, int iterations,
 				MakeString() << "Cannot solve. Image dimensions do not match "
 						<< sourceImg.dimensions() << " "
 						<< targetImg.dimensions());
-	Image4f divergence(sourceImg.width, sourceImg.height);
-	divergence.set(float4(0.0f));
-#pragma omp parallel for
-	for (int j = 1; j < sourceImg.height - 1; j++) {
-		for (int i = 1; i < sourceImg.width - 1; i++) {
-			float4 src = sourceImg(i, j);
-			float4 tar = targetImg(i, j);
-			float alpha = src.w;
-			src.w = 1.0f;
-			float4 val1 = sourceImg(i, j);
-			float4 val2 = sourceImg(i, j + 1);
-			float4 val3 = sourceImg(i, j - 1);
-			float4 val4 = sourceImg(i + 1, j);
-			float4 val5 = sourceImg(i - 1, j);
-			float4 div(0.0f);
-			if (val1.w > 0 && val2.w > 0 && val3.w > 0 && val4.w > 0
-					&& val5.w > 0) {
-				div = val1 - 0.25f * (val2 + val3 + val4 + val5);
-				div.w = 0.0f;
-			}
-			divergence(i, j) = alpha * div;
-			targetImg(i, j) = mix(tar, src, alpha);
-		}
-	}
+	Image4f divergence;
+	LaplaceFillDivergence(sourceImg, targetImg, divergence);
 	const int xShift[] = { 0, 0, 1, 1 };
 	const int yShift[] = { 0, 1, 0, 1 };
 	for (int iter = 0; iter < iterations; iter++) {
@@ -176,7 +288,8 @@ void LaplaceFill(const Image4f& sourceImg, Image4f& targetImg, int iterations,
 	}
 }
 void PoissonInpaint(const Image4f& sourceImg, const Image4f& targetImg,
-		Image4f& outImg, int iterations, int levels, float lambda) {
+		Image4f& outImg, int iterations, int levels, float lambda,
+		float tolerance, MultigridCycle cycle) {
 	//Assumes mask is encoded in the W channel of the source image.
 	if (sourceImg.dimensions() != targetImg.dimensions()
 			|| sourceImg.dimensions() != outImg.dimensions())
@@ -187,24 +300,8 @@ void PoissonInpaint(const Image4f& sourceImg, const Image4f& targetImg,
 	if (levels <= 1) {
 		PoissonInpaint(sourceImg, targetImg, outImg, iterations, lambda);
 	} else {
-		std::vector<Image4f> srcPyramid(levels);
-		std::vector<Image4f> tarPyramid(levels);
-		std::vector<Image4f> outPyramid(levels);
-		srcPyramid[0] = sourceImg;
-		tarPyramid[0] = targetImg;
-		outPyramid[0] = outImg;
-		for (int l = 1; l < levels; l++) {
-			srcPyramid[l - 1].downSample(srcPyramid[l]);
-			tarPyramid[l - 1].downSample(tarPyramid[l]);
-			outPyramid[l - 1].downSample(outPyramid[l]);
-		}
-		for (int l = levels - 1; l >= 1; l--) {
-			PoissonInpaint(srcPyramid[l], tarPyramid[l], outPyramid[l],
-					iterations, lambda);
-			outPyramid[l].upSample(outPyramid[l - 1]);
-		}
-		outImg = outPyramid[0];
-		PoissonInpaint(sourceImg, targetImg, outImg, iterations, lambda);
+		PoissonInpaintMultigrid(sourceImg, targetImg, outImg, iterations,
+				levels, lambda, tolerance, cycle);
 	}
 }
 void PoissonInpaint(const Image4f& sourceImg, const Image4f& targetImg,
@@ -216,40 +313,8 @@ void PoissonInpaint(const Image4f& sourceImg, const Image4f& targetImg,
 				MakeString() << "Cannot solve. Image dimensions do not match "
 						<< sourceImg.dimensions() << " "
 						<< targetImg.dimensions());
-	Image4f divergence(sourceImg.width, sourceImg.height);
-	divergence.set(float4(0.0f));
-#pragma omp parallel for
-	for (int j = 1; j < sourceImg.height - 1; j++) {
-		for (int i = 1; i < sourceImg.width - 1; i++) {
-			float4 src = sourceImg(i, j);
-			float alpha = src.w;
-			src.w = 1.0f;
-			float4 val1 = sourceImg(i, j);
-			float4 val2 = sourceImg(i, j + 1);
-			float4 val3 = sourceImg(i, j - 1);
-			float4 val4 = sourceImg(i + 1, j);
-			float4 val5 = sourceImg(i - 1, j);
-			float4 divSrc(0.0f);
-			if (val1.w > 0 && val2.w > 0 && val3.w > 0 && val4.w > 0
-					&& val5.w > 0) {
-				divSrc = val1 - 0.25f * (val2 + val3 + val4 + val5);
-				divSrc.w = 0.0f;
-			}
-
-			val1 = targetImg(i, j);
-			val2 = targetImg(i, j + 1);
-			val3 = targetImg(i, j - 1);
-			val4 = targetImg(i + 1, j);
-			val5 = targetImg(i - 1, j);
-			float4 divTar(0.0f);
-			if (val1.w > 0 && val2.w > 0 && val3.w > 0 && val4.w > 0
-					&& val5.w > 0) {
-				divTar = val1 - 0.25f * (val2 + val3 + val4 + val5);
-				divTar.w = 0.0f;
-			}
-			divergence(i, j) = mix(divTar, divSrc, alpha);
-		}
-	}
+	Image4f divergence;
+	PoissonInpaintDivergence(sourceImg, targetImg, divergence);
 	const int xShift[] = { 0, 0, 1, 1 };
 	const int yShift[] = { 0, 1, 0, 1 };
 	for (int iter = 0; iter < iterations; iter++) {
@@ -271,7 +336,8 @@ void PoissonInpaint(const Image4f& sourceImg, const Image4f& targetImg,
 	}
 }
 void PoissonInpaint(const Image2f& sourceImg, const Image2f& targetImg,
-		Image2f& outImg, int iterations, int levels, float lambda) {
+		Image2f& outImg, int iterations, int levels, float lambda,
+		float tolerance, MultigridCycle cycle) {
 	//Assumes mask is encoded in the W channel of the source image.
 	if (sourceImg.dimensions() != targetImg.dimensions()
 			|| sourceImg.dimensions() != outImg.dimensions())
@@ -282,24 +348,8 @@ void PoissonInpaint(const Image2f& sourceImg, const Image2f& targetImg,
 	if (levels <= 1) {
 		PoissonInpaint(sourceImg, targetImg, outImg, iterations, lambda);
 	} else {
-		std::vector<Image2f> srcPyramid(levels);
-		std::vector<Image2f> tarPyramid(levels);
-		std::vector<Image2f> outPyramid(levels);
-		srcPyramid[0] = sourceImg;
-		tarPyramid[0] = targetImg;
-		outPyramid[0] = outImg;
-		for (int l = 1; l < levels; l++) {
-			srcPyramid[l - 1].downSample(srcPyramid[l]);
-			tarPyramid[l - 1].downSample(tarPyramid[l]);
-			outPyramid[l - 1].downSample(outPyramid[l]);
-		}
-		for (int l = levels - 1; l >= 1; l--) {
-			PoissonInpaint(srcPyramid[l], tarPyramid[l], outPyramid[l],
-					iterations, lambda);
-			outPyramid[l].upSample(outPyramid[l - 1]);
-		}
-		outImg = outPyramid[0];
-		PoissonInpaint(sourceImg, targetImg, outImg, iterations, lambda);
+		PoissonInpaintMultigrid(sourceImg, targetImg, outImg, iterations,
+				levels, lambda, tolerance, cycle);
 	}
 }
 void PoissonInpaint(const Image2f& sourceImg, const Image2f& targetImg,
@@ -311,40 +361,8 @@ void PoissonInpaint(const Image2f& sourceImg, const Image2f& targetImg,
 				MakeString() << "Cannot solve. Image dimensions do not match "
 						<< sourceImg.dimensions() << " "
 						<< targetImg.dimensions());
-	Image2f divergence(sourceImg.width, sourceImg.height);
-	divergence.set(float2(0.0f));
-#pragma omp parallel for
-	for (int j = 1; j < sourceImg.height - 1; j++) {
-		for (int i = 1; i < sourceImg.width - 1; i++) {
-			float2 src = sourceImg(i, j);
-			float alpha = src.y;
-			src.y = 1.0f;
-			float2 val1 = sourceImg(i, j);
-			float2 val2 = sourceImg(i, j + 1);
-			float2 val3 = sourceImg(i, j - 1);
-			float2 val4 = sourceImg(i + 1, j);
-			float2 val5 = sourceImg(i - 1, j);
-			float2 divSrc(0.0f);
-			if (val1.y > 0 && val2.y > 0 && val3.y > 0 && val4.y > 0
-					&& val5.y > 0) {
-				divSrc = val1 - 0.25f * (val2 + val3 + val4 + val5);
-				divSrc.y = 0.0f;
-			}
-
-			val1 = targetImg(i, j);
-			val2 = targetImg(i, j + 1);
-			val3 = targetImg(i, j - 1);
-			val4 = targetImg(i + 1, j);
-			val5 = targetImg(i - 1, j);
-			float2 divTar(0.0f);
-			if (val1.y > 0 && val2.y > 0 && val3.y > 0 && val4.y > 0
-					&& val5.y > 0) {
-				divTar = val1 - 0.25f * (val2 + val3 + val4 + val5);
-				divTar.y = 0.0f;
-			}
-			divergence(i, j) = mix(divTar, divSrc, alpha);
-		}
-	}
+	Image2f divergence;
+	PoissonInpaintDivergence(sourceImg, targetImg, divergence);
 	const int xShift[] = { 0, 0, 1, 1 };
 	const int yShift[] = { 0, 1, 0, 1 };
 	for (int iter = 0; iter < iterations; iter++) {
@@ -366,7 +384,7 @@ void PoissonInpaint(const Image2f& sourceImg, const Image2f& targetImg,
 	}
 }
 void PoissonBlend(const Image4f& sourceImg, Image4f& targetImg, int iterations,
-		int levels, float lambda) {
+		int levels, float lambda, float tolerance, MultigridCycle cycle) {
 	if (sourceImg.dimensions() != targetImg.dimensions())
 		throw std::runtime_error(
 				MakeString() << "Cannot solve. Image dimensions do not match "
@@ -375,24 +393,12 @@ void PoissonBlend(const Image4f& sourceImg, Image4f& targetImg, int iterations,
 	if (levels <= 1) {
 		PoissonBlend(sourceImg, targetImg, iterations, lambda);
 	} else {
-		std::vector<Image4f> srcPyramid(levels);
-		std::vector<Image4f> tarPyramid(levels);
-		srcPyramid[0] = sourceImg;
-		tarPyramid[0] = targetImg;
-		for (int l = 1; l < levels; l++) {
-			srcPyramid[l - 1].downSample(srcPyramid[l]);
-			tarPyramid[l - 1].downSample(tarPyramid[l]);
-		}
-		for (int l = levels - 1; l >= 1; l--) {
-			PoissonBlend(srcPyramid[l], tarPyramid[l], iterations, lambda);
-			tarPyramid[l].upSample(tarPyramid[l - 1]);
-		}
-		targetImg = tarPyramid[0];
-		PoissonBlend(sourceImg, targetImg, iterations, lambda);
+		PoissonBlendMultigrid(sourceImg, targetImg, iterations, levels, lambda,
+				tolerance, cycle);
 	}
 }
 void PoissonBlend(const Image2f& sourceImg, Image2f& targetImg, int iterations,
-		int levels, float lambda) {
+		int levels, float lambda, float tolerance, MultigridCycle cycle) {
 	if (sourceImg.dimensions() != targetImg.dimensions())
 		throw std::runtime_error(
 				MakeString() << "Cannot solve. Image dimensions do not match "
@@ -401,20 +407,8 @@ void PoissonBlend(const Image2f& sourceImg, Image2f& targetImg, int iterations,
 	if (levels <= 1) {
 		PoissonBlend(sourceImg, targetImg, iterations, lambda);
 	} else {
-		std::vector<Image2f> srcPyramid(levels);
-		std::vector<Image2f> tarPyramid(levels);
-		srcPyramid[0] = sourceImg;
-		tarPyramid[0] = targetImg;
-		for (int l = 1; l < levels; l++) {
-			srcPyramid[l - 1].downSample(srcPyramid[l]);
-			tarPyramid[l - 1].downSample(tarPyramid[l]);
-		}
-		for (int l = levels - 1; l >= 1; l--) {
-			PoissonBlend(srcPyramid[l], tarPyramid[l], iterations, lambda);
-			tarPyramid[l].upSample(tarPyramid[l - 1]);
-		}
-		targetImg = tarPyramid[0];
-		PoissonBlend(sourceImg, targetImg, iterations, lambda);
+		PoissonBlendMultigrid(sourceImg, targetImg, iterations, levels, lambda,
+				tolerance, cycle);
 	}
 }
 void PoissonBlend(const Image4f& sourceImg, Image4f& targetImg, int iterations,
@@ -424,25 +418,8 @@ void PoissonBlend(const Image4f& sourceImg, Image4f& targetImg, int iterations,
 				MakeString() << "Cannot solve. Image dimensions do not match "
 						<< sourceImg.dimensions() << " "
 						<< targetImg.dimensions());
-	Image4f divergence(sourceImg.width, sourceImg.height);
-#pragma omp parallel for
-	for (int j = 1; j < sourceImg.height - 1; j++) {
-		for (int i = 1; i < sourceImg.width - 1; i++) {
-			float4 val1 = sourceImg(i, j);
-			float4 val2 = sourceImg(i, j + 1);
-			float4 val3 = sourceImg(i, j - 1);
-			float4 val4 = sourceImg(i + 1, j);
-			float4 val5 = sourceImg(i - 1, j);
-			float4 div(0.0f);
-			if (val1.w > 0 && val2.w > 0 && val3.w > 0 && val4.w > 0
-					&& val5.w > 0) {
-				div = val1 - 0.25f * (val2 + val3 + val4 + val5);
-				div.w = 0.0f;
-			}
-			divergence(i, j) = div;
-
-		}
-	}
+	Image4f divergence;
+	PoissonBlendDivergence(sourceImg, divergence);
 	const int xShift[] = { 0, 0, 1, 1 };
 	const int yShift[] = { 0, 1, 0, 1 };
 	const float THRESHOLD = 0.5;
@@ -471,7 +448,6 @@ void PoissonBlend(const Image4f& sourceImg, Image4f& targetImg, int iterations,
 		}
 	}
 }
-
 void PoissonBlend(const Image2f& sourceImg, Image2f& targetImg, int iterations,
 		float lambda) {
 	if (sourceImg.dimensions() != targetImg.dimensions())
@@ -479,25 +455,8 @@ void PoissonBlend(const Image2f& sourceImg, Image2f& targetImg, int iterations,
 				MakeString() << "Cannot solve. Image dimensions do not match "
 						<< sourceImg.dimensions() << " "
 						<< targetImg.dimensions());
-	Image2f divergence(sourceImg.width, sourceImg.height);
-#pragma omp parallel for
-	for (int j = 1; j < sourceImg.height - 1; j++) {
-		for (int i = 1; i < sourceImg.width - 1; i++) {
-			float2 val1 = sourceImg(i, j);
-			float2 val2 = sourceImg(i, j + 1);
-			float2 val3 = sourceImg(i, j - 1);
-			float2 val4 = sourceImg(i + 1, j);
-			float2 val5 = sourceImg(i - 1, j);
-			float2 div(0.0f);
-			if (val1.y > 0 && val2.y > 0 && val3.y > 0 && val4.y > 0
-					&& val5.y > 0) {
-				div = val1 - 0.25f * (val2 + val3 + val4 + val5);
-				div.y = 0.0f;
-			}
-			divergence(i, j) = div;
-
-		}
-	}
+	Image2f divergence;
+	PoissonBlendDivergence(sourceImg, divergence);
 	const int xShift[] = { 0, 0, 1, 1 };
 	const int yShift[] = { 0, 1, 0, 1 };
 	const float THRESHOLD = 0.5;
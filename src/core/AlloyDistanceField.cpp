@@ -22,6 +22,7 @@
 #include "AlloyDistanceField.h"
 #include "BinaryMinHeap.h"
 #include <list>
+#include <vector>
 using namespace std;
 namespace aly {
 const ubyte1 DistanceField3f::ALIVE = ubyte1((uint8_t) 1);
@@ -35,6 +36,101 @@ const ubyte1 DistanceField2f::NARROW_BAND = ubyte1((uint8_t) 2);
 const ubyte1 DistanceField2f::FAR_AWAY = ubyte1((uint8_t) 3);
 const float DistanceField2f::DISTANCE_UNDEFINED =
 		std::numeric_limits<float>::max();
+//Updates smaller than this (in voxels) do not trigger another sweep or keep a voxel in the active list.
+static const float EIKONAL_TOLERANCE = 1E-4f;
+static const int MAX_SWEEP_ITERATIONS = 32;
+/*
+ Godunov upwind solution of |grad(u)|=1 with unit grid spacing, given the smaller neighbor along each axis.
+ Undefined neighbors are DISTANCE_UNDEFINED, which sorts last and never enters the quadratic.
+ */
+static float SolveEikonal(float a, float b) {
+	if (a > b)
+		std::swap(a, b);
+	if (a == std::numeric_limits<float>::max())
+		return a;
+	float u = a + 1.0f;
+	if (u <= b)
+		return u;
+	float d = a - b;
+	return 0.5f * (a + b + std::sqrt(2.0f - d * d));
+}
+static float SolveEikonal(float a, float b, float c) {
+	if (a > b)
+		std::swap(a, b);
+	if (b > c)
+		std::swap(b, c);
+	if (a > b)
+		std::swap(a, b);
+	float u = SolveEikonal(a, b);
+	if (u <= c)
+		return u;
+	float s = a + b + c;
+	float s2 = a * a + b * b + c * c;
+	return (s + std::sqrt(s * s - 3.0f * (s2 - 1.0f))) / 3.0f;
+}
+//Also returns the sign of the closest neighbor with a known sign, which is used to sign voxels that were undefined in the input.
+static float UpdateVoxel(const Volume1f& distVol, const Volume1b& signVol, int i,
+		int j, int k, int8_t& sign) {
+	const int dims[3] = { distVol.rows, distVol.cols, distVol.slices };
+	const size_t strides[3] = { 1, (size_t) dims[0], (size_t) dims[0] * dims[1] };
+	const int coords[3] = { i, j, k };
+	const size_t index = i + j * strides[1] + k * strides[2];
+	float mins[3];
+	float closest = DistanceField3f::DISTANCE_UNDEFINED;
+	sign = 0;
+	for (int n = 0; n < 3; n++) {
+		mins[n] = DistanceField3f::DISTANCE_UNDEFINED;
+		if (coords[n] > 0) {
+			size_t nbr = index - strides[n];
+			mins[n] = distVol.data[nbr].x;
+			if (mins[n] < closest && signVol.data[nbr].x != 0) {
+				closest = mins[n];
+				sign = signVol.data[nbr].x;
+			}
+		}
+		if (coords[n] < dims[n] - 1) {
+			size_t nbr = index + strides[n];
+			float value = distVol.data[nbr].x;
+			mins[n] = std::min(mins[n], value);
+			if (value < closest && signVol.data[nbr].x != 0) {
+				closest = value;
+				sign = signVol.data[nbr].x;
+			}
+		}
+	}
+	return SolveEikonal(mins[0], mins[1], mins[2]);
+}
+static float UpdatePixel(const Image1f& distVol, const Image1b& signVol, int i,
+		int j, int8_t& sign) {
+	const int dims[2] = { distVol.width, distVol.height };
+	const size_t strides[2] = { 1, (size_t) dims[0] };
+	const int coords[2] = { i, j };
+	const size_t index = i + j * strides[1];
+	float mins[2];
+	float closest = DistanceField2f::DISTANCE_UNDEFINED;
+	sign = 0;
+	for (int n = 0; n < 2; n++) {
+		mins[n] = DistanceField2f::DISTANCE_UNDEFINED;
+		if (coords[n] > 0) {
+			size_t nbr = index - strides[n];
+			mins[n] = distVol.data[nbr].x;
+			if (mins[n] < closest && signVol.data[nbr].x != 0) {
+				closest = mins[n];
+				sign = signVol.data[nbr].x;
+			}
+		}
+		if (coords[n] < dims[n] - 1) {
+			size_t nbr = index + strides[n];
+			float value = distVol.data[nbr].x;
+			mins[n] = std::min(mins[n], value);
+			if (value < closest && signVol.data[nbr].x != 0) {
+				closest = value;
+				sign = signVol.data[nbr].x;
+			}
+		}
+	}
+	return SolveEikonal(mins[0], mins[1]);
+}
 /*
  Sethian, J. A. (1999). Level set methods and fast marching methods: evolving interfaces
  in computational geometry, fluid mechanics, computer vision, and materials science (Vol. 3).
@@ -94,23 +190,15 @@ float DistanceField3f::march(float IMv, float IPv, float JMv, float JPv,
 	tmp = (s + std::sqrt((s * s - count * (s2 - 1.0f)))) / count;
 	return tmp;
 }
-void DistanceField3f::solve(const Volume1f& vol, Volume1f& distVol,
-		float maxDistance) {
+size_t DistanceField3f::initialize(const Volume1f& vol, Volume1f& distVol,
+		Volume1ub& labelVol, Volume1b& signVol) {
 	const int rows = vol.rows;
 	const int cols = vol.cols;
 	const int slices = vol.slices;
-	BinaryMinHeap<float, 3> heap(vol.dimensions());
 	distVol.resize(rows, cols, slices);
 	distVol.set(float1(DISTANCE_UNDEFINED));
-
-	static const int neighborsX[6] = { 1, 0, -1, 0, 0, 0 };
-	static const int neighborsY[6] = { 0, 1, 0, -1, 0, 0 };
-	static const int neighborsZ[6] = { 0, 0, 0, 0, 1, -1 };
-	std::list<VoxelIndex> voxelList;
-	VoxelIndex* he = nullptr;
-
-	Volume1ub labelVol(rows, cols, slices);
-	Volume1b signVol(rows, cols, slices);
+	labelVol.resize(rows, cols, slices);
+	signVol.resize(rows, cols, slices);
 	labelVol.set(FAR_AWAY);
 	size_t countAlive = 0;
 #pragma omp parallel for
@@ -215,6 +303,19 @@ void DistanceField3f::solve(const Volume1f& vol, Volume1f& distVol,
 			}
 		}
 	}
+	return countAlive;
+}
+void DistanceField3f::solveFastMarching(Volume1f& distVol, Volume1ub& labelVol,
+		Volume1b& signVol, size_t countAlive, float maxDistance) {
+	const int rows = distVol.rows;
+	const int cols = distVol.cols;
+	const int slices = distVol.slices;
+	BinaryMinHeap<float, 3> heap(distVol.dimensions());
+	static const int neighborsX[6] = { 1, 0, -1, 0, 0, 0 };
+	static const int neighborsY[6] = { 0, 1, 0, -1, 0, 0 };
+	static const int neighborsZ[6] = { 0, 0, 0, 0, 1, -1 };
+	std::list<VoxelIndex> voxelList;
+	VoxelIndex* he = nullptr;
 	heap.reserve(countAlive);
 	{
 		int koff;
@@ -398,6 +499,13 @@ void DistanceField3f::solve(const Volume1f& vol, Volume1f& distVol,
 			}
 		}
 	}
+	heap.clear();
+}
+void DistanceField3f::finalize(const Volume1f& vol, Volume1f& distVol,
+		const Volume1ub& labelVol, const Volume1b& signVol, float maxDistance) {
+	const int rows = vol.rows;
+	const int cols = vol.cols;
+	const int slices = vol.slices;
 #pragma omp parallel for
 	for (int k = 0; k < slices; k++) {
 		for (int j = 0; j < cols; j++) {
@@ -413,7 +521,320 @@ void DistanceField3f::solve(const Volume1f& vol, Volume1f& distVol,
 			}
 		}
 	}
-	heap.clear();
+}
+/*
+ Marks voxels within the chessboard distance of an ALIVE voxel that a distance of maxDistance can reach as NARROW_BAND.
+ The dilation is separable, so it runs as three passes of one dimensional dilations along each axis.
+ */
+void DistanceField3f::markBand(Volume1ub& labelVol, float maxDistance) {
+	const int rows = labelVol.rows;
+	const int cols = labelVol.cols;
+	const int slices = labelVol.slices;
+	const int radius = (int) std::min(std::ceil(maxDistance) + 1.0f,
+			(float) (rows + cols + slices));
+	std::vector<uint8_t> mask(labelVol.size());
+#pragma omp parallel for
+	for (int k = 0; k < slices; k++) {
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				size_t index = i + (j + (size_t) k * cols) * rows;
+				mask[index] = (labelVol.data[index] == ALIVE) ? 1 : 0;
+			}
+		}
+	}
+	const int dims[3] = { rows, cols, slices };
+	const size_t strides[3] = { 1, (size_t) rows, (size_t) rows * cols };
+	for (int axis = 0; axis < 3; axis++) {
+		const int n = dims[axis];
+		const size_t stride = strides[axis];
+		const int u = (axis == 0) ? 1 : 0;
+		const int v = (axis == 2) ? 1 : 2;
+		const int lines = dims[u] * dims[v];
+#pragma omp parallel
+		{
+			std::vector<uint8_t> buffer(n);
+#pragma omp for
+			for (int l = 0; l < lines; l++) {
+				size_t start = (l % dims[u]) * strides[u] + (l / dims[u]) * strides[v];
+				for (int t = 0; t < n; t++) {
+					buffer[t] = mask[start + t * stride];
+				}
+				int last = -radius - 1;
+				for (int t = 0; t < n; t++) {
+					if (buffer[t])
+						last = t;
+					mask[start + t * stride] = (t - last <= radius) ? 1 : 0;
+				}
+				last = n + radius;
+				for (int t = n - 1; t >= 0; t--) {
+					if (buffer[t])
+						last = t;
+					if (last - t <= radius)
+						mask[start + t * stride] = 1;
+				}
+			}
+		}
+	}
+#pragma omp parallel for
+	for (int k = 0; k < slices; k++) {
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				size_t index = i + (j + (size_t) k * cols) * rows;
+				if (mask[index] && labelVol.data[index] != ALIVE) {
+					labelVol.data[index] = NARROW_BAND;
+				}
+			}
+		}
+	}
+}
+/*
+ Zhao, H. (2005). A fast sweeping method for eikonal equations. Mathematics of computation, 74(250), 603-627.
+
+ Detrixhe, M., Gibou, F., & Min, C. (2013). A parallel fast sweeping method for the eikonal equation.
+ Journal of Computational Physics, 237, 46-55.
+
+ Each of the eight sweep orderings visits rows of voxels along the first axis in order of their (j,k) diagonal.
+ Rows on the same diagonal do not neighbor each other, so they are updated in parallel without changing the Gauss-Seidel ordering.
+ */
+void DistanceField3f::solveFastSweeping(const Volume1f& vol, Volume1f& distVol,
+		Volume1ub& labelVol, Volume1b& signVol, float maxDistance) {
+	const int rows = vol.rows;
+	const int cols = vol.cols;
+	const int slices = vol.slices;
+	markBand(labelVol, maxDistance);
+	//First and last band voxel in each row, so rows outside the band are skipped entirely.
+	std::vector<int2> extents(cols * slices);
+#pragma omp parallel for
+	for (int k = 0; k < slices; k++) {
+		for (int j = 0; j < cols; j++) {
+			int2 extent(rows, -1);
+			for (int i = 0; i < rows; i++) {
+				size_t index = i + (j + (size_t) k * cols) * rows;
+				if (labelVol.data[index] == ALIVE)
+					continue;
+				distVol.data[index].x = DISTANCE_UNDEFINED;
+				if (labelVol.data[index] == NARROW_BAND) {
+					extent.x = std::min(extent.x, i);
+					extent.y = i;
+				}
+			}
+			extents[j + k * cols] = extent;
+		}
+	}
+	for (int iter = 0; iter < MAX_SWEEP_ITERATIONS; iter++) {
+		bool changed = false;
+		for (int dir = 0; dir < 8; dir++) {
+			for (int level = 0; level < cols + slices - 1; level++) {
+				int kmin = std::max(0, level - (cols - 1));
+				int kmax = std::min(slices - 1, level);
+#pragma omp parallel for reduction(||:changed)
+				for (int kk = kmin; kk <= kmax; kk++) {
+					int k = (dir & 4) ? slices - 1 - kk : kk;
+					int j = (dir & 2) ? cols - 1 - (level - kk) : level - kk;
+					int2 extent = extents[j + k * cols];
+					if (extent.x > extent.y)
+						continue;
+					int step = (dir & 1) ? -1 : 1;
+					int start = (dir & 1) ? extent.y : extent.x;
+					int end = (dir & 1) ? extent.x - 1 : extent.y + 1;
+					for (int i = start; i != end; i += step) {
+						size_t index = i + (j + (size_t) k * cols) * rows;
+						if (labelVol.data[index] != NARROW_BAND)
+							continue;
+						int8_t s;
+						float value = UpdateVoxel(distVol, signVol, i, j, k, s);
+						float& current = distVol.data[index].x;
+						if (value < current) {
+							if (current - value > EIKONAL_TOLERANCE)
+								changed = true;
+							current = value;
+							if (vol.data[index].x == DISTANCE_UNDEFINED && s != 0)
+								signVol.data[index].x = s;
+						}
+					}
+				}
+			}
+		}
+		if (!changed)
+			break;
+	}
+#pragma omp parallel for
+	for (int k = 0; k < slices; k++) {
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				size_t index = i + (j + (size_t) k * cols) * rows;
+				if (distVol.data[index].x <= maxDistance) {
+					labelVol.data[index] = ALIVE;
+				}
+			}
+		}
+	}
+}
+/*
+ Jeong, W. K., & Whitaker, R. T. (2008). A fast iterative method for eikonal equations.
+ SIAM Journal on Scientific Computing, 30(5), 2512-2534.
+
+ Voxels in the active list are labeled NARROW_BAND. All active voxels are updated at once, converged voxels leave the list
+ and activate neighbors whose distance they lower. Neighbors further than maxDistance are never activated.
+ */
+void DistanceField3f::solveFastIterative(const Volume1f& vol, Volume1f& distVol,
+		Volume1ub& labelVol, Volume1b& signVol, float maxDistance) {
+	const int rows = vol.rows;
+	const int cols = vol.cols;
+	const int slices = vol.slices;
+	const size_t sliceSize = (size_t) rows * cols;
+	std::vector<size_t> activeList;
+#pragma omp parallel
+	{
+		std::vector<size_t> seeds;
+#pragma omp for
+		for (int k = 0; k < slices; k++) {
+			for (int j = 0; j < cols; j++) {
+				for (int i = 0; i < rows; i++) {
+					size_t index = i + j * (size_t) rows + k * sliceSize;
+					if (labelVol.data[index] == ALIVE)
+						continue;
+					distVol.data[index].x = DISTANCE_UNDEFINED;
+					if ((i > 0 && labelVol.data[index - 1] == ALIVE)
+							|| (i < rows - 1 && labelVol.data[index + 1] == ALIVE)
+							|| (j > 0 && labelVol.data[index - rows] == ALIVE)
+							|| (j < cols - 1 && labelVol.data[index + rows] == ALIVE)
+							|| (k > 0 && labelVol.data[index - sliceSize] == ALIVE)
+							|| (k < slices - 1 && labelVol.data[index + sliceSize] == ALIVE)) {
+						seeds.push_back(index);
+					}
+				}
+			}
+		}
+#pragma omp critical
+		activeList.insert(activeList.end(), seeds.begin(), seeds.end());
+	}
+	for (size_t index : activeList) {
+		labelVol.data[index] = NARROW_BAND;
+	}
+	static const int neighborsX[6] = { 1, 0, -1, 0, 0, 0 };
+	static const int neighborsY[6] = { 0, 1, 0, -1, 0, 0 };
+	static const int neighborsZ[6] = { 0, 0, 0, 0, 1, -1 };
+	std::vector<float> values;
+	std::vector<int8_t> signs;
+	std::vector<std::pair<size_t, float>> candidates;
+	std::vector<int8_t> candidateSigns;
+	std::vector<size_t> nextList;
+	while (activeList.size() > 0) {
+		int N = (int) activeList.size();
+		values.resize(N);
+		signs.resize(N);
+#pragma omp parallel for
+		for (int n = 0; n < N; n++) {
+			size_t index = activeList[n];
+			int i = (int) (index % rows);
+			int j = (int) ((index / rows) % cols);
+			int k = (int) (index / sliceSize);
+			values[n] = UpdateVoxel(distVol, signVol, i, j, k, signs[n]);
+		}
+		candidates.clear();
+		candidateSigns.clear();
+		nextList.clear();
+#pragma omp parallel
+		{
+#pragma omp for
+			for (int n = 0; n < N; n++) {
+				size_t index = activeList[n];
+				float& current = distVol.data[index].x;
+				bool done = (current - values[n] <= EIKONAL_TOLERANCE);
+				if (values[n] < current) {
+					current = values[n];
+					if (vol.data[index].x == DISTANCE_UNDEFINED && signs[n] != 0)
+						signVol.data[index].x = signs[n];
+				}
+				if (done) {
+					labelVol.data[index] = FAR_AWAY;
+				}
+			}
+			//Barrier at the end of the previous loop makes all updated values visible before neighbors read them.
+			std::vector<std::pair<size_t, float>> localCandidates;
+			std::vector<int8_t> localSigns;
+			std::vector<size_t> localActive;
+#pragma omp for
+			for (int n = 0; n < N; n++) {
+				size_t index = activeList[n];
+				if (labelVol.data[index] == NARROW_BAND) {
+					localActive.push_back(index);
+					continue;
+				}
+				int i = (int) (index % rows);
+				int j = (int) ((index / rows) % cols);
+				int k = (int) (index / sliceSize);
+				for (int koff = 0; koff < 6; koff++) {
+					int ni = i + neighborsX[koff];
+					int nj = j + neighborsY[koff];
+					int nk = k + neighborsZ[koff];
+					if (nj < 0 || nj >= cols || nk < 0 || nk >= slices || ni < 0
+							|| ni >= rows) {
+						continue;
+					}
+					size_t nindex = ni + nj * (size_t) rows + nk * sliceSize;
+					if (labelVol.data[nindex] != FAR_AWAY) {
+						continue;
+					}
+					int8_t s;
+					float value = UpdateVoxel(distVol, signVol, ni, nj, nk, s);
+					if (value <= maxDistance && value < distVol.data[nindex].x) {
+						localCandidates.push_back(std::pair<size_t, float>(nindex, value));
+						localSigns.push_back(s);
+					}
+				}
+			}
+#pragma omp critical
+			{
+				nextList.insert(nextList.end(), localActive.begin(), localActive.end());
+				candidates.insert(candidates.end(), localCandidates.begin(), localCandidates.end());
+				candidateSigns.insert(candidateSigns.end(), localSigns.begin(), localSigns.end());
+			}
+		}
+		for (size_t n = 0; n < candidates.size(); n++) {
+			size_t index = candidates[n].first;
+			float& current = distVol.data[index].x;
+			if (candidates[n].second < current) {
+				current = candidates[n].second;
+				if (vol.data[index].x == DISTANCE_UNDEFINED && candidateSigns[n] != 0)
+					signVol.data[index].x = candidateSigns[n];
+			}
+			if (labelVol.data[index] != NARROW_BAND) {
+				labelVol.data[index] = NARROW_BAND;
+				nextList.push_back(index);
+			}
+		}
+		activeList.swap(nextList);
+	}
+#pragma omp parallel for
+	for (int k = 0; k < slices; k++) {
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				size_t index = i + j * (size_t) rows + k * sliceSize;
+				if (distVol.data[index].x <= maxDistance) {
+					labelVol.data[index] = ALIVE;
+				}
+			}
+		}
+	}
+}
+void DistanceField3f::solve(const Volume1f& vol, Volume1f& distVol,
+		float maxDistance) {
+	Volume1ub labelVol;
+	Volume1b signVol;
+	size_t countAlive = initialize(vol, distVol, labelVol, signVol);
+	switch (method) {
+	case DistanceFieldMethod::FastSweeping:
+		solveFastSweeping(vol, distVol, labelVol, signVol, maxDistance);
+		break;
+	case DistanceFieldMethod::FastIterative:
+		solveFastIterative(vol, distVol, labelVol, signVol, maxDistance);
+		break;
+	default:
+		solveFastMarching(distVol, labelVol, signVol, countAlive, maxDistance);
+	}
+	finalize(vol, distVol, labelVol, signVol, maxDistance);
 }
 
 float DistanceField2f::march(float IMv, float IPv, float JMv, float JPv,
@@ -455,21 +876,14 @@ float DistanceField2f::march(float IMv, float IPv, float JMv, float JPv,
 	tmp = (s + std::sqrt((s * s - count * (s2 - 1.0f)))) / count;
 	return tmp;
 }
-void DistanceField2f::solve(const Image1f& vol, Image1f& distVol,
-		float maxDistance) {
+size_t DistanceField2f::initialize(const Image1f& vol, Image1f& distVol,
+		Image1ub& labelVol, Image1b& signVol) {
 	const int width = vol.width;
 	const int height = vol.height;
-	BinaryMinHeap<float, 2> heap(vol.dimensions());
 	distVol.resize(width, height);
 	distVol.set(float1(DISTANCE_UNDEFINED));
-
-	static const int neighborsX[4] = { 1, 0, -1, 0 };
-	static const int neighborsY[4] = { 0, 1, 0, -1 };
-	std::list<PixelIndex> voxelList;
-	PixelIndex* he = nullptr;
-
-	Image1ub labelVol(width, height);
-	Image1b signVol(width, height);
+	labelVol.resize(width, height);
+	signVol.resize(width, height);
 	labelVol.set(FAR_AWAY);
 	size_t countAlive = 0;
 #pragma omp parallel for
@@ -550,6 +964,17 @@ void DistanceField2f::solve(const Image1f& vol, Image1f& distVol,
 			}
 		}
 	}
+	return countAlive;
+}
+void DistanceField2f::solveFastMarching(Image1f& distVol, Image1ub& labelVol,
+		Image1b& signVol, size_t countAlive, float maxDistance) {
+	const int width = distVol.width;
+	const int height = distVol.height;
+	BinaryMinHeap<float, 2> heap(distVol.dimensions());
+	static const int neighborsX[4] = { 1, 0, -1, 0 };
+	static const int neighborsY[4] = { 0, 1, 0, -1 };
+	std::list<PixelIndex> voxelList;
+	PixelIndex* he = nullptr;
 	heap.reserve(countAlive);
 	{
 		int koff;
@@ -683,6 +1108,12 @@ void DistanceField2f::solve(const Image1f& vol, Image1f& distVol,
 			}
 		}
 	}
+	heap.clear();
+}
+void DistanceField2f::finalize(const Image1f& vol, Image1f& distVol,
+		const Image1ub& labelVol, const Image1b& signVol, float maxDistance) {
+	const int width = vol.width;
+	const int height = vol.height;
 #pragma omp parallel for
 	for (int j = 0; j < height; j++) {
 		for (int i = 0; i < width; i++) {
@@ -695,6 +1126,442 @@ void DistanceField2f::solve(const Image1f& vol, Image1f& distVol,
 
 		}
 	}
-	heap.clear();
+}
+/*
+ Marks pixels within the chessboard distance of an ALIVE pixel that a distance of maxDistance can reach as NARROW_BAND.
+ */
+void DistanceField2f::markBand(Image1ub& labelVol, float maxDistance) {
+	const int width = labelVol.width;
+	const int height = labelVol.height;
+	const int radius = (int) std::min(std::ceil(maxDistance) + 1.0f,
+			(float) (width + height));
+	std::vector<uint8_t> mask(labelVol.size());
+#pragma omp parallel for
+	for (int j = 0; j < height; j++) {
+		for (int i = 0; i < width; i++) {
+			size_t index = i + (size_t) j * width;
+			mask[index] = (labelVol.data[index] == ALIVE) ? 1 : 0;
+		}
+	}
+	const int dims[2] = { width, height };
+	const size_t strides[2] = { 1, (size_t) width };
+	for (int axis = 0; axis < 2; axis++) {
+		const int n = dims[axis];
+		const size_t stride = strides[axis];
+		const int lines = dims[1 - axis];
+#pragma omp parallel
+		{
+			std::vector<uint8_t> buffer(n);
+#pragma omp for
+			for (int l = 0; l < lines; l++) {
+				size_t start = l * strides[1 - axis];
+				for (int t = 0; t < n; t++) {
+					buffer[t] = mask[start + t * stride];
+				}
+				int last = -radius - 1;
+				for (int t = 0; t < n; t++) {
+					if (buffer[t])
+						last = t;
+					mask[start + t * stride] = (t - last <= radius) ? 1 : 0;
+				}
+				last = n + radius;
+				for (int t = n - 1; t >= 0; t--) {
+					if (buffer[t])
+						last = t;
+					if (last - t <= radius)
+						mask[start + t * stride] = 1;
+				}
+			}
+		}
+	}
+#pragma omp parallel for
+	for (int j = 0; j < height; j++) {
+		for (int i = 0; i < width; i++) {
+			size_t index = i + (size_t) j * width;
+			if (mask[index] && labelVol.data[index] != ALIVE) {
+				labelVol.data[index] = NARROW_BAND;
+			}
+		}
+	}
+}
+/*
+ Parallel fast sweeping. Each of the four sweep orderings visits pixels in order of their diagonal,
+ and pixels on the same diagonal are updated in parallel.
+ */
+void DistanceField2f::solveFastSweeping(const Image1f& vol, Image1f& distVol,
+		Image1ub& labelVol, Image1b& signVol, float maxDistance) {
+	const int width = vol.width;
+	const int height = vol.height;
+	markBand(labelVol, maxDistance);
+#pragma omp parallel for
+	for (int j = 0; j < height; j++) {
+		for (int i = 0; i < width; i++) {
+			size_t index = i + (size_t) j * width;
+			if (labelVol.data[index] != ALIVE) {
+				distVol.data[index].x = DISTANCE_UNDEFINED;
+			}
+		}
+	}
+	for (int iter = 0; iter < MAX_SWEEP_ITERATIONS; iter++) {
+		bool changed = false;
+		for (int dir = 0; dir < 4; dir++) {
+			for (int level = 0; level < width + height - 1; level++) {
+				int jmin = std::max(0, level - (width - 1));
+				int jmax = std::min(height - 1, level);
+#pragma omp parallel for reduction(||:changed)
+				for (int jj = jmin; jj <= jmax; jj++) {
+					int j = (dir & 2) ? height - 1 - jj : jj;
+					int i = (dir & 1) ? width - 1 - (level - jj) : level - jj;
+					size_t index = i + (size_t) j * width;
+					if (labelVol.data[index] != NARROW_BAND)
+						continue;
+					int8_t s;
+					float value = UpdatePixel(distVol, signVol, i, j, s);
+					float& current = distVol.data[index].x;
+					if (value < current) {
+						if (current - value > EIKONAL_TOLERANCE)
+							changed = true;
+						current = value;
+						if (vol.data[index].x == DISTANCE_UNDEFINED && s != 0)
+							signVol.data[index].x = s;
+					}
+				}
+			}
+		}
+		if (!changed)
+			break;
+	}
+#pragma omp parallel for
+	for (int j = 0; j < height; j++) {
+		for (int i = 0; i < width; i++) {
+			size_t index = i + (size_t) j * width;
+			if (distVol.data[index].x <= maxDistance) {
+				labelVol.data[index] = ALIVE;
+			}
+		}
+	}
+}
+/*
+ Fast iterative method, see DistanceField3f::solveFastIterative().
+ */
+void DistanceField2f::solveFastIterative(const Image1f& vol, Image1f& distVol,
+		Image1ub& labelVol, Image1b& signVol, float maxDistance) {
+	const int width = vol.width;
+	const int height = vol.height;
+	std::vector<size_t> activeList;
+#pragma omp parallel
+	{
+		std::vector<size_t> seeds;
+#pragma omp for
+		for (int j = 0; j < height; j++) {
+			for (int i = 0; i < width; i++) {
+				size_t index = i + (size_t) j * width;
+				if (labelVol.data[index] == ALIVE)
+					continue;
+				distVol.data[index].x = DISTANCE_UNDEFINED;
+				if ((i > 0 && labelVol.data[index - 1] == ALIVE)
+						|| (i < width - 1 && labelVol.data[index + 1] == ALIVE)
+						|| (j > 0 && labelVol.data[index - width] == ALIVE)
+						|| (j < height - 1 && labelVol.data[index + width] == ALIVE)) {
+					seeds.push_back(index);
+				}
+			}
+		}
+#pragma omp critical
+		activeList.insert(activeList.end(), seeds.begin(), seeds.end());
+	}
+	for (size_t index : activeList) {
+		labelVol.data[index] = NARROW_BAND;
+	}
+	static const int neighborsX[4] = { 1, 0, -1, 0 };
+	static const int neighborsY[4] = { 0, 1, 0, -1 };
+	std::vector<float> values;
+	std::vector<int8_t> signs;
+	std::vector<std::pair<size_t, float>> candidates;
+	std::vector<int8_t> candidateSigns;
+	std::vector<size_t> nextList;
+	while (activeList.size() > 0) {
+		int N = (int) activeList.size();
+		values.resize(N);
+		signs.resize(N);
+#pragma omp parallel for
+		for (int n = 0; n < N; n++) {
+			size_t index = activeList[n];
+			values[n] = UpdatePixel(distVol, signVol, (int) (index % width),
+					(int) (index / width), signs[n]);
+		}
+		candidates.clear();
+		candidateSigns.clear();
+		nextList.clear();
+#pragma omp parallel
+		{
+#pragma omp for
+			for (int n = 0; n < N; n++) {
+				size_t index = activeList[n];
+				float& current = distVol.data[index].x;
+				bool done = (current - values[n] <= EIKONAL_TOLERANCE);
+				if (values[n] < current) {
+					current = values[n];
+					if (vol.data[index].x == DISTANCE_UNDEFINED && signs[n] != 0)
+						signVol.data[index].x = signs[n];
+				}
+				if (done) {
+					labelVol.data[index] = FAR_AWAY;
+				}
+			}
+			std::vector<std::pair<size_t, float>> localCandidates;
+			std::vector<int8_t> localSigns;
+			std::vector<size_t> localActive;
+#pragma omp for
+			for (int n = 0; n < N; n++) {
+				size_t index = activeList[n];
+				if (labelVol.data[index] == NARROW_BAND) {
+					localActive.push_back(index);
+					continue;
+				}
+				int i = (int) (index % width);
+				int j = (int) (index / width);
+				for (int koff = 0; koff < 4; koff++) {
+					int ni = i + neighborsX[koff];
+					int nj = j + neighborsY[koff];
+					if (nj < 0 || nj >= height || ni < 0 || ni >= width) {
+						continue;
+					}
+					size_t nindex = ni + (size_t) nj * width;
+					if (labelVol.data[nindex] != FAR_AWAY) {
+						continue;
+					}
+					int8_t s;
+					float value = UpdatePixel(distVol, signVol, ni, nj, s);
+					if (value <= maxDistance && value < distVol.data[nindex].x) {
+						localCandidates.push_back(std::pair<size_t, float>(nindex, value));
+						localSigns.push_back(s);
+					}
+				}
+			}
+#pragma omp critical
+			{
+				nextList.insert(nextList.end(), localActive.begin(), localActive.end());
+				candidates.insert(candidates.end(), localCandidates.begin(), localCandidates.end());
+				candidateSigns.insert(candidateSigns.end(), localSigns.begin(), localSigns.end());
+			}
+		}
+		for (size_t n = 0; n < candidates.size(); n++) {
+			size_t index = candidates[n].first;
+			float& current = distVol.data[index].x;
+			if (candidates[n].second < current) {
+				current = candidates[n].second;
+				if (vol.data[index].x == DISTANCE_UNDEFINED && candidateSigns[n] != 0)
+					signVol.data[index].x = candidateSigns[n];
+			}
+			if (labelVol.data[index] != NARROW_BAND) {
+				labelVol.data[index] = NARROW_BAND;
+				nextList.push_back(index);
+			}
+		}
+		activeList.swap(nextList);
+	}
+#pragma omp parallel for
+	for (int j = 0; j < height; j++) {
+		for (int i = 0; i < width; i++) {
+			size_t index = i + (size_t) j * width;
+			if (distVol.data[index].x <= maxDistance) {
+				labelVol.data[index] = ALIVE;
+			}
+		}
+	}
+}
+void DistanceField2f::solve(const Image1f& vol, Image1f& distVol,
+		float maxDistance) {
+	Image1ub labelVol;
+	Image1b signVol;
+	size_t countAlive = initialize(vol, distVol, labelVol, signVol);
+	switch (method) {
+	case DistanceFieldMethod::FastSweeping:
+		solveFastSweeping(vol, distVol, labelVol, signVol, maxDistance);
+		break;
+	case DistanceFieldMethod::FastIterative:
+		solveFastIterative(vol, distVol, labelVol, signVol, maxDistance);
+		break;
+	default:
+		solveFastMarching(distVol, labelVol, signVol, countAlive, maxDistance);
+	}
+	finalize(vol, distVol, labelVol, signVol, maxDistance);
+}
+/*
+ Felzenszwalb, P. F., & Huttenlocher, D. P. (2012). Distance transforms of sampled functions. Theory of computing, 8(1), 415-428.
+
+ Lower envelope of the parabolas (x - p)^2 + f(p) over all sites p along one line. Sites with f(p) == undefined are left out,
+ so a line without sites stays undefined.
+ */
+static void DistanceTransformLine(const std::vector<float>& f, const std::vector<int>& fid,
+		int n, bool hasFeatures, std::vector<float>& d, std::vector<int>& did,
+		std::vector<int>& v, std::vector<double>& z, float undefined) {
+	int k = -1;
+	for (int q = 0; q < n; q++) {
+		if (f[q] == undefined)
+			continue;
+		if (k < 0) {
+			k = 0;
+			v[0] = q;
+			z[0] = -std::numeric_limits<double>::max();
+			z[1] = std::numeric_limits<double>::max();
+			continue;
+		}
+		//z[0] is -infinity, so the envelope never loses its first parabola.
+		double s;
+		while (true) {
+			int p = v[k];
+			s = ((f[q] + (double) q * q) - (f[p] + (double) p * p)) / (2.0 * (q - p));
+			if (s <= z[k]) {
+				k--;
+			} else {
+				break;
+			}
+		}
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = std::numeric_limits<double>::max();
+	}
+	if (k < 0) {
+		for (int q = 0; q < n; q++) {
+			d[q] = undefined;
+			did[q] = -1;
+		}
+		return;
+	}
+	k = 0;
+	for (int q = 0; q < n; q++) {
+		while (z[k + 1] < q) {
+			k++;
+		}
+		int p = v[k];
+		d[q] = (float) ((double) (q - p) * (q - p) + f[p]);
+		if (hasFeatures)
+			did[q] = fid[p];
+	}
+}
+/*
+ Replaces squared distances along one axis with the lower envelope of all lines along that axis.
+ */
+static void DistanceTransformAxis(float1* dist, int1* features,
+		const int* dims, const size_t* strides, int D, int axis, float undefined) {
+	const int n = dims[axis];
+	const size_t stride = strides[axis];
+	int lines = 1;
+	for (int a = 0; a < D; a++) {
+		if (a != axis)
+			lines *= dims[a];
+	}
+#pragma omp parallel
+	{
+		std::vector<float> f(n), d(n);
+		std::vector<int> fid(n), did(n), v(n);
+		std::vector<double> z(n + 1);
+#pragma omp for
+		for (int l = 0; l < lines; l++) {
+			size_t start = 0;
+			int r = l;
+			for (int a = 0; a < D; a++) {
+				if (a == axis)
+					continue;
+				start += (r % dims[a]) * strides[a];
+				r /= dims[a];
+			}
+			for (int q = 0; q < n; q++) {
+				f[q] = dist[start + q * stride].x;
+				if (features)
+					fid[q] = features[start + q * stride].x;
+			}
+			DistanceTransformLine(f, fid, n, features != nullptr, d, did, v, z, undefined);
+			for (int q = 0; q < n; q++) {
+				dist[start + q * stride].x = d[q];
+				if (features)
+					features[start + q * stride].x = did[q];
+			}
+		}
+	}
+}
+static void DistanceTransform(const Volume1ub& mask, Volume1f& distVol, Volume1i* features) {
+	const int rows = mask.rows;
+	const int cols = mask.cols;
+	const int slices = mask.slices;
+	const float undefined = DistanceField3f::DISTANCE_UNDEFINED;
+	distVol.resize(rows, cols, slices);
+	if (features)
+		features->resize(rows, cols, slices);
+#pragma omp parallel for
+	for (int k = 0; k < slices; k++) {
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				size_t index = i + (j + (size_t) k * cols) * rows;
+				bool site = (mask.data[index].x != 0);
+				distVol.data[index].x = site ? 0.0f : undefined;
+				if (features)
+					features->data[index].x = site ? (int) index : -1;
+			}
+		}
+	}
+	const int dims[3] = { rows, cols, slices };
+	const size_t strides[3] = { 1, (size_t) rows, (size_t) rows * cols };
+	for (int axis = 0; axis < 3; axis++) {
+		DistanceTransformAxis(distVol.data.data(), features ? features->data.data() : nullptr,
+				dims, strides, 3, axis, undefined);
+	}
+#pragma omp parallel for
+	for (int k = 0; k < slices; k++) {
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				float& d = distVol.data[i + (j + (size_t) k * cols) * rows].x;
+				if (d != undefined)
+					d = std::sqrt(d);
+			}
+		}
+	}
+}
+static void DistanceTransform(const Image1ub& mask, Image1f& distImg, Image1i* features) {
+	const int width = mask.width;
+	const int height = mask.height;
+	const float undefined = DistanceField2f::DISTANCE_UNDEFINED;
+	distImg.resize(width, height);
+	if (features)
+		features->resize(width, height);
+#pragma omp parallel for
+	for (int j = 0; j < height; j++) {
+		for (int i = 0; i < width; i++) {
+			size_t index = i + (size_t) j * width;
+			bool site = (mask.data[index].x != 0);
+			distImg.data[index].x = site ? 0.0f : undefined;
+			if (features)
+				features->data[index].x = site ? (int) index : -1;
+		}
+	}
+	const int dims[2] = { width, height };
+	const size_t strides[2] = { 1, (size_t) width };
+	for (int axis = 0; axis < 2; axis++) {
+		DistanceTransformAxis(distImg.data.data(), features ? features->data.data() : nullptr,
+				dims, strides, 2, axis, undefined);
+	}
+#pragma omp parallel for
+	for (int j = 0; j < height; j++) {
+		for (int i = 0; i < width; i++) {
+			float& d = distImg.data[i + (size_t) j * width].x;
+			if (d != undefined)
+				d = std::sqrt(d);
+		}
+	}
+}
+void DistanceTransform(const Volume1ub& mask, Volume1f& distVol) {
+	DistanceTransform(mask, distVol, (Volume1i*) nullptr);
+}
+void DistanceTransform(const Volume1ub& mask, Volume1f& distVol, Volume1i& features) {
+	DistanceTransform(mask, distVol, &features);
+}
+void DistanceTransform(const Image1ub& mask, Image1f& distImg) {
+	DistanceTransform(mask, distImg, (Image1i*) nullptr);
+}
+void DistanceTransform(const Image1ub& mask, Image1f& distImg, Image1i& features) {
+	DistanceTransform(mask, distImg, &features);
 }
 }
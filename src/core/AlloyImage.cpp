@@ -30,208 +30,534 @@
 #include "tinyexr.h"
 
 #include <fstream>
+#include <cmath>
 
 #ifndef _CRT_SECURE_NO_WARNINGS
 #define _CRT_SECURE_NO_WARNINGS // suppress warnings about fopen()
 #endif
 
 namespace aly {
-void ConvertImage(const Image1f& in, ImageRGBAf& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	int N = (int) out.size();
-#pragma omp parallel for
-	for (int i = 0; i < N; i++) {
-		float lum = in[i].x;
-		out[i] = float4(lum, lum, lum, 1.0f);
+/*
+ Vectorized kernels behind the common ConvertImage paths. Each kernel converts a
+ run of n contiguous components or pixels. SSE2 is the x86 baseline, AVX2 variants
+ are selected once at runtime from the CPU feature flags, and plain loops handle
+ the tails and every other architecture. All paths clamp in single precision
+ before truncating so that SIMD and scalar results are bit identical.
+ */
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ALY_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#define ALY_AVX2 1
+#define ALY_TARGET_AVX2
+#include <intrin.h>
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(ALY_SSE2)
+#define ALY_AVX2 1
+#define ALY_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+#endif
+namespace simd {
+static const size_t CONVERT_CHUNK = 16384;
+static bool DetectAVX2() {
+#if defined(ALY_AVX2) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(ALY_AVX2)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	return false;
+#endif
+}
+static bool UseAVX2() {
+	static const bool avx2 = DetectAVX2();
+	return avx2;
+}
+inline uint8_t ToByte(float v) {
+	return (uint8_t) (int) (v > 0.0f ? (v < 255.0f ? v : 255.0f) : 0.0f);
+}
+/*
+ Transfer functions from IEC 61966-2-1. Decoding is a 256 entry table whose upper half
+ holds the linear ramp used for alpha. Encoding quantizes linear values to 14 bits.
+ */
+static const int SRGB_ENCODE_BITS = 14;
+static const int SRGB_ENCODE_SIZE = 1 << SRGB_ENCODE_BITS;
+static const float* SRGBDecodeTable() {
+	struct Table {
+		float values[512];
+		Table() {
+			for (int i = 0; i < 256; i++) {
+				double c = i / 255.0;
+				values[i] = (float) (
+						(c <= 0.04045) ?
+								c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+				values[i + 256] = i / 255.0f;
+			}
+		}
+	};
+	static const Table table;
+	return table.values;
+}
+static const uint8_t* SRGBEncodeTable() {
+	struct Table {
+		//Padded so 32-bit gathers at the last index stay in bounds.
+		uint8_t values[SRGB_ENCODE_SIZE + 4];
+		Table() {
+			for (int i = 0; i < SRGB_ENCODE_SIZE; i++) {
+				double l = i / (double) (SRGB_ENCODE_SIZE - 1);
+				double c = (l <= 0.0031308) ?
+						12.92 * l : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+				values[i] = (uint8_t) clamp((int) std::floor(255.0 * c + 0.5), 0,
+						255);
+			}
+			values[SRGB_ENCODE_SIZE] = values[SRGB_ENCODE_SIZE + 1] =
+					values[SRGB_ENCODE_SIZE + 2] = values[SRGB_ENCODE_SIZE + 3] =
+							0;
+		}
+	};
+	static const Table table;
+	return table.values;
+}
+inline int SRGBEncodeIndex(float v) {
+	v = (v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f);
+	return (int) (v * (SRGB_ENCODE_SIZE - 1) + 0.5f);
+}
+inline uint8_t AlphaToByte(float v) {
+	v = (v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f);
+	return (uint8_t) (int) (v * 255.0f + 0.5f);
+}
+#ifdef ALY_AVX2
+ALY_TARGET_AVX2 static size_t BytesToFloatsAVX2(const uint8_t* src, float* dst,
+		size_t n) {
+	const __m256 scale = _mm256_set1_ps(255.0f);
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		for (int k = 0; k < 32; k += 8) {
+			__m256i v = _mm256_cvtepu8_epi32(
+					_mm_loadl_epi64((const __m128i*) (src + i + k)));
+			_mm256_storeu_ps(dst + i + k,
+					_mm256_div_ps(_mm256_cvtepi32_ps(v), scale));
+		}
 	}
+	return i;
 }
-void ConvertImage(const Image2f& in, ImageRGBAf& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	int N = (int) out.size();
-#pragma omp parallel for
-	for (int i = 0; i < N; i++) {
-		float2 val = in[i];
-		float lum = val.x;
-		out[i] = float4(lum, lum, lum, val.y);
+ALY_TARGET_AVX2 static size_t FloatsToBytesAVX2(const float* src, uint8_t* dst,
+		size_t n) {
+	const __m256 scale = _mm256_set1_ps(255.0f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	__m256i q[4];
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		for (int k = 0; k < 4; k++) {
+			__m256 v = _mm256_mul_ps(_mm256_loadu_ps(src + i + 8 * k), scale);
+			v = _mm256_min_ps(_mm256_max_ps(v, zero), scale);
+			q[k] = _mm256_cvttps_epi32(v);
+		}
+		__m256i b = _mm256_packus_epi16(_mm256_packs_epi32(q[0], q[1]),
+				_mm256_packs_epi32(q[2], q[3]));
+		_mm256_storeu_si256((__m256i *) (dst + i),
+				_mm256_permutevar8x32_epi32(b, order));
 	}
+	return i;
 }
-void ConvertImage(const Image1f& in, ImageRGBf& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	int N = (int) out.size();
-#pragma omp parallel for
-	for (int i = 0; i < N; i++) {
-		float lum = in[i].x;
-		out[i] = float3(lum, lum, lum);
+ALY_TARGET_AVX2 static size_t SRGBToLinearAVX2(const ubyte4* src, float4* dst,
+		size_t n) {
+	const float* table = SRGBDecodeTable();
+	const __m256i alpha = _mm256_setr_epi32(0, 0, 0, 256, 0, 0, 0, 256);
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2) {
+		__m256i idx = _mm256_add_epi32(
+				_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (src + i))),
+				alpha);
+		_mm256_storeu_ps(&dst[i].x, _mm256_i32gather_ps(table, idx, 4));
 	}
+	return i;
 }
-void ConvertImage(const Image1ub& in, ImageRGBAf& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	int N = (int) out.size();
-#pragma omp parallel for
-	for (int i = 0; i < N; i++) {
-		float lum = in[i].x / 255.0f;
-		out[i] = float4(lum, lum, lum, 1.0f);
+ALY_TARGET_AVX2 static size_t LinearToSRGBAVX2(const float4* src, ubyte4* dst,
+		size_t n) {
+	const int* table = (const int*) SRGBEncodeTable();
+	const float top = (float) (SRGB_ENCODE_SIZE - 1);
+	const __m256 scale = _mm256_setr_ps(top, top, top, 255.0f, top, top, top,
+			255.0f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256i alpha = _mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1);
+	const __m256i low = _mm256_set1_epi32(0xFF);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	__m256i q[2];
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		for (int k = 0; k < 2; k++) {
+			__m256 v = _mm256_loadu_ps(&src[i + 2 * k].x);
+			v = _mm256_min_ps(_mm256_max_ps(v, zero), one);
+			__m256i idx = _mm256_cvttps_epi32(
+					_mm256_add_ps(_mm256_mul_ps(v, scale), half));
+			__m256i enc = _mm256_and_si256(
+					_mm256_i32gather_epi32(table, idx, 1), low);
+			q[k] = _mm256_blendv_epi8(enc, idx, alpha);
+		}
+		__m256i s = _mm256_packs_epi32(q[0], q[1]);
+		__m256i b = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(s, s),
+				order);
+		_mm_storeu_si128((__m128i *) (dst + i), _mm256_castsi256_si128(b));
 	}
+	return i;
 }
-void ConvertImage(const Image1ub& in, ImageRGBf& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	int N = (int) out.size();
-#pragma omp parallel for
-	for (int i = 0; i < N; i++) {
-		float lum = in[i].x / 255.0f;
-		out[i] = float3(lum, lum, lum);
+#endif
+#ifdef ALY_SSE2
+static size_t BytesToFloatsSSE2(const uint8_t* src, float* dst, size_t n) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(255.0f);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i b = _mm_loadu_si128((const __m128i *) (src + i));
+		__m128i lo = _mm_unpacklo_epi8(b, zero);
+		__m128i hi = _mm_unpackhi_epi8(b, zero);
+		_mm_storeu_ps(dst + i,
+				_mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + i + 4,
+				_mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + i + 8,
+				_mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+		_mm_storeu_ps(dst + i + 12,
+				_mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
 	}
+	return i;
 }
-void ConvertImage(const Image1ub& in, ImageRGBA& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	int N = (int) out.size();
-#pragma omp parallel for
-	for (int i = 0; i < N; i++) {
-		ubyte lum = in[i].x;
-		out[i] = RGBA(lum, lum, lum, 255);
+inline __m128i FloatsToInts(__m128 v, __m128 scale, __m128 zero) {
+	v = _mm_mul_ps(v, scale);
+	return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(v, zero), scale));
+}
+static size_t FloatsToBytesSSE2(const float* src, uint8_t* dst, size_t n) {
+	const __m128 scale = _mm_set1_ps(255.0f);
+	const __m128 zero = _mm_setzero_ps();
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = FloatsToInts(_mm_loadu_ps(src + i), scale, zero);
+		__m128i b = FloatsToInts(_mm_loadu_ps(src + i + 4), scale, zero);
+		__m128i c = FloatsToInts(_mm_loadu_ps(src + i + 8), scale, zero);
+		__m128i d = FloatsToInts(_mm_loadu_ps(src + i + 12), scale, zero);
+		_mm_storeu_si128((__m128i *) (dst + i),
+				_mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
 	}
+	return i;
 }
-void ConvertImage(const Image1ub& in, ImageRGB& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	int N = (int) out.size();
-#pragma omp parallel for
-	for (int i = 0; i < N; i++) {
-		ubyte lum = in[i].x;
-		out[i] = RGB(lum, lum, lum);
+static size_t GrayToRGBASSE2(const uint8_t* src, ubyte4* dst, size_t n) {
+	const __m128i opaque = _mm_set1_epi8((char) 0xFF);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i g = _mm_loadu_si128((const __m128i *) (src + i));
+		__m128i gg = _mm_unpacklo_epi8(g, g);
+		__m128i ga = _mm_unpacklo_epi8(g, opaque);
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi16(gg, ga));
+		_mm_storeu_si128((__m128i *) (dst + i + 4), _mm_unpackhi_epi16(gg, ga));
+		gg = _mm_unpackhi_epi8(g, g);
+		ga = _mm_unpackhi_epi8(g, opaque);
+		_mm_storeu_si128((__m128i *) (dst + i + 8), _mm_unpacklo_epi16(gg, ga));
+		_mm_storeu_si128((__m128i *) (dst + i + 12),
+				_mm_unpackhi_epi16(gg, ga));
 	}
+	return i;
 }
-
-void ConvertImage(const Image1f& in, ImageRGBA& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	int N = (int) out.size();
-#pragma omp parallel for
-	for (int i = 0; i < N; i++) {
-		ubyte lum = (ubyte) clamp(255.0 * in[i].x, 0.0, 255.0);
-		out[i] = RGBA(lum, lum, lum, 255);
+static size_t GrayToRGBAfSSE2(const float* src, float4* dst, size_t n) {
+	const __m128 rgb = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	const __m128 opaque = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 g = _mm_loadu_ps(src + i);
+		_mm_storeu_ps(&dst[i].x,
+				_mm_or_ps(_mm_and_ps(_mm_shuffle_ps(g, g, 0x00), rgb), opaque));
+		_mm_storeu_ps(&dst[i + 1].x,
+				_mm_or_ps(_mm_and_ps(_mm_shuffle_ps(g, g, 0x55), rgb), opaque));
+		_mm_storeu_ps(&dst[i + 2].x,
+				_mm_or_ps(_mm_and_ps(_mm_shuffle_ps(g, g, 0xAA), rgb), opaque));
+		_mm_storeu_ps(&dst[i + 3].x,
+				_mm_or_ps(_mm_and_ps(_mm_shuffle_ps(g, g, 0xFF), rgb), opaque));
 	}
+	return i;
 }
-void ConvertImage(const Image1f& in, ImageRGB& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	int N = (int) out.size();
-#pragma omp parallel for
-	for (int i = 0; i < N; i++) {
-		ubyte lum = (ubyte) clamp(255.0 * in[i].x, 0.0, 255.0);
-		out[i] = RGB(lum, lum, lum);
+static size_t LuminanceSSE2(const ubyte4* src, float* dst, size_t n,
+		const float3& w) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 wr = _mm_set1_ps(w.x), wg = _mm_set1_ps(w.y), wb = _mm_set1_ps(
+			w.z);
+	const __m128 scale = _mm_set1_ps(255.0f);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i b = _mm_loadu_si128((const __m128i *) (src + i));
+		__m128i lo = _mm_unpacklo_epi8(b, zero);
+		__m128i hi = _mm_unpackhi_epi8(b, zero);
+		__m128 p0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+		__m128 p1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+		__m128 p2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+		__m128 p3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+		_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+		__m128 l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wr, p0), _mm_mul_ps(wg, p1)),
+				_mm_mul_ps(wb, p2));
+		_mm_storeu_ps(dst + i, _mm_div_ps(l, scale));
 	}
+	return i;
 }
-void ConvertImage(const ImageRGBA& in, Image1f& out, bool sRGB) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	int N = (int) out.size();
-
-	if (sRGB) {
-#pragma omp parallel for
-		for (int i = 0; i < N; i++) {
-			ubyte4 c = in[i];
-			out[i] = float1(
-					(float) (0.21 * c.x + 0.72 * c.y + 0.07 * c.z) / 255.0f);
-		}
-	} else {
-#pragma omp parallel for
-		for (int i = 0; i < N; i++) {
-			ubyte4 c = in[i];
-			out[i] = float1(
-					(float) (0.30 * c.x + 0.59 * c.y + 0.11 * c.z) / 255.0f);
+static size_t LuminanceSSE2(const float4* src, uint8_t* dst, size_t n,
+		const float3& w) {
+	const __m128 wr = _mm_set1_ps(w.x), wg = _mm_set1_ps(w.y), wb = _mm_set1_ps(
+			w.z);
+	const __m128 scale = _mm_set1_ps(255.0f);
+	const __m128 zero = _mm_setzero_ps();
+	__m128i q[4];
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		for (int k = 0; k < 4; k++) {
+			const float* ptr = &src[i + 4 * k].x;
+			__m128 p0 = _mm_loadu_ps(ptr);
+			__m128 p1 = _mm_loadu_ps(ptr + 4);
+			__m128 p2 = _mm_loadu_ps(ptr + 8);
+			__m128 p3 = _mm_loadu_ps(ptr + 12);
+			_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+			__m128 l = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(wr, p0), _mm_mul_ps(wg, p1)),
+					_mm_mul_ps(wb, p2));
+			q[k] = FloatsToInts(l, scale, zero);
 		}
+		_mm_storeu_si128((__m128i *) (dst + i),
+				_mm_packus_epi16(_mm_packs_epi32(q[0], q[1]),
+						_mm_packs_epi32(q[2], q[3])));
 	}
+	return i;
 }
-
-void ConvertImage(const ImageRGB& in, Image1f& out, bool sRGB) {
+#endif
+static void BytesToFloats(const uint8_t* src, float* dst, size_t n) {
+	size_t i = 0;
+#ifdef ALY_AVX2
+	if (UseAVX2())
+		i = BytesToFloatsAVX2(src, dst, n);
+#endif
+#ifdef ALY_SSE2
+	i += BytesToFloatsSSE2(src + i, dst + i, n - i);
+#endif
+	for (; i < n; i++) {
+		dst[i] = src[i] / 255.0f;
+	}
+}
+static void FloatsToBytes(const float* src, uint8_t* dst, size_t n) {
+	size_t i = 0;
+#ifdef ALY_AVX2
+	if (UseAVX2())
+		i = FloatsToBytesAVX2(src, dst, n);
+#endif
+#ifdef ALY_SSE2
+	i += FloatsToBytesSSE2(src + i, dst + i, n - i);
+#endif
+	for (; i < n; i++) {
+		dst[i] = ToByte(src[i] * 255.0f);
+	}
+}
+static void GrayToRGBA(const uint8_t* src, ubyte4* dst, size_t n) {
+	size_t i = 0;
+#ifdef ALY_SSE2
+	i = GrayToRGBASSE2(src, dst, n);
+#endif
+	for (; i < n; i++) {
+		dst[i] = ubyte4(src[i], src[i], src[i], 255);
+	}
+}
+static void GrayToRGBA(const float* src, float4* dst, size_t n) {
+	size_t i = 0;
+#ifdef ALY_SSE2
+	i = GrayToRGBAfSSE2(src, dst, n);
+#endif
+	for (; i < n; i++) {
+		dst[i] = float4(src[i], src[i], src[i], 1.0f);
+	}
+}
+static void Luminance(const ubyte4* src, float* dst, size_t n,
+		const float3& w) {
+	size_t i = 0;
+#ifdef ALY_SSE2
+	i = LuminanceSSE2(src, dst, n, w);
+#endif
+	for (; i < n; i++) {
+		const ubyte4& c = src[i];
+		dst[i] = (w.x * c.x + w.y * c.y + w.z * c.z) / 255.0f;
+	}
+}
+static void Luminance(const float4* src, uint8_t* dst, size_t n,
+		const float3& w) {
+	size_t i = 0;
+#ifdef ALY_SSE2
+	i = LuminanceSSE2(src, dst, n, w);
+#endif
+	for (; i < n; i++) {
+		const float4& c = src[i];
+		dst[i] = ToByte((w.x * c.x + w.y * c.y + w.z * c.z) * 255.0f);
+	}
+}
+static void SRGBToLinear(const ubyte4* src, float4* dst, size_t n) {
+	const float* table = SRGBDecodeTable();
+	size_t i = 0;
+#ifdef ALY_AVX2
+	if (UseAVX2())
+		i = SRGBToLinearAVX2(src, dst, n);
+#endif
+	for (; i < n; i++) {
+		const ubyte4& c = src[i];
+		dst[i] = float4(table[c.x], table[c.y], table[c.z], table[256 + c.w]);
+	}
+}
+static void LinearToSRGB(const float4* src, ubyte4* dst, size_t n) {
+	const uint8_t* table = SRGBEncodeTable();
+	size_t i = 0;
+#ifdef ALY_AVX2
+	if (UseAVX2())
+		i = LinearToSRGBAVX2(src, dst, n);
+#endif
+	for (; i < n; i++) {
+		const float4& c = src[i];
+		dst[i] = ubyte4(table[SRGBEncodeIndex(c.x)], table[SRGBEncodeIndex(c.y)],
+				table[SRGBEncodeIndex(c.z)], AlphaToByte(c.w));
+	}
+}
+/*
+ Like ConvertPixels, but hands whole runs of pixels to a kernel. Contiguous views are
+ processed as one run split into cache sized chunks, strided views row by row.
+ */
+template<class T, int C, ImageType I, class S, int D, ImageType J, class F> void ConvertRuns(
+		const ConstImageView<T, C, I>& in, Image<S, D, J>& out, const F& func) {
 	out.resize(in.width, in.height);
 	out.id = in.id;
 	out.setPosition(in.position());
-	int N = (int) out.size();
-
-	if (sRGB) {
+	if (out.size() == 0)
+		return;
+	if (in.isContiguous()) {
+		const size_t N = out.size();
+		const int chunks = (int) ((N + CONVERT_CHUNK - 1) / CONVERT_CHUNK);
 #pragma omp parallel for
-		for (int i = 0; i < N; i++) {
-			ubyte3 c = in[i];
-			out[i] = float1(
-					(float) (0.21 * c.x + 0.72 * c.y + 0.07 * c.z) / 255.0f);
+		for (int c = 0; c < chunks; c++) {
+			size_t start = c * CONVERT_CHUNK;
+			func(in.vecPtr() + start, &out.data[start],
+					std::min(CONVERT_CHUNK, N - start));
 		}
 	} else {
 #pragma omp parallel for
-		for (int i = 0; i < N; i++) {
-			ubyte3 c = in[i];
-			out[i] = float1(
-					(float) (0.30 * c.x + 0.59 * c.y + 0.11 * c.z) / 255.0f);
+		for (int j = 0; j < in.height; j++) {
+			func(in.row(j), &out.data[j * (size_t) in.width],
+					(size_t) in.width);
 		}
 	}
 }
-void ConvertImage(const ImageRGBAf& in, Image1ub& out, bool sRGB) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	int N = (int) out.size();
+}
+void ConvertImage(const ConstImageView1f& in, ImageRGBAf& out) {
+	simd::ConvertRuns(in, out, [](const float1* src, float4* dst, size_t n) {
+		simd::GrayToRGBA(&src->x, dst, n);
+	});
+}
+void ConvertImage(const ConstImageView2f& in, ImageRGBAf& out) {
+	ConvertPixels(in, out, [](const float2& c) {
+		return float4(c.x, c.x, c.x, c.y);
+	});
+}
+void ConvertImage(const ConstImageView1f& in, ImageRGBf& out) {
+	ConvertPixels(in, out, [](const float1& c) {
+		return float3(c.x, c.x, c.x);
+	});
+}
+void ConvertImage(const ConstImageView1ub& in, ImageRGBAf& out) {
+	simd::ConvertRuns(in, out, [](const ubyte1* src, float4* dst, size_t n) {
+		float lum[256];
+		for (size_t i = 0; i < n; i += 256) {
+			size_t m = std::min((size_t) 256, n - i);
+			simd::BytesToFloats(&src[i].x, lum, m);
+			simd::GrayToRGBA(lum, dst + i, m);
+		}
+	});
+}
+void ConvertImage(const ConstImageView1ub& in, ImageRGBf& out) {
+	ConvertPixels(in, out, [](const ubyte1& c) {
+		float lum = c.x / 255.0f;
+		return float3(lum, lum, lum);
+	});
+}
+void ConvertImage(const ConstImageView1ub& in, ImageRGBA& out) {
+	simd::ConvertRuns(in, out, [](const ubyte1* src, ubyte4* dst, size_t n) {
+		simd::GrayToRGBA(&src->x, dst, n);
+	});
+}
+void ConvertImage(const ConstImageView1ub& in, ImageRGB& out) {
+	ConvertPixels(in, out, [](const ubyte1& c) {
+		return RGB(c.x, c.x, c.x);
+	});
+}
 
-	if (sRGB) {
-#pragma omp parallel for
-		for (int i = 0; i < N; i++) {
-			float4 c = in[i];
-			out[i] = ubyte1(
-					(uint8_t) clamp(
-							255 * (0.21 * c.x + 0.72 * c.y + 0.07 * c.z), 0.0,
-							255.0));
+void ConvertImage(const ConstImageView1f& in, ImageRGBA& out) {
+	simd::ConvertRuns(in, out, [](const float1* src, ubyte4* dst, size_t n) {
+		uint8_t lum[256];
+		for (size_t i = 0; i < n; i += 256) {
+			size_t m = std::min((size_t) 256, n - i);
+			simd::FloatsToBytes(&src[i].x, lum, m);
+			simd::GrayToRGBA(lum, dst + i, m);
 		}
+	});
+}
+void ConvertImage(const ConstImageView1f& in, ImageRGB& out) {
+	ConvertPixels(in, out, [](const float1& c) {
+		ubyte lum = simd::ToByte(255.0f * c.x);
+		return RGB(lum, lum, lum);
+	});
+}
+void ConvertImage(const ConstImageViewRGBA& in, Image1f& out, bool sRGB) {
+	const float3 w = (sRGB) ?
+			float3(0.21f, 0.72f, 0.07f) : float3(0.30f, 0.59f, 0.11f);
+	simd::ConvertRuns(in, out, [=](const ubyte4* src, float1* dst, size_t n) {
+		simd::Luminance(src, &dst->x, n, w);
+	});
+}
+
+void ConvertImage(const ConstImageViewRGB& in, Image1f& out, bool sRGB) {
+	if (sRGB) {
+		ConvertPixels(in, out, [](const ubyte3& c) {
+			return float1((0.21f * c.x + 0.72f * c.y + 0.07f * c.z) / 255.0f);
+		});
 	} else {
-#pragma omp parallel for
-		for (int i = 0; i < N; i++) {
-			float4 c = in[i];
-			out[i] = ubyte1(
-					(uint8_t) clamp(
-							255 * (0.30 * c.x + 0.59 * c.y + 0.11 * c.z), 0.0,
-							255.0));
-		}
+		ConvertPixels(in, out, [](const ubyte3& c) {
+			return float1((0.30f * c.x + 0.59f * c.y + 0.11f * c.z) / 255.0f);
+		});
 	}
 }
-void ConvertImage(const ImageRGBf& in, Image1ub& out, bool sRGB) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	int N = (int) out.size();
-
+void ConvertImage(const ConstImageViewRGBAf& in, Image1ub& out, bool sRGB) {
+	const float3 w = (sRGB) ?
+			float3(0.21f, 0.72f, 0.07f) : float3(0.30f, 0.59f, 0.11f);
+	simd::ConvertRuns(in, out, [=](const float4* src, ubyte1* dst, size_t n) {
+		simd::Luminance(src, &dst->x, n, w);
+	});
+}
+void ConvertImage(const ConstImageViewRGBf& in, Image1ub& out, bool sRGB) {
 	if (sRGB) {
-#pragma omp parallel for
-		for (int i = 0; i < N; i++) {
-			float3 c = in[i];
-			out[i] = ubyte1(
-					(uint8_t) clamp(
-							255 * (0.21 * c.x + 0.72 * c.y + 0.07 * c.z), 0.0,
-							255.0));
-		}
+		ConvertPixels(in, out, [](const float3& c) {
+			return ubyte1(
+					simd::ToByte(
+							(0.21f * c.x + 0.72f * c.y + 0.07f * c.z) * 255.0f));
+		});
 	} else {
-#pragma omp parallel for
-		for (int i = 0; i < N; i++) {
-			float3 c = in[i];
-			out[i] = ubyte1(
-					(uint8_t) clamp(
-							255 * (0.30 * c.x + 0.59 * c.y + 0.11 * c.z), 0.0,
-							255.0));
-		}
+		ConvertPixels(in, out, [](const float3& c) {
+			return ubyte1(
+					simd::ToByte(
+							(0.30f * c.x + 0.59f * c.y + 0.11f * c.z) * 255.0f));
+		});
 	}
 }
 void WriteImageToFile(const std::string& file, const ImageRGB& image) {
@@ -704,87 +1030,54 @@ void WriteImageToFile(const std::string& file, const ImageRGBf& img) {
 	}
 }
 
-void ConvertImage(const ImageRGBf& in, ImageRGB& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	size_t index = 0;
-	for (const RGBf& ct : in.data) {
-		out[index++] = RGB(clamp((int) (ct.x * 255.0f), 0, 255),
-				clamp((int) (ct.y * 255.0f), 0, 255),
-				clamp((int) (ct.z * 255.0f), 0, 255));
-	}
+void ConvertImage(const ConstImageViewRGBf& in, ImageRGB& out) {
+	simd::ConvertRuns(in, out, [](const RGBf* src, RGB* dst, size_t n) {
+		simd::FloatsToBytes(&src->x, &dst->x, 3 * n);
+	});
 }
-void ConvertImage(const ImageRGBAf& in, ImageRGBA& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	size_t index = 0;
-	for (const RGBAf& ct : in.data) {
-		out[index++] = RGBA(clamp((int) (ct.x * 255.0f), 0, 255),
-				clamp((int) (ct.y * 255.0f), 0, 255),
-				clamp((int) (ct.z * 255.0f), 0, 255),
-				clamp((int) (ct.w * 255.0f), 0, 255));
-	}
+void ConvertImage(const ConstImageViewRGBAf& in, ImageRGBA& out) {
+	simd::ConvertRuns(in, out, [](const RGBAf* src, RGBA* dst, size_t n) {
+		simd::FloatsToBytes(&src->x, &dst->x, 4 * n);
+	});
 }
-void ConvertImage(const ImageRGBA& in, ImageRGBAf& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	size_t index = 0;
-	for (RGBAf& ct : out.data) {
-		RGBA cs = in[index++];
-		ct = RGBAf(cs.x / 255.0f, cs.y / 255.0f, cs.z / 255.0f, cs.w / 255.0f);
-	}
+void ConvertImage(const ConstImageViewRGBA& in, ImageRGBAf& out) {
+	simd::ConvertRuns(in, out, [](const RGBA* src, RGBAf* dst, size_t n) {
+		simd::BytesToFloats(&src->x, &dst->x, 4 * n);
+	});
 }
-void ConvertImage(const ImageRGB& in, ImageRGBf& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	size_t index = 0;
-	for (RGBf& ct : out.data) {
-		RGB cs = in[index++];
-		ct = RGBf(cs.x / 255.0f, cs.y / 255.0f, cs.z / 255.0f);
-	}
+void ConvertImage(const ConstImageViewRGB& in, ImageRGBf& out) {
+	simd::ConvertRuns(in, out, [](const RGB* src, RGBf* dst, size_t n) {
+		simd::BytesToFloats(&src->x, &dst->x, 3 * n);
+	});
 }
-void ConvertImage(const ImageRGB& in, ImageRGBA& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	size_t index = 0;
-	for (RGBA& ct : out.data) {
-		RGB cs = in[index++];
-		ct = RGBA(cs, 255);
-	}
+void ConvertSRGBToLinear(const ConstImageViewRGBA& in, ImageRGBAf& out) {
+	simd::ConvertRuns(in, out, [](const RGBA* src, RGBAf* dst, size_t n) {
+		simd::SRGBToLinear(src, dst, n);
+	});
 }
-void ConvertImage(const ImageRGBf& in, ImageRGBAf& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	size_t index = 0;
-	for (RGBAf& ct : out.data) {
-		RGBf cs = in[index++];
-		ct = RGBAf(cs, 1.0f);
-	}
+void ConvertLinearToSRGB(const ConstImageViewRGBAf& in, ImageRGBA& out) {
+	simd::ConvertRuns(in, out, [](const RGBAf* src, RGBA* dst, size_t n) {
+		simd::LinearToSRGB(src, dst, n);
+	});
 }
-void ConvertImage(const ImageRGBAf& in, ImageRGBf& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	size_t index = 0;
-	for (RGBf& ct : out.data) {
-		RGBAf cs = in[index++];
-		ct = cs.xyz();
-	}
+void ConvertImage(const ConstImageViewRGB& in, ImageRGBA& out) {
+	ConvertPixels(in, out, [](const RGB& cs) {
+		return RGBA(cs, 255);
+	});
 }
-void ConvertImage(const ImageRGBA& in, ImageRGB& out) {
-	out.resize(in.width, in.height);
-	out.id = in.id;
-	out.setPosition(in.position());
-	size_t index = 0;
-	for (RGB& ct : out.data) {
-		RGBA cs = in[index++];
-		ct = cs.xyz();
-	}
+void ConvertImage(const ConstImageViewRGBf& in, ImageRGBAf& out) {
+	ConvertPixels(in, out, [](const RGBf& cs) {
+		return RGBAf(cs, 1.0f);
+	});
+}
+void ConvertImage(const ConstImageViewRGBAf& in, ImageRGBf& out) {
+	ConvertPixels(in, out, [](const RGBAf& cs) {
+		return cs.xyz();
+	});
+}
+void ConvertImage(const ConstImageViewRGBA& in, ImageRGB& out) {
+	ConvertPixels(in, out, [](const RGBA& cs) {
+		return cs.xyz();
+	});
 }
 }
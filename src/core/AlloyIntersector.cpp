@@ -58,28 +58,13 @@
 #include <AlloyIntersector.h>
 #include "AlloyMesh.h"
 
-#include <list>
 #include <queue>
 #include <vector>
 #include <algorithm>
+#include <functional>
 namespace aly {
 static const double ZERO_TOLERANCE = 1E-6;
-void KDBox::update() {
-	minPoint.x = minPoint.y = minPoint.z = 1E30f;
-	maxPoint.x = maxPoint.y = maxPoint.z = -1E30f;
-	for (KDBox* child : children) {
-		child->update();
-		float3 p = child->getMin();
-		minPoint.x = aly::min(minPoint.x, p.x);
-		minPoint.y = aly::min(minPoint.y, p.y);
-		minPoint.z = aly::min(minPoint.z, p.z);
-		p = child->getMax();
-		maxPoint.x = aly::max(maxPoint.x, p.x);
-		maxPoint.y = aly::max(maxPoint.y, p.y);
-		maxPoint.z = aly::max(maxPoint.z, p.z);
-	}
-}
-double KDBox::distanceToBox(const float3& p) const {
+double BVHNode::distanceToBox(const float3& p) const {
 	if (inside(p)) {
 		return -1;
 	}
@@ -89,21 +74,12 @@ double KDBox::distanceToBox(const float3& p) const {
 	ref.z = aly::clamp(p.z, minPoint.z, maxPoint.z);
 	return distance(p, ref);
 }
-bool KDBox::intersects(const KDBox& test) const {
-	double dx = aly::min(test.maxPoint.x, maxPoint.x)
-			- aly::max(test.minPoint.x, minPoint.x);
-	double dy = aly::min(test.maxPoint.y, maxPoint.y)
-			- aly::max(test.minPoint.y, minPoint.y);
-	double dz = aly::min(test.maxPoint.z, maxPoint.z)
-			- aly::max(test.minPoint.z, minPoint.z);
-	return (dx >= 0) && (dy >= 0) && (dz >= 0);
-}
-bool KDBox::inside(const float3& test) const {
+bool BVHNode::inside(const float3& test) const {
 	return (test.x >= minPoint.x) && (test.x <= maxPoint.x)
 			&& (test.y >= minPoint.y) && (test.y <= maxPoint.y)
 			&& (test.z >= minPoint.z) && (test.z <= maxPoint.z);
 }
-bool KDBox::intersectRayBox(const float3& org, const float3& dr) const {
+bool BVHNode::intersectRayBox(const float3& org, const float3& dr) const {
 	double3 minB(minPoint);
 	double3 maxB(maxPoint);
 	double3 origin(org);
@@ -161,27 +137,7 @@ bool KDBox::intersectRayBox(const float3& org, const float3& dr) const {
 	}
 	return true;
 }
-void KDBoxEdge::set(KDBox* b, int dim, bool start) {
-	box = b;
-	this->start = start;
-	if (b == nullptr)
-		return;
-	switch (dim) {
-	case 0:
-		value = (start) ? b->getMin().x : b->getMax().x;
-		break;
-	case 1:
-		value = (start) ? b->getMin().y : b->getMax().y;
-		break;
-	case 2:
-		value = (start) ? b->getMin().z : b->getMax().z;
-		break;
-	default:
-		value = 0;
-	}
-
-}
-bool KDBox::intersectSegmentBox(const float3& org, const float3& end) const {
+bool BVHNode::intersectSegmentBox(const float3& org, const float3& end) const {
 	if (inside(org) || inside(end))
 		return true;
 	float3 dr = end - org;
@@ -890,298 +846,522 @@ double KDTriangle::distance(const float3& p, float3& lastIntersect) const {
 	lastIntersect = pts[0] + kEdge0 * (float) fS + kEdge1 * (float) fT;
 	return std::sqrt(fSqrDistance);
 }
-void Intersector::build(const Mesh& mesh, int maxDepth) {
-	root = std::shared_ptr<KDBox>(new KDBox());
-	uint64_t id = 0;
-	KDTriangle* tri;
+struct BVHBin {
+	float3 minPoint;
+	float3 maxPoint;
+	uint32_t count;
+	BVHBin() :
+			minPoint(1E30f), maxPoint(-1E30f), count(0) {
+	}
+};
+static inline float SurfaceArea(const float3& minPoint, const float3& maxPoint) {
+	float3 d = aly::max(maxPoint - minPoint, float3(0.0f));
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+void Intersector::build(const Mesh& mesh, int maxLeafSize) {
+	reset();
+	vertexes = mesh.vertexLocations.data;
+	triangles.reserve(2 * mesh.quadIndexes.size() + mesh.triIndexes.size());
+	faceIds.reserve(triangles.capacity());
+	uint32_t id = 0;
 	for (const uint4& face : mesh.quadIndexes.data) {
-		float3 pt1 = mesh.vertexLocations[face.x];
-		float3 pt2 = mesh.vertexLocations[face.y];
-		float3 pt3 = mesh.vertexLocations[face.z];
-		float3 pt4 = mesh.vertexLocations[face.w];
+		float3 pt1 = vertexes[face.x];
+		float3 pt2 = vertexes[face.y];
+		float3 pt3 = vertexes[face.z];
+		float3 pt4 = vertexes[face.w];
 		if (distanceSqr(pt1, pt3) < distanceSqr(pt2, pt4)) {
-			storage.push_back(
-					std::shared_ptr<KDTriangle>(
-							tri = new KDTriangle(pt1, pt2, pt3, id, 1)));
-			root->getChildren().push_back(tri);
-			storage.push_back(
-					std::shared_ptr<KDTriangle>(
-							tri = new KDTriangle(pt3, pt4, pt1, id, 1)));
-			root->getChildren().push_back(tri);
+			triangles.push_back(uint3(face.x, face.y, face.z));
+			triangles.push_back(uint3(face.z, face.w, face.x));
 		} else {
-			storage.push_back(
-					std::shared_ptr<KDTriangle>(
-							tri = new KDTriangle(pt1, pt2, pt4, id, 1)));
-			root->getChildren().push_back(tri);
-			storage.push_back(
-					std::shared_ptr<KDTriangle>(
-							tri = new KDTriangle(pt4, pt2, pt3, id, 1)));
-			root->getChildren().push_back(tri);
-
+			triangles.push_back(uint3(face.x, face.y, face.w));
+			triangles.push_back(uint3(face.w, face.y, face.z));
 		}
+		faceIds.push_back(id);
+		faceIds.push_back(id);
 		id++;
 	}
 	for (const uint3& face : mesh.triIndexes.data) {
-		storage.push_back(
-				std::shared_ptr<KDTriangle>(
-						tri = new KDTriangle(mesh.vertexLocations[face.x],
-								mesh.vertexLocations[face.y],
-								mesh.vertexLocations[face.z], id, 1)));
-		root->getChildren().push_back(tri);
+		triangles.push_back(face);
+		faceIds.push_back(id);
 		id++;
 	}
-	root->update();
-	buildTree(maxDepth);
+	this->maxLeafSize = std::max(maxLeafSize, 1);
+	if (triangles.size() > 0) {
+		buildTree();
+	}
 }
-void Intersector::buildTree(int maxDepth) {
-	std::list<KDBox*> boxes;
-	boxes.push_back(root.get());
-	int sz;
-	int splitPos;
-	KDBox* leftChild;
-	KDBox* rightChild;
-	int depthCount = 0;
-	while (boxes.size() > 0) {
-		KDBox* box = boxes.front();
-		boxes.pop_front();
-		if (box->getDepth() > maxDepth)
-			continue;
-		if (box->getDepth() > depthCount) {
-			depthCount = box->getDepth();
+/*
+ * Builds the subtree over triangles [first,last) into "out", with its root at out[0]. Right child offsets are
+ * relative to "out", leaf offsets are absolute triangle indexes. Triangles in the range are reordered to match.
+ */
+void Intersector::buildNodes(uint32_t first, uint32_t last, std::vector<BVHNode>& out) {
+	struct BuildTask {
+		uint32_t start;
+		uint32_t end;
+		uint32_t parent;
+		bool right;
+	};
+	//Bounding boxes are partitioned in place, so every pass over a node's triangles reads contiguous memory.
+	struct BuildPrimitive {
+		float3 minPoint;
+		uint32_t index;
+		float3 maxPoint;
+		float3 centroid() const {
+			return 0.5f * (minPoint + maxPoint);
 		}
-		std::vector<KDBox*>& children = box->getChildren();
-		if (children.size() < 2)
-			continue;
-		sz = (int) children.size() * 2;
-		std::vector<KDBoxEdge> edges;
-		splitPos = splitPosition(children, edges, box);
-		if (splitPos <= 0 || splitPos == sz - 1) {
-			continue;
+	};
+	uint32_t N = last - first;
+	std::vector<BuildPrimitive> prims(N);
+#pragma omp parallel for
+	for (int t = 0; t < (int) N; t++) {
+		const uint3& tri = triangles[first + t];
+		const float3& pt1 = vertexes[tri.x];
+		const float3& pt2 = vertexes[tri.y];
+		const float3& pt3 = vertexes[tri.z];
+		BuildPrimitive& prim = prims[t];
+		prim.minPoint = aly::min(aly::min(pt1, pt2), pt3);
+		prim.maxPoint = aly::max(aly::max(pt1, pt2), pt3);
+		prim.index = first + t;
+	}
+	//SAH is allowed to keep leaves larger than maxLeafSize when splitting does not pay off, but not arbitrarily large.
+	const uint32_t forceSplitSize = 8 * maxLeafSize;
+	out.clear();
+	out.reserve(2 * (N / maxLeafSize) + 1);
+	std::vector<BuildTask> tasks;
+	tasks.push_back( { 0, N, 0, false });
+	BVHBin bins[3][BIN_COUNT];
+	float rightAreas[BIN_COUNT];
+	uint32_t rightCounts[BIN_COUNT];
+	while (tasks.size() > 0) {
+		BuildTask task = tasks.back();
+		tasks.pop_back();
+		uint32_t index = (uint32_t) out.size();
+		if (task.right) {
+			out[task.parent].offset = index;
 		}
-		storage.push_back(
-				std::shared_ptr<KDBox>(
-						leftChild = new KDBox(box->getDepth() + 1)));
-		storage.push_back(
-				std::shared_ptr<KDBox>(
-						rightChild = new KDBox(box->getDepth() + 1)));
-		std::vector<KDBox*>& lchildren = leftChild->getChildren();
-		std::vector<KDBox*>& rchildren = rightChild->getChildren();
-		for (int i = 0; i < splitPos; i++) {
-			if (edges[i].isMin()) {
-				edges[i].getBox()->setDepth(leftChild->getDepth() + 1);
-				lchildren.push_back(edges[i].getBox());
-
+		float3 minPoint(1E30f), maxPoint(-1E30f);
+		float3 minCentroid(1E30f), maxCentroid(-1E30f);
+		for (uint32_t i = task.start; i < task.end; i++) {
+			const BuildPrimitive& prim = prims[i];
+			float3 centroid = prim.centroid();
+			minPoint = aly::min(minPoint, prim.minPoint);
+			maxPoint = aly::max(maxPoint, prim.maxPoint);
+			minCentroid = aly::min(minCentroid, centroid);
+			maxCentroid = aly::max(maxCentroid, centroid);
+		}
+		uint32_t count = task.end - task.start;
+		int bestAxis = -1;
+		int bestBin = -1;
+		double bestCost = 1E30;
+		float3 extent = maxCentroid - minCentroid;
+		//Small nodes use fewer bins, otherwise clearing and sweeping the bins costs more than binning the triangles.
+		int numBins = std::min((int) BIN_COUNT, (int) count);
+		float3 scale;
+		for (int axis = 0; axis < 3; axis++) {
+			scale[axis] = (extent[axis] > 0.0f) ? numBins / extent[axis] : 0.0f;
+		}
+		if (count > (uint32_t) maxLeafSize && (scale.x > 0.0f || scale.y > 0.0f || scale.z > 0.0f)) {
+			for (int axis = 0; axis < 3; axis++) {
+				for (int b = 0; b < numBins; b++) {
+					bins[axis][b] = BVHBin();
+				}
+			}
+			for (uint32_t i = task.start; i < task.end; i++) {
+				const BuildPrimitive& prim = prims[i];
+				float3 offset = (prim.centroid() - minCentroid) * scale;
+				for (int axis = 0; axis < 3; axis++) {
+					BVHBin& bin = bins[axis][std::min((int) offset[axis], numBins - 1)];
+					bin.minPoint = aly::min(bin.minPoint, prim.minPoint);
+					bin.maxPoint = aly::max(bin.maxPoint, prim.maxPoint);
+					bin.count++;
+				}
+			}
+			for (int axis = 0; axis < 3; axis++) {
+				if (scale[axis] == 0.0f)
+					continue;
+				float3 binMin(1E30f), binMax(-1E30f);
+				uint32_t binCount = 0;
+				for (int b = numBins - 1; b > 0; b--) {
+					binMin = aly::min(binMin, bins[axis][b].minPoint);
+					binMax = aly::max(binMax, bins[axis][b].maxPoint);
+					binCount += bins[axis][b].count;
+					rightAreas[b] = SurfaceArea(binMin, binMax);
+					rightCounts[b] = binCount;
+				}
+				binMin = float3(1E30f);
+				binMax = float3(-1E30f);
+				binCount = 0;
+				for (int b = 0; b < numBins - 1; b++) {
+					binMin = aly::min(binMin, bins[axis][b].minPoint);
+					binMax = aly::max(binMax, bins[axis][b].maxPoint);
+					binCount += bins[axis][b].count;
+					if (binCount == 0 || rightCounts[b + 1] == 0)
+						continue;
+					double cost = SurfaceArea(binMin, binMax) * (double) binCount
+							+ rightAreas[b + 1] * (double) rightCounts[b + 1];
+					if (cost < bestCost) {
+						bestCost = cost;
+						bestAxis = axis;
+						bestBin = b;
+					}
+				}
 			}
 		}
-		for (int i = splitPos + 1; i < sz; i++) {
-			if (!edges[i].isMin()) {
-				edges[i].getBox()->setDepth(rightChild->getDepth() + 1);
-				rchildren.push_back(edges[i].getBox());
+		uint32_t mid = task.start;
+		if (bestAxis >= 0) {
+			double area = std::max(SurfaceArea(minPoint, maxPoint), 1E-30f);
+			double splitCost = traversalCost + intersectCost * bestCost / area;
+			if (splitCost < intersectCost * count || count > forceSplitSize) {
+				float axisScale = scale[bestAxis];
+				float minValue = minCentroid[bestAxis];
+				mid = (uint32_t) (std::partition(prims.begin() + task.start, prims.begin() + task.end,
+						[&](const BuildPrimitive& prim) {
+							return std::min((int) ((prim.centroid()[bestAxis] - minValue) * axisScale), numBins - 1) <= bestBin;
+						}) - prims.begin());
 			}
+		} else if (count > forceSplitSize) {
+			//Coincident centroids, any balanced split is as good as another.
+			mid = task.start + count / 2;
 		}
-		if (lchildren.size() >= children.size()
-				|| rchildren.size() >= children.size()) {
+		BVHNode node;
+		node.minPoint = minPoint;
+		node.maxPoint = maxPoint;
+		if (mid > task.start && mid < task.end) {
+			node.count = 0;
+			tasks.push_back( { mid, task.end, index, true });
+			tasks.push_back( { task.start, mid, index, false });
+		} else {
+			node.offset = first + task.start;
+			node.count = count;
+		}
+		out.push_back(node);
+	}
+	out.shrink_to_fit();
+	std::vector<uint3> sortedTriangles(N);
+	std::vector<uint32_t> sortedIds(N);
+#pragma omp parallel for
+	for (int i = 0; i < (int) N; i++) {
+		sortedTriangles[i] = triangles[prims[i].index];
+		sortedIds[i] = faceIds[prims[i].index];
+	}
+	std::copy(sortedTriangles.begin(), sortedTriangles.end(), triangles.begin() + first);
+	std::copy(sortedIds.begin(), sortedIds.end(), faceIds.begin() + first);
+}
+void Intersector::buildTree() {
+	buildNodes(0, (uint32_t) triangles.size(), nodes);
+	costs.resize(nodes.size());
+	updateCosts(0, (uint32_t) nodes.size(), costs);
+}
+/*
+ * Normalized SAH cost (expected cost of a query that reaches the node) of every node in [first,last),
+ * which must be a complete subtree or the whole tree.
+ */
+void Intersector::updateCosts(uint32_t first, uint32_t last, std::vector<float>& out) const {
+	std::vector<double> sums(last - first);
+	for (int64_t n = (int64_t) last - 1; n >= (int64_t) first; n--) {
+		const BVHNode& node = nodes[n];
+		double area = SurfaceArea(node.minPoint, node.maxPoint);
+		double sum;
+		if (node.isLeaf()) {
+			sum = intersectCost * area * node.count;
+		} else {
+			sum = traversalCost * area + sums[n + 1 - first] + sums[node.offset - first];
+		}
+		sums[n - first] = sum;
+		out[n] = (float) (sum / std::max(area, 1E-30));
+	}
+}
+int Intersector::refit(const Mesh& mesh, float rebuildRatio) {
+	if (nodes.size() == 0)
+		throw std::runtime_error("Intersector has not been initialized.");
+	if (mesh.vertexLocations.size() != vertexes.size()
+			|| 2 * mesh.quadIndexes.size() + mesh.triIndexes.size() != triangles.size())
+		throw std::runtime_error("Cannot refit Intersector, mesh topology has changed since it was built.");
+	vertexes = mesh.vertexLocations.data;
+	refitBounds();
+	if (rebuildRatio <= 0.0f) {
+		return 0;
+	}
+	std::vector<float> current(nodes.size());
+	updateCosts(0, (uint32_t) nodes.size(), current);
+	//Leaf costs do not change with their bounds, so only interior nodes can trigger a rebuild.
+	std::vector<uint32_t> degraded;
+	std::vector<uint32_t> stack(1, 0);
+	while (stack.size() > 0) {
+		uint32_t index = stack.back();
+		stack.pop_back();
+		const BVHNode& node = nodes[index];
+		if (node.isLeaf())
 			continue;
+		if (current[index] > rebuildRatio * costs[index]) {
+			degraded.push_back(index);
+		} else {
+			stack.push_back(node.offset);
+			stack.push_back(index + 1);
 		}
-		leftChild->update();
-		rightChild->update();
-		children.clear();
-		children.push_back(leftChild);
-		children.push_back(rightChild);
-		box->update();
-		//std::cout << "Left: " << *leftChild<<std::endl;
-		//std::cout << "Right: " << *rightChild << std::endl;
-		boxes.push_back(leftChild);
-		boxes.push_back(rightChild);
-
 	}
+	if (degraded.size() > 0) {
+		rebuildSubtrees(degraded);
+	}
+	return (int) degraded.size();
 }
-int Intersector::splitPosition(std::vector<KDBox*>& children,
-		std::vector<KDBoxEdge>& edges, KDBox* box) {
-	int nAbove = 0;
-	int nBelow = 0;
-	double pAbove = 0;
-	double pBelow = 0;
-	double cost = 0;
-	int dim = 0;
-	int bestSplit = -1;
-	double sum = 0;
-	double prod = 0;
-	double voxel;
-	double val;
-	double minCost;
-	int sz;
-	//KDBoxEdge e1, e2;
-	float3 v = box->getMax() - box->getMin();
-	if (v.x > v.y && v.x > v.z)
-		dim = 0;
-	else if (v.y > v.z)
-		dim = 1;
-	else
-		dim = 2;
-	int retry = 3;
-	voxel = 1.0 / (v.x + v.y + v.z);
-	do {
-		bestSplit = -1;
-		switch (dim) {
-		case 0:
-			sum = v.y + v.z;
-			prod = v.y * v.z;
-			break;
-		case 1:
-			sum = v.x + v.z;
-			prod = v.x * v.z;
-			break;
-		case 2:
-			sum = v.x + v.y;
-			prod = v.x * v.y;
-			break;
+void Intersector::refitBounds() {
+	uint32_t N = (uint32_t) nodes.size();
+	//Children always follow their parent, so depths can be assigned in one forward pass.
+	std::vector<uint32_t> depths(N, 0);
+	uint32_t maxDepth = 0;
+	for (uint32_t n = 0; n < N; n++) {
+		const BVHNode& node = nodes[n];
+		if (!node.isLeaf()) {
+			depths[n + 1] = depths[node.offset] = depths[n] + 1;
+			maxDepth = std::max(maxDepth, depths[n]);
 		}
-
-		sz = (int) children.size() * 2;
-		edges.resize(sz);
-		for (int i = 0; i < sz; i++) {
-			KDBox* child = children[i / 2];
-			edges[i] = KDBoxEdge(child, dim, (i % 2 == 1) ? true : false);
+	}
+	std::vector<uint32_t> levelOffsets(maxDepth + 2, 0);
+	for (uint32_t n = 0; n < N; n++) {
+		if (!nodes[n].isLeaf()) {
+			levelOffsets[depths[n] + 1]++;
 		}
-
-		std::sort(edges.begin(), edges.end(),
-				[](const KDBoxEdge& e1, const KDBoxEdge& e2) {
-					return (e1.getValue() < e2.getValue());
-				});
-		for (int i = 0; i < (int) edges.size() - 1; i++) {
-			KDBoxEdge& e1 = edges[i];
-			KDBoxEdge& e2 = edges[i + 1];
-			if (e1.getValue() == e2.getValue()) {
-				if (!e1.isMin() && e2.isMin()) {
-					std::swap(e1, e2);
-				}
+	}
+	for (uint32_t d = 0; d <= maxDepth; d++) {
+		levelOffsets[d + 1] += levelOffsets[d];
+	}
+	std::vector<uint32_t> levels(levelOffsets.back());
+	std::vector<uint32_t> positions(levelOffsets.begin(), levelOffsets.end() - 1);
+	for (uint32_t n = 0; n < N; n++) {
+		if (!nodes[n].isLeaf()) {
+			levels[positions[depths[n]]++] = n;
+		}
+	}
+#pragma omp parallel for
+	for (int n = 0; n < (int) N; n++) {
+		BVHNode& node = nodes[n];
+		if (node.isLeaf()) {
+			float3 minPoint(1E30f), maxPoint(-1E30f);
+			for (uint32_t t = node.offset; t < node.offset + node.count; t++) {
+				const uint3& tri = triangles[t];
+				minPoint = aly::min(aly::min(minPoint, vertexes[tri.x]), aly::min(vertexes[tri.y], vertexes[tri.z]));
+				maxPoint = aly::max(aly::max(maxPoint, vertexes[tri.x]), aly::max(vertexes[tri.y], vertexes[tri.z]));
 			}
+			node.minPoint = minPoint;
+			node.maxPoint = maxPoint;
 		}
-		nBelow = 0;
-		nAbove = (int) children.size();
-		// Do not assume prior minimum cost because the spherical
-		// orientation
-		// is in some sense optimal when rays are cast from outside the
-		// sphere.
-		// If minimum cost is assumed, then no branches in kd-tree will be
-		// generated
-		// minCost=intersectCost*nAbove;
-		minCost = 1E30;
-
-		KDBoxEdge e1(box, dim, true);
-		KDBoxEdge e2(box, dim, false);
-		for (int i = 0; i < sz; i++) {
-			if (!edges[i].isMin())
-				nAbove--;
-			val = edges[i].getValue();
-			if (val > e1.getValue() && e2.getValue() > val) {
-				pBelow = (sum * (val - e1.getValue()) + prod) * voxel;
-				pAbove = (sum * (e2.getValue() - val) + prod) * voxel;
-				cost = traversalCost
-						+ intersectCost
-								* (1
-										- ((nAbove == 0 || nBelow == 0) ?
-												emptyBonus : 0))
-								* (pBelow * nBelow + pAbove * nAbove);
-				if (cost < minCost) {
-					minCost = cost;
-					bestSplit = i;
+	}
+	for (int d = (int) maxDepth; d >= 0; d--) {
+#pragma omp parallel for
+		for (int i = (int) levelOffsets[d]; i < (int) levelOffsets[d + 1]; i++) {
+			uint32_t n = levels[i];
+			BVHNode& node = nodes[n];
+			const BVHNode& left = nodes[n + 1];
+			const BVHNode& right = nodes[node.offset];
+			node.minPoint = aly::min(left.minPoint, right.minPoint);
+			node.maxPoint = aly::max(left.maxPoint, right.maxPoint);
+		}
+	}
+}
+/*
+ * Rebuilds the given disjoint subtrees and splices them back into the node array in one pass.
+ * Roots must be in ascending order.
+ */
+void Intersector::rebuildSubtrees(const std::vector<uint32_t>& roots) {
+	//A subtree occupies a contiguous range of nodes and a contiguous range of triangles.
+	int K = (int) roots.size();
+	std::vector<uint32_t> ends(K);
+	std::vector<std::vector<BVHNode>> subtrees(K);
+#pragma omp parallel for schedule(dynamic)
+	for (int k = 0; k < K; k++) {
+		uint32_t index = roots[k];
+		uint32_t end = index;
+		uint32_t first = std::numeric_limits<uint32_t>::max();
+		uint32_t last = 0;
+		std::vector<uint32_t> stack(1, index);
+		while (stack.size() > 0) {
+			uint32_t n = stack.back();
+			stack.pop_back();
+			const BVHNode& node = nodes[n];
+			end = std::max(end, n + 1);
+			if (node.isLeaf()) {
+				first = std::min(first, node.offset);
+				last = std::max(last, node.offset + node.count);
+			} else {
+				stack.push_back(node.offset);
+				stack.push_back(n + 1);
+			}
+		}
+		ends[k] = end;
+		buildNodes(first, last, subtrees[k]);
+	}
+	//New position of an old node outside the rebuilt ranges, or of a rebuilt root.
+	std::vector<int64_t> shifts(K + 1, 0);
+	for (int k = 0; k < K; k++) {
+		shifts[k + 1] = shifts[k] + (int64_t) subtrees[k].size() - (int64_t) (ends[k] - roots[k]);
+	}
+	auto remap = [&](uint32_t n) {
+		int k = (int)(std::upper_bound(ends.begin(), ends.end(), n) - ends.begin());
+		return (uint32_t) (n + shifts[k]);
+	};
+	std::vector<BVHNode> rebuilt;
+	std::vector<float> rebuiltCosts;
+	rebuilt.reserve(nodes.size() + shifts[K]);
+	rebuiltCosts.reserve(rebuilt.capacity());
+	uint32_t n = 0;
+	for (int k = 0; k <= K; k++) {
+		uint32_t start = (k < K) ? roots[k] : (uint32_t) nodes.size();
+		for (; n < start; n++) {
+			BVHNode node = nodes[n];
+			if (!node.isLeaf()) {
+				node.offset = remap(node.offset);
+			}
+			rebuilt.push_back(node);
+			rebuiltCosts.push_back(costs[n]);
+		}
+		if (k < K) {
+			uint32_t root = (uint32_t) rebuilt.size();
+			for (BVHNode node : subtrees[k]) {
+				if (!node.isLeaf()) {
+					node.offset += root;
 				}
+				rebuilt.push_back(node);
+				rebuiltCosts.push_back(0.0f);
 			}
-			if (edges[i].isMin())
-				nBelow++;
+			n = ends[k];
 		}
-		dim = (dim + 1) % 3;
-		retry--;
-	} while (bestSplit == -1 && retry > 0);
-	return bestSplit;
+	}
+	nodes.swap(rebuilt);
+	costs.swap(rebuiltCosts);
+	for (int k = 0; k < K; k++) {
+		uint32_t root = remap(roots[k]);
+		updateCosts(root, root + (uint32_t) subtrees[k].size(), costs);
+	}
 }
-double Intersector::intersectRayDistance(const float3& p1, const float3& v,
-		float3& lastPoint, KDTriangle*& lastTriangle) const {
-	if (root->getChildren().size() == 0)
-		throw new std::runtime_error("KD-Tree has not been initialized.");
-	std::list<KDBox*> boxes;
-	boxes.push_back(getRoot());
-	double d;
-	double mind = 1E30;
-	KDTriangle* resultTriangle = nullptr;
-	float3 resultIntersect = NO_HIT_POINT;
-	KDTriangle* tri;
-	while (boxes.size() > 0) {
-		KDBox* box = boxes.front();
-		//std::cout << *box << std::endl;
-		boxes.pop_front();
-		if (box->intersectRayBox(p1, v)) {
-			if (box->isLeaf) {
-				tri = dynamic_cast<KDTriangle*>(box);
-				float3 intersect = tri->intersectionPointRay(p1, v);
-				if (intersect != NO_HIT_POINT) {
-					d = distance(p1, intersect);
+/*
+ * Front-to-back traversal of the ray org+t*dir for t in (0,tmax]. The nearer child is visited first and any node
+ * that starts beyond the closest hit so far is skipped. Distances are measured from org, as in the triangle tests.
+ * The triangle tests are two-sided along the line, so hits outside (0,tmax] are rejected here. A hit at the origin
+ * is rejected too, so rays leaving a surface do not see that surface.
+ */
+template<class F> int64_t Intersector::traverseRay(const float3& org, const float3& dir, float tmax,
+		bool anyHit, const F& intersect, Traversal& traversal, float3& lastPoint, double& mind) const {
+	if (nodes.size() == 0)
+		throw std::runtime_error("Intersector has not been initialized.");
+	float3 invDir;
+	for (int i = 0; i < 3; i++) {
+		invDir[i] = 1.0f / ((std::abs(dir[i]) > 1E-20f) ? dir[i] : std::copysign(1E-20f, dir[i]));
+	}
+	double len = length(dir);
+	double lenSqr = len * len;
+	int64_t resultTriangle = -1;
+	mind = 1E30;
+	float tnear;
+	if (!nodes[0].intersectRay(org, invDir, tmax, tnear)) {
+		return resultTriangle;
+	}
+	std::vector<std::pair<uint32_t, float>>& stack = traversal.stack;
+	stack.clear();
+	stack.push_back(std::pair<uint32_t, float>(0, tnear));
+	while (stack.size() > 0) {
+		std::pair<uint32_t, float> entry = stack.back();
+		stack.pop_back();
+		if (entry.second * len > mind)
+			continue;
+		const BVHNode& node = nodes[entry.first];
+		if (node.isLeaf()) {
+			for (uint32_t t = node.offset; t < node.offset + node.count; t++) {
+				float3 pt = intersect(getTriangle(t));
+				if (pt != NO_HIT_POINT) {
+					double tpt = dot(double3(pt - org), double3(dir)) / lenSqr;
+					if (tpt <= 0.0 || tpt > tmax)
+						continue;
+					double d = distance(org, pt);
 					if (d < mind) {
 						mind = d;
-						resultTriangle = tri;
-						resultIntersect = intersect;
+						resultTriangle = t;
+						lastPoint = pt;
+						if (anyHit) {
+							return resultTriangle;
+						}
 					}
 				}
 			}
-			boxes.insert(boxes.end(), box->getChildren().begin(),
-					box->getChildren().end());
+		} else {
+			uint32_t left = entry.first + 1;
+			uint32_t right = node.offset;
+			float tleft, tright;
+			bool hitLeft = nodes[left].intersectRay(org, invDir, tmax, tleft);
+			bool hitRight = nodes[right].intersectRay(org, invDir, tmax, tright);
+			if (hitLeft && hitRight) {
+				if (tleft <= tright) {
+					stack.push_back(std::pair<uint32_t, float>(right, tright));
+					stack.push_back(std::pair<uint32_t, float>(left, tleft));
+				} else {
+					stack.push_back(std::pair<uint32_t, float>(left, tleft));
+					stack.push_back(std::pair<uint32_t, float>(right, tright));
+				}
+			} else if (hitLeft) {
+				stack.push_back(std::pair<uint32_t, float>(left, tleft));
+			} else if (hitRight) {
+				stack.push_back(std::pair<uint32_t, float>(right, tright));
+			}
 		}
 	}
-	lastTriangle = resultTriangle;
-	lastPoint = resultIntersect;
-	if (resultTriangle == nullptr) {
+	return resultTriangle;
+}
+double Intersector::intersectRayDistance(const float3& p1, const float3& v,
+		float3& lastPoint, KDTriangle& lastTriangle) const {
+	double mind;
+	Traversal traversal;
+	lastPoint = NO_HIT_POINT;
+	int64_t resultTriangle = traverseRay(p1, v, NO_HIT_DISTANCE, false,
+			[&](const KDTriangle& tri) {
+				return tri.intersectionPointRay(p1, v);
+			}, traversal, lastPoint, mind);
+	if (resultTriangle < 0) {
 		return NO_HIT_DISTANCE;
 	} else {
+		lastTriangle = getTriangle((uint32_t) resultTriangle);
 		return mind;
 	}
 }
 double Intersector::intersectSegmentDistance(const float3& p1, const float3& p2,
-		float3& lastPoint, KDTriangle*& lastTriangle) const {
-	if (root->getChildren().size() == 0)
-		throw new std::runtime_error("KD-Tree has not been initialized.");
-	std::list<KDBox*> boxes;
-	boxes.push_back(getRoot());
-	double d;
-	double mind = 1E30;
-	KDTriangle* resultTriangle = nullptr;
-	float3 resultIntersect = NO_HIT_POINT;
-	KDTriangle* tri;
-	while (boxes.size() > 0) {
-		KDBox* box = boxes.front();
-		boxes.pop_front();
-		if (box->intersectSegmentBox(p1, p2)) {
-			if (box->isLeaf) {
-				tri = dynamic_cast<KDTriangle*>(box);
-				float3 intersect = tri->intersectionPointSegment(p1, p2);
-				if (intersect != NO_HIT_POINT) {
-					d = distance(p1, intersect);
-					if (d < mind) {
-						mind = d;
-						resultTriangle = tri;
-						resultIntersect = intersect;
-					}
-				}
-			}
-			boxes.insert(boxes.end(), box->getChildren().begin(),
-					box->getChildren().end());
-		}
-	}
-	lastTriangle = resultTriangle;
-	lastPoint = resultIntersect;
-	if (resultTriangle == nullptr) {
+		float3& lastPoint, KDTriangle& lastTriangle) const {
+	double mind;
+	Traversal traversal;
+	lastPoint = NO_HIT_POINT;
+	int64_t resultTriangle = traverseRay(p1, p2 - p1, 1.0f, false,
+			[&](const KDTriangle& tri) {
+				return tri.intersectionPointSegment(p1, p2);
+			}, traversal, lastPoint, mind);
+	if (resultTriangle < 0) {
 		return NO_HIT_DISTANCE;
 	} else {
+		lastTriangle = getTriangle((uint32_t) resultTriangle);
 		return mind;
 	}
 }
+bool Intersector::intersectsRay(const float3& p1, const float3& v) const {
+	double mind;
+	float3 lastPoint;
+	Traversal traversal;
+	return (traverseRay(p1, v, NO_HIT_DISTANCE, true,
+			[&](const KDTriangle& tri) {
+				return tri.intersectionPointRay(p1, v);
+			}, traversal, lastPoint, mind) >= 0);
+}
+bool Intersector::intersectsSegment(const float3& p1, const float3& p2) const {
+	double mind;
+	float3 lastPoint;
+	Traversal traversal;
+	return (traverseRay(p1, p2 - p1, 1.0f, true,
+			[&](const KDTriangle& tri) {
+				return tri.intersectionPointSegment(p1, p2);
+			}, traversal, lastPoint, mind) >= 0);
+}
 double Intersector::closestPointSignedDistance(const float3& r, float3& lastPoint,
-		KDTriangle*& lastTriangle) const {
+		KDTriangle& lastTriangle) const {
 	double d = closestPoint(r, lastPoint, lastTriangle);
 	if (d >= 0&& d!=NO_HIT_DISTANCE) {
-		float3 norm = lastTriangle->getNormal();
-		float3 center = lastTriangle->getCentroid();
+		float3 norm = lastTriangle.getNormal();
+		float3 center = lastTriangle.getCentroid();
 		float3 diff = r - center;
 		return sign(dot(diff, norm)) * d;
 	} else {
@@ -1189,11 +1369,11 @@ double Intersector::closestPointSignedDistance(const float3& r, float3& lastPoin
 	}
 }
 double Intersector::closestPointSignedDistance(const float3& r,const float& maxDistance, float3& lastPoint,
-	KDTriangle*& lastTriangle) const {
+	KDTriangle& lastTriangle) const {
 	double d = closestPoint(r, maxDistance, lastPoint, lastTriangle);
 	if (d >= 0&&d!= NO_HIT_DISTANCE) {
-		float3 norm = lastTriangle->getNormal();
-		float3 center = lastTriangle->getCentroid();
+		float3 norm = lastTriangle.getNormal();
+		float3 center = lastTriangle.getCentroid();
 		float3 diff = r - center;
 		return sign(dot(diff, norm)) * d;
 	}
@@ -1201,129 +1381,269 @@ double Intersector::closestPointSignedDistance(const float3& r,const float& maxD
 		return NO_HIT_DISTANCE;
 	}
 }
-double Intersector::closestPoint(const float3& pt, const float& maxDistance,
-		float3& lastPoint, KDTriangle*& lastTriangle) const {
-	if (root->getChildren().size() == 0)
-		throw new std::runtime_error("KD-Tree has not been initialized.");
+int64_t Intersector::closestTriangle(const float3& pt, double maxDistance, Traversal& traversal,
+		float3& lastPoint, double& triangleDist) const {
+	if (nodes.size() == 0)
+		throw std::runtime_error("Intersector has not been initialized.");
 	double d;
-	double triangleDist = maxDistance;
-	std::priority_queue<KDBoxDistance> queue;
-	queue.push(KDBoxDistance(pt, getRoot()));
-	lastTriangle = nullptr;
-	lastPoint = NO_HIT_POINT;
-	float3 lastIntersect = NO_HIT_POINT;
+	int64_t resultTriangle = -1;
+	float3 lastIntersect;
+	std::vector<BVHNodeDistance>& queue = traversal.queue;
+	queue.clear();
+	queue.push_back(BVHNodeDistance(0, nodes[0].distanceToBox(pt)));
+	triangleDist = maxDistance;
 	while (queue.size() > 0) {
-		KDBoxDistance boxd = queue.top();
-		queue.pop();
-		if (boxd.box->isLeaf) {
-			KDTriangle* tri = dynamic_cast<KDTriangle*>(boxd.box);
-			d = tri->distance(pt, lastIntersect);
-			if (d <= triangleDist) {
-				triangleDist = d;
-				lastTriangle = tri;
-				lastPoint = lastIntersect;
+		std::pop_heap(queue.begin(), queue.end());
+		BVHNodeDistance boxd = queue.back();
+		queue.pop_back();
+		//Nodes come off the queue in ascending order, so nothing left can be closer.
+		if (boxd.dist > triangleDist)
+			break;
+		const BVHNode& node = nodes[boxd.node];
+		if (node.isLeaf()) {
+			for (uint32_t t = node.offset; t < node.offset + node.count; t++) {
+				d = getTriangle(t).distance(pt, lastIntersect);
+				if (d <= triangleDist) {
+					triangleDist = d;
+					resultTriangle = t;
+					lastPoint = lastIntersect;
+				}
 			}
 		} else {
-			for (KDBox* child : boxd.box->getChildren()) {
-				KDBoxDistance kdb(pt, child);
-				if (kdb.dist <= maxDistance) {
-					queue.push(kdb);
+			uint32_t children[2] = { boxd.node + 1, node.offset };
+			for (uint32_t child : children) {
+				d = nodes[child].distanceToBox(pt);
+				if (d <= triangleDist) {
+					queue.push_back(BVHNodeDistance(child, d));
+					std::push_heap(queue.begin(), queue.end());
 				}
 			}
 		}
 	}
-	if (lastTriangle == nullptr) {
+	return resultTriangle;
+}
+double Intersector::closestPoint(const float3& pt, const float& maxDistance,
+		float3& lastPoint, KDTriangle& lastTriangle) const {
+	double triangleDist;
+	Traversal traversal;
+	lastPoint = NO_HIT_POINT;
+	int64_t resultTriangle = closestTriangle(pt, maxDistance, traversal, lastPoint, triangleDist);
+	if (resultTriangle < 0) {
 		return NO_HIT_DISTANCE;
 	} else {
+		lastTriangle = getTriangle((uint32_t) resultTriangle);
 		return triangleDist;
 	}
 }
 double Intersector::closestPoint(const float3& pt, float3& lastPoint,
-		KDTriangle*& lastTriangle) const {
-	if (root->getChildren().size() == 0)
-		throw new std::runtime_error("KD-Tree has not been initialized.");
-	double d;
-	double mind = 1E30;
-	double triangleDist = 1E30;
-	std::priority_queue<KDBoxDistance> queue;
-	queue.push(KDBoxDistance(pt, getRoot()));
-	lastTriangle = nullptr;
-	lastPoint = NO_HIT_POINT;
-	float3 lastIntersect = NO_HIT_POINT;
-	while (queue.size() > 0) {
-		KDBoxDistance boxd = queue.top();
-		queue.pop();
-		if (boxd.dist <= mind || boxd.box->isLeaf) {
-			if (boxd.box->isLeaf) {
-				mind = boxd.dist;
-				KDTriangle* tri = dynamic_cast<KDTriangle*>(boxd.box);
-				d = tri->distance(pt, lastIntersect);
-				if (d < triangleDist) {
-					triangleDist = d;
-					lastTriangle = tri;
-					lastPoint = lastIntersect;
-				}
-			} else {
-				for (KDBox* child : boxd.box->getChildren()) {
-					KDBoxDistance kdb(pt, child);
-					queue.push(kdb);
-				}
-			}
+		KDTriangle& lastTriangle) const {
+	return closestPoint(pt, NO_HIT_DISTANCE, lastPoint, lastTriangle);
+}
+
+void Intersector::intersectRayDistance(const Vector3f& origins, const Vector3f& directions,
+		Vector1f& distances, Vector3f& lastPoints, Vector1i& hitIds) const {
+	if (origins.size() != directions.size())
+		throw std::runtime_error("Number of ray origins and directions do not match.");
+	int N = (int) origins.size();
+	distances.resize(N);
+	lastPoints.resize(N);
+	hitIds.resize(N);
+#pragma omp parallel
+	{
+		Traversal traversal;
+#pragma omp for schedule(dynamic, 64)
+		for (int i = 0; i < N; i++) {
+			const float3& p1 = origins[i];
+			const float3& v = directions[i];
+			double mind;
+			float3 lastPoint = NO_HIT_POINT;
+			int64_t t = traverseRay(p1, v, NO_HIT_DISTANCE, false,
+					[&](const KDTriangle& tri) {
+						return tri.intersectionPointRay(p1, v);
+					}, traversal, lastPoint, mind);
+			distances[i].x = (t < 0) ? NO_HIT_DISTANCE : (float) mind;
+			lastPoints[i] = lastPoint;
+			hitIds[i].x = (t < 0) ? -1 : (int) faceIds[t];
 		}
 	}
-	if (lastTriangle == nullptr) {
-		return NO_HIT_DISTANCE;
-	} else {
-		return triangleDist;
+}
+void Intersector::intersectRayDistance(const Vector3f& origins, const Vector3f& directions,
+		Vector1f& distances) const {
+	Vector3f lastPoints;
+	Vector1i hitIds;
+	intersectRayDistance(origins, directions, distances, lastPoints, hitIds);
+}
+void Intersector::intersectSegmentDistance(const Vector3f& starts, const Vector3f& ends,
+		Vector1f& distances, Vector3f& lastPoints, Vector1i& hitIds) const {
+	if (starts.size() != ends.size())
+		throw std::runtime_error("Number of segment start and end points do not match.");
+	int N = (int) starts.size();
+	distances.resize(N);
+	lastPoints.resize(N);
+	hitIds.resize(N);
+#pragma omp parallel
+	{
+		Traversal traversal;
+#pragma omp for schedule(dynamic, 64)
+		for (int i = 0; i < N; i++) {
+			const float3& p1 = starts[i];
+			const float3& p2 = ends[i];
+			double mind;
+			float3 lastPoint = NO_HIT_POINT;
+			int64_t t = traverseRay(p1, p2 - p1, 1.0f, false,
+					[&](const KDTriangle& tri) {
+						return tri.intersectionPointSegment(p1, p2);
+					}, traversal, lastPoint, mind);
+			distances[i].x = (t < 0) ? NO_HIT_DISTANCE : (float) mind;
+			lastPoints[i] = lastPoint;
+			hitIds[i].x = (t < 0) ? -1 : (int) faceIds[t];
+		}
 	}
 }
+void Intersector::intersectSegmentDistance(const Vector3f& starts, const Vector3f& ends,
+		Vector1f& distances) const {
+	Vector3f lastPoints;
+	Vector1i hitIds;
+	intersectSegmentDistance(starts, ends, distances, lastPoints, hitIds);
+}
+void Intersector::intersectsRay(const Vector3f& origins, const Vector3f& directions, Vector1b& hits) const {
+	if (origins.size() != directions.size())
+		throw std::runtime_error("Number of ray origins and directions do not match.");
+	int N = (int) origins.size();
+	hits.resize(N);
+#pragma omp parallel
+	{
+		Traversal traversal;
+#pragma omp for schedule(dynamic, 64)
+		for (int i = 0; i < N; i++) {
+			const float3& p1 = origins[i];
+			const float3& v = directions[i];
+			double mind;
+			float3 lastPoint;
+			hits[i].x = (traverseRay(p1, v, NO_HIT_DISTANCE, true,
+					[&](const KDTriangle& tri) {
+						return tri.intersectionPointRay(p1, v);
+					}, traversal, lastPoint, mind) >= 0) ? 1 : 0;
+		}
+	}
+}
+void Intersector::intersectsSegment(const Vector3f& starts, const Vector3f& ends, Vector1b& hits) const {
+	if (starts.size() != ends.size())
+		throw std::runtime_error("Number of segment start and end points do not match.");
+	int N = (int) starts.size();
+	hits.resize(N);
+#pragma omp parallel
+	{
+		Traversal traversal;
+#pragma omp for schedule(dynamic, 64)
+		for (int i = 0; i < N; i++) {
+			const float3& p1 = starts[i];
+			const float3& p2 = ends[i];
+			double mind;
+			float3 lastPoint;
+			hits[i].x = (traverseRay(p1, p2 - p1, 1.0f, true,
+					[&](const KDTriangle& tri) {
+						return tri.intersectionPointSegment(p1, p2);
+					}, traversal, lastPoint, mind) >= 0) ? 1 : 0;
+		}
+	}
+}
+void Intersector::closestPoint(const Vector3f& points, Vector1f& distances, Vector3f& lastPoints,
+		Vector1i& hitIds, float maxDistance) const {
+	int N = (int) points.size();
+	distances.resize(N);
+	lastPoints.resize(N);
+	hitIds.resize(N);
+#pragma omp parallel
+	{
+		Traversal traversal;
+#pragma omp for schedule(dynamic, 64)
+		for (int i = 0; i < N; i++) {
+			double d;
+			float3 lastPoint = NO_HIT_POINT;
+			int64_t t = closestTriangle(points[i], maxDistance, traversal, lastPoint, d);
+			distances[i].x = (t < 0) ? NO_HIT_DISTANCE : (float) d;
+			lastPoints[i] = lastPoint;
+			hitIds[i].x = (t < 0) ? -1 : (int) faceIds[t];
+		}
+	}
+}
+void Intersector::closestPoint(const Vector3f& points, Vector1f& distances, float maxDistance) const {
+	Vector3f lastPoints;
+	Vector1i hitIds;
+	closestPoint(points, distances, lastPoints, hitIds, maxDistance);
+}
+void Intersector::closestPointSignedDistance(const Vector3f& points, Vector1f& distances,
+		Vector3f& lastPoints, Vector1i& hitIds, float maxDistance) const {
+	int N = (int) points.size();
+	distances.resize(N);
+	lastPoints.resize(N);
+	hitIds.resize(N);
+#pragma omp parallel
+	{
+		Traversal traversal;
+#pragma omp for schedule(dynamic, 64)
+		for (int i = 0; i < N; i++) {
+			double d;
+			float3 lastPoint = NO_HIT_POINT;
+			int64_t t = closestTriangle(points[i], maxDistance, traversal, lastPoint, d);
+			distances[i].x = (t < 0) ? NO_HIT_DISTANCE : (float) signedDistance(points[i], d, (uint32_t) t);
+			lastPoints[i] = lastPoint;
+			hitIds[i].x = (t < 0) ? -1 : (int) faceIds[t];
+		}
+	}
+}
+void Intersector::closestPointSignedDistance(const Vector3f& points, Vector1f& distances,
+		float maxDistance) const {
+	Vector3f lastPoints;
+	Vector1i hitIds;
+	closestPointSignedDistance(points, distances, lastPoints, hitIds, maxDistance);
+}
 
 double Intersector::closestPointOutside(const float3& r, const float3& v,
-		float3& lastPoint, KDTriangle*& lastTriangle) const {
-	if (root->getChildren().size() == 0)
-		throw new std::runtime_error("KD-Tree has not been initialized.");
-
+		float3& lastPoint, KDTriangle& lastTriangle) const {
+	if (nodes.size() == 0)
+		throw std::runtime_error("Intersector has not been initialized.");
 	double d;
-	double mind = 1E30;
 	double triangleDist = 1E30;
-	std::priority_queue<KDBoxDistance> queue;
-	queue.push(KDBoxDistance(r, getRoot()));
-
-	lastTriangle = nullptr;
+	int64_t resultTriangle = -1;
+	std::priority_queue<BVHNodeDistance> queue;
+	queue.push(BVHNodeDistance(0, nodes[0].distanceToBox(r)));
 	lastPoint = NO_HIT_POINT;
-	float3 pt;
-	float3 testv;
 	float3 lastIntersect;
 	while (queue.size() > 0) {
-		KDBoxDistance boxd = queue.top();
+		BVHNodeDistance boxd = queue.top();
 		queue.pop();
-		if (boxd.dist <= mind || boxd.box->isLeaf) {
-			if (boxd.box->isLeaf) {
-				mind = boxd.dist;
-				KDTriangle* tri = dynamic_cast<KDTriangle*>(boxd.box);
-				d = tri->distance(r, lastIntersect);
-				boxd.dist = d;
+		if (boxd.dist > triangleDist)
+			break;
+		const BVHNode& node = nodes[boxd.node];
+		if (node.isLeaf()) {
+			for (uint32_t t = node.offset; t < node.offset + node.count; t++) {
+				d = getTriangle(t).distance(r, lastIntersect);
 				if (d < triangleDist) {
-					pt = lastIntersect;
-					testv = pt - r;
 					// Test if point is on one side of plane
-					if (dot(testv, v) >= 0) {
+					if (dot(lastIntersect - r, v) >= 0) {
 						triangleDist = d;
-						lastTriangle = tri;
-						lastPoint = pt;
+						resultTriangle = t;
+						lastPoint = lastIntersect;
 					}
 				}
-			} else {
-				for (KDBox* child : boxd.box->getChildren()) {
-					queue.push(KDBoxDistance(pt, child));
+			}
+		} else {
+			uint32_t children[2] = { boxd.node + 1, node.offset };
+			for (uint32_t child : children) {
+				d = nodes[child].distanceToBox(r);
+				if (d <= triangleDist) {
+					queue.push(BVHNodeDistance(child, d));
 				}
 			}
 		}
 	}
-	if (lastTriangle == nullptr) {
+	if (resultTriangle < 0) {
 		return NO_HIT_DISTANCE;
 	} else {
-		return mind;
+		lastTriangle = getTriangle((uint32_t) resultTriangle);
+		return triangleDist;
 	}
 }
 
@@ -20,9 +20,10 @@
 */
 
 #include "AlloyIsoContour.h"
-#include <map>
-#include <list>
+#include "AlloyMesh.h"
 namespace aly {
+	const uint32_t IsoContour::SEAM_FLAG = 0x80000000;
+	const uint32_t IsoContour::NO_SPLIT = 0xFFFFFFFF;
 	bool IsoContour::orient(const Image1f& img, const EdgeSplit& split1, const EdgeSplit& split2, Edge& edge) {
 		float2 pt1 = split1.pt2d;
 		float2 pt2 = split2.pt2d;
@@ -34,46 +35,88 @@ namespace aly {
 		return true;
 	}
 
+	/*
+	 Squares are contoured in bands of rows that run in parallel. Each band assigns local ids to the splits it owns in flat per-key arrays,
+	 then bands are stitched at their seams and all points and edges are written straight into their final ranges.
+	 */
 	void IsoContour::solve(const Image1f& levelset, float isoLevel, const TopologyRule2D& topoRule,const Winding& winding){
+		static const int BAND_HEIGHT = 32;
 		rows = levelset.width;
 		cols = levelset.height;
 		this->isoLevel = isoLevel;
 		rule = topoRule;
 		img = &levelset;
-		vertCount = 0;
-		std::map<uint64_t, EdgeSplitPtr> splits;
-		std::list<EdgePtr> edges;
-		for (int i = 0; i < rows; i++) {
-			for (int j = 0; j < cols; j++) {
-				processSquare(i, j, splits, edges);
-			}
+		//Squares reach one past the last row and column, where values are clamped.
+		size_t keyCount = (size_t)(rows + 1) * (cols + 1) * 3;
+		if (splitIds.size() != keyCount) {
+			splitIds.assign(keyCount, NO_SPLIT);
 		}
-		std::vector<EdgeSplitPtr> pts(splits.size());
-		for (const std::pair<uint64_t, EdgeSplitPtr>& split : splits) {
-			pts[split.second->vid] = split.second;
+		int bandCount = std::max((cols + BAND_HEIGHT - 1) / BAND_HEIGHT, 0);
+		bands.resize(bandCount);
+#pragma omp parallel for schedule(dynamic)
+		for (int b = 0; b < bandCount; b++) {
+			Band& band = bands[b];
+			band.start = b * BAND_HEIGHT;
+			band.end = std::min(band.start + BAND_HEIGHT, cols);
+			band.splits.clear();
+			band.seamSplits.clear();
+			band.edges.clear();
+			band.seamIds.assign((rows + 1) * 3, NO_SPLIT);
+			for (int j = band.start; j < band.end; j++) {
+				for (int i = 0; i < rows; i++) {
+					processSquare(i, j, band);
+				}
+			}
 		}
-		// Generate iso-surface from list of triangles
-		indexes.resize(edges.size() * 2);
-		points.resize(splits.size());
-		uint32_t index = 0;
-		if (winding == Winding::Clockwise) {
-			for (EdgePtr edge : edges) {
-				indexes[index++] = uint2(edge->x, edge->y);
+		//Seam splits that the next band did not create itself are appended to it, so every split has exactly one owner.
+		for (int b = 0; b < bandCount - 1; b++) {
+			Band& next = bands[b + 1];
+			for (size_t key : bands[b].seamSplits) {
+				if (splitIds[key] == NO_SPLIT) {
+					splitIds[key] = (uint32_t)next.splits.size();
+					next.splits.push_back(key);
+				}
 			}
 		}
-		else if (winding == Winding::CounterClockwise) {
-			for (EdgePtr edge : edges) {
-				indexes[index++]= uint2(edge->y,edge->x);
+		uint32_t splitCount = 0;
+		uint32_t edgeCount = 0;
+		for (Band& band : bands) {
+			band.splitOffset = splitCount;
+			band.edgeOffset = edgeCount;
+			splitCount += (uint32_t)band.splits.size();
+			edgeCount += (uint32_t)band.edges.size();
+		}
+		points.resize(splitCount);
+		indexes.resize(edgeCount);
+#pragma omp parallel for schedule(dynamic)
+		for (int b = 0; b < bandCount; b++) {
+			Band& band = bands[b];
+			for (size_t n = 0; n < band.splits.size(); n++) {
+				points[band.splitOffset + n] = getSplitPoint(band.splits[n]);
+			}
+			for (size_t n = 0; n < band.edges.size(); n++) {
+				uint2 edge = band.edges[n];
+				for (int c = 0; c < 2; c++) {
+					uint32_t id = edge[c];
+					if (id & SEAM_FLAG) {
+						edge[c] = bands[b + 1].splitOffset + splitIds[band.seamSplits[id & ~SEAM_FLAG]];
+					}
+					else {
+						edge[c] = band.splitOffset + id;
+					}
+				}
+				indexes[band.edgeOffset + n] = (winding == Winding::Clockwise) ? edge : uint2(edge.y, edge.x);
 			}
 		}
-		index = 0;
-		for (const std::pair<uint64_t, EdgeSplitPtr>& split : splits) {
-			index = split.second->vid;
-			points[index] = split.second->pt2d;
+#pragma omp parallel for
+		for (int b = 0; b < bandCount; b++) {
+			for (size_t key : bands[b].splits) {
+				splitIds[key] = NO_SPLIT;
+			}
 		}
 		img = nullptr;
 	}
-	void IsoContour::processSquare2(int x, int y, std::map<uint64_t, EdgeSplitPtr>& splits, std::list<EdgePtr>& edges) {
+	void IsoContour::processSquare2(int x, int y, Band& band) {
 		int iFlagIndex = 0;
 		for (int iVertex = 0; iVertex < 4; iVertex++) {
 			if (getValue(x + a2fVertex1Offset[iVertex][0], y + a2fVertex1Offset[iVertex][1]) > isoLevel) {
@@ -87,74 +130,22 @@ namespace aly {
 		else {
 			mask = &afSquareValue8[iFlagIndex][0];
 		}
-
-		if (mask[0] < 4) {
-			EdgeSplitPtr split1 = createSplit(splits, x
-				+ a2fVertex1Offset[mask[0]][0], y
-				+ a2fVertex1Offset[mask[0]][1], x
-				+ a2fVertex2Offset[mask[0]][0], y
-				+ a2fVertex2Offset[mask[0]][1]);
-
-			EdgeSplitPtr split2 = createSplit(splits, x
-				+ a2fVertex1Offset[mask[1]][0], y
-				+ a2fVertex1Offset[mask[1]][1], x
-				+ a2fVertex2Offset[mask[1]][0], y
-				+ a2fVertex2Offset[mask[1]][1]);
-			EdgePtr edge = EdgePtr(new Edge(split1->vid, split2->vid));
-
-			if (split1->e1.get() == nullptr) {
-				split1->e1 = edge;
-			}
-			else {
-				split1->e2 = edge;
-			}
-			if (split2->e1.get() == nullptr) {
-				split2->e1 = edge;
-			}
-			else {
-				split2->e2 = edge;
-			}
-			edges.push_back(edge);
-
-		}
-
-		if (mask[2] < 4) {
-			EdgeSplitPtr split1 = createSplit(splits, x
-				+ a2fVertex1Offset[mask[2]][0], y
-				+ a2fVertex1Offset[mask[2]][1], x
-				+ a2fVertex2Offset[mask[2]][0], y
-				+ a2fVertex2Offset[mask[2]][1]);
-
-			EdgeSplitPtr split2 = createSplit(splits, x
-				+ a2fVertex1Offset[mask[3]][0], y
-				+ a2fVertex1Offset[mask[3]][1], x
-				+ a2fVertex2Offset[mask[3]][0], y
-				+ a2fVertex2Offset[mask[3]][1]);
-
-			EdgePtr edge = EdgePtr(new Edge(split1->vid, split2->vid));
-			// orient(*split1, *split2, edge);
-			if (split1->e1.get() == nullptr) {
-				split1->e1 = edge;
+		for (int n = 0; n < 4; n += 2) {
+			if (mask[n] < 4) {
+				addEdge(band,
+					x + a2fVertex1Offset[mask[n]][0], y + a2fVertex1Offset[mask[n]][1],
+					x + a2fVertex2Offset[mask[n]][0], y + a2fVertex2Offset[mask[n]][1],
+					x + a2fVertex1Offset[mask[n + 1]][0], y + a2fVertex1Offset[mask[n + 1]][1],
+					x + a2fVertex2Offset[mask[n + 1]][0], y + a2fVertex2Offset[mask[n + 1]][1]);
 			}
-			else {
-				split1->e2 = edge;
-			}
-			if (split2->e1.get() == nullptr) {
-				split2->e1 = edge;
-			}
-			else {
-				split2->e2 = edge;
-			}
-			edges.push_back(edge);
 		}
-
 	}
-	void IsoContour::processSquare(int x, int y, std::map<uint64_t, EdgeSplitPtr>& splits, std::list<EdgePtr>& edges) {
+	void IsoContour::processSquare(int x, int y, Band& band) {
 		if (rule == TopologyRule2D::Unconstrained) {
-			processSquare1(x, y, splits, edges);
+			processSquare1(x, y, band);
 		}
 		else {
-			processSquare2(x, y, splits, edges);
+			processSquare2(x, y, band);
 		}
 	}
 	/*
@@ -164,7 +155,7 @@ namespace aly {
 	*
 	* File Version: 4.10.0 (2009/11/18)
 	*/
-	void IsoContour::processSquare1(int i, int j, std::map<uint64_t, EdgeSplitPtr>& splits, std::list<EdgePtr>& edges) {
+	void IsoContour::processSquare1(int i, int j, Band& band) {
 		float iF00 = getValue(i, j);
 		float iF10 = getValue(i + 1, j);
 		float iF01 = getValue(i, j + 1);
@@ -187,24 +178,24 @@ namespace aly {
 					}
 					else {
 						// +++-
-						addEdge(splits, edges, i, j + 1, i + 1, j + 1, i,
+						addEdge(band, i, j + 1, i + 1, j + 1, i,
 							j + 1, i, j);
 					}
 				}
 				else if (iF11 < 0) {
 					if (iF01 > 0) {
 						// ++-+
-						addEdge(splits, edges, i + 1, j, i + 1, j + 1, i + 1,
+						addEdge(band, i + 1, j, i + 1, j + 1, i + 1,
 							j + 1, i, j + 1);
 					}
 					else if (iF01 < 0) {
 						// ++--
-						addEdge(splits, edges, i, j + 1, i, j, i + 1, j, i + 1,
+						addEdge(band, i, j + 1, i, j, i + 1, j, i + 1,
 							j + 1);
 					}
 					else {
 						// ++-0
-						addEdge(splits, edges, i, j + 1, i, j + 1, i + 1, j,
+						addEdge(band, i, j + 1, i, j + 1, i + 1, j,
 							i + 1, j + 1);
 					}
 				}
@@ -215,12 +206,12 @@ namespace aly {
 					}
 					else if (iF01 < 0) {
 						// ++0-
-						addEdge(splits, edges, i + 1, j + 1, i + 1, j + 1, i,
+						addEdge(band, i + 1, j + 1, i + 1, j + 1, i,
 							j, i, j + 1);
 					}
 					else {
 						// ++00
-						addEdge(splits, edges, i + 1, j + 1, i + 1, j + 1, i,
+						addEdge(band, i + 1, j + 1, i + 1, j + 1, i,
 							j + 1, i, j + 1);
 					}
 				}
@@ -229,7 +220,7 @@ namespace aly {
 				if (iF11 > 0) {
 					if (iF01 > 0) {
 						// +-++
-						addEdge(splits, edges, i, j, i + 1, j, i + 1, j + 1,
+						addEdge(band, i, j, i + 1, j, i + 1, j + 1,
 							i + 1, j);
 					}
 					else if (iF01 < 0) {
@@ -248,86 +239,86 @@ namespace aly {
 								iDet = iXN0 * iD3 - iXN1 * iD0;
 							}
 							if (iDet > 0) {
-								addEdge(splits, edges, i + 1, j + 1, i, j + 1,
+								addEdge(band, i + 1, j + 1, i, j + 1,
 									i + 1, j + 1, i + 1, j);
-								addEdge(splits, edges, i, j, i + 1, j, i, j, i,
+								addEdge(band, i, j, i + 1, j, i, j, i,
 									j + 1);
 							}
 							else {
-								addEdge(splits, edges, i + 1, j + 1, i, j + 1,
+								addEdge(band, i + 1, j + 1, i, j + 1,
 									i, j, i, j + 1);
-								addEdge(splits, edges, i, j, i + 1, j, i + 1,
+								addEdge(band, i, j, i + 1, j, i + 1,
 									j + 1, i + 1, j);
 							}
 						}
 						else if (rule == TopologyRule2D::Connect4) {
 							if (signFlip) {
-								addEdge(splits, edges, i + 1, j + 1, i, j + 1,
+								addEdge(band, i + 1, j + 1, i, j + 1,
 									i + 1, j + 1, i + 1, j);
-								addEdge(splits, edges, i, j, i + 1, j, i, j, i,
+								addEdge(band, i, j, i + 1, j, i, j, i,
 									j + 1);
 							}
 							else {
-								addEdge(splits, edges, i + 1, j + 1, i, j + 1,
+								addEdge(band, i + 1, j + 1, i, j + 1,
 									i, j, i, j + 1);
-								addEdge(splits, edges, i, j, i + 1, j, i + 1,
+								addEdge(band, i, j, i + 1, j, i + 1,
 									j + 1, i + 1, j);
 							}
 						}
 						else if (rule == TopologyRule2D::Connect8) {
 							if (signFlip) {
-								addEdge(splits, edges, i + 1, j + 1, i, j + 1,
+								addEdge(band, i + 1, j + 1, i, j + 1,
 									i, j, i, j + 1);
-								addEdge(splits, edges, i, j, i + 1, j, i + 1,
+								addEdge(band, i, j, i + 1, j, i + 1,
 									j + 1, i + 1, j);
 							}
 							else {
-								addEdge(splits, edges, i + 1, j + 1, i, j + 1,
+								addEdge(band, i + 1, j + 1, i, j + 1,
 									i + 1, j + 1, i + 1, j);
-								addEdge(splits, edges, i, j, i + 1, j, i, j, i,
+								addEdge(band, i, j, i + 1, j, i, j, i,
 									j + 1);
 							}
 						}
 					}
 					else {
 						// +-+0
-						addEdge(splits, edges, i, j, i + 1, j, i + 1, j + 1,
+						addEdge(band, i, j, i + 1, j, i + 1, j + 1,
 							i + 1, j);
 					}
 				}
 				else if (iF11 < 0) {
 					if (iF01 > 0) {
 						// +--+
-						addEdge(splits, edges, i, j, i + 1, j, i + 1, j + 1, i,
+						addEdge(band, i, j, i + 1, j, i + 1, j + 1, i,
 							j + 1);
 					}
 					else if (iF01 < 0) {
 						// +---
-						addEdge(splits, edges, i, j + 1, i, j, i, j, i + 1, j);
+						addEdge(band, i, j + 1, i, j, i, j, i + 1, j);
 					}
 					else {
 						// +--0
-						addEdge(splits, edges, i, j + 1, i, j + 1, i, j, i + 1,
+						addEdge(band, i, j + 1, i, j + 1, i, j, i + 1,
 							j);
 					}
 				}
 				else {
 					if (iF01 > 0) {
 						// +-0+
-						addEdge(splits, edges, i + 1, j + 1, i + 1, j + 1, i,
+						addEdge(band, i + 1, j + 1, i + 1, j + 1, i,
 							j, i + 1, j);
 					}
 					else if (iF01 < 0) {
 						// +-0-
-						addEdge(splits, edges, i, j + 1, i, j, i, j, i + 1, j);
+						addEdge(band, i, j + 1, i, j, i, j, i + 1, j);
 					}
 					else {
 						// +-00
-						addEdge(splits, edges, i + 1, j + 1, i + 1, j + 1, i,
+						addEdge(band, i + 1, j + 1, i + 1, j + 1, i,
 							j + 1, i + 1, j + 1);
-						addEdge(splits, edges, i, j + 1, i + 1, j + 1, i,
+						addEdge(band, i, j + 1, i + 1, j + 1, i,
 							j + 1, i, j + 1);
-						addEdge(splits, edges, i, j + 1, i + 1, j + 1, i, j,
+						addEdge(band, i, j + 1, i + 1, j + 1, i, j,
 							i + 1, j);
 					}
 				}
@@ -339,46 +330,46 @@ namespace aly {
 					}
 					else if (iF01 < 0) {
 						// +0+-
-						addEdge(splits, edges, i, j + 1, i + 1, j + 1, i,
+						addEdge(band, i, j + 1, i + 1, j + 1, i,
 							j + 1, i, j);
 					}
 				}
 				else if (iF11 < 0) {
 					if (iF01 > 0) {
 						// +0-+
-						addEdge(splits, edges, i + 1, j, i + 1, j, i, j + 1,
+						addEdge(band, i + 1, j, i + 1, j, i, j + 1,
 							i + 1, j + 1);
 					}
 					else if (iF01 < 0) {
 						// +0--
-						addEdge(splits, edges, i + 1, j, i + 1, j, i, j, i,
+						addEdge(band, i + 1, j, i + 1, j, i, j, i,
 							j + 1);
 					}
 					else {
 						// +0-0
-						addEdge(splits, edges, i + 1, j, i + 1, j, i, j + 1, i,
+						addEdge(band, i + 1, j, i + 1, j, i, j + 1, i,
 							j + 1);
 					}
 				}
 				else {
 					if (iF01 > 0) {
 						// +00+
-						addEdge(splits, edges, i + 1, j, i + 1, j, i + 1,
+						addEdge(band, i + 1, j, i + 1, j, i + 1,
 							j + 1, i + 1, j + 1);
 					}
 					else if (iF01 < 0) {
 						// +00-
-						addEdge(splits, edges, i + 1, j, i + 1, j, i + 1, j,
+						addEdge(band, i + 1, j, i + 1, j, i + 1, j,
 							i + 1, j + 1);
-						addEdge(splits, edges, i + 1, j, i + 1, j + 1, i + 1,
+						addEdge(band, i + 1, j, i + 1, j + 1, i + 1,
 							j + 1, i + 1, j + 1);
-						addEdge(splits, edges, i + 1, j, i + 1, j + 1, i, j, i,
+						addEdge(band, i + 1, j, i + 1, j + 1, i, j, i,
 							j + 1);
 					}
 					else {
 						// +000
-						addEdge(splits, edges, i, j + 1, i, j + 1, i, j, i, j);
-						addEdge(splits, edges, i, j, i, j, i + 1, j, i + 1, j);
+						addEdge(band, i, j + 1, i, j + 1, i, j, i, j);
+						addEdge(band, i, j, i, j, i + 1, j, i + 1, j);
 					}
 				}
 			}
@@ -397,28 +388,28 @@ namespace aly {
 				}
 				else if (iF01 < 0) {
 					// 0++-
-					addEdge(splits, edges, i, j, i, j, i, j + 1, i + 1, j + 1);
+					addEdge(band, i, j, i, j, i, j + 1, i + 1, j + 1);
 				}
 				else {
 					// 0++0
-					addEdge(splits, edges, i, j + 1, i, j + 1, i, j, i, j);
+					addEdge(band, i, j + 1, i, j + 1, i, j, i, j);
 				}
 			}
 			else if (iF11 < 0) {
 				if (iF01 > 0) {
 					// 0+-+
-					addEdge(splits, edges, i + 1, j, i + 1, j + 1, i + 1,
+					addEdge(band, i + 1, j, i + 1, j + 1, i + 1,
 						j + 1, i, j + 1);
 				}
 				else if (iF01 < 0) {
 					// 0+--
-					addEdge(splits, edges, i, j, i, j, i + 1, j, i + 1, j + 1);
+					addEdge(band, i, j, i, j, i + 1, j, i + 1, j + 1);
 				}
 				else {
 					// 0+-0
-					addEdge(splits, edges, i, j, i, j, i, j, i, j + 1);
-					addEdge(splits, edges, i, j, i, j + 1, i, j + 1, i, j + 1);
-					addEdge(splits, edges, i, j, i, j + 1, i + 1, j, i + 1,
+					addEdge(band, i, j, i, j, i, j, i, j + 1);
+					addEdge(band, i, j, i, j + 1, i, j + 1, i, j + 1);
+					addEdge(band, i, j, i, j + 1, i + 1, j, i + 1,
 						j + 1);
 				}
 			}
@@ -428,14 +419,14 @@ namespace aly {
 				}
 				else if (iF01 < 0) {
 					// 0+0-
-					addEdge(splits, edges, i, j, i, j, i + 1, j + 1, i + 1,
+					addEdge(band, i, j, i, j, i + 1, j + 1, i + 1,
 						j + 1);
 				}
 				else {
 					// 0+00
-					addEdge(splits, edges, i + 1, j + 1, i + 1, j + 1, i,
+					addEdge(band, i + 1, j + 1, i + 1, j + 1, i,
 						j + 1, i, j + 1);
-					addEdge(splits, edges, i, j + 1, i, j + 1, i, j, i, j);
+					addEdge(band, i, j + 1, i, j + 1, i, j, i, j);
 				}
 			}
 		}
@@ -448,39 +439,39 @@ namespace aly {
 
 			if (iF01 > 0) {
 				// 00++
-				addEdge(splits, edges, i, j, i, j, i + 1, j, i + 1, j);
+				addEdge(band, i, j, i, j, i + 1, j, i + 1, j);
 			}
 			else if (iF01 < 0) {
 				// 00+-
-				addEdge(splits, edges, i, j, i, j, i, j, i + 1, j);
-				addEdge(splits, edges, i, j, i + 1, j, i + 1, j, i + 1, j);
-				addEdge(splits, edges, i, j, i + 1, j, i, j + 1, i + 1, j + 1);
+				addEdge(band, i, j, i, j, i, j, i + 1, j);
+				addEdge(band, i, j, i + 1, j, i + 1, j, i + 1, j);
+				addEdge(band, i, j, i + 1, j, i, j + 1, i + 1, j + 1);
 			}
 			else {
 				// 00+0
-				addEdge(splits, edges, i + 1, j, i + 1, j, i + 1, j + 1, i + 1,
+				addEdge(band, i + 1, j, i + 1, j, i + 1, j + 1, i + 1,
 					j + 1);
-				addEdge(splits, edges, i + 1, j + 1, i + 1, j + 1, i, j + 1, i,
+				addEdge(band, i + 1, j + 1, i + 1, j + 1, i, j + 1, i,
 					j + 1);
 			}
 		}
 		else if (iF01 != 0) {
 			// cases 000+ or 000-
-			addEdge(splits, edges, i, j, i, j, i + 1, j, i + 1, j);
-			addEdge(splits, edges, i + 1, j, i + 1, j, i + 1, j + 1, i + 1,
+			addEdge(band, i, j, i, j, i + 1, j, i + 1, j);
+			addEdge(band, i + 1, j, i + 1, j, i + 1, j + 1, i + 1,
 				j + 1);
 		}
 		else {
 			// case 0000
-			addEdge(splits, edges, i, j, i, j, i + 1, j, i + 1, j);
-			addEdge(splits, edges, i + 1, j, i + 1, j, i + 1, j + 1, i + 1,
+			addEdge(band, i, j, i, j, i + 1, j, i + 1, j);
+			addEdge(band, i + 1, j, i + 1, j, i + 1, j + 1, i + 1,
 				j + 1);
-			addEdge(splits, edges, i + 1, j + 1, i + 1, j + 1, i, j + 1, i,
+			addEdge(band, i + 1, j + 1, i + 1, j + 1, i, j + 1, i,
 				j + 1);
-			addEdge(splits, edges, i, j + 1, i, j + 1, i, j, i, j);
+			addEdge(band, i, j + 1, i, j + 1, i, j, i, j);
 		}
 	}
-	float IsoContour::getValue(int i, int j) {
+	float IsoContour::getValue(int i, int j) const {
 		float val = (*img)(i,j) - isoLevel;
 		if (nudgeLevelSet) {
 			if (val < 0) {
@@ -492,7 +483,7 @@ namespace aly {
 		}
 		return val;
 	}
-	float IsoContour::fGetOffset(uint2 v1, uint2 v2) {
+	float IsoContour::fGetOffset(uint2 v1, uint2 v2) const {
 		float fValue1 = getValue(v1.x, v1.y);
 		float fValue2 = getValue(v2.x, v2.y);
 		double fDelta = fValue2 - fValue1;
@@ -501,43 +492,343 @@ namespace aly {
 		}
 		return (float)(-fValue1 / fDelta);
 	}
+	float2 IsoContour::getSplitPoint(size_t key) const {
+		int type = (int)(key % 3);
+		size_t index = key / 3;
+		uint2 p1((uint32_t)(index % (rows + 1)), (uint32_t)(index / (rows + 1)));
+		uint2 p2 = p1;
+		if (type == 1) {
+			p2.x++;
+		}
+		else if (type == 2) {
+			p2.y++;
+		}
+		float fOffset = fGetOffset(p1, p2);
+		float fInvOffset = 1.0f - fOffset;
+		return float2(fInvOffset * p1.x + fOffset * p2.x, fInvOffset * p1.y + fOffset * p2.y);
+	}
+	void IsoContour::addEdge(Band& band, int p1x, int p1y, int p2x, int p2y, int p3x, int p3y, int p4x, int p4y) {
+		uint32_t split1 = createSplit(band, p1x, p1y, p2x, p2y);
+		uint32_t split2 = createSplit(band, p3x, p3y, p4x, p4y);
+		band.edges.push_back(uint2(split1, split2));
+	}
+	/*
+	 Returns the band local id of the split between two neighboring grid points, or of a grid point if both are the same.
+	 Splits on the last row of a band belong to the next band and get an id flagged with SEAM_FLAG instead.
+	 */
+	uint32_t IsoContour::createSplit(Band& band, int p1x, int p1y, int p2x, int p2y) {
+		int x = std::min(p1x, p2x);
+		int y = std::min(p1y, p2y);
+		int type = (p1x != p2x) ? 1 : ((p1y != p2y) ? 2 : 0);
+		size_t key = (x + (size_t)y * (rows + 1)) * 3 + type;
+		if (y == band.end && band.end < cols) {
+			uint32_t& seamId = band.seamIds[x * 3 + type];
+			if (seamId == NO_SPLIT) {
+				seamId = (uint32_t)band.seamSplits.size();
+				band.seamSplits.push_back(key);
+			}
+			return seamId | SEAM_FLAG;
+		}
+		uint32_t& id = splitIds[key];
+		if (id == NO_SPLIT) {
+			id = (uint32_t)band.splits.size();
+			band.splits.push_back(key);
+		}
+		return id;
+	}
+	/*
+	 Lorensen, W. E., & Cline, H. E. (1987). Marching cubes: A high resolution 3D surface construction algorithm.
+	 ACM SIGGRAPH computer graphics, 21(4), 163-169.
 
-	void IsoContour::addEdge(std::map<uint64_t, EdgeSplitPtr>& splits, std::list<EdgePtr>& edges, int p1x, int p1y, int p2x, int p2y, int p3x, int p3y, int p4x, int p4y) {
-		EdgeSplitPtr split1 = createSplit(splits, p1x, p1y, p2x, p2y);
-		EdgeSplitPtr split2 = createSplit(splits, p3x, p3y, p4x, p4y);
-		lastSplit1 = split1;
-		lastSplit2 = split2;
-		EdgePtr edge = EdgePtr(new Edge(split1->vid, split2->vid));
-		if (split1->e1.get() == nullptr) {
-			split1->e1 = edge;
+	 Triangulations of the 256 cube configurations are generated once instead of being tabulated. Corner c sits at (c&1,(c>>1)&1,(c>>2)&1)
+	 and is inside when its value is below the iso-level. Edge e runs along axis e/4 and starts at the corner whose other two coordinates
+	 are the bits of e%4. On every face the crossing edges are connected so that inside corners stay connected. Adjacent cubes resolve
+	 their shared face the same way, so the surface is watertight. Chaining the face segments gives closed polygons, which are fanned into triangles.
+	 */
+	struct MarchingCubesTable {
+		static const int MAX_INDEXES = 31;
+		int8_t triangles[256][MAX_INDEXES];
+		int counts[256];
+		static bool shareFace(int e1, int e2) {
+			int faces[2][2];
+			int edges[2] = { e1, e2 };
+			for (int n = 0; n < 2; n++) {
+				int axis = edges[n] / 4;
+				int other1 = (axis == 0) ? 1 : 0;
+				int other2 = (axis == 2) ? 1 : 2;
+				faces[n][0] = 2 * other1 + (edges[n] & 1);
+				faces[n][1] = 2 * other2 + ((edges[n] >> 1) & 1);
+			}
+			return faces[0][0] == faces[1][0] || faces[0][0] == faces[1][1] || faces[0][1] == faces[1][0] || faces[0][1] == faces[1][1];
 		}
-		else {
-			split1->e2 = edge;
+		MarchingCubesTable() {
+			static const int axisU[3] = { 1, 0, 0 };
+			static const int axisV[3] = { 2, 2, 1 };
+			static const int cycleU[4] = { 0, 1, 1, 0 };
+			static const int cycleV[4] = { 0, 0, 1, 1 };
+			for (int config = 0; config < 256; config++) {
+				int next[12];
+				for (int e = 0; e < 12; e++) {
+					next[e] = -1;
+				}
+				for (int a = 0; a < 3; a++) {
+					int u = axisU[a];
+					int v = axisV[a];
+					for (int side = 0; side < 2; side++) {
+						int corners[4];
+						int edges[4];
+						//Traverse counter-clockwise as seen from outside the cube.
+						bool flip = (((a == 1) ? -1 : 1) * (side ? 1 : -1)) < 0;
+						for (int m = 0; m < 4; m++) {
+							int n = flip ? (4 - m) % 4 : m;
+							corners[m] = (side << a) | (cycleU[n] << u) | (cycleV[n] << v);
+						}
+						for (int m = 0; m < 4; m++) {
+							int c1 = corners[m];
+							int c2 = corners[(m + 1) % 4];
+							int axis = (c1 ^ c2) == (1 << u) ? u : v;
+							int c = std::min(c1, c2);
+							int other1 = (axis == 0) ? 1 : 0;
+							int other2 = (axis == 2) ? 1 : 2;
+							edges[m] = 4 * axis + ((c >> other1) & 1) + 2 * ((c >> other2) & 1);
+						}
+						for (int m = 0; m < 4; m++) {
+							bool in1 = ((config >> corners[m]) & 1) != 0;
+							bool in2 = ((config >> corners[(m + 1) % 4]) & 1) != 0;
+							if (in1 && !in2) {
+								for (int l = 1; l < 4; l++) {
+									int n = (m + l) % 4;
+									if (((config >> corners[n]) & 1) == 0 && ((config >> corners[(n + 1) % 4]) & 1) != 0) {
+										next[edges[m]] = edges[n];
+										break;
+									}
+								}
+							}
+						}
+					}
+				}
+				int count = 0;
+				bool visited[12] = { false };
+				for (int e = 0; e < 12; e++) {
+					if (next[e] < 0 || visited[e])
+						continue;
+					int loop[12];
+					int loopSize = 0;
+					for (int f = e; !visited[f]; f = next[f]) {
+						visited[f] = true;
+						loop[loopSize++] = f;
+					}
+					//Fan from a vertex whose diagonals do not lie on a cube face, otherwise the neighboring cube may create the same diagonal.
+					int start = 0;
+					for (int l = 0; l < loopSize; l++) {
+						bool valid = true;
+						for (int m = 2; m + 1 < loopSize && valid; m++) {
+							valid = !shareFace(loop[l], loop[(l + m) % loopSize]);
+						}
+						if (valid) {
+							start = l;
+							break;
+						}
+					}
+					for (int l = 1; l + 1 < loopSize; l++) {
+						triangles[config][count++] = (int8_t) loop[start];
+						triangles[config][count++] = (int8_t) loop[(start + l + 1) % loopSize];
+						triangles[config][count++] = (int8_t) loop[(start + l) % loopSize];
+					}
+				}
+				counts[config] = count / 3;
+				for (int n = count; n < MAX_INDEXES; n++) {
+					triangles[config][n] = -1;
+				}
+			}
 		}
-		if (split2->e1.get() == nullptr) {
-			split2->e1 = edge;
+	};
+	static const MarchingCubesTable& GetMarchingCubesTable() {
+		static MarchingCubesTable table;
+		return table;
+	}
+	float IsoSurface::getValue(int i, int j, int k) const {
+		float val = vol->data[i + (j + (size_t)k * vol->cols) * vol->rows].x - isoLevel;
+		if (nudgeLevelSet) {
+			if (val < 0) {
+				val = std::min(val, -LEVEL_SET_TOLERANCE);
+			}
+			else {
+				val = std::max(val, LEVEL_SET_TOLERANCE);
+			}
 		}
-		else {
-			split2->e2 = edge;
+		return val;
+	}
+	/*
+	 Vertexes owned by slice k, which are the crossings of the +x and +y edges in the slice followed by the crossings
+	 of the +z edges to slice k+1. xyCount returns the number of vertexes on +x and +y edges.
+	 */
+	uint32_t IsoSurface::countVertexes(int k, uint32_t& xyCount) const {
+		const int rows = vol->rows;
+		const int cols = vol->cols;
+		uint32_t count = 0;
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				bool in = getValue(i, j, k) < 0;
+				if (i < rows - 1 && (getValue(i + 1, j, k) < 0) != in)
+					count++;
+				if (j < cols - 1 && (getValue(i, j + 1, k) < 0) != in)
+					count++;
+			}
+		}
+		xyCount = count;
+		if (k < vol->slices - 1) {
+			for (int j = 0; j < cols; j++) {
+				for (int i = 0; i < rows; i++) {
+					if ((getValue(i, j, k) < 0) != (getValue(i, j, k + 1) < 0))
+						count++;
+				}
+			}
+		}
+		return count;
+	}
+	static inline int CubeIndex(const float* values) {
+		int config = 0;
+		for (int c = 0; c < 8; c++) {
+			if (values[c] < 0)
+				config |= (1 << c);
+		}
+		return config;
+	}
+	uint32_t IsoSurface::countTriangles(int k) const {
+		const MarchingCubesTable& table = GetMarchingCubesTable();
+		uint32_t count = 0;
+		float values[8];
+		for (int j = 0; j < vol->cols - 1; j++) {
+			for (int i = 0; i < vol->rows - 1; i++) {
+				for (int c = 0; c < 8; c++) {
+					values[c] = getValue(i + (c & 1), j + ((c >> 1) & 1), k + ((c >> 2) & 1));
+				}
+				count += table.counts[CubeIndex(values)];
+			}
 		}
-		edges.push_back(edge);
+		return count;
 	}
-	EdgeSplitPtr IsoContour::createSplit(std::map<uint64_t, EdgeSplitPtr>& splits, int p1x, int p1y, int p2x, int p2y) {
-		EdgeSplitPtr split=EdgeSplitPtr(new EdgeSplit(uint2(p1x, p1y), uint2(p2x, p2y)));
-		uint64_t hash = split->hashValue(rows, cols);
-		if (splits.find(hash) != splits.end()) {
-			EdgeSplitPtr foundSplit = splits[hash];
-			return foundSplit;
-		} else {
-			split->vid = vertCount++;
-			float2 pt2d(0.0f);
-			float fOffset = fGetOffset(split->pt1, split->pt2);
-			float fInvOffset = 1.0f - fOffset;
-			pt2d.x = (fInvOffset * p1x + fOffset * p2x);
-			pt2d.y = (fInvOffset * p1y + fOffset * p2y);
-			split->pt2d = pt2d;
-			splits[split->hashValue(rows,cols)]= split;
-			return split;
+	/*
+	 Writes the vertexes owned by slice k and the triangles of the slab between slices k and k+1. Vertex ids on the +x and +y edges of slice k+1
+	 are recomputed from nextVertexOffset in the same order countVertexes() visits them, so no slab has to wait for another.
+	 */
+	void IsoSurface::processSlab(int k, uint32_t vertexOffset, uint32_t xyCount, uint32_t nextVertexOffset, uint32_t triangleOffset,
+		std::vector<uint32_t>& cache, Mesh& mesh) const {
+		const int rows = vol->rows;
+		const int cols = vol->cols;
+		const size_t sliceSize = (size_t)rows * cols;
+		cache.resize(5 * sliceSize);
+		//Edge ids for +x, +y and +z edges of slice k followed by +x and +y edges of slice k+1.
+		uint32_t* xIds[2] = { &cache[0], &cache[3 * sliceSize] };
+		uint32_t* yIds[2] = { &cache[sliceSize], &cache[4 * sliceSize] };
+		uint32_t* zIds = &cache[2 * sliceSize];
+		uint32_t xyId = vertexOffset;
+		uint32_t zId = vertexOffset + xyCount;
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				size_t index = i + j * (size_t)rows;
+				float v = getValue(i, j, k);
+				if (i < rows - 1) {
+					float w = getValue(i + 1, j, k);
+					if ((w < 0) != (v < 0)) {
+						mesh.vertexLocations[xyId] = float3(i + v / (v - w), (float)j, (float)k);
+						xIds[0][index] = xyId++;
+					}
+				}
+				if (j < cols - 1) {
+					float w = getValue(i, j + 1, k);
+					if ((w < 0) != (v < 0)) {
+						mesh.vertexLocations[xyId] = float3((float)i, j + v / (v - w), (float)k);
+						yIds[0][index] = xyId++;
+					}
+				}
+			}
+		}
+		if (k == vol->slices - 1)
+			return;
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				float v = getValue(i, j, k);
+				float w = getValue(i, j, k + 1);
+				if ((w < 0) != (v < 0)) {
+					mesh.vertexLocations[zId] = float3((float)i, (float)j, k + v / (v - w));
+					zIds[i + j * (size_t)rows] = zId++;
+				}
+			}
+		}
+		uint32_t nextId = nextVertexOffset;
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				size_t index = i + j * (size_t)rows;
+				bool in = getValue(i, j, k + 1) < 0;
+				if (i < rows - 1 && (getValue(i + 1, j, k + 1) < 0) != in)
+					xIds[1][index] = nextId++;
+				if (j < cols - 1 && (getValue(i, j + 1, k + 1) < 0) != in)
+					yIds[1][index] = nextId++;
+			}
+		}
+		const MarchingCubesTable& table = GetMarchingCubesTable();
+		uint32_t triangle = triangleOffset;
+		float values[8];
+		uint32_t ids[12];
+		for (int j = 0; j < cols - 1; j++) {
+			for (int i = 0; i < rows - 1; i++) {
+				for (int c = 0; c < 8; c++) {
+					values[c] = getValue(i + (c & 1), j + ((c >> 1) & 1), k + ((c >> 2) & 1));
+				}
+				int config = CubeIndex(values);
+				if (table.counts[config] == 0)
+					continue;
+				size_t index = i + j * (size_t)rows;
+				for (int b = 0; b < 4; b++) {
+					int lo = b & 1;
+					int hi = (b >> 1) & 1;
+					ids[b] = xIds[hi][index + lo * rows];
+					ids[4 + b] = yIds[hi][index + lo];
+					ids[8 + b] = zIds[index + lo + hi * rows];
+				}
+				const int8_t* edges = table.triangles[config];
+				for (int t = 0; t < table.counts[config]; t++) {
+					mesh.triIndexes[triangle++] = uint3(ids[edges[3 * t]], ids[edges[3 * t + 1]], ids[edges[3 * t + 2]]);
+				}
+			}
+		}
+	}
+	void IsoSurface::solve(const Volume1f& levelset, Mesh& mesh, float isoLevel) {
+		this->isoLevel = isoLevel;
+		vol = &levelset;
+		const int slices = levelset.slices;
+		mesh.clear();
+		if (levelset.rows < 2 || levelset.cols < 2 || slices < 2) {
+			return;
+		}
+		std::vector<uint32_t> vertexCounts(slices + 1, 0);
+		std::vector<uint32_t> xyCounts(slices, 0);
+		std::vector<uint32_t> triangleCounts(slices, 0);
+#pragma omp parallel for schedule(dynamic)
+		for (int k = 0; k < slices; k++) {
+			vertexCounts[k + 1] = countVertexes(k, xyCounts[k]);
+			if (k < slices - 1) {
+				triangleCounts[k + 1] = countTriangles(k);
+			}
+		}
+		for (int k = 0; k < slices; k++) {
+			vertexCounts[k + 1] += vertexCounts[k];
+			if (k < slices - 1) {
+				triangleCounts[k + 1] += triangleCounts[k];
+			}
+		}
+		mesh.vertexLocations.resize(vertexCounts[slices]);
+		mesh.triIndexes.resize(triangleCounts[slices - 1]);
+#pragma omp parallel
+		{
+			std::vector<uint32_t> cache;
+#pragma omp for schedule(dynamic)
+			for (int k = 0; k < slices; k++) {
+				processSlab(k, vertexCounts[k], xyCounts[k], vertexCounts[k + 1], triangleCounts[k], cache, mesh);
+			}
 		}
+		mesh.setDirty(true);
 	}
-}
\ No newline at end of file
+}
@@ -29,6 +29,10 @@
 #include <string.h>
 #include <stddef.h>
 #include <set>
+#include <deque>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "AlloyPLY.h"
 #include "tiny_obj_loader.h"
 #ifndef ALY_WINDOWS
@@ -502,6 +506,27 @@ namespace aly {
 	Mesh::Mesh(std::shared_ptr<AlloyContext>& context) :
 		glOnScreen(*this, true, context), glOffScreen(*this, false, context), pose(float4x4::identity()) {
 	}
+	Mesh::Mesh(Mesh&& mesh) :
+		glOnScreen(*this, true, mesh.glOnScreen.getContext()), glOffScreen(*this, false, mesh.glOffScreen.getContext()), pose(float4x4::identity()) {
+		*this = std::move(mesh);
+	}
+	Mesh& Mesh::operator=(Mesh&& mesh) {
+		if (this == &mesh)
+			return *this;
+		boundingBox = mesh.boundingBox;
+		vertexLocations = std::move(mesh.vertexLocations);
+		vertexNormals = std::move(mesh.vertexNormals);
+		vertexColors = std::move(mesh.vertexColors);
+		quadIndexes = std::move(mesh.quadIndexes);
+		triIndexes = std::move(mesh.triIndexes);
+		textureMap = std::move(mesh.textureMap);
+		textureImage = std::move(mesh.textureImage);
+		pose = mesh.pose;
+		mesh.boundingBox = box3f();
+		setDirty(true);
+		mesh.setDirty(true);
+		return *this;
+	}
 	bool Mesh::load(const std::string& file) {
 		try {
 			ReadMeshFromFile(file, *this);
@@ -831,6 +856,162 @@ namespace aly {
 			}
 		}
 	}
+	//Edge visitors for CompressAdjacency. Each one calls emit(source, target) for every directed edge of faces [first,last).
+	//Faces are numbered triangles first, then quads.
+	struct VertexEdgeVisitor {
+		size_t size(const Mesh& mesh) const {
+			return mesh.triIndexes.size() + mesh.quadIndexes.size();
+		}
+		template<class E> void operator()(const Mesh& mesh, size_t first, size_t last, E& emit) const {
+			size_t T = mesh.triIndexes.size();
+			for (size_t f = first; f < std::min(last, T); f++) {
+				const uint3& face = mesh.triIndexes[f];
+				emit(face.x, face.y);
+				emit(face.y, face.z);
+				emit(face.z, face.x);
+				emit(face.z, face.y);
+				emit(face.y, face.x);
+				emit(face.x, face.z);
+			}
+			for (size_t f = std::max(first, T); f < last; f++) {
+				const uint4& face = mesh.quadIndexes[f - T];
+				emit(face.x, face.y);
+				emit(face.y, face.z);
+				emit(face.z, face.w);
+				emit(face.w, face.x);
+				emit(face.w, face.z);
+				emit(face.z, face.y);
+				emit(face.y, face.x);
+				emit(face.x, face.w);
+			}
+		}
+	};
+	//Emits the (previous, next) corner pair of every face around a vertex as two consecutive entries.
+	struct OrderedVertexEdgeVisitor {
+		size_t size(const Mesh& mesh) const {
+			return mesh.triIndexes.size() + mesh.quadIndexes.size();
+		}
+		template<class E> void operator()(const Mesh& mesh, size_t first, size_t last, E& emit) const {
+			size_t T = mesh.triIndexes.size();
+			for (size_t f = first; f < std::min(last, T); f++) {
+				const uint3& face = mesh.triIndexes[f];
+				emit(face.x, face.z);
+				emit(face.x, face.y);
+
+				emit(face.y, face.x);
+				emit(face.y, face.z);
+
+				emit(face.z, face.y);
+				emit(face.z, face.x);
+			}
+			for (size_t f = std::max(first, T); f < last; f++) {
+				const uint4& face = mesh.quadIndexes[f - T];
+				emit(face.x, face.w);
+				emit(face.x, face.y);
+
+				emit(face.y, face.x);
+				emit(face.y, face.z);
+
+				emit(face.z, face.y);
+				emit(face.z, face.w);
+
+				emit(face.w, face.z);
+				emit(face.w, face.x);
+			}
+		}
+	};
+	struct QuadNormalEdgeVisitor {
+		size_t size(const Mesh& mesh) const {
+			return mesh.quadIndexes.size();
+		}
+		template<class E> void operator()(const Mesh& mesh, size_t first, size_t last, E& emit) const {
+			for (size_t f = first; f < last; f++) {
+				const uint4& face = mesh.quadIndexes[f];
+				emit(face.x, face.y);
+				emit(face.y, face.z);
+				emit(face.z, face.x);
+
+				emit(face.z, face.w);
+				emit(face.w, face.x);
+				emit(face.x, face.z);
+			}
+		}
+	};
+	struct EdgeCounter {
+		std::vector<uint32_t>& counts;
+		EdgeCounter(std::vector<uint32_t>& counts) :counts(counts) {
+		}
+		void operator()(uint32_t source, uint32_t target) {
+			counts[source]++;
+		}
+	};
+	struct EdgeWriter {
+		const std::vector<size_t>& offsets;
+		std::vector<uint32_t>& positions;
+		std::vector<uint32_t>& indexes;
+		EdgeWriter(const std::vector<size_t>& offsets, std::vector<uint32_t>& positions, std::vector<uint32_t>& indexes) :
+			offsets(offsets), positions(positions), indexes(indexes) {
+		}
+		void operator()(uint32_t source, uint32_t target) {
+			indexes[offsets[source] + positions[source]++] = target;
+		}
+	};
+	//Counting sort of directed edges by source vertex. The visitor runs once to count and once to fill, so no edge list is stored.
+	//Faces are split into one contiguous block per thread. Each block counts its edges per vertex, and a prefix sum over
+	//blocks gives every block its own slot in each row, so targets keep the order in which they were visited.
+	template<class V> static void CompressAdjacency(const Mesh& mesh, const V& visitor,
+		MeshNeighborTable& table) {
+		size_t N = mesh.vertexLocations.size();
+		size_t F = visitor.size(mesh);
+		//Small meshes are not worth a count array per thread.
+		int blocks = 1;
+#ifdef _OPENMP
+		blocks = (int)std::max(std::min((size_t)omp_get_max_threads(), F / 4096), (size_t)1);
+#endif
+		std::vector<std::vector<uint32_t>> counts(blocks);
+#pragma omp parallel for
+		for (int b = 0; b < blocks; b++) {
+			counts[b].assign(N, 0);
+			EdgeCounter counter(counts[b]);
+			visitor(mesh, F * b / blocks, F * (b + 1) / blocks, counter);
+		}
+		table.offsets.assign(N + 1, 0);
+#pragma omp parallel for
+		for (int i = 0; i < (int)N; i++) {
+			uint32_t count = 0;
+			for (int b = 0; b < blocks; b++) {
+				uint32_t c = counts[b][i];
+				counts[b][i] = count;
+				count += c;
+			}
+			table.offsets[i + 1] = count;
+		}
+		for (size_t i = 0; i < N; i++) {
+			table.offsets[i + 1] += table.offsets[i];
+		}
+		table.indexes.resize(table.offsets[N]);
+#pragma omp parallel for
+		for (int b = 0; b < blocks; b++) {
+			EdgeWriter writer(table.offsets, counts[b], table.indexes);
+			visitor(mesh, F * b / blocks, F * (b + 1) / blocks, writer);
+		}
+	}
+	//Moves the first counts[i+1] entries of every row to the front and drops the rest.
+	static void CompactNeighborTable(MeshNeighborTable& table, std::vector<size_t>& counts) {
+		size_t N = table.size();
+		for (size_t i = 0; i < N; i++) {
+			counts[i + 1] += counts[i];
+		}
+		std::vector<uint32_t> indexes(counts[N]);
+#pragma omp parallel for
+		for (int i = 0; i < (int)N; i++) {
+			std::copy(table.indexes.begin() + table.offsets[i],
+				table.indexes.begin() + table.offsets[i] + (counts[i + 1] - counts[i]),
+				indexes.begin() + counts[i]);
+		}
+		table.indexes.swap(indexes);
+		table.offsets.swap(counts);
+	}
 	void Mesh::updateVertexNormals(int SMOOTH_ITERATIONS, float DOT_TOLERANCE) {
 		uint32_t sz = (uint32_t)triIndexes.size();
 		float3 pt;
@@ -866,26 +1047,10 @@ namespace aly {
 		if (SMOOTH_ITERATIONS > 0) {
 			int vertCount = (int)vertexLocations.size();
 			std::vector<float3> tmp(vertCount);
-			std::vector<std::list<int>> vertNbrs(vertCount);
-			int indexCount = (int)quadIndexes.size();
-
-			for (int i = 0; i < indexCount; i++) {
-				uint4 verts = quadIndexes[i];
-				int v1 = verts.x;
-				int v2 = verts.y;
-				int v3 = verts.z;
-				int v4 = verts.w;
-
-				vertNbrs[v1].push_back(v2);
-				vertNbrs[v2].push_back(v3);
-				vertNbrs[v3].push_back(v1);
-
-				vertNbrs[v3].push_back(v4);
-				vertNbrs[v4].push_back(v1);
-				vertNbrs[v1].push_back(v3);
-			}
+			MeshNeighborTable vertNbrs;
+			CompressAdjacency(*this, QuadNormalEdgeVisitor(), vertNbrs);
 			for (int iter = 0; iter < SMOOTH_ITERATIONS; iter++) {
-#pragma omp for
+#pragma omp parallel for
 				for (int i = 0; i < vertCount; i++) {
 					float3 norm = vertexNormals[i];
 					float3 avg = float3(0.0f);
@@ -1377,138 +1542,134 @@ namespace aly {
 		mesh.setDirty(true);
 	}
 
-	void CreateVertexNeighborTable(const Mesh& mesh,
-		std::vector<std::set<uint32_t>>& vertNbrs) {
-		vertNbrs.resize(mesh.vertexLocations.size());
-		for (const uint3& face : mesh.triIndexes.data) {
-			vertNbrs[face.x].insert(face.y);
-			vertNbrs[face.y].insert(face.z);
-			vertNbrs[face.z].insert(face.x);
-			vertNbrs[face.z].insert(face.y);
-			vertNbrs[face.y].insert(face.x);
-			vertNbrs[face.x].insert(face.z);
-		}
-		for (const uint4& face : mesh.quadIndexes.data) {
-			vertNbrs[face.x].insert(face.y);
-			vertNbrs[face.y].insert(face.z);
-			vertNbrs[face.z].insert(face.w);
-			vertNbrs[face.w].insert(face.x);
-			vertNbrs[face.w].insert(face.z);
-			vertNbrs[face.z].insert(face.y);
-			vertNbrs[face.y].insert(face.x);
-			vertNbrs[face.x].insert(face.w);
+	void CreateVertexNeighborTable(const Mesh& mesh, MeshNeighborTable& table) {
+		CompressAdjacency(mesh, VertexEdgeVisitor(), table);
+		size_t N = table.size();
+		std::vector<size_t> counts(N + 1, 0);
+#pragma omp parallel for
+		for (int i = 0; i < (int)N; i++) {
+			auto start = table.indexes.begin() + table.offsets[i];
+			auto end = table.indexes.begin() + table.offsets[i + 1];
+			std::sort(start, end);
+			counts[i + 1] = std::unique(start, end) - start;
 		}
-	}
-	inline uint64_t faceHashCode(const uint2& val) {
-		return ((uint64_t)val.y) << 32 | ((uint64_t)val.x);
+		CompactNeighborTable(table, counts);
 	}
 	void CreateOrderedVertexNeighborTable(const Mesh& mesh,
-		std::vector<std::list<uint32_t>>& vertNbrsOut, bool leaveTail) {
+		MeshNeighborTable& table, bool leaveTail) {
 		//Leave tail means to not remove the duplicate vertex neighbor at the end of the neighbor list.
 		//Non-manifold vertexes will not have a tail, so the tail can be used to detect them in simple (common) cases.
-		vertNbrsOut.resize(mesh.vertexLocations.size());
-		std::vector<std::vector<uint32_t>> vertNbrs(mesh.vertexLocations.size());
-		for (const uint3& face : mesh.triIndexes.data) {
-			vertNbrs[face.x].push_back(face.z);
-			vertNbrs[face.x].push_back(face.y);
-
-			vertNbrs[face.y].push_back(face.x);
-			vertNbrs[face.y].push_back(face.z);
-
-			vertNbrs[face.z].push_back(face.y);
-			vertNbrs[face.z].push_back(face.x);
-		}
-		for (const uint4& face : mesh.quadIndexes.data) {
-			vertNbrs[face.x].push_back(face.w);
-			vertNbrs[face.x].push_back(face.y);
-
-			vertNbrs[face.y].push_back(face.x);
-			vertNbrs[face.y].push_back(face.z);
-
-			vertNbrs[face.z].push_back(face.y);
-			vertNbrs[face.z].push_back(face.w);
-
-			vertNbrs[face.w].push_back(face.z);
-			vertNbrs[face.w].push_back(face.x);
-		}
-		int N = (int)vertNbrs.size();
-#pragma omp parallel for
-		for (int n = 0; n < N; n++) {
-			std::vector<uint32_t>& nbrs = vertNbrs[n];
-			if (nbrs.size() > 0) {
-				vertNbrsOut[n].clear();
-				bool found;
-				std::list<uint32_t> chain;
-				chain.push_back(nbrs[0]);
-				chain.push_back(nbrs[1]);
-				nbrs[0] = -1;
-				nbrs[1] = -1;
-				do {
-					uint32_t front = chain.front();
-					uint32_t back = chain.back();
-					found = false;
-					for (int i = 0; i < (int)nbrs.size(); i += 2) {
-						if (nbrs[i] == back) {
-							chain.push_back(nbrs[i + 1]);
-							nbrs[i + 1] = -1;
-							found = true;
-							break;
-						}
-					}
-					if (!found) {
-						for (int i = 1; i < (int)nbrs.size(); i += 2) {
-							if (nbrs[i] == front) {
-								chain.push_front(nbrs[i - 1]);
-								nbrs[i - 1] = -1;
+		MeshNeighborTable pairs;
+		CompressAdjacency(mesh, OrderedVertexEdgeVisitor(), pairs);
+		size_t N = pairs.size();
+		//Every chain of k pairs yields at most k+1 vertexes, so a vertex's output fits in the space of its 2k pair entries.
+		table.offsets = pairs.offsets;
+		table.indexes.resize(pairs.indexes.size());
+		std::vector<size_t> counts(N + 1, 0);
+		bool overflow = false;
+#pragma omp parallel
+		{
+			std::deque<uint32_t> chain;
+#pragma omp for
+			for (int n = 0; n < (int)N; n++) {
+				uint32_t* nbrs = pairs.indexes.data() + pairs.offsets[n];
+				int sz = (int)(pairs.offsets[n + 1] - pairs.offsets[n]);
+				uint32_t* out = table.indexes.data() + table.offsets[n];
+				size_t count = 0;
+				size_t capacity = (size_t)sz;
+				if (sz > 0) {
+					bool found;
+					chain.clear();
+					chain.push_back(nbrs[0]);
+					chain.push_back(nbrs[1]);
+					nbrs[0] = -1;
+					nbrs[1] = -1;
+					do {
+						uint32_t front = chain.front();
+						uint32_t back = chain.back();
+						found = false;
+						for (int i = 0; i < sz; i += 2) {
+							if (nbrs[i] == back) {
+								chain.push_back(nbrs[i + 1]);
+								nbrs[i + 1] = -1;
 								found = true;
 								break;
 							}
 						}
-					}
-					if (!found) {
-						if (chain.size() > 0) {
-							if (!leaveTail && chain.front() == chain.back())
-								chain.pop_back();
-							vertNbrsOut[n].insert(vertNbrsOut[n].end(),
-								chain.begin(), chain.end());
-							chain.clear();
+						if (!found) {
+							for (int i = 1; i < sz; i += 2) {
+								if (nbrs[i] == front) {
+									chain.push_front(nbrs[i - 1]);
+									nbrs[i - 1] = -1;
+									found = true;
+									break;
+								}
+							}
 						}
-						for (int i = 0; i < (int)nbrs.size(); i += 2) {
-							if (nbrs[i] != (uint32_t)-1
-								&& nbrs[i + 1] != (uint32_t)-1) {
-								chain.push_back(nbrs[i]);
-								chain.push_back(nbrs[i + 1]);
-								found = true;
-								break;
+						if (!found) {
+							if (chain.size() > 0) {
+								if (!leaveTail && chain.front() == chain.back())
+									chain.pop_back();
+								out = std::copy(chain.begin(), chain.end(), out);
+								count += chain.size();
+								chain.clear();
+							}
+							for (int i = 0; i < sz; i += 2) {
+								if (nbrs[i] != (uint32_t)-1
+									&& nbrs[i + 1] != (uint32_t)-1) {
+									chain.push_back(nbrs[i]);
+									chain.push_back(nbrs[i + 1]);
+									found = true;
+									break;
+								}
 							}
 						}
+					} while (found && count + chain.size() <= capacity);
+					if (count + chain.size() > capacity) {
+						//Inconsistently oriented faces make the chain revisit consumed pairs without terminating.
+						overflow = true;
+						chain.clear();
+					}
+					if (chain.size() > 0) {
+						if (!leaveTail && chain.front() == chain.back())
+							chain.pop_back();
+						std::copy(chain.begin(), chain.end(), out);
+						count += chain.size();
 					}
-				} while (found);
-
-				if (chain.size() > 0) {
-					if (!leaveTail && chain.front() == chain.back())
-						chain.pop_back();
-					vertNbrsOut[n].insert(vertNbrsOut[n].end(), chain.begin(),
-						chain.end());
-					/*
-					 nbrs=vertNbrs[n];
-					 std::cout << "in " << n << ": ";
-					 for (int i = 0; i < nbrs.size(); i += 2) {
-					 std::cout << "(" << nbrs[i] << "," << nbrs[i + 1] << ") ";
-					 }
-					 std::cout << std::endl;
-
-					 std::cout << "out " << n << ": ";
-					 for (uint32_t elem : vertNbrsOut[n]) {
-					 std::cout << elem << " ";
-					 }
-
-					 std::cout << std::endl;
-					 */
 				}
-
+				counts[n + 1] = count;
 			}
 		}
+		if (overflow) {
+			throw std::runtime_error(
+				"Error: Could not order vertex neighbors, mesh faces are not consistently oriented.");
+		}
+		CompactNeighborTable(table, counts);
+	}
+	void CreateVertexNeighborTable(const Mesh& mesh,
+		std::vector<std::set<uint32_t>>& vertNbrs) {
+		MeshNeighborTable table;
+		CreateVertexNeighborTable(mesh, table);
+		vertNbrs.clear();
+		vertNbrs.resize(table.size());
+#pragma omp parallel for
+		for (int i = 0; i < (int)table.size(); i++) {
+			vertNbrs[i].insert(table[i].begin(), table[i].end());
+		}
+	}
+	inline uint64_t faceHashCode(const uint2& val) {
+		return ((uint64_t)val.y) << 32 | ((uint64_t)val.x);
+	}
+	void CreateOrderedVertexNeighborTable(const Mesh& mesh,
+		std::vector<std::list<uint32_t>>& vertNbrsOut, bool leaveTail) {
+		MeshNeighborTable table;
+		CreateOrderedVertexNeighborTable(mesh, table, leaveTail);
+		vertNbrsOut.clear();
+		vertNbrsOut.resize(table.size());
+#pragma omp parallel for
+		for (int i = 0; i < (int)table.size(); i++) {
+			vertNbrsOut[i].assign(table[i].begin(), table[i].end());
+		}
 	}
 
 	void Mesh::convertQuadsToTriangles() {
@@ -22,85 +22,268 @@
 #include "AlloyMath.h"
 #include "AlloyWorker.h"
 namespace aly {
+static thread_local WorkerPool* CurrentPool = nullptr;
+static thread_local size_t CurrentQueue = 0;
+WorkerPool& AlloyWorkerPool() {
+	static WorkerPool pool;
+	return pool;
+}
+WorkerPool::WorkerPool(size_t threadCount) :
+		pending(0), nextQueue(0), stopped(false) {
+	if (threadCount == 0) {
+		threadCount = std::max((size_t) 4,
+				(size_t) std::thread::hardware_concurrency());
+	}
+	for (size_t i = 0; i < threadCount; i++) {
+		queues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue()));
+	}
+	for (size_t i = 0; i < threadCount; i++) {
+		threads.push_back(std::thread(&WorkerPool::run, this, i));
+	}
+	scheduler = std::thread(&WorkerPool::schedule, this);
+}
+WorkerPool::~WorkerPool() {
+	stopped = true;
+	{
+		std::lock_guard<std::mutex> lockMe(idleLock);
+	}
+	idleCondition.notify_all();
+	{
+		std::lock_guard<std::mutex> lockMe(delayLock);
+	}
+	delayCondition.notify_all();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	scheduler.join();
+}
+void WorkerPool::enqueue(const std::function<void()>& task) {
+	size_t index =
+			(CurrentPool == this) ?
+					CurrentQueue : (nextQueue++ % queues.size());
+	{
+		std::lock_guard<std::mutex> lockMe(queues[index]->lock);
+		queues[index]->tasks.push_back(task);
+	}
+	pending++;
+	{
+		std::lock_guard<std::mutex> lockMe(idleLock);
+	}
+	idleCondition.notify_one();
+}
+void WorkerPool::enqueue(const std::function<void()>& task, long milliseconds) {
+	if (milliseconds <= 0) {
+		enqueue(task);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lockMe(delayLock);
+		delayed.insert(
+				std::make_pair(
+						std::chrono::steady_clock::now()
+								+ std::chrono::milliseconds(milliseconds), task));
+	}
+	delayCondition.notify_one();
+}
+bool WorkerPool::pop(size_t index, std::function<void()>& task) {
+	{
+		TaskQueue& queue = *queues[index];
+		std::lock_guard<std::mutex> lockMe(queue.lock);
+		if (!queue.tasks.empty()) {
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+			pending--;
+			return true;
+		}
+	}
+	for (size_t k = 1; k < queues.size(); k++) {
+		TaskQueue& queue = *queues[(index + k) % queues.size()];
+		std::lock_guard<std::mutex> lockMe(queue.lock);
+		if (!queue.tasks.empty()) {
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+			pending--;
+			return true;
+		}
+	}
+	return false;
+}
+void WorkerPool::run(size_t index) {
+	CurrentPool = this;
+	CurrentQueue = index;
+	std::function<void()> task;
+	while (!stopped) {
+		if (pop(index, task)) {
+			task();
+			task = nullptr;
+			continue;
+		}
+		std::unique_lock<std::mutex> lockMe(idleLock);
+		idleCondition.wait(lockMe, [this] {return stopped || pending > 0;});
+	}
+}
+void WorkerPool::schedule() {
+	std::unique_lock<std::mutex> lockMe(delayLock);
+	while (!stopped) {
+		if (delayed.empty()) {
+			delayCondition.wait(lockMe);
+		} else if (delayed.begin()->first <= std::chrono::steady_clock::now()) {
+			std::function<void()> task = delayed.begin()->second;
+			delayed.erase(delayed.begin());
+			lockMe.unlock();
+			enqueue(task);
+			lockMe.lock();
+		} else {
+			delayCondition.wait_until(lockMe, delayed.begin()->first);
+		}
+	}
+}
+const uint64_t Worker::IDLE = 0;
+const uint64_t Worker::QUEUED = 1;
+const uint64_t Worker::RUNNING = 2;
 Worker::Worker(const std::function<void()>& func) :
-		executionTask(func), endTask() {
+		state(new WorkerState()), executionTask(func), endTask(), running(
+				false), complete(false), requestCancel(false) {
 
 }
 Worker::Worker(const std::function<void()>& func,
 		const std::function<void()>& end) :
-		executionTask(func), endTask(end) {
+		state(new WorkerState()), executionTask(func), endTask(end), running(
+				false), complete(false), requestCancel(false) {
 
 }
 void Worker::task() {
-	running = true;
-	requestCancel = false;
 	if (executionTask) {
 		executionTask();
 	}
 	if (!requestCancel) {
 		done();
 	}
-	running = false;
-	requestCancel = false;
 	complete = true;
 }
 void Worker::done() {
 	if (endTask)
 		endTask();
 }
+void Worker::queue(long milliseconds) {
+	std::shared_ptr<WorkerState> s = state;
+	const uint64_t generation = (s->status >> 2) + 1;
+	const uint64_t queued = (generation << 2) | QUEUED;
+	std::function<void()> run = [this, s, queued] {
+		uint64_t expected = queued;
+		if (!s->status.compare_exchange_strong(expected, (queued & ~3) | RUNNING)) {
+			return;
+		}
+		rescheduleDelay = -1;
+		task();
+		long delay = rescheduleDelay;
+		if (delay >= 0 && !requestCancel) {
+			queue(delay);
+		} else {
+			running = false;
+			s->status = (queued & ~3) | IDLE;
+		}
+		s->notify();
+	};
+	s->status = queued;
+	AlloyWorkerPool().enqueue(run, milliseconds);
+}
 void Worker::execute(bool block) {
+	cancel(true);
+	requestCancel = false;
+	complete = false;
+	running = true;
+	long delay = prepare();
 	if (block) {
-		task();
+		state->status = (((state->status >> 2) + 1) << 2) | RUNNING;
+		while (true) {
+			if (delay > 0) {
+				wait(delay);
+			}
+			rescheduleDelay = -1;
+			task();
+			delay = rescheduleDelay;
+			if (delay < 0 || requestCancel) {
+				break;
+			}
+		}
+		running = false;
+		state->status = (state->status & ~3) | IDLE;
+		state->notify();
 	} else {
-		workerThread = std::thread(&Worker::task, this);
+		queue(delay);
 	}
 }
+void Worker::wait(long milliseconds) {
+	std::unique_lock<std::mutex> lockMe(state->lock);
+	state->condition.wait_for(lockMe, std::chrono::milliseconds(milliseconds),
+			[this] {return (bool)requestCancel;});
+}
 Worker::~Worker() {
 	cancel();
 }
 void Worker::cancel(bool block) {
-	if (block) {
-		if (workerThread.joinable()) {
-			if (!requestCancel) {
-				requestCancel = true;
-				workerThread.join();
+	requestCancel = true;
+	std::unique_lock<std::mutex> lockMe(state->lock);
+	state->condition.notify_all();
+	while (true) {
+		uint64_t status = state->status;
+		if ((status & 3) == QUEUED) {
+			//Withdrawn runs still report on a pool thread, block waits for that like for a running task.
+			if (state->status.compare_exchange_strong(status,
+					(status & ~3) | RUNNING)) {
+				std::shared_ptr<WorkerState> s = state;
+				AlloyWorkerPool().enqueue([this, s] {
+					canceled();
+					running = false;
+					s->status = (s->status & ~3) | IDLE;
+					s->notify();
+				});
 			}
+		} else if ((status & 3) == IDLE || !block) {
+			return;
+		} else {
+			state->condition.wait(lockMe);
 		}
-	} else {
-		requestCancel = true;
 	}
 }
 RecurrentWorker::RecurrentWorker(const std::function<bool(uint64_t)>& func,
 		long timeout) :
-		Worker([this] {this->step();}), recurrentTask(func), timeout(timeout) {
+		Worker(std::function<void()>()), recurrentTask(func), timeout(timeout) {
 
 }
 RecurrentWorker::RecurrentWorker(const std::function<bool(uint64_t)>& func,
 		const std::function<void()>& end, long timeout) :
-		Worker([this] {this->step();}, end), recurrentTask(func), timeout(
+		Worker(std::function<void()>(), end), recurrentTask(func), timeout(
 				timeout) {
 
 }
-
-void RecurrentWorker::step() {
-	uint64_t iter = 0;
-	while (!requestCancel) {
-		auto currentTime = std::chrono::steady_clock::now();
-		if (recurrentTask) {
-			if (!recurrentTask(iter++))
-				break;
-		}
-		if (requestCancel)
-			break;
+RecurrentWorker::~RecurrentWorker() {
+	cancel();
+}
+long RecurrentWorker::prepare() {
+	iteration = 0;
+	return 0;
+}
+//One iteration per pool task, the next one is rescheduled instead of sleeping on the thread.
+void RecurrentWorker::task() {
+	auto currentTime = std::chrono::steady_clock::now();
+	if (!requestCancel && (!recurrentTask || recurrentTask(iteration++))
+			&& !requestCancel) {
 		auto nextTime = std::chrono::steady_clock::now();
-		//sleep_until has different behavior on Linux and Windows. Use sleep_for instead.
 		long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(
 				nextTime - currentTime).count();
-		std::this_thread::sleep_for(
-				std::chrono::milliseconds(aly::max(0, (int) (timeout - ms))));
+		rescheduleDelay = aly::max(0L, (long) (timeout - ms));
+		return;
 	}
+	if (!requestCancel) {
+		done();
+	}
+	complete = true;
+}
+void RecurrentWorker::canceled() {
+	complete = true;
 }
-
 Timer::Timer(const std::function<void()>& successFunc,
 		const std::function<void()>& failureFunc, long timeout,
 		long samplingTime) :
@@ -108,20 +291,34 @@ Timer::Timer(const std::function<void()>& successFunc,
 				samplingTime) {
 
 }
-
-void Timer::task() {
-	running = true;
-	requestCancel = false;
-	complete = false;
-	auto currentTime = std::chrono::steady_clock::now();
+Timer::~Timer() {
+	cancel();
+}
+long Timer::prepare() {
+	return timeout;
+}
+//Polls so a flag raised through isCanceledPtr() is noticed too, cancel() wakes the wait directly.
+void Timer::wait(long milliseconds) {
+	if (samplingTime <= 0) {
+		Worker::wait(milliseconds);
+		return;
+	}
+	auto endTime = std::chrono::steady_clock::now()
+			+ std::chrono::milliseconds(milliseconds);
+	std::unique_lock<std::mutex> lockMe(state->lock);
 	while (!requestCancel) {
-		std::this_thread::sleep_for(std::chrono::milliseconds(samplingTime));
-		auto nextTime = std::chrono::steady_clock::now();
-		long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-				nextTime - currentTime).count();
-		if (ms >= timeout)
+		auto currentTime = std::chrono::steady_clock::now();
+		if (currentTime >= endTime) {
 			break;
+		}
+		state->condition.wait_for(lockMe,
+				std::min(endTime - currentTime,
+						std::chrono::steady_clock::duration(
+								std::chrono::milliseconds(samplingTime))),
+				[this] {return (bool)requestCancel;});
 	}
+}
+void Timer::task() {
 	if (requestCancel) {
 		if (endTask)
 			endTask();
@@ -131,8 +328,10 @@ void Timer::task() {
 			executionTask();
 		complete = true;
 	}
-	running = false;
-	requestCancel = false;
+}
+void Timer::canceled() {
+	if (endTask)
+		endTask();
+	complete = false;
 }
 }
-
@@ -22,6 +22,7 @@
 #include "AlloyIntersector.h"
 #include "AlloyLocator.h"
 #include "AlloyDistanceField.h"
+#include "AlloyIsoContour.h"
 #include "AlloySparseSolve.h"
 #include "AlloyMath.h"
 #include "AlloyImage.h"
@@ -35,12 +36,17 @@
 #include "AlloyDenseMatrix.h"
 #include "AlloyArray.h"
 #include "AlloySpline.h"
+#include "AlloyDelaunay.h"
 #include "cereal/archives/xml.hpp"
 #include "cereal/archives/json.hpp"
 #include "cereal/archives/binary.hpp"
 #include <iostream>
 #include <fstream>
 #include <random>
+#include <cstring>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #ifndef ALY_WINDOWS
 #pragma GCC diagnostic ignored "-Wunused-variable"
 #pragma GCC diagnostic ignored "-Wunused-but-set-variable"
@@ -424,6 +430,28 @@ namespace aly {
 		SolveCG(b1, A1, x1);
 		SolveVecBICGStab(b, A, x);
 		SolveBICGStab(b1, A1, x1);
+		SolveVecCG(b, A, x, PreconditionerType::Jacobi);
+		SolveCG(b1, A1, x1, PreconditionerType::IncompleteCholesky);
+		SolveVecBICGStab(b, A, x, PreconditionerType::IncompleteLU);
+		SolveBICGStab(b1, A1, x1, PreconditionerType::IncompleteLU);
+		{
+			TripletMatrix1f T(A1.rows, A1.cols);
+			for (int i = 0; i < (int)T.rows; i++) {
+				T.add(i, i, 3.0f);
+				if (i > 0) T.add(i, i - 1, -1.0f);
+				if (i + 1 < (int)T.rows) T.add(i, i + 1, -1.0f);
+			}
+			CompressedSparseMatrix1f L = T.compress();
+			SparseLDLTf ldlt;
+			ldlt.analyze(L);
+			ldlt.factor(L);
+			x = ldlt.solve(b);
+			std::cout << "LDLT residual " << lengthL1(lengthVecSqr(L * x - b)) << std::endl;
+			L.values[0] = float1(4.0f);
+			ldlt.factor(L);
+			x = ldlt.solve(b);
+			std::cout << "LDLT refactor residual " << lengthL1(lengthVecSqr(L * x - b)) << std::endl;
+		}
 		std::ofstream os("matrix.json");
 		cereal::JSONOutputArchive archiver(os);
 		archiver(A);
@@ -433,7 +461,7 @@ namespace aly {
 	bool SANITY_CHECK_DISTANCE_FIELD() {
 		Mesh mesh;
 		mesh.load(AlloyDefaultContext()->getFullPath("models/monkey.ply"));
-		Intersector kdTree(mesh, 6);
+		Intersector kdTree(mesh);
 		box3f bbox = mesh.getBoundingBox();
 		float3 center = bbox.position + bbox.dimensions*0.5f;
 		float maxDim = 1.1f*aly::max(bbox.dimensions);
@@ -445,15 +473,24 @@ namespace aly {
 		Image1f distImg;
 		float voxelSize = maxDim / vol.rows;
 		float maxDistance = 3.0f *voxelSize;
+		Vector3f points(vol.size());
+		Vector1f distances;
 #pragma omp parallel for
 		for (int k = 0; k < vol.slices; k++) {
 			for (int j = 0; j < vol.cols; j++) {
 				for (int i = 0; i < vol.rows; i++) {
-					float3 pt1 = bbox.position
+					points[i + (j + k * vol.cols) * vol.rows] = bbox.position
 						+ bbox.dimensions
 						* float3((i + 0.5f) / vol.rows, (j + 0.5f) / vol.cols, (k + 0.5f) / vol.slices);
-					float3 lastPoint(0.0f);
-					double d = kdTree.closestPointSignedDistance(pt1,maxDistance);
+				}
+			}
+		}
+		kdTree.closestPointSignedDistance(points, distances, maxDistance);
+#pragma omp parallel for
+		for (int k = 0; k < vol.slices; k++) {
+			for (int j = 0; j < vol.cols; j++) {
+				for (int i = 0; i < vol.rows; i++) {
+					float d = distances[i + (j + k * vol.cols) * vol.rows].x;
 					if (d != NO_HIT_DISTANCE) {
 						vol(i, j, k).x = (float)d/ voxelSize;
 					}
@@ -481,10 +518,304 @@ namespace aly {
 		distImg.writeToXML("img_df.xml");
 		return true;
 	}
+	bool SANITY_CHECK_DISTANCE_FIELD_ACCURACY() {
+		//The input is a level set of a sphere that is not a distance function, so the solvers must recover the distance.
+		const int N = 40;
+		const float R = 9.3f, maxDistance = 6.0f;
+		const float3 center(19.6f, 20.2f, 18.7f);
+		const float2 center2(30.3f, 22.8f);
+		Volume1f vol(N, N, N), exact(N, N, N);
+		Image1f img(64, 48), exact2(64, 48);
+		for (int k = 0; k < N; k++) {
+			for (int j = 0; j < N; j++) {
+				for (int i = 0; i < N; i++) {
+					float r = length(float3((float)i, (float)j, (float)k) - center);
+					exact(i, j, k).x = r - R;
+					vol(i, j, k).x = 0.85f * (r * r - R * R) / R;
+				}
+			}
+		}
+		for (int j = 0; j < img.height; j++) {
+			for (int i = 0; i < img.width; i++) {
+				float r = length(float2((float)i, (float)j) - center2);
+				exact2(i, j).x = r - R;
+				img(i, j).x = 0.3f * (r * r - R * R) / R;
+			}
+		}
+		const DistanceFieldMethod methods[3] = { DistanceFieldMethod::FastMarching, DistanceFieldMethod::FastSweeping, DistanceFieldMethod::FastIterative };
+		Volume1f distVol[3];
+		Image1f distImg[3];
+		bool ok = true;
+		for (int m = 0; m < 3; m++) {
+			DistanceField3f df3(methods[m]);
+			df3.solve(vol, distVol[m], maxDistance);
+			DistanceField2f df2(methods[m]);
+			df2.solve(img, distImg[m], maxDistance);
+			double maxError = 0.0, meanError = 0.0, maxError2 = 0.0, maxDiff = 0.0;
+			int count = 0;
+			for (size_t i = 0; i < vol.size(); i++) {
+				if (std::abs(exact[i].x) < maxDistance - 1.0f) {
+					double err = std::abs(distVol[m][i].x - exact[i].x);
+					maxError = std::max(maxError, err);
+					meanError += err;
+					maxDiff = std::max(maxDiff, (double)std::abs(distVol[m][i].x - distVol[0][i].x));
+					count++;
+				}
+			}
+			meanError /= count;
+			for (size_t i = 0; i < img.size(); i++) {
+				if (std::abs(exact2[i].x) < maxDistance - 1.0f) {
+					maxError2 = std::max(maxError2, (double)std::abs(distImg[m][i].x - exact2[i].x));
+					maxDiff = std::max(maxDiff, (double)std::abs(distImg[m][i].x - distImg[0][i].x));
+				}
+			}
+			std::cout << "Distance field method " << (int)methods[m] << " 3D max error " << maxError << " mean error " << meanError
+				<< " 2D max error " << maxError2 << " max difference to fast marching " << maxDiff << std::endl;
+			//First order upwind schemes are accurate to a fraction of a voxel.
+			ok &= (maxError < 0.5 && meanError < 0.2 && maxError2 < 0.5 && maxDiff < 0.05);
+		}
+		return ok;
+	}
+	bool SANITY_CHECK_DISTANCE_TRANSFORM() {
+		//Squared distances are small integers, so the transform must match brute force exactly.
+		std::mt19937 gen(771);
+		std::uniform_int_distribution<int> r(0, 99);
+		int errors = 0;
+		for (int test = 0; test < 3; test++) {
+			//Sparse random sites, a single corner site and an empty mask.
+			Volume1ub mask(24, 20, 16);
+			Image1ub mask2(61, 47);
+			for (size_t i = 0; i < mask.size(); i++) {
+				mask[i].x = (test == 0 && r(gen) == 0) ? 1 : 0;
+			}
+			for (size_t i = 0; i < mask2.size(); i++) {
+				mask2[i].x = (test == 0 && r(gen) == 0) ? 1 : 0;
+			}
+			if (test == 1) {
+				mask(mask.rows - 1, 0, mask.slices - 1).x = 1;
+				mask2(0, mask2.height - 1).x = 1;
+			}
+			Volume1f distVol;
+			Volume1i features;
+			Image1f distImg;
+			Image1i features2;
+			DistanceTransform(mask, distVol, features);
+			DistanceTransform(mask2, distImg, features2);
+			std::vector<int3> sites;
+			std::vector<int2> sites2;
+			for (int k = 0; k < mask.slices; k++) {
+				for (int j = 0; j < mask.cols; j++) {
+					for (int i = 0; i < mask.rows; i++) {
+						if (mask(i, j, k).x)
+							sites.push_back(int3(i, j, k));
+					}
+				}
+			}
+			for (int j = 0; j < mask2.height; j++) {
+				for (int i = 0; i < mask2.width; i++) {
+					if (mask2(i, j).x)
+						sites2.push_back(int2(i, j));
+				}
+			}
+			for (int k = 0; k < mask.slices; k++) {
+				for (int j = 0; j < mask.cols; j++) {
+					for (int i = 0; i < mask.rows; i++) {
+						int best = -1;
+						for (int3 s : sites) {
+							int3 d = s - int3(i, j, k);
+							int dd = d.x * d.x + d.y * d.y + d.z * d.z;
+							if (best < 0 || dd < best)
+								best = dd;
+						}
+						float expected = (best < 0) ? DistanceField3f::DISTANCE_UNDEFINED : std::sqrt((float)best);
+						int f = features(i, j, k).x;
+						bool featureOk = (best < 0) ? (f == -1) : (f >= 0 && mask[f].x != 0);
+						if (featureOk && best >= 0) {
+							int3 d = int3(f % mask.rows, (f / mask.rows) % mask.cols, f / (mask.rows * mask.cols)) - int3(i, j, k);
+							featureOk = (d.x * d.x + d.y * d.y + d.z * d.z == best);
+						}
+						if (distVol(i, j, k).x != expected || !featureOk)
+							errors++;
+					}
+				}
+			}
+			for (int j = 0; j < mask2.height; j++) {
+				for (int i = 0; i < mask2.width; i++) {
+					int best = -1;
+					for (int2 s : sites2) {
+						int2 d = s - int2(i, j);
+						int dd = d.x * d.x + d.y * d.y;
+						if (best < 0 || dd < best)
+							best = dd;
+					}
+					float expected = (best < 0) ? DistanceField2f::DISTANCE_UNDEFINED : std::sqrt((float)best);
+					int f = features2(i, j).x;
+					bool featureOk = (best < 0) ? (f == -1) : (f >= 0 && mask2[f].x != 0);
+					if (featureOk && best >= 0) {
+						int2 d = int2(f % mask2.width, f / mask2.width) - int2(i, j);
+						featureOk = (d.x * d.x + d.y * d.y == best);
+					}
+					if (distImg(i, j).x != expected || !featureOk)
+						errors++;
+				}
+			}
+		}
+		std::cout << "Distance transform mismatches " << errors << std::endl;
+		return (errors == 0);
+	}
+	bool SANITY_CHECK_ISO_SURFACE() {
+		//Closed level sets must give watertight, consistently oriented meshes, including ambiguous cells of random volumes.
+		std::mt19937 gen(1931);
+		std::uniform_real_distribution<float> r(-1.0f, 1.0f);
+		const int N = 32;
+		const float R = 10.3f;
+		const float3 center(15.4f, 16.1f, 15.7f);
+		bool ok = true;
+		for (int test = 0; test < 3; test++) {
+			Volume1f vol(N, N, N);
+			for (int k = 0; k < N; k++) {
+				for (int j = 0; j < N; j++) {
+					for (int i = 0; i < N; i++) {
+						bool border = (i == 0 || j == 0 || k == 0 || i == N - 1 || j == N - 1 || k == N - 1);
+						if (test == 0) {
+							vol(i, j, k).x = length(float3((float)i, (float)j, (float)k) - center) - R;
+						} else {
+							//Values exactly at the iso-level exercise the nudge on the last test.
+							vol(i, j, k).x = (border) ? 1.0f : ((test == 2) ? std::round(2.0f * r(gen)) * 0.5f : r(gen));
+						}
+					}
+				}
+			}
+			Mesh mesh;
+			IsoSurface iso;
+			iso.solve(vol, mesh);
+			std::map<std::pair<uint32_t, uint32_t>, int> edges;
+			int degenerate = 0;
+			double volume = 0.0;
+			for (uint3 tri : mesh.triIndexes.data) {
+				if (tri.x == tri.y || tri.y == tri.z || tri.z == tri.x)
+					degenerate++;
+				for (int n = 0; n < 3; n++) {
+					edges[std::make_pair(tri[n], tri[(n + 1) % 3])]++;
+				}
+				float3 a = mesh.vertexLocations[tri.x], b = mesh.vertexLocations[tri.y], c = mesh.vertexLocations[tri.z];
+				volume += dot(a - center, cross(b - center, c - center)) / 6.0;
+			}
+			int unmatched = 0;
+			for (auto edge : edges) {
+				auto opposite = edges.find(std::make_pair(edge.first.second, edge.first.first));
+				if (edge.second != 1 || opposite == edges.end() || opposite->second != 1)
+					unmatched++;
+			}
+			std::cout << "Iso-surface " << test << " vertexes " << mesh.vertexLocations.size() << " triangles " << mesh.triIndexes.size()
+				<< " unmatched edges " << unmatched << " degenerate " << degenerate << std::endl;
+			ok &= (mesh.triIndexes.size() > 0 && unmatched == 0 && degenerate == 0);
+			if (test == 0) {
+				//A sphere has Euler characteristic 2 and its triangles face away from the center.
+				int euler = (int)mesh.vertexLocations.size() - (int)edges.size() / 2 + (int)mesh.triIndexes.size();
+				double exact = 4.0 * ALY_PI * R * R * R / 3.0;
+				std::cout << "Sphere Euler characteristic " << euler << " volume " << volume << " / " << exact << std::endl;
+				ok &= (euler == 2 && std::abs(volume - exact) < 0.02 * exact);
+			}
+		}
+		return ok;
+	}
+	bool SANITY_CHECK_DELAUNAY() {
+		//Integer coordinates keep the brute force predicates exact in 64 bit arithmetic.
+		std::mt19937 gen(4113);
+		std::uniform_int_distribution<int> r(0, 1023);
+		bool ok = true;
+		for (int test = 0; test < 3; test++) {
+			//Random points, a grid where every cell is cocircular, and random points with duplicates.
+			std::vector<float2> points;
+			if (test == 1) {
+				for (int j = 0; j < 16; j++) {
+					for (int i = 0; i < 16; i++) {
+						points.push_back(float2((float)(4 * i), (float)(4 * j)));
+					}
+				}
+			} else {
+				for (int n = 0; n < 500; n++) {
+					points.push_back(float2((float)r(gen), (float)r(gen)));
+				}
+				if (test == 2) {
+					for (int n = 0; n < 100; n++) {
+						points.push_back(points[n * 3]);
+					}
+				}
+			}
+			std::vector<int64_t> xs(points.size()), ys(points.size());
+			for (size_t n = 0; n < points.size(); n++) {
+				xs[n] = (int64_t)points[n].x;
+				ys[n] = (int64_t)points[n].y;
+			}
+			auto orient = [&](size_t a, size_t b, size_t c) {
+				return (xs[b] - xs[a]) * (ys[c] - ys[a]) - (ys[b] - ys[a]) * (xs[c] - xs[a]);
+			};
+			std::vector<uint3> triangles;
+			MakeDelaunay(points, triangles);
+			int degenerate = 0, flipped = 0, nonEmpty = 0;
+			int64_t area = 0;
+			int64_t sign = (triangles.size() > 0) ? ((orient(triangles[0].x, triangles[0].y, triangles[0].z) > 0) ? 1 : -1) : 1;
+			for (uint3 tri : triangles) {
+				int64_t o = orient(tri.x, tri.y, tri.z);
+				if (o == 0) {
+					degenerate++;
+					continue;
+				}
+				if ((o > 0) != (sign > 0))
+					flipped++;
+				area += o * sign;
+				for (size_t n = 0; n < points.size(); n++) {
+					int64_t ax = xs[tri.x] - xs[n], ay = ys[tri.x] - ys[n];
+					int64_t bx = xs[tri.y] - xs[n], by = ys[tri.y] - ys[n];
+					int64_t cx = xs[tri.z] - xs[n], cy = ys[tri.z] - ys[n];
+					int64_t det = (ax * ax + ay * ay) * (bx * cy - cx * by) - (bx * bx + by * by) * (ax * cy - cx * ay)
+						+ (cx * cx + cy * cy) * (ax * by - bx * ay);
+					if (det * sign > 0)
+						nonEmpty++;
+				}
+			}
+			//Triangles must tile the convex hull, whose doubled area comes from a monotone chain.
+			std::vector<size_t> order(points.size());
+			for (size_t n = 0; n < order.size(); n++)
+				order[n] = n;
+			std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+				return (xs[a] < xs[b]) || (xs[a] == xs[b] && ys[a] < ys[b]);
+			});
+			std::vector<size_t> hull(2 * order.size());
+			size_t h = 0;
+			for (size_t n = 0; n < order.size(); n++) {
+				while (h >= 2 && orient(hull[h - 2], hull[h - 1], order[n]) <= 0)
+					h--;
+				hull[h++] = order[n];
+			}
+			for (size_t n = order.size() - 1, lower = h + 1; n > 0; n--) {
+				while (h >= lower && orient(hull[h - 2], hull[h - 1], order[n - 1]) <= 0)
+					h--;
+				hull[h++] = order[n - 1];
+			}
+			int64_t hullArea = 0;
+			for (size_t n = 0; n + 1 < h; n++) {
+				hullArea += xs[hull[n]] * ys[hull[n + 1]] - xs[hull[n + 1]] * ys[hull[n]];
+			}
+			std::cout << "Delaunay " << test << " triangles " << triangles.size() << " degenerate " << degenerate << " flipped " << flipped
+				<< " non-empty circumcircles " << nonEmpty << " area " << area << " / " << hullArea << std::endl;
+			ok &= (triangles.size() > 0 && degenerate == 0 && flipped == 0 && nonEmpty == 0 && area == hullArea);
+		}
+		std::vector<float2> collinear;
+		for (int n = 0; n < 20; n++) {
+			collinear.push_back(float2((float)n, (float)(2 * n)));
+		}
+		std::vector<uint3> triangles;
+		MakeDelaunay(collinear, triangles);
+		ok &= triangles.empty();
+		return ok;
+	}
 	bool SANITY_CHECK_KDTREE() {
 		Mesh mesh;
 		mesh.load(AlloyDefaultContext()->getFullPath("models/monkey.ply"));
-		Intersector kdTree(mesh, 6);
+		Intersector kdTree(mesh);
 		Camera camera;
 		camera.setNearFarPlanes(0.1f, 2.0f);
 		camera.setZoom(0.75f);
@@ -555,6 +886,116 @@ namespace aly {
 		rgba.writeToXML("closest_clamped.xml");
 		return true;
 	}
+	bool SANITY_CHECK_RAY_INTERSECT() {
+		//Geometry on both sides of the ray origin. Only hits in front of the origin may be reported.
+		Mesh mesh;
+		mesh.vertexLocations.push_back(float3(-1.0f, -1.0f, 0.0f));
+		mesh.vertexLocations.push_back(float3(1.0f, -1.0f, 0.0f));
+		mesh.vertexLocations.push_back(float3(0.0f, 1.0f, 0.0f));
+		mesh.vertexLocations.push_back(float3(5.0f, 5.0f, 10.0f));
+		mesh.vertexLocations.push_back(float3(6.0f, 5.0f, 10.0f));
+		mesh.vertexLocations.push_back(float3(5.0f, 6.0f, 10.0f));
+		mesh.triIndexes.push_back(uint3(0, 1, 2));
+		mesh.triIndexes.push_back(uint3(3, 4, 5));
+		Intersector tree(mesh);
+		float3 lastPoint;
+		bool ok = true;
+		ok &= (tree.intersectRayDistance(float3(0.0f, 0.0f, 1.0f), float3(0.0f, 0.0f, 1.0f), lastPoint) == NO_HIT_DISTANCE);
+		ok &= (std::abs(tree.intersectRayDistance(float3(0.0f, 0.0f, 1.0f), float3(0.0f, 0.0f, -1.0f), lastPoint) - 1.0) < 1E-6);
+		ok &= (tree.intersectSegmentDistance(float3(0.0f, 0.0f, 1.0f), float3(0.0f, 0.0f, 2.0f), lastPoint) == NO_HIT_DISTANCE);
+		std::cout << "Ray clip " << ok << std::endl;
+		//Compare against testing every triangle.
+		std::mt19937 gen(9051);
+		std::uniform_real_distribution<float> r(-1.0f, 1.0f);
+		mesh.clear();
+		for (int t = 0; t < 1000; t++) {
+			float3 center(r(gen), r(gen), r(gen));
+			for (int k = 0; k < 3; k++) {
+				mesh.vertexLocations.push_back(center + 0.1f * float3(r(gen), r(gen), r(gen)));
+			}
+			mesh.triIndexes.push_back(uint3(3 * t, 3 * t + 1, 3 * t + 2));
+		}
+		tree.build(mesh);
+		int mismatches = 0;
+		int behind = 0;
+		for (int n = 0; n < 1000; n++) {
+			float3 org(r(gen), r(gen), r(gen));
+			float3 v = normalize(float3(r(gen), r(gen), r(gen)));
+			double mind = NO_HIT_DISTANCE;
+			for (const uint3& tri : mesh.triIndexes.data) {
+				KDTriangle kdTri(mesh.vertexLocations[tri.x], mesh.vertexLocations[tri.y], mesh.vertexLocations[tri.z]);
+				float3 pt = kdTri.intersectionPointRay(org, v);
+				if (pt != NO_HIT_POINT && dot(pt - org, v) > 0.0f) {
+					mind = std::min(mind, (double)distance(org, pt));
+				}
+			}
+			double d = tree.intersectRayDistance(org, v, lastPoint);
+			if (d != NO_HIT_DISTANCE && dot(lastPoint - org, v) <= 0.0f) {
+				behind++;
+			}
+			if ((d == NO_HIT_DISTANCE) != (mind == NO_HIT_DISTANCE) || (d != NO_HIT_DISTANCE && std::abs(d - mind) > 1E-5)) {
+				mismatches++;
+			}
+			if (tree.intersectsRay(org, v) != (mind != NO_HIT_DISTANCE)) {
+				mismatches++;
+			}
+		}
+		std::cout << "Ray intersect mismatches " << mismatches << " hits behind origin " << behind << std::endl;
+		ok &= (mismatches == 0 && behind == 0);
+		return ok;
+	}
+	bool SANITY_CHECK_OCCLUSION() {
+		//A floor at z=0 and a roof over half of it at z=1. Visibility rays start on or just above the floor and point up.
+		Mesh mesh;
+		const int N = 8;
+		for (int k = 0; k < 2; k++) {
+			uint32_t first = (uint32_t)mesh.vertexLocations.size();
+			for (int j = 0; j <= N; j++) {
+				for (int i = 0; i <= N; i++) {
+					mesh.vertexLocations.push_back(float3(2.0f * i / N - 1.0f, 2.0f * j / N - 1.0f, (float)k));
+				}
+			}
+			for (int j = 0; j < N; j++) {
+				for (int i = 0; i < ((k == 0) ? N : N / 2); i++) {
+					uint32_t v = first + j * (N + 1) + i;
+					mesh.quadIndexes.push_back(uint4(v, v + 1, v + N + 2, v + N + 1));
+				}
+			}
+		}
+		Intersector tree(mesh);
+		std::mt19937 gen(2707);
+		std::uniform_real_distribution<float> r(-1.0f, 1.0f);
+		Vector3f origins, directions, ends;
+		std::vector<bool> expected;
+		for (int n = 0; n < 2000; n++) {
+			float3 org(0.9f * r(gen), 0.9f * r(gen), (n % 2 == 0) ? 0.0f : 1E-4f);
+			float3 v = normalize(float3(0.5f * r(gen), 0.5f * r(gen), 0.5f + 0.5f * std::abs(r(gen))));
+			float3 hit = org + v * ((1.0f - org.z) / v.z);
+			origins.push_back(org);
+			directions.push_back(v);
+			ends.push_back(org + 0.5f * v);
+			expected.push_back(hit.x < 0.0f && hit.x > -1.0f && std::abs(hit.y) < 1.0f);
+		}
+		Vector1b rayHits, segmentHits;
+		tree.intersectsRay(origins, directions, rayHits);
+		tree.intersectsSegment(origins, ends, segmentHits);
+		int errors = 0;
+		for (int n = 0; n < (int)origins.size(); n++) {
+			//Skip rays that graze an edge of the roof, where either answer is acceptable.
+			float3 hit = origins[n] + directions[n] * ((1.0f - origins[n].z) / directions[n].z);
+			if (std::abs(hit.x) < 1E-3f || std::abs(hit.x + 1.0f) < 1E-3f || std::abs(std::abs(hit.y) - 1.0f) < 1E-3f)
+				continue;
+			if (tree.intersectsRay(origins[n], directions[n]) != expected[n] || (rayHits[n].x != 0) != expected[n])
+				errors++;
+			if (tree.intersectsSegment(origins[n], ends[n]) || segmentHits[n].x != 0)
+				errors++;
+		}
+		//Pointing down from just above the floor must still hit it.
+		float3 lastPoint;
+		double d = tree.intersectRayDistance(float3(0.1f, 0.1f, 1E-4f), float3(0.0f, 0.0f, -1.0f), lastPoint);
+		std::cout << "Occlusion errors " << errors << " floor distance " << d << std::endl;
+		return (errors == 0 && std::abs(d - 1E-4) < 1E-6);
+	}
 	bool SANITY_CHECK_IMAGE_PROCESSING() {
 		ImageRGBAf img;
 		ImageRGBAf laplacian;
@@ -638,7 +1079,7 @@ namespace aly {
 				sum += row[j] * Y[j];
 				row[j] += float1(0.1f * ((rand() % 1000) / 1000.0f - 0.5f));
 			}
-			A[i] = row;
+			A.setRow(i, row);
 			b[i] = sum;
 		}
 		std::vector<int> order(N);
@@ -699,7 +1140,7 @@ namespace aly {
 		LaplaceFill(mask, out, 128);
 		WriteImageToFile("laplace_fill.png", out);
 
-		std::cout << "Pyramid Laplace Fill" << std::endl;
+		std::cout << "Multigrid Laplace Fill" << std::endl;
 		out = tar;
 		LaplaceFill(mask, out, 64, 6);
 		WriteImageToFile("laplace_fill_pyr.png", out);
@@ -709,7 +1150,7 @@ namespace aly {
 		PoissonInpaint(mask, src, out, 128);
 		WriteImageToFile("poisson_inpaint.png", out);
 
-		std::cout << "Poisson Inpaint Pyramid" << std::endl;
+		std::cout << "Multigrid Poisson Inpaint" << std::endl;
 		out = tar;
 		PoissonInpaint(mask, src, out, 64, 6);
 		WriteImageToFile("poisson_inpaint_pyr.png", out);
@@ -720,7 +1161,7 @@ namespace aly {
 		WriteImageToFile("poisson_blend.png", out);
 		out = tar;
 
-		std::cout << "Pyramid Poisson Blend" << std::endl;
+		std::cout << "Multigrid Poisson Blend" << std::endl;
 		PoissonBlend(src, out, 32, 6);
 		WriteImageToFile("poisson_blend_pyr.png", out);
 		std::cout << "Done!" << std::endl;
@@ -853,7 +1294,7 @@ namespace aly {
 		A = A.transpose();
 		std::cout << "At=\n" << A << std::endl;
 		return true;
-		MeshListNeighborTable vertTable;
+		MeshNeighborTable vertTable;
 		Mesh mesh;
 		mesh.load(AlloyDefaultContext()->getFullPath("models/monkey.ply"));
 		CreateOrderedVertexNeighborTable(mesh, vertTable);
@@ -1118,6 +1559,268 @@ namespace aly {
 			return false;
 		}
 	}
+	template<class T, int C, ImageType I, class S, int D, ImageType J, class F> int ConvertMismatches(
+		const Image<T, C, I>& in, const int2& pos, const Image<S, D, J>& out, const F& ref) {
+		int count = 0;
+		for (int j = 0; j < out.height; j++) {
+			for (int i = 0; i < out.width; i++) {
+				vec<S, D> expected = ref(in(i + pos.x, j + pos.y));
+				if (std::memcmp(&expected, &out(i, j), sizeof(expected)) != 0)
+					count++;
+			}
+		}
+		return count;
+	}
+	bool SANITY_CHECK_IMAGE_CONVERT() {
+		//Odd sizes leave scalar tails after the SIMD runs and the sub-views have strided rows.
+		const int W = 67, H = 13;
+		const int2 pos(3, 2), dims(W - 7, H - 4);
+		std::mt19937 gen(8317);
+		std::uniform_int_distribution<int> bytes(0, 255);
+		std::uniform_real_distribution<float> floats(-0.25f, 1.25f);
+		ImageRGBA rgba(W, H);
+		ImageRGB rgb(W, H);
+		ImageRGBAf rgbaf(W, H);
+		ImageRGBf rgbf(W, H);
+		Image1ub gray(W, H);
+		Image1f grayf(W, H);
+		for (int i = 0; i < (int)rgba.size(); i++) {
+			rgba[i] = ubyte4(bytes(gen), bytes(gen), bytes(gen), bytes(gen));
+			rgb[i] = rgba[i].xyz();
+			rgbaf[i] = float4(floats(gen), floats(gen), floats(gen), floats(gen));
+			rgbf[i] = rgbaf[i].xyz();
+			gray[i] = ubyte1(bytes(gen));
+			grayf[i] = float1(floats(gen));
+		}
+		auto toByte = [](float v) {
+			return (uint8_t)(int)(v > 0.0f ? (v < 255.0f ? v : 255.0f) : 0.0f);
+		};
+		auto decode = [](int i) {
+			double c = i / 255.0;
+			return (float)((c <= 0.04045) ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+		};
+		auto encode = [](float v) {
+			v = (v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f);
+			double l = (int)(v * 16383 + 0.5f) / 16383.0;
+			double c = (l <= 0.0031308) ? 12.92 * l : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+			return (uint8_t)clamp((int)std::floor(255.0 * c + 0.5), 0, 255);
+		};
+		auto alpha = [](float v) {
+			v = (v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f);
+			return (uint8_t)(int)(v * 255.0f + 0.5f);
+		};
+		int errors = 0;
+		for (int strided = 0; strided < 2; strided++) {
+			const int2 p = (strided) ? pos : int2(0, 0);
+			const int2 d = (strided) ? dims : int2(W, H);
+			ImageRGBAf outRGBAf;
+			ImageRGBf outRGBf;
+			ImageRGBA outRGBA;
+			ImageRGB outRGB;
+			Image1f out1f;
+			Image1ub out1ub;
+			ConvertImage(rgba.view(p, d), outRGBAf);
+			errors += ConvertMismatches(rgba, p, outRGBAf, [](const ubyte4& c) {
+				return float4(c.x / 255.0f, c.y / 255.0f, c.z / 255.0f, c.w / 255.0f);
+			});
+			ConvertImage(rgb.view(p, d), outRGBf);
+			errors += ConvertMismatches(rgb, p, outRGBf, [](const ubyte3& c) {
+				return float3(c.x / 255.0f, c.y / 255.0f, c.z / 255.0f);
+			});
+			ConvertImage(rgbaf.view(p, d), outRGBA);
+			errors += ConvertMismatches(rgbaf, p, outRGBA, [=](const float4& c) {
+				return ubyte4(toByte(c.x * 255.0f), toByte(c.y * 255.0f), toByte(c.z * 255.0f), toByte(c.w * 255.0f));
+			});
+			ConvertImage(rgbf.view(p, d), outRGB);
+			errors += ConvertMismatches(rgbf, p, outRGB, [=](const float3& c) {
+				return ubyte3(toByte(c.x * 255.0f), toByte(c.y * 255.0f), toByte(c.z * 255.0f));
+			});
+			ConvertImage(gray.view(p, d), outRGBA);
+			errors += ConvertMismatches(gray, p, outRGBA, [](const ubyte1& c) {
+				return ubyte4(c.x, c.x, c.x, 255);
+			});
+			ConvertImage(gray.view(p, d), outRGBAf);
+			errors += ConvertMismatches(gray, p, outRGBAf, [](const ubyte1& c) {
+				return float4(c.x / 255.0f, c.x / 255.0f, c.x / 255.0f, 1.0f);
+			});
+			ConvertImage(grayf.view(p, d), outRGBAf);
+			errors += ConvertMismatches(grayf, p, outRGBAf, [](const float1& c) {
+				return float4(c.x, c.x, c.x, 1.0f);
+			});
+			ConvertImage(grayf.view(p, d), outRGBA);
+			errors += ConvertMismatches(grayf, p, outRGBA, [=](const float1& c) {
+				uint8_t lum = toByte(c.x * 255.0f);
+				return ubyte4(lum, lum, lum, 255);
+			});
+			for (int sRGB = 0; sRGB < 2; sRGB++) {
+				const float3 w = (sRGB) ? float3(0.21f, 0.72f, 0.07f) : float3(0.30f, 0.59f, 0.11f);
+				ConvertImage(rgba.view(p, d), out1f, sRGB != 0);
+				errors += ConvertMismatches(rgba, p, out1f, [=](const ubyte4& c) {
+					return float1((w.x * c.x + w.y * c.y + w.z * c.z) / 255.0f);
+				});
+				ConvertImage(rgbaf.view(p, d), out1ub, sRGB != 0);
+				errors += ConvertMismatches(rgbaf, p, out1ub, [=](const float4& c) {
+					return ubyte1(toByte((w.x * c.x + w.y * c.y + w.z * c.z) * 255.0f));
+				});
+			}
+			ConvertSRGBToLinear(rgba.view(p, d), outRGBAf);
+			errors += ConvertMismatches(rgba, p, outRGBAf, [=](const ubyte4& c) {
+				return float4(decode(c.x), decode(c.y), decode(c.z), c.w / 255.0f);
+			});
+			ConvertLinearToSRGB(rgbaf.view(p, d), outRGBA);
+			errors += ConvertMismatches(rgbaf, p, outRGBA, [=](const float4& c) {
+				return ubyte4(encode(c.x), encode(c.y), encode(c.z), alpha(c.w));
+			});
+		}
+		std::cout << "Image conversion mismatches " << errors << std::endl;
+		return (errors == 0);
+	}
+	bool SANITY_CHECK_IMAGE_VIEW() {
+		//Views of a non-const image are mutable ImageViews. Every filter must accept them and match filtering a copy of the region.
+		std::mt19937 gen(6151);
+		std::uniform_real_distribution<float> r(0.0f, 1.0f);
+		ImageRGBAf rgba(61, 47);
+		ImageRGBf rgb(61, 47);
+		for (size_t i = 0; i < rgba.size(); i++) {
+			rgba[i] = float4(r(gen), r(gen), r(gen), r(gen));
+			rgb[i] = rgba[i].xyz();
+		}
+		const int2 pos(5, 7), dims(33, 29);
+		ImageRGBAf region(rgba.view(pos, dims));
+		ImageRGBf regionRGB(rgb.view(pos, dims));
+		auto same = [](const ImageRGBAf& a, const ImageRGBAf& b) {
+			return a.dimensions() == b.dimensions() && std::memcmp(a.ptr(), b.ptr(), a.size() * sizeof(float4)) == 0;
+		};
+		int errors = 0;
+		ImageRGBAf out, ref, outY, refY;
+		Smooth5x5(rgba.view(pos, dims), out);
+		Smooth5x5(region, ref);
+		errors += !same(out, ref);
+		Smooth<7, 3>(rgba.view(pos, dims), out);
+		Smooth<7, 3>(region, ref);
+		errors += !same(out, ref);
+		Laplacian3x3(rgba.view(pos, dims), out);
+		Laplacian3x3(region, ref);
+		errors += !same(out, ref);
+		Gradient5x5(rgba.view(pos, dims), out, outY);
+		Gradient5x5(region, ref, refY);
+		errors += !same(out, ref) + !same(outY, refY);
+		DownSample(rgba.view(pos, dims), out);
+		DownSample(region, ref);
+		errors += !same(out, ref);
+		out.clear();
+		ref.clear();
+		UpSample(rgba.view(pos, dims), out);
+		UpSample(region, ref);
+		errors += !same(out, ref);
+		out.resize(dims.x + 4, dims.y + 4);
+		ref.resize(dims.x + 4, dims.y + 4);
+		out.setZero();
+		ref.setZero();
+		Set(rgba.view(pos, dims), out.view(), int2(2, 3));
+		Set(region, ref, int2(2, 3));
+		errors += !same(out, ref);
+		Image1f gray, grayRef;
+		Image2f grayAlpha, grayAlphaRef;
+		ConvertImage(rgba.view(pos, dims), gray);
+		ConvertImage(region, grayRef);
+		errors += (std::memcmp(gray.ptr(), grayRef.ptr(), gray.size() * sizeof(float)) != 0);
+		ConvertImage(rgba.view(pos, dims), grayAlpha, false);
+		ConvertImage(region, grayAlphaRef, false);
+		errors += (std::memcmp(grayAlpha.ptr(), grayAlphaRef.ptr(), grayAlpha.size() * sizeof(float2)) != 0);
+		ConvertImage(rgb.view(pos, dims), gray);
+		ConvertImage(regionRGB, grayRef);
+		errors += (std::memcmp(gray.ptr(), grayRef.ptr(), gray.size() * sizeof(float)) != 0);
+		std::cout << "Image view filter mismatches " << errors << std::endl;
+		return (errors == 0);
+	}
+	bool SANITY_CHECK_REDUCTION() {
+		//Odd lengths leave partial blocks, results must be identical for any thread count.
+		const int N = 100003;
+		std::mt19937 gen(2391);
+		std::uniform_real_distribution<float> r(-1000.0f, 1000.0f);
+		Vector4f a(N), b(N);
+		Image2f img(317, 211);
+		for (int i = 0; i < N; i++) {
+			a[i] = float4(r(gen), r(gen), r(gen), r(gen));
+			b[i] = float4(r(gen), r(gen), r(gen), r(gen));
+		}
+		for (int i = 0; i < (int)img.size(); i++) {
+			img[i] = float2(r(gen), r(gen));
+		}
+		const Summation methods[3] = { Summation::Naive, Summation::Pairwise, Summation::Kahan };
+		auto stats = [&]() {
+			std::vector<double> out;
+			std::pair<float4, float4> range = a.range();
+			std::pair<float2, float2> imgRange = img.range();
+			float4 vals[4] = { a.min(), a.max(), range.first, range.second };
+			for (float4 v : vals) {
+				for (int c = 0; c < 4; c++) out.push_back(v[c]);
+			}
+			float2 imgVals[4] = { img.min(), img.max(), imgRange.first, imgRange.second };
+			for (float2 v : imgVals) {
+				for (int c = 0; c < 2; c++) out.push_back(v[c]);
+			}
+			for (Summation method : methods) {
+				double4 d = dotVec(a, b, method);
+				float4 m = a.mean(method);
+				float2 im = img.mean(method);
+				for (int c = 0; c < 4; c++) {
+					out.push_back(d[c]);
+					out.push_back(m[c]);
+				}
+				out.push_back(im.x);
+				out.push_back(im.y);
+				out.push_back(lengthSqr(a, method));
+				out.push_back(lengthL1(b, method));
+			}
+			return out;
+		};
+		int errors = 0;
+#ifdef _OPENMP
+		const int maxThreads = omp_get_max_threads();
+		const int threadCounts[3] = { 1, 3, std::max(maxThreads, 2) };
+		std::vector<double> reference;
+		for (int threads : threadCounts) {
+			omp_set_num_threads(threads);
+			std::vector<double> result = stats();
+			if (reference.size() == 0) {
+				reference = result;
+			} else if (std::memcmp(&reference[0], &result[0], sizeof(double) * result.size()) != 0) {
+				std::cout << "Reduction differs with " << threads << " threads" << std::endl;
+				errors++;
+			}
+		}
+		omp_set_num_threads(maxThreads);
+#endif
+		float4 minRef(std::numeric_limits<float>::max()), maxRef(std::numeric_limits<float>::lowest());
+		double4 dotRef(0.0), dotBound(0.0);
+		for (int i = 0; i < N; i++) {
+			for (int c = 0; c < 4; c++) {
+				minRef[c] = std::min(minRef[c], a[i][c]);
+				maxRef[c] = std::max(maxRef[c], a[i][c]);
+				double p = (double)a[i][c] * (double)b[i][c];
+				dotRef[c] += p;
+				dotBound[c] += std::abs(p);
+			}
+		}
+		std::pair<float4, float4> range = a.range();
+		if (a.min() != minRef || a.max() != maxRef || range.first != minRef || range.second != maxRef) {
+			std::cout << "Reduction min/max differs from serial reference" << std::endl;
+			errors++;
+		}
+		for (Summation method : methods) {
+			double4 d = dotVec(a, b, method);
+			for (int c = 0; c < 4; c++) {
+				if (std::abs(d[c] - dotRef[c]) > 1E-12 * dotBound[c]) {
+					std::cout << "Dot " << (int)method << " error " << std::abs(d[c] - dotRef[c]) << std::endl;
+					errors++;
+				}
+			}
+		}
+		std::cout << "Reduction mismatches " << errors << std::endl;
+		return (errors == 0);
+	}
 	bool SANITY_CHECK_SVD() {
 
 		int N = 100;
@@ -79,7 +79,7 @@ bool IntersectorEx::init(Composite& rootNode) {
 		Image1f depthImg(tarImg.width, tarImg.height);
 		camera.aim(depthFrameBuffer.getViewport());
 		textLabel->label = "Building Kd-Tree ...";
-		kdTree.build(mesh,6);
+		kdTree.build(mesh);
 		textLabel->label = "Computing Depth Field ...";
 		float minD = 1E30f;
 		float maxD = 0;
@@ -90,59 +90,62 @@ bool MeshSmoothEx::init(Composite& rootNode) {
 	return true;
 }
 void MeshSmoothEx::smooth() {
-	static MeshListNeighborTable nbrTable;
+	static MeshNeighborTable nbrTable;
 	if(nbrTable.size()==0){
 		//Only need to compute this once since topology doesn't change.
 		CreateOrderedVertexNeighborTable(mesh, nbrTable, true);
 	}
-	int index = 0;
-	std::vector<float> angles;
-	std::vector<float> weights;
 	float smoothness = 10.0f;
 	int N = (int) mesh.vertexLocations.size();
-	SparseMatrix1f A(N, N);
+	TripletMatrix1f A(N, N, 8 * N);
 	Vector3f b(N);
-	for (std::list<uint32_t>& nbrs : nbrTable) {
-		int K = (int) nbrs.size() - 1;
-		float3 pt = mesh.vertexLocations[index];
-		angles.resize(K);
-		weights.resize(K);
-		{
-			auto nbrIter = nbrs.begin();
-			for (int k = 0; k < K; k++) {
-				float3 current = mesh.vertexLocations[*nbrIter];
-				nbrIter++;
-				float3 next = mesh.vertexLocations[*nbrIter];
-				angles[k] = std::tan(Angle(next, pt, current) * 0.5f);
+#pragma omp parallel
+	{
+		std::vector<float> angles;
+		std::vector<float> weights;
+#pragma omp for
+		for (int index = 0; index < N; index++) {
+			MeshNeighborTable::Range nbrs = nbrTable[index];
+			int K = (int) nbrs.size() - 1;
+			float3 pt = mesh.vertexLocations[index];
+			angles.resize(K);
+			weights.resize(K);
+			{
+				auto nbrIter = nbrs.begin();
+				for (int k = 0; k < K; k++) {
+					float3 current = mesh.vertexLocations[*nbrIter];
+					nbrIter++;
+					float3 next = mesh.vertexLocations[*nbrIter];
+					angles[k] = std::tan(Angle(next, pt, current) * 0.5f);
+				}
 			}
-		}
-		float wsum = 0.0f;
-		{
-			auto nbrIter = nbrs.begin();
-			nbrIter++;
-			for (int k = 0; k < K; k++) {
-				float3 ptNext = mesh.vertexLocations[*nbrIter];
-				float w = (angles[k] + angles[(k + 1) % K])
-						/ distance(pt, ptNext);
-				wsum += w;
-				weights[k] = w;
+			float wsum = 0.0f;
+			{
+				auto nbrIter = nbrs.begin();
 				nbrIter++;
+				for (int k = 0; k < K; k++) {
+					float3 ptNext = mesh.vertexLocations[*nbrIter];
+					float w = (angles[k] + angles[(k + 1) % K])
+							/ distance(pt, ptNext);
+					wsum += w;
+					weights[k] = w;
+					nbrIter++;
+				}
 			}
-		}
-		{
-			auto nbrIter = nbrs.begin();
-			nbrIter++;
-			for (int k = 0; k < K; k++) {
-				float w = -smoothness * weights[k] / wsum;
-				A.set(index, *nbrIter, w);
+			{
+				auto nbrIter = nbrs.begin();
 				nbrIter++;
+				for (int k = 0; k < K; k++) {
+					float w = -smoothness * weights[k] / wsum;
+					A.add(index, *nbrIter, w);
+					nbrIter++;
+				}
 			}
+			A.add(index, index, smoothness + 1);
+			b[index] = pt;
 		}
-		A.set(index, index, smoothness + 1);
-		b[index] = pt;
-		index++;
 	}
-	SolveBICGStab(b, A, mesh.vertexLocations, 100, 1E-6f,
+	SolveBICGStab(b, A.compress(), mesh.vertexLocations, PreconditionerType::IncompleteLU, 100, 1E-6f,
 			[this](int iter,double error) {
 				textLabel->label = MakeString() << "Smooth [" << iter << "] Error: " << error;
 			});
@@ -19,6 +19,7 @@
  * THE SOFTWARE.
  */
 #include "Alloy.h"
+#include "AlloyIsoContour.h"
 #include "../../include/example/UnitsEx.h"
 #include "../../include/example/CompositeEx.h"
 #include "../../include/example/EventsEx.h"
@@ -94,6 +95,15 @@ typedef std::unique_ptr<Example> ExamplePtr;
 bool SANITY_CHECK() {
 	bool ret = true;
 	ret&=SANITY_CHECK_LOCATOR();
+	ret&=SANITY_CHECK_IMAGE_CONVERT();
+	ret&=SANITY_CHECK_IMAGE_VIEW();
+	ret&=SANITY_CHECK_REDUCTION();
+	ret&=SANITY_CHECK_DISTANCE_FIELD_ACCURACY();
+	ret&=SANITY_CHECK_DISTANCE_TRANSFORM();
+	ret&=SANITY_CHECK_ISO_SURFACE();
+	ret&=SANITY_CHECK_DELAUNAY();
+	ret&=SANITY_CHECK_RAY_INTERSECT();
+	ret&=SANITY_CHECK_OCCLUSION();
 	//SANITY_CHECK_ANY();
 	//SANITY_CHECK_SVD();
 	//SANITY_CHECK_ALGO();